@@ -37,6 +37,38 @@ bool OfsCreateDirectory(const char *path);
 bool OfsDeleteFile(const char *path);
 bool OfsDeleteDirectory(const char *path);
 bool OfsRenameFile(const char *path, const char *new_path);
+bool OfsCreateDirectories(const char *path);
+bool OfsGetFileInfo(const char *path, OFS::ofs64& size, time_t& mod_time);
+bool OfsSetModificationTime(const char *path, time_t mod_time);
+bool OfsPathExists(const char *path);
+void OfsListDirectory(const char *path, std::vector<std::string>& names);
 void OfsListContents(OFS::_OfsBase *owner, OFS::_OfsBase::OfsEntryDesc *desc, int &id, const char *path, bool linkmode);
 
+/* Kinds of changes reported by a directory watch */
+enum OfsWatchEventType
+{
+    OFS_WATCH_CREATE = 1,
+    OFS_WATCH_DELETE = 2,
+    OFS_WATCH_CONTENT = 4,
+    OFS_WATCH_MOVED_FROM = 8,
+    OFS_WATCH_MOVED_TO = 16,
+    OFS_WATCH_IGNORED = 32,     /* The watch was removed, explicitly or with its directory */
+    OFS_WATCH_OVERFLOW = 64     /* Changes were lost, the watched tree needs to be checked again */
+};
+
+struct OfsWatchEvent
+{
+    int          Watch;         /* Watch reporting the change, -1 for OFS_WATCH_OVERFLOW */
+    unsigned int Type;          /* Combination of OfsWatchEventType */
+    unsigned int Cookie;        /* Pairs OFS_WATCH_MOVED_FROM with OFS_WATCH_MOVED_TO of the same move */
+    std::string  Name;          /* Name of the changed entry in the watched directory */
+};
+
+/* Directory watches are only available on Linux (inotify), elsewhere OfsWatchOpen fails */
+int  OfsWatchOpen();
+int  OfsWatchAdd(int watcher, const char *path);
+void OfsWatchRemove(int watcher, int watch);
+bool OfsWatchRead(int watcher, std::vector<OfsWatchEvent>& events, int timeout);
+void OfsWatchClose(int watcher);
+
 //------------------------------------------------------------------------------
@@ -47,12 +47,14 @@ namespace OFS
          * OFS_FREE_BLOCK is a mask which marks a block as FREE
          * OFS_MAIN_BLOCK is the first block of any file or folder which contains all required header data
          * OFS_EXTENDED_BLOCK is any extra block needed for extending the file, only contains a short header
+         * OFS_INDEX_BLOCK holds the directory index written at unmount, only valid while the file header points to it
          */
         enum BlockType
         {
             OFS_FREE_BLOCK = 0xFF000000,
             OFS_MAIN_BLOCK = 1,
-            OFS_EXTENDED_BLOCK = 2
+            OFS_EXTENDED_BLOCK = 2,
+            OFS_INDEX_BLOCK = 3
         };
 
 #pragma pack(push)
@@ -65,7 +67,8 @@ namespace OFS
             unsigned char VERSION[4];          /* Version of the OFS File */
             unsigned int  BLOCK_HEADER_SIG[2]; /* Identifiers used as Block Header Signatures */
             unsigned int  LAST_ID;             /* The Last ID used for any entry */
-            unsigned int  RESERVED[27];        /* RESERVED */
+            ofs64         INDEX_POS;           /* Position of a valid directory index block, 0 if none */
+            unsigned int  RESERVED[25];        /* RESERVED */
         };
 
         /* Holds information about an allocated block (for writing to file as block header) */
@@ -94,7 +97,7 @@ namespace OFS
             int          ParentId;        /* Id of the Owner Entry's Parent Directory, -1 if root directory */
             unsigned int Flags;           /* File Flags */
             int          OldParentId;     /* Id of the Owner Entry's Old Parent Directory, -1 if root directory */
-            unsigned int RESERVED[2];     /* RESERVED */
+            ofs64        UncompressedSize;/* Size of contents before compression, only valid for OFS_COMPRESSED files */
             ofs64        FileSize;        /* Entry's File Size, 0 for Directories */
             ofs64        NextBlock;       /* File Position of Next Block owned by this entry */
             char         Name[256];       /* Entry's Name */
@@ -102,10 +105,100 @@ namespace OFS
             UUID         Uuid;            /* UUID of Entry */
         };
 
+        /* Header at the start of stored data of OFS_COMPRESSED files, followed by (NumChunks + 1) chunk offsets */
+        struct strCompressedHeader
+        {
+            unsigned char ID[4];          /* The compressed data identifier */
+            unsigned int  ChunkSize;      /* Size of an uncompressed chunk */
+            unsigned int  NumChunks;      /* Number of compressed chunks */
+            unsigned int  RESERVED;       /* RESERVED */
+            ofs64         Size;           /* Size of uncompressed contents */
+        };
+
+        /* Stored data of an OFS_DEDUP file, refers to the entry holding the shared contents */
+        struct strDedupReference
+        {
+            unsigned char ID[4];          /* The reference identifier */
+            int           SharedId;       /* Id of the entry holding the contents */
+            unsigned int  RESERVED[2];    /* RESERVED */
+        };
+
+        /* Record of a block move done by compactFileSystem, kept in a side file until the move is on disk */
+        struct strCompactJournal
+        {
+            unsigned char ID[4];          /* The journal identifier */
+            unsigned int  Type;           /* Block Type of the moved block */
+            ofs64         SrcPos;         /* Start of the block at its old location */
+            ofs64         DestPos;        /* Start of the block at its new location */
+            ofs64         Length;         /* Length of the block at its old location */
+            ofs64         NewLength;      /* Length of the block at its new location */
+            ofs64         FreePos;        /* Start of the free block left after the new location, 0 if none */
+            ofs64         FreeLength;     /* Length of the free block left after the new location */
+            ofs64         PointerPos;     /* File position of the NextBlock field pointing to the block, 0 if none */
+        };
+
+        /* Directory Index Header, followed by entry records and free block records */
+        struct strIndexHeader
+        {
+            unsigned char ID[4];          /* The index identifier */
+            unsigned int  NumEntries;     /* Number of entry records */
+            unsigned int  NumFreeBlocks;  /* Number of free block records */
+            unsigned int  Checksum;       /* CRC32 of the records */
+            ofs64         FileSize;       /* Size of the file system file when the index was written */
+            ofs64         DataSize;       /* Size of the records following this header */
+        };
+
+        /* Index record of an entry, followed by its name and records of its used blocks */
+        struct strIndexEntry
+        {
+            int          Id;              /* Id of the Entry */
+            int          ParentId;        /* Id of the Entry's Parent Directory */
+            unsigned int Flags;           /* File Flags */
+            int          OldParentId;     /* Id of the Entry's Old Parent Directory */
+            ofs64        UncompressedSize;/* Size of contents before compression */
+            ofs64        FileSize;        /* Entry's File Size */
+            OTIME        CreationTime;    /* Entry's Creation Time */
+            UUID         Uuid;            /* UUID of Entry */
+            unsigned int NameLength;      /* Length of the Entry's name */
+            unsigned int NumBlocks;       /* Number of used blocks */
+        };
+
+        /* Index record of a used or free block */
+        struct strIndexBlock
+        {
+            unsigned int Type;            /* Block Type */
+            unsigned int Reserved;        /* RESERVED */
+            ofs64        Start;           /* Starting position of Block in File, just after header */
+            ofs64        Length;          /* Length of the block not including block header */
+            ofs64        NextBlock;       /* Position of Next Block in file */
+        };
+
 #pragma pack(pop)
 
         typedef std::map<ofs64, BlockData> PosBlockDataMap;
         typedef std::vector<BlockData> BlockDataVector;
+        typedef std::set<std::pair<ofs64, ofs64> > LengthPosSet;
+        typedef std::map<ofs64, std::pair<OfsEntryDesc*, unsigned int> > PosOwnerMap;
+
+        /* State of an entry kept only in memory, carried over when the file system is reloaded */
+        struct EntryState
+        {
+            std::string               Path;       /* Path of the entry, ending with '/' for directories */
+            std::vector<CallBackData> Triggers;   /* Triggers of the entry */
+            std::vector<std::string>  Links;      /* Names of file systems linked into the directory */
+        };
+
+        /* Host file prepared by an importFiles reading thread, waiting to be stored */
+        struct ImportItem
+        {
+            unsigned int      Index;      /* Index of the request */
+            ofs64             Size;       /* Size of the host file */
+            ofs64             Hash;       /* dedupHash of Data, only valid if Hashed */
+            bool              Hashed;     /* Is Hash computed, set for files to be deduplicated */
+            bool              Streamed;   /* Too large to hold in memory, copied in chunks when stored */
+            std::vector<char> Data;       /* Contents to store, already compressed for OFS_COMPRESSED requests */
+            OfsResult         Result;     /* Result of reading the host file */
+        };
 
 
         /**
@@ -115,6 +208,11 @@ namespace OFS
         */
         OfsResult    getFileSystemStats(FileSystemStats& stats);
         /**
+        * Sets the size of the cache holding recently read file contents
+        * @param size Maximum number of bytes held, 0 disables the cache
+        */
+        void         setReadCacheSize(ofs64 size);
+        /**
         * Adds a new file system trigger
         * @param _owner The owner class or id for the trigger
         * @param _type Type of events to get notified about
@@ -122,7 +220,7 @@ namespace OFS
         * @param _data User data to be passed to notification function
         * @return Result of operation, OFS_OK if successful
         */
-        OfsResult    addTrigger(void *_owner, CallBackType _type, CallBackFunction _func, void *_data = 0);
+        OfsResult    addTrigger(void *_owner, CallBackType _type, CallBackFunction _func, void *_data = 0, unsigned int _interval = 0);
         /**
         * Removes a file system trigger
         * @param _owner The owner class or id for the trigger
@@ -154,6 +252,35 @@ namespace OFS
         */
         OfsResult    defragFileSystemTo(const char *dest, LogCallBackFunction* logCallbackFunc = NULL);
         /**
+        * Compacts the file system in place by moving blocks from the end of the file into free
+        * space closer to its start, meant to be called repeatedly (eg. from an idle timer).
+        * Blocks of open files are left untouched, an interrupted move is completed on next mount
+        * @param max_blocks maximum number of blocks to move during this call
+        * @param progress receives the state of compaction after this call
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    compactFileSystem(unsigned int max_blocks, CompactionProgress& progress);
+        /**
+        * Starts a batch of operations which is committed atomically, writes done until the matching
+        * commitTransaction are rolled back on next mount if the application stops before committing.
+        * Calls can be nested, only the outermost commit makes the batch durable
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    beginTransaction();
+        /**
+        * Commits a batch of operations started with beginTransaction, the whole batch is rolled back
+        * instead if any of its nested calls was ended with abortTransaction
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    commitTransaction();
+        /**
+        * Ends a batch of operations started with beginTransaction and undoes all writes of the outermost batch,
+        * a nested batch is undone when the outermost one ends. The file system is reloaded from the restored file,
+        * this fails with OFS_ACCESS_DENIED and commits the batch instead if files are open
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    abortTransaction();
+        /**
         * Copies the current file system and switches to it
         * @param dest path of the destination file
         * @return Result of operation, OFS_OK if successful
@@ -306,6 +433,15 @@ namespace OFS
         */
         OfsResult    truncateFile(OFSHANDLE& handle, ofs64 file_size = -1);
         /**
+        * Reserves room for the contents of a file, so writes up to given size need no further
+        * allocation and the file stays contiguous. The file size is not changed, reserved space
+        * that was not written is given back when the last handle of the file is closed
+        * @param handle File Handle of the file, opened for writing
+        * @param size Number of content bytes to make room for, counted from the start of the file
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    reserve(OFSHANDLE& handle, ofs64 size);
+        /**
         * List files/folders in a given directory
         * @param path path of the directory
         * @param file_flags Filters the results by given flag
@@ -494,6 +630,35 @@ namespace OFS
         */
         OfsResult    read(OFSHANDLE& handle, char *dest, unsigned int length, unsigned int *actual_read = NULL);
         /**
+        * Reads a batch of whole files in one pass, ordering the underlying
+        * reads by their position on disk
+        * @param requests List of files to read, results are stored per request
+        * @return OFS_OK if all requests succeeded, otherwise the first failing result
+        */
+        OfsResult    readFiles(ReadRequestList& requests);
+        /**
+        * Imports files from the host file system. Host files are read, hashed and
+        * compressed on a pool of threads while the calling thread stores them in the
+        * order they become ready
+        * @param requests List of files to import, results are stored per request
+        * @param num_threads Number of reading threads, 0 for one per hardware thread
+        * @param callback Function to call after each request, NULL for none
+        * @param userData User data passed to callback
+        * @return OFS_OK if all requests succeeded, otherwise the first failing result
+        */
+        OfsResult    importFiles(ImportRequestList& requests, unsigned int num_threads = 0, ImportCallBackFunction callback = NULL, void *userData = NULL);
+        /**
+        * Extracts files to the host file system. Contents are read in the order they are
+        * stored while a pool of threads writes the host files. Destinations with the same
+        * size and modification time as the file are left alone
+        * @param requests List of files and directories to extract, results are stored per request
+        * @param num_threads Number of writing threads, 0 for one per hardware thread
+        * @param callback Function to call after each request, NULL for none
+        * @param userData User data passed to callback
+        * @return OFS_OK if all requests succeeded, otherwise the first failing result
+        */
+        OfsResult    extractFiles(ExtractRequestList& requests, unsigned int num_threads = 0, ExtractCallBackFunction callback = NULL, void *userData = NULL);
+        /**
         * Writes data to a given file (handle)
         * @param handle handle of the file
         * @param src Buffer to write data from
@@ -525,7 +690,17 @@ namespace OFS
     private:
         FileStream                mStream;              // Handle of underlying file system
         strFileHeader             mHeader;              // File System Header
-        BlockDataVector           mFreeBlocks;          // Vector holding free(available) blocks in file system 
+        PosBlockDataMap           mFreeBlocks;          // Map holding free(available) blocks in file system indexed by position
+        LengthPosSet              mFreeBlocksBySize;    // Set of (Length, Position) pairs of free blocks, used for best fit allocation
+        boost::mutex              mActiveFilesMutex;    // Guards use counts and active files of read-only opens done under shared lock
+        int                       mTransactionDepth;    // Nesting depth of beginTransaction calls
+        bool                      mTransactionAborted;  // Was a call of the current batch ended with abortTransaction?
+        BlockData                 mIndexBlock;          // Block holding the directory index, Start is 0 if there is none
+        OfsEntryDesc              mDedupRoot;           // Root of hidden entries holding contents shared by OFS_DEDUP files
+        bool                      mDedupMode;           // Are new files deduplicated against shared contents?
+        BlockCache                mCache;               // Recently read contents of the file system file, bypassed while memory mapped
+
+        SHARED_AUTO_MUTEX
 
         /* Private Constructor */
         _Ofs();
@@ -538,17 +713,43 @@ namespace OFS
         OfsResult     _mount(const char *file, unsigned int op = OFS_MOUNT_OPEN);
         /* Unmount file system */
         void          _unmount(); 
+        /* Enables/Disables memory mapped reads */
+        void          _setMemoryMapped(bool enable);
 
         /* Reads the file system header */
         OfsResult     _readHeader();
         /* Writes the file system header */
         OfsResult     _writeHeader();
+        /* Loads directory tree and free blocks from the index block, false if the index is not usable */
+        bool          _readIndex(ofs64 index_pos, ofs64 file_size);
+        /* Writes the directory index into a new block and points the file header to it */
+        void          _writeIndex();
+        /* Appends index records of an entry and its children to the buffer */
+        void          _writeIndexEntries(OfsEntryDesc *desc, std::vector<char>& buffer, unsigned int& count);
+        /* Arms the write barrier which marks the index as stale on the first change to the file */
+        inline void   _armIndexBarrier();
 
+        /* Reads raw data at a given file position, from the memory mapping if available */
+        inline void   _readData(ofs64 pos, char *dest, unsigned int length);
+        /* Serves a batch read request through a regular file handle (linked and compressed files) */
+        OfsResult     _readFileThroughHandle(ReadRequest& request);
+        /* Creates the directories leading to an imported file */
+        void          _createImportPath(const std::string& name);
+        /* Stores an import item held in memory, called with the file system locked */
+        OfsResult     _storeImported(const ImportRequest& request, ImportItem& item);
+        /* Stores an import item too large to hold in memory by copying it in chunks */
+        OfsResult     _storeImportedStreamed(const ImportRequest& request, ImportItem& item);
         /* Clears the state of file system (during error) */
         inline void   _clear();
         /* Deallocates children of an entry recursively */
         inline void   _deallocateChildren(OfsEntryDesc* parent);
-        /* Marks a used block as free (available) */
+        /* Adds a block to free block indices */
+        inline void   _insertFreeBlock(const BlockData& data);
+        /* Removes a block from free block indices */
+        inline void   _eraseFreeBlock(const BlockData& data);
+        /* Finds the smallest free block which can hold block_size bytes, false if none found */
+        inline bool   _findFreeBlock(ofs64 block_size, BlockData& data);
+        /* Marks a used block as free (available), coalescing it with adjacent free blocks */
         inline void   _markUnused(BlockData data);
         /* Allocates a data block for use, either from free blocks or creates a new block and writes given header */
         inline void   _allocateFileBlock(OfsEntryDesc *desc, strMainEntryHeader& mainEntry, ofs64 block_size, unsigned int data_size = 0, const char *data = NULL);
@@ -562,9 +763,9 @@ namespace OFS
         /* Retrieves directory descriptor of a given path, null if not found */
         OfsEntryDesc* _getDirectoryDesc(const char *filename);
         /* Retrieves file descriptor of a given file in a given directory, null if not found */
-        OfsEntryDesc* _getFileDesc(OfsEntryDesc *dir_desc, std::string filename);
+        OfsEntryDesc* _getFileDesc(OfsEntryDesc *dir_desc, const std::string& filename);
         /* Retrieves file descriptor of a given child in a given directory, null if not found */
-        OfsEntryDesc* _findChild(OfsEntryDesc *dir_desc, std::string child_name);
+        OfsEntryDesc* _findChild(OfsEntryDesc *dir_desc, const std::string& child_name);
         /* Retrieves filename from a given path */
         std::string   _extractFileName(const char *filename);
         /* Internal createDirectory implementation */
@@ -581,6 +782,79 @@ namespace OFS
         inline void   _deleteRecycleBinDesc(OfsEntryDesc *desc);
         /* Internal  function to find an entry by id */
         OfsEntryDesc* _findDescById(OfsEntryDesc* base, int id);
+
+        /* Reads stored data at handle's position, returns the amount read */
+        unsigned int  _readRaw(OFSHANDLE& handle, char *dest, unsigned int length);
+        /* Loads the data following a sequential read into the cache, walking the blocks of the file */
+        void          _readAhead(OFSHANDLE& handle, unsigned int length);
+        /* Writes stored data at handle's position, allocating blocks as needed */
+        void          _writeRaw(OFSHANDLE& handle, const char *src, unsigned int length);
+        /* Truncates stored data to given size if it is larger */
+        void          _truncateRaw(OFSHANDLE& handle, ofs64 file_size);
+        /* Returns the number of content bytes the blocks of an entry can hold */
+        ofs64         _getAllocatedSize(OfsEntryDesc *desc);
+        /* Gives unused space at the end of an entry's last block back as a free block */
+        void          _releaseUnusedSpace(OfsEntryDesc *desc);
+        /* Returns the size of an entry's contents as seen by readers, uncompressed if needed */
+        inline ofs64  _getContentSize(OfsEntryDesc *desc);
+        /* Prepares the uncompressed view of an OFS_COMPRESSED file for a newly opened handle */
+        OfsResult     _openCompressed(OFSHANDLE& handle);
+        /* Reads the compressed data header and chunk offsets of handle's file */
+        OfsResult     _readCompressedIndex(OFSHANDLE& handle);
+        /* Decompresses a chunk of handle's file into dest, which must hold the whole chunk */
+        OfsResult     _decompressChunk(OFSHANDLE& handle, unsigned int chunk, char *dest);
+        /* Compresses the contents held by a write handle and replaces the stored data with them */
+        OfsResult     _storeCompressed(OFSHANDLE& handle);
+        /* Converts the file of a write handle between compressed and uncompressed storage */
+        OfsResult     _setCompressed(OFSHANDLE& handle, bool compress);
+        /* Writes the size of uncompressed contents into entry's header */
+        inline void   _writeUncompressedSize(OfsEntryDesc *desc);
+
+        /* Returns the path of the side file holding the compaction journal */
+        inline std::string _getCompactJournalName();
+        /* Returns the path of the side file holding the undo journal of an uncommitted transaction */
+        inline std::string _getTransactionJournalName();
+        /* Undoes the writes of the ended outermost batch and reloads the file system */
+        OfsResult     _rollbackTransaction();
+        /* Collects in-memory state of an entry and its children which has to survive a reload */
+        void          _saveEntryState(OfsEntryDesc *desc, const std::string& path, std::vector<EntryState>& states);
+        /* Completes a block move left unfinished by an interrupted compaction */
+        void          _replayCompactJournal();
+        /* Performs the on-disk part of a block move, safe to repeat after a crash */
+        void          _applyCompactMove(const strCompactJournal& move);
+        /* Collects used blocks of entries which can be moved, indexed by position */
+        void          _collectMovableBlocks(OfsEntryDesc *desc, PosOwnerMap& blocks);
+        /* Finds the smallest free block located before given block which can hold it, false if none found */
+        bool          _findCompactTarget(const BlockData& block, BlockData& target);
+        /* Moves a used block of an entry into the given free block */
+        OfsResult     _compactBlock(OfsEntryDesc *desc, unsigned int index, const BlockData& target);
+        /* Cuts a free block at the end of the file off the file system */
+        void          _truncateFreeTail();
+
+        /* Links OFS_DEDUP files to their shared contents after mount and frees contents nobody refers to */
+        void          _linkSharedFiles();
+        /* Links OFS_DEDUP files below an entry to shared contents indexed by id */
+        void          _linkSharedFilesRecursive(OfsEntryDesc *desc, const IdDescMap& shared);
+        /* Checks if a file's contents are worth sharing */
+        inline bool   _canShare(OfsEntryDesc *file);
+        /* Returns the name of the shared entry for contents with given hash and size */
+        std::string   _getSharedName(ofs64 hash, ofs64 size);
+        /* Hashes the stored contents of an entry */
+        ofs64         _hashContents(OfsEntryDesc *desc);
+        /* Finds a shared entry with given name holding the same contents as a file or a buffer, null if none found */
+        OfsEntryDesc* _findSharedContents(const std::string& name, OfsEntryDesc *file, const char *data, ofs64 size);
+        /* Creates an OFS_DEDUP file referring to the contents of given shared entry */
+        OfsEntryDesc* _createSharedFile(OfsEntryDesc *parent, const std::string& name, const UUID& uuid, time_t creation_time, unsigned int flags, OfsEntryDesc *shared);
+        /* Replaces a closed file with an OFS_DEDUP file, its contents become shared unless identical ones exist, returns the new entry */
+        OfsEntryDesc* _dedupFile(OfsEntryDesc *file);
+        /* Gives an OFS_DEDUP file its own storage again, copying the shared contents if keep_contents is set */
+        void          _unshareFile(OfsEntryDesc *file, bool keep_contents);
+        /* Unshares the file of a handle before it is modified through the handle */
+        void          _unshareHandle(OFSHANDLE& handle);
+        /* Drops the reference of an OFS_DEDUP file, freeing the shared contents when no longer used */
+        void          _releaseShared(OfsEntryDesc *file);
+        /* Removes a shared entry and frees its blocks */
+        void          _freeShared(OfsEntryDesc *shared);
     };
 
 //------------------------------------------------------------------------------
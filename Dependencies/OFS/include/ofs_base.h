@@ -34,6 +34,9 @@
 
 #include <vector>
 #include <map>
+#include <set>
+#include <list>
+#include <functional>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -41,6 +44,7 @@
 #include <exception>
 #include <time.h>
 #include <boost/thread.hpp>
+#include <boost/detail/atomic_count.hpp>
 
 #if (defined( __WIN32__ ) || defined( _WIN32 )) && ! defined( __GNUC__ )
    #ifdef OFS_EXPORT
@@ -64,6 +68,7 @@ const char VERSION_FIX      = '0';
 
 const int ROOT_DIRECTORY_ID = -1;
 const int RECYCLEBIN_DIRECTORY_ID = -2;
+const int DEDUP_DIRECTORY_ID = -3;
 
 
 #define AUTO_MUTEX mutable boost::recursive_mutex OfsMutex;
@@ -71,6 +76,10 @@ const int RECYCLEBIN_DIRECTORY_ID = -2;
 #define STATIC_AUTO_MUTEX_DECL(a) boost::recursive_mutex a::OfsStaticMutex;
 #define STATIC_AUTO_MUTEX static boost::recursive_mutex OfsStaticMutex;
 #define STATIC_LOCK_AUTO_MUTEX boost::recursive_mutex::scoped_lock ofsAutoMutexLock(OfsStaticMutex);
+#define SHARED_AUTO_MUTEX mutable OfsSharedMutex OfsRWMutex;
+#define LOCK_SHARED_AUTO_MUTEX OfsScopedLock ofsSharedMutexLock(OfsRWMutex, false);
+#define LOCK_EXCLUSIVE_AUTO_MUTEX(stream) OfsScopedLock ofsSharedMutexLock(OfsRWMutex, true, stream);
+#define LOCK_SELECT_AUTO_MUTEX(exclusive, stream) OfsScopedLock ofsSharedMutexLock(OfsRWMutex, exclusive, stream);
 
 #if (defined( __WIN32__ ) || defined( _WIN32 )) && ! defined( __GNUC__ )
 typedef __int64 ofs64;
@@ -85,12 +94,25 @@ typedef off_t ofs64;
  #endif
 #endif
 
+    class BlockCache;
+
     class FileStream
     {
     public:
         FileStream()
         {
             m_pFile = NULL;
+            m_pCache = NULL;
+            m_pMap = NULL;
+            m_hMapping = NULL;
+            m_MapSize = 0;
+            m_MapEnabled = false;
+            m_MapStale = false;
+            m_Dirty = false;
+            m_pUndo = NULL;
+            m_UndoBase = 0;
+            m_UndoUnsynced = 0;
+            m_BarrierPos = 0;
         }
 
         ~FileStream()
@@ -141,9 +163,231 @@ typedef off_t ofs64;
 
 		void fill( ofs64 len );
 
+        /* Positional read which leaves the stream position untouched, safe to call from concurrent readers */
+        size_t readAt( ofs64 pos, void *data, size_t size );
+
+        /* Flushes pending writes and refreshes a stale mapping so concurrent readers see current data */
+        void sync();
+
+        /* Flushes pending writes and makes sure they reach the disk before returning */
+        void commit();
+
+        /* Cuts the file at given size, dropping the mapping until it is next needed, returns true if successful */
+        bool truncate( ofs64 size );
+
+        /* Starts saving original contents of the file into given journal before they are overwritten */
+        bool beginUndoJournal( const char *journal_file );
+
+        /* Makes all writes since beginUndoJournal durable and deletes the journal, this is the commit point */
+        void commitUndoJournal();
+
+        /* Restores the contents saved in given journal by an uncommitted batch of writes, then deletes the journal */
+        void rollbackUndoJournal( const char *journal_file );
+
+        /* Undoes all writes since beginUndoJournal and deletes the journal */
+        void abortUndoJournal();
+
+        bool isUndoJournalActive() const
+        {
+            return ( m_pUndo != NULL );
+        }
+
+        /* Arms a patch which is written and synced to the file right before the next write,
+           used to invalidate data describing the current contents of the file */
+        void setWriteBarrier( ofs64 pos, const void *data, size_t size );
+
+        /* Returns true if no write was done since the barrier was armed */
+        bool isWriteBarrierArmed() const
+        {
+            return !m_Barrier.empty();
+        }
+
+        /* Enables/Disables a read-only memory mapping of the whole file, returns true if mapping is active */
+        bool setMapped( bool enable );
+
+        bool isMapped() const
+        {
+            return m_MapEnabled;
+        }
+
+        /* Returns a pointer to mapped file data at pos, NULL if mapping is disabled or range is not mapped */
+        const char *view( ofs64 pos, ofs64 size );
+
+        /* Attaches a cache of file contents which is invalidated by all writes done through this stream */
+        void setCache( BlockCache *cache )
+        {
+            m_pCache = cache;
+        }
+
     protected:
         FILE *m_pFile;
+        BlockCache *m_pCache;  // Cache of file contents kept in sync with writes, NULL if none
+        char *m_pMap;        // Base address of read-only file mapping
+        void *m_hMapping;    // Platform mapping handle (Windows only)
+        ofs64 m_MapSize;     // Length of the mapped region
+        bool  m_MapEnabled;  // Is memory mapped reading requested?
+        bool  m_MapStale;    // Has the file been written since it was mapped?
+        bool  m_Dirty;       // Are there buffered writes not yet flushed to the file?
+        FILE *m_pUndo;       // Undo journal of the active batch of writes
+        std::string m_UndoName;        // Path of the undo journal
+        ofs64 m_UndoBase;              // Size of the file when the batch was started
+        std::set<ofs64> m_UndoPages;   // Pages whose original contents are already in the undo journal
+        ofs64 m_UndoUnsynced;          // Bytes written to the undo journal since it was last synced
+        ofs64 m_BarrierPos;            // Position of the write barrier patch
+        std::string m_Barrier;         // Contents of the write barrier patch, empty if not armed
+
+        void _map();
+        void _unmap();
+        void _saveUndo( ofs64 pos, ofs64 size );
+        void _fireBarrier();
+        /* Grows the file by len bytes if the position is at its end, leaving the position at the new end */
+        bool _extend( ofs64 len );
+    };
+
+
+    /* Bounded LRU cache of file contents in fixed size pages keyed by their offset in the file.
+       Safe to use from concurrent readers, writers must invalidate the ranges they change */
+    class BlockCache
+    {
+    public:
+        BlockCache() : m_Capacity( 0 ), m_Hits( 0 ), m_Misses( 0 ) {}
+
+        /* Sets the maximum number of bytes held, 0 disables the cache */
+        void setCapacity( ofs64 capacity );
+
+        ofs64 getCapacity();
+
+        /* Reads through the cache, missing pages are loaded from the stream, returns number of bytes read */
+        size_t read( FileStream& stream, ofs64 pos, void *data, size_t size );
+
+        /* Loads pages of the given range which are not cached yet, contiguous missing pages with a single read */
+        void prefetch( FileStream& stream, ofs64 pos, ofs64 size );
+
+        /* Drops pages overlapping the given range, size of -1 drops everything after pos */
+        void invalidate( ofs64 pos, ofs64 size );
+
+        /* Drops all pages and resets the counters */
+        void clear();
+
+        void getCounters( ofs64& hits, ofs64& misses );
+
+    protected:
+        struct Page
+        {
+            std::vector<char>          Data;
+            std::list<ofs64>::iterator Lru;
+        };
+
+        typedef std::map<ofs64, Page> PageMap;
+
+        boost::mutex     m_Mutex;     // Guards all members below
+        PageMap          m_Pages;     // Cached pages keyed by their offset
+        std::list<ofs64> m_Lru;       // Offsets of cached pages, most recently used first
+        ofs64            m_Capacity;  // Maximum number of bytes held
+        ofs64            m_Hits;      // Number of pages found in the cache
+        ofs64            m_Misses;    // Number of pages loaded on demand
+
+        /* Adds a page if it is not cached yet, evicting least recently used pages, called with the mutex held */
+        void _insert( ofs64 pos, const char *data, size_t size );
+    };
 
+
+    /* Reader/writer lock which is recursive for the exclusive owner. A thread holding the
+       exclusive lock may take it again or take the shared lock without blocking; taking the
+       exclusive lock while holding only the shared lock is not allowed */
+    class OfsSharedMutex
+    {
+    public:
+        void lockExclusive()
+        {
+            LockDepth *depth = _depth();
+            assert( depth->Shared == 0 );
+
+            if( depth->Exclusive++ == 0 )
+                m_Mutex.lock();
+        }
+
+        void unlockExclusive()
+        {
+            if( --_depth()->Exclusive == 0 )
+                m_Mutex.unlock();
+        }
+
+        bool isOutermostExclusive()
+        {
+            return ( _depth()->Exclusive == 1 );
+        }
+
+        void lockShared()
+        {
+            LockDepth *depth = _depth();
+
+            if( depth->Exclusive == 0 && depth->Shared++ == 0 )
+                m_Mutex.lock_shared();
+        }
+
+        void unlockShared()
+        {
+            LockDepth *depth = _depth();
+
+            if( depth->Exclusive == 0 && --depth->Shared == 0 )
+                m_Mutex.unlock_shared();
+        }
+
+    protected:
+        struct LockDepth
+        {
+            LockDepth() : Exclusive( 0 ), Shared( 0 ) {}
+
+            unsigned int Exclusive;
+            unsigned int Shared;
+        };
+
+        boost::shared_mutex m_Mutex;
+        boost::thread_specific_ptr<LockDepth> m_Depth;   // Per thread lock depths
+
+        LockDepth *_depth()
+        {
+            LockDepth *depth = m_Depth.get();
+            if( depth == NULL )
+            {
+                depth = new LockDepth();
+                m_Depth.reset( depth );
+            }
+
+            return depth;
+        }
+    };
+
+    class OfsScopedLock
+    {
+    public:
+        /* If a stream is given, it is synced before the last exclusive lock is released */
+        OfsScopedLock( OfsSharedMutex& mutex, bool exclusive, FileStream *stream = NULL ) : m_Mutex( mutex ), m_Exclusive( exclusive ), m_pStream( stream )
+        {
+            if( m_Exclusive )
+                m_Mutex.lockExclusive();
+            else
+                m_Mutex.lockShared();
+        }
+
+        ~OfsScopedLock()
+        {
+            if( m_Exclusive )
+            {
+                if( m_pStream != NULL && m_Mutex.isOutermostExclusive() )
+                    m_pStream->sync();
+
+                m_Mutex.unlockExclusive();
+            }
+            else
+                m_Mutex.unlockShared();
+        }
+
+    protected:
+        OfsSharedMutex& m_Mutex;
+        bool            m_Exclusive;
+        FileStream     *m_pStream;
     };
 
 
@@ -171,7 +415,9 @@ typedef off_t ofs64;
         OFS_MOUNT_CREATE = 0,
         OFS_MOUNT_OPEN = 1,
         OFS_MOUNT_RECOVER = 2,
-        OFS_MOUNT_LINK = 4
+        OFS_MOUNT_LINK = 4,
+        OFS_MOUNT_MMAP = 8,
+        OFS_MOUNT_DEDUP = 16
     };
 
     enum FileOpType
@@ -196,6 +442,8 @@ typedef off_t ofs64;
         OFS_FILE     = 0x00000002,
         OFS_READONLY = 0x00000004,
         OFS_HIDDEN   = 0x00000008,
+        OFS_COMPRESSED = 0x00000010,
+        OFS_DEDUP    = 0x00000020,
         OFS_LINK     = 0x80000000
     };
 
@@ -215,6 +463,11 @@ typedef off_t ofs64;
         {
             memset(data, 0, 16);
         };
+
+        UUID(const UUID& uuid)
+        {
+            memcpy(data, uuid.data, 16);
+        };
         
         UUID(unsigned int _a, unsigned short _b, unsigned short _c, unsigned char _d0, unsigned char _d1, unsigned char _d2, unsigned char _d3, unsigned char _d4, unsigned char _d5, unsigned char _d6, unsigned char _d7)
         {
@@ -370,7 +623,66 @@ typedef off_t ofs64;
         ofs64 ActualUsedSpace;
         ofs64 ActualFreeSpace;
         ofs64 TotalFileSize;
+        ofs64 DedupSavedSpace;
+        ofs64 CacheHits;        /* Number of pages served by the read cache since mount */
+        ofs64 CacheMisses;      /* Number of pages the read cache had to load on demand */
+    };
+
+    struct CompactionProgress
+    {
+        unsigned int BlocksMoved;    /* Number of blocks moved during last call */
+        ofs64        BytesMoved;     /* Number of bytes moved during last call */
+        ofs64        FreeSpace;      /* Free space still left inside the file system */
+        ofs64        TotalFileSize;  /* Size of the file system file after last call */
+        bool         Finished;       /* True if there is nothing left to compact */
+    };
+
+    struct ReadRequest
+    {
+        std::string  Name;           /* Path of the file, used if Uuid is UUID_ZERO */
+        UUID         Uuid;           /* UUID of the file, takes precedence over Name */
+        char        *Buffer;         /* Destination buffer, NULL to only query FileSize */
+        unsigned int BufferSize;     /* Size of the destination buffer */
+        unsigned int BytesRead;      /* Number of bytes actually read into Buffer */
+        ofs64        FileSize;       /* Size of the file */
+        OfsResult    Result;         /* Result of the request, OFS_OK if successful */
+
+        ReadRequest() : Uuid(UUID_ZERO), Buffer(0), BufferSize(0), BytesRead(0), FileSize(0), Result(OFS_OK) {}
+    };
+
+    typedef std::vector<ReadRequest> ReadRequestList;
+
+    struct ImportRequest
+    {
+        std::string  SourcePath;     /* Path of the file on the host file system, empty to only create the directory Name */
+        std::string  Name;           /* Path of the file inside the file system, missing directories are created */
+        unsigned int Flags;          /* OFS_COMPRESSED to store the file compressed */
+        ofs64        FileSize;       /* Size of the imported file */
+        OfsResult    Result;         /* Result of the request, OFS_OK if successful */
+
+        ImportRequest() : Flags(0), FileSize(0), Result(OFS_OK) {}
+    };
+
+    typedef std::vector<ImportRequest> ImportRequestList;
+
+    /* Called by importFiles on the importing thread each time a request is done */
+    typedef void (*ImportCallBackFunction)(void *userData, const ImportRequest& request);
+
+    struct ExtractRequest
+    {
+        std::string  Name;           /* Path of the file or directory inside the file system */
+        std::string  DestPath;       /* Path to extract to on the host file system, missing directories are created */
+        ofs64        FileSize;       /* Size of the extracted file */
+        bool         Skipped;        /* true if the destination already had the same size and modification time */
+        OfsResult    Result;         /* Result of the request, OFS_OK if successful */
+
+        ExtractRequest() : FileSize(0), Skipped(false), Result(OFS_OK) {}
     };
+
+    typedef std::vector<ExtractRequest> ExtractRequestList;
+
+    /* Called by extractFiles on the extracting thread each time a request is done */
+    typedef void (*ExtractCallBackFunction)(void *userData, const ExtractRequest& request);
     
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
@@ -468,6 +780,19 @@ typedef off_t ofs64;
             CallBackFunction  func;
             void             *data;
             void             *owner;
+            unsigned int      interval;   /* Minimum milliseconds between two notifications, 0 for no limit */
+
+            /* Orders triggers by identity, the interval is not part of it */
+            bool operator<(const CallBackData& other) const
+            {
+                if(owner != other.owner)
+                    return std::less<void*>()(owner, other.owner);
+                if(type != other.type)
+                    return type < other.type;
+                if(func != other.func)
+                    return std::less<CallBackFunction>()(func, other.func);
+                return std::less<void*>()(data, other.data);
+            }
         };
 
 
@@ -480,8 +805,20 @@ typedef off_t ofs64;
             ofs64        NextBlock;   /* Position of Next Block in file */
         };
 
+        /* Holds the state of an open handle to an OFS_COMPRESSED file (for keeping in memory) */
+        struct CompressedData
+        {
+            ofs64              Pos;           /* Position in uncompressed contents */
+            ofs64              Size;          /* Size of uncompressed contents */
+            unsigned int       ChunkSize;     /* Size of an uncompressed chunk */
+            std::vector<ofs64> ChunkOffsets;  /* Positions of compressed chunks in stored data, followed by end of last chunk */
+            int                CachedChunk;   /* Index of the chunk held in Buffer for read handles, -1 if none */
+            std::vector<char>  Buffer;        /* Decompressed chunk for read handles, whole contents for write handles */
+        };
+
 
         typedef std::map<std::string, OfsPtr> NameOfsPtrMap;
+        typedef std::multimap<std::string, OfsEntryDesc*> NameDescMap;
 
         /* Entry Descriptor, contains all information needed for entry (in memory) */
         struct OfsEntryDesc
@@ -494,12 +831,17 @@ typedef off_t ofs64;
             UUID          Uuid;                   /* UUID of Entry */
             time_t        CreationTime;           /* Entry's Creation Time */
             ofs64         FileSize;               /* Entry's File Size, 0 for Directories */
+            ofs64         UncompressedSize;       /* Size of contents before compression, only valid for OFS_COMPRESSED files */
+            OfsEntryDesc *SharedData;             /* Entry holding the contents of an OFS_DEDUP file, NULL otherwise */
+            int           ShareCount;             /* Number of OFS_DEDUP files sharing this entry's contents */
             std::string   Name;                   /* Entry's Name */
             OfsEntryDesc *Parent;                 /* Pointer to Entry's Parent's descriptor */
             int           UseCount;               /* Number of handles using this entry */
             bool          WriteLocked;            /* If true, Entry is not suitable for WRITE operations */
             std::vector<BlockData> UsedBlocks;    /* Vector of BlockData used by this entry */
             std::vector<OfsEntryDesc*> Children;  /* Vector of Entry's children */
+            unsigned int  ChildPos;               /* Position of the Entry in its parent's Children, kept by _addChild once Parent is set */
+            NameDescMap   ChildIndex;             /* Entry's children indexed by name, kept in sync with Children */
             std::vector<CallBackData> Triggers;   /* Vector of Entry's triggers */
             NameOfsPtrMap Links;                  /* Map of of OfsPtr links */
         };
@@ -539,14 +881,23 @@ typedef off_t ofs64;
         */
         virtual OfsResult    getFileSystemStats(FileSystemStats& stats) = 0;
         /**
+        * Sets the size of the cache holding recently read file contents, ignored by file systems
+        * which read host files directly
+        * @param size Maximum number of bytes held, 0 disables the cache
+        */
+        virtual void         setReadCacheSize(ofs64 /*size*/) {};
+        /**
         * Adds a new file system trigger
         * @param _owner The owner class or id for the trigger
         * @param _type Type of events to get notified about
         * @param _func Function to call for notification
         * @param _data User data to be passed to notification function
+        * @param _interval Minimum milliseconds between two notifications, changes in between are
+        * reported together with NULL arguments; 0 to be notified about every entry separately.
+        * Notifications held back by the interval go out with the next operation or deliverDueTriggers
         * @return Result of operation, OFS_OK if successful
         */
-        virtual OfsResult    addTrigger(void *_owner, CallBackType _type, CallBackFunction _func, void *_data = 0)  = 0;
+        virtual OfsResult    addTrigger(void *_owner, CallBackType _type, CallBackFunction _func, void *_data = 0, unsigned int _interval = 0)  = 0;
         /**
         * Removes a file system trigger
         * @param _owner The owner class or id for the trigger
@@ -571,6 +922,27 @@ typedef off_t ofs64;
         */
         virtual void         removeFileTrigger(const char *filename, void *_owner, CallBackType _type) = 0;
         /**
+        * Starts a batch of operations. Trigger notifications are always held until the operation
+        * causing them is over and the file system is unlocked; within a batch they are held until
+        * the matching endTriggerBatch, and an entry changed several times is reported once
+        */
+        void         beginTriggerBatch();
+        /**
+        * Ends a batch of operations started with beginTriggerBatch, delivers held notifications
+        * once the outermost batch is over
+        */
+        void         endTriggerBatch();
+        /**
+        * Delivers held notifications, including those of triggers whose interval has not passed yet.
+        * Does nothing while a batch is open, notifications still held at unmount are discarded
+        */
+        void         flushTriggers();
+        /**
+        * Delivers held notifications of triggers whose interval has passed. Without further operations
+        * nothing else delivers them, owners of triggers with an interval call this from a timer
+        */
+        void         deliverDueTriggers();
+        /**
         * Makes a defragmented copy of the file system
         * @param dest path of the destination file
         * @param logCallBackFunc method that gets called for each processed OFS component
@@ -578,6 +950,35 @@ typedef off_t ofs64;
         */
         virtual OfsResult    defragFileSystemTo(const char *dest, LogCallBackFunction* logCallbackFunc = NULL) = 0;
         /**
+        * Compacts the file system in place by moving blocks from the end of the file into free
+        * space closer to its start, meant to be called repeatedly (eg. from an idle timer).
+        * Blocks of open files are left untouched, an interrupted move is completed on next mount
+        * @param max_blocks maximum number of blocks to move during this call
+        * @param progress receives the state of compaction after this call
+        * @return Result of operation, OFS_OK if successful
+        */
+        virtual OfsResult    compactFileSystem(unsigned int max_blocks, CompactionProgress& progress) = 0;
+        /**
+        * Starts a batch of operations which is committed atomically, writes done until the matching
+        * commitTransaction are rolled back on next mount if the application stops before committing.
+        * Calls can be nested, only the outermost commit makes the batch durable
+        * @return Result of operation, OFS_OK if successful
+        */
+        virtual OfsResult    beginTransaction() = 0;
+        /**
+        * Commits a batch of operations started with beginTransaction, the whole batch is rolled back
+        * instead if any of its nested calls was ended with abortTransaction
+        * @return Result of operation, OFS_OK if successful
+        */
+        virtual OfsResult    commitTransaction() = 0;
+        /**
+        * Ends a batch of operations started with beginTransaction and undoes all writes of the outermost batch,
+        * a nested batch is undone when the outermost one ends. The file system is reloaded from the restored file,
+        * this fails with OFS_ACCESS_DENIED and commits the batch instead if files are open
+        * @return Result of operation, OFS_OK if successful
+        */
+        virtual OfsResult    abortTransaction() = 0;
+        /**
         * Copies the current file system and switches to it
         * @param dest path of the destination file
         * @return Result of operation, OFS_OK if successful
@@ -753,6 +1154,15 @@ typedef off_t ofs64;
         */
         virtual OfsResult    truncateFile(OFSHANDLE& handle, ofs64 file_size = -1) = 0;
         /**
+        * Reserves room for the contents of a file, so writes up to given size need no further
+        * allocation and the file stays contiguous. The file size is not changed, reserved space
+        * that was not written is given back when the last handle of the file is closed
+        * @param handle File Handle of the file, opened for writing
+        * @param size Number of content bytes to make room for, counted from the start of the file
+        * @return Result of operation, OFS_OK if successful
+        */
+        virtual OfsResult    reserve(OFSHANDLE& handle, ofs64 size) = 0;
+        /**
         * List files/folders in a given directory
         * @param path path of the directory
         * @param file_flags Filters the results by given flag
@@ -842,17 +1252,17 @@ typedef off_t ofs64;
         */
         virtual OfsResult    getFileSize(OFSHANDLE& handle, ofs64& size) = 0; 
         /**
-        * Sets file flags like read-only/hidden
+        * Sets file flags like read-only/hidden, toggling OFS_COMPRESSED converts the stored data
         * @param filename path to the file
         * @param flags combination of flags to set
-        * @return Result of operation, OFS_OK if successful
+        * @return Result of operation, OFS_OK if successful, OFS_ACCESS_DENIED if compression changes while file is open
         */
         virtual OfsResult    setFileFlags(const char *filename, unsigned int flags) = 0; 
         /**
-        * Sets file flags like read-only/hidden
+        * Sets file flags like read-only/hidden, toggling OFS_COMPRESSED converts the stored data
         * @param handle handle to the file
         * @param flags combination of flags to set
-        * @return Result of operation, OFS_OK if successful
+        * @return Result of operation, OFS_OK if successful, OFS_ACCESS_DENIED if compression changes on a handle not opened for writing
         */
         virtual OfsResult    setFileFlags(OFSHANDLE& handle, unsigned int flags) = 0; 
         /**
@@ -941,6 +1351,35 @@ typedef off_t ofs64;
         */
         virtual OfsResult    read(OFSHANDLE& handle, char *dest, unsigned int length, unsigned int *actual_read = NULL) = 0;
         /**
+        * Reads a batch of whole files in one pass, ordering the underlying
+        * reads by their position on disk
+        * @param requests List of files to read, results are stored per request
+        * @return OFS_OK if all requests succeeded, otherwise the first failing result
+        */
+        virtual OfsResult    readFiles(ReadRequestList& requests) = 0;
+        /**
+        * Imports files from the host file system. Host files are read, hashed and
+        * compressed on a pool of threads while the calling thread stores them in the
+        * order they become ready
+        * @param requests List of files to import, results are stored per request
+        * @param num_threads Number of reading threads, 0 for one per hardware thread
+        * @param callback Function to call after each request, NULL for none
+        * @param userData User data passed to callback
+        * @return OFS_OK if all requests succeeded, otherwise the first failing result
+        */
+        virtual OfsResult    importFiles(ImportRequestList& requests, unsigned int num_threads = 0, ImportCallBackFunction callback = NULL, void *userData = NULL) = 0;
+        /**
+        * Extracts files to the host file system. Contents are read in the order they are
+        * stored while a pool of threads writes the host files. Destinations with the same
+        * size and modification time as the file are left alone
+        * @param requests List of files and directories to extract, results are stored per request
+        * @param num_threads Number of writing threads, 0 for one per hardware thread
+        * @param callback Function to call after each request, NULL for none
+        * @param userData User data passed to callback
+        * @return OFS_OK if all requests succeeded, otherwise the first failing result
+        */
+        virtual OfsResult    extractFiles(ExtractRequestList& requests, unsigned int num_threads = 0, ExtractCallBackFunction callback = NULL, void *userData = NULL) = 0;
+        /**
         * Writes data to a given file (handle)
         * @param handle handle of the file
         * @param src Buffer to write data from
@@ -972,9 +1411,20 @@ typedef off_t ofs64;
         /* Retrieves directory descriptor of a given path, null if not found */
         virtual OfsEntryDesc* _getDirectoryDesc(const char *filename) = 0;
         /* Retrieves file descriptor of a given file in a given directory, null if not found */
-        virtual OfsEntryDesc* _getFileDesc(OfsEntryDesc *dir_desc, std::string filename) = 0;
+        virtual OfsEntryDesc* _getFileDesc(OfsEntryDesc *dir_desc, const std::string& filename) = 0;
         /* Retrieves file descriptor of a given child in a given directory, null if not found */
-        virtual OfsEntryDesc* _findChild(OfsEntryDesc *dir_desc, std::string child_name) = 0;
+        virtual OfsEntryDesc* _findChild(OfsEntryDesc *dir_desc, const std::string& child_name) = 0;
+
+        /* Adds a child to a directory descriptor and its name index */
+        static void          _addChild(OfsEntryDesc *parent, OfsEntryDesc *child);
+        /* Removes a child from a directory descriptor and its name index */
+        static void          _removeChild(OfsEntryDesc *parent, OfsEntryDesc *child);
+        /* Renames an entry, keeping its parent's name index in sync */
+        static void          _renameChild(OfsEntryDesc *child, const std::string& name);
+        /* Removes all children from a directory descriptor and its name index */
+        static void          _clearChildren(OfsEntryDesc *parent);
+        /* Retrieves a child with a given name matching any of the given flags, null if not found */
+        static OfsEntryDesc* _lookupChild(OfsEntryDesc *dir_desc, const std::string& name, unsigned int flags = OFS_FILE | OFS_DIR);
 
     protected:
         STATIC_AUTO_MUTEX
@@ -991,6 +1441,58 @@ typedef off_t ofs64;
         bool                      mLinkMode;            // Is link mode activated?
         std::vector<CallBackData> mTriggers;            // Vector of File System Triggers 
         LogCallBackFunction       mLogCallBackFunc;     // Function pointer to callback handler
+
+        /* Trigger notification held until the outermost trigger batch is over */
+        struct PendingTrigger
+        {
+            CallBackData  Trigger;
+            OfsEntryDesc *Desc;
+            std::string   Arg;
+            bool          HasArg;
+
+            bool operator<(const PendingTrigger& other) const
+            {
+                if(Trigger < other.Trigger || other.Trigger < Trigger)
+                    return Trigger < other.Trigger;
+                if(Desc != other.Desc)
+                    return std::less<OfsEntryDesc*>()(Desc, other.Desc);
+                if(HasArg != other.HasArg)
+                    return HasArg < other.HasArg;
+                return Arg < other.Arg;
+            }
+        };
+
+        typedef std::map<OfsEntryDesc*, unsigned int> DescCountMap;
+        typedef std::map<CallBackData, boost::system_time> TriggerTimeMap;
+
+        /* Keeps a trigger batch open for its lifetime, declared before the lock so notifications go out after unlocking */
+        class TriggerBatch
+        {
+        public:
+            TriggerBatch(_OfsBase *owner) : mOwner(owner) { mOwner->beginTriggerBatch(); }
+            ~TriggerBatch() { mOwner->endTriggerBatch(); }
+        private:
+            _OfsBase *mOwner;
+        };
+
+        boost::mutex                 mTriggerMutex;         // Guards the members below
+        unsigned int                 mTriggerDepth;         // Number of open trigger batches
+        std::vector<PendingTrigger>  mPendingTriggers;      // Notifications held by open batches
+        DescCountMap                 mPendingDescs;         // Number of held notifications per entry
+        TriggerTimeMap               mTriggerDeliveries;    // Last notification time of triggers with an interval
+
+        /* Directory lookup result, valid while no tree of any mounted file system has changed since */
+        struct PathCacheEntry
+        {
+            OfsEntryDesc *Desc;
+            long          Generation;
+        };
+
+        typedef std::map<std::string, PathCacheEntry> PathCacheMap;
+
+        boost::mutex                 mPathCacheMutex;       // Guards mPathCache
+        PathCacheMap                 mPathCache;            // Directory lookups by path, including paths into linked file systems
+        static boost::detail::atomic_count mTreeGeneration; // Number of changes made to the trees of all file systems
         
 
 
@@ -1013,6 +1515,24 @@ typedef off_t ofs64;
         virtual OfsResult     _mount(const char *file, unsigned int op = OFS_MOUNT_OPEN) = 0;
         /* Unmount file system */
         virtual void          _unmount() = 0; 
+        /* Enables/Disables memory mapped reads, no-op for file systems that don't support it */
+        virtual void          _setMemoryMapped(bool /*enable*/) {};
+        /* Queues notifications for the triggers of a given type, delivered when the outermost batch is over */
+        void          _fireTriggers(const std::vector<CallBackData>& triggers, CallBackType type, OfsEntryDesc *desc, const char *arg);
+        /* Points held notifications about an entry at its replacement, or drops them if there is none */
+        void          _retargetPendingTriggers(OfsEntryDesc *desc, OfsEntryDesc *replacement);
+        /* Drops held notifications of a trigger that is being removed */
+        void          _dropPendingTriggers(void *owner, CallBackType type);
+        /* Forgets all held notifications, the entries they refer to are about to be deallocated */
+        void          _discardPendingTriggers();
+        /* Delivers held notifications unless a batch is open, force ignores trigger intervals */
+        void          _dispatchTriggers(bool force);
+        /* Retrieves a remembered directory lookup, false if there is none for the given tree generation */
+        bool          _lookupPathCache(const char *path, long generation, OfsEntryDesc*& desc);
+        /* Remembers a directory lookup made at the given tree generation, returns desc */
+        OfsEntryDesc* _storePathCache(const char *path, long generation, OfsEntryDesc *desc);
+        /* Forgets all remembered directory lookups */
+        void          _clearPathCache();
 
     };
 
@@ -1029,8 +1549,8 @@ typedef off_t ofs64;
         friend class _OfsRfs;
     public:
 
-        OFSHANDLE() : mEntryDesc(NULL), mAccessFlags(0), mBlock(0), mBlockEnd(0), mPos(0), mRealPos(0) {}
-        ~OFSHANDLE() { };
+        OFSHANDLE() : mEntryDesc(NULL), mDataDesc(NULL), mAccessFlags(0), mBlock(0), mBlockEnd(0), mPos(0), mRealPos(0), mReadAhead(0), mCompressed(NULL) {}
+        ~OFSHANDLE() { delete mCompressed; };
 
         inline unsigned int getAcessFlags() const { return mAccessFlags; };
         
@@ -1042,6 +1562,7 @@ typedef off_t ofs64;
 
     protected:
         _OfsBase::OfsEntryDesc *mEntryDesc;
+        _OfsBase::OfsEntryDesc *mDataDesc;        // Entry holding the shared contents of an OFS_DEDUP file, NULL otherwise
         FileStream    mStream;
         unsigned int  mAccessFlags;
         unsigned int  mBlock;
@@ -1049,11 +1570,20 @@ typedef off_t ofs64;
         ofs64         mBlockEnd;
         ofs64         mPos;
         ofs64         mRealPos;
+        ofs64         mReadAhead;                 // File position up to which contents were read ahead into the cache
 
-        OFSHANDLE(_OfsBase::OfsEntryDesc *_entryDesc) : mEntryDesc(_entryDesc), mAccessFlags(0), mBlock(0), mPos(0), mRealPos(0)
+        _OfsBase::CompressedData *mCompressed;    // Uncompressed view of an OFS_COMPRESSED file, NULL otherwise
+
+        OFSHANDLE(_OfsBase::OfsEntryDesc *_entryDesc) : mEntryDesc(_entryDesc), mDataDesc(NULL), mAccessFlags(0), mBlock(0), mPos(0), mRealPos(0), mReadAhead(0), mCompressed(NULL)
         {
         };
 
+        /**
+        * Retrieves the entry whose blocks hold the data read through this handle
+        * @return Shared entry for OFS_DEDUP files, entry of the handle otherwise
+        */
+        inline _OfsBase::OfsEntryDesc *_dataDesc() { return (mDataDesc != NULL) ? mDataDesc : mEntryDesc; };
+
         /**
         * Prepares Read and Write pointers' initial positions
         * @param append pass true to set write pointer to end of file 
@@ -1103,7 +1633,7 @@ typedef off_t ofs64;
         /**
         * Mounts a given OFS file as a virtual file system
         * @param file path of the file to mount
-        * @param op Mount type : OFS_MOUNT_OPEN or OFS_MOUNT_CREATE
+        * @param op Mount type : OFS_MOUNT_OPEN or OFS_MOUNT_CREATE, optionally OR'ed with OFS_MOUNT_MMAP
         * @return Result of operation, OFS_OK if successful
         */
         OfsResult    mount(const char *file, unsigned int op = OFS_MOUNT_OPEN);
@@ -1113,6 +1643,13 @@ typedef off_t ofs64;
         */
         void         unmount(); 
 
+        /**
+        * Enables/Disables memory mapped reads of the mounted file system, this applies to
+        * everyone sharing the mount of the same file
+        * @param enable If true, reads are served from a read-only mapping of the file
+        */
+        void         setMemoryMapped(bool enable);
+
         /**
         * Checks if object has a valid file system pointer
         * @return True if object is holding a mounted file system
@@ -41,14 +41,23 @@ namespace OFS
         OfsConverter();
         ~OfsConverter();
 
-        bool convert(std::string infile, std::string outfile);
+        /**
+        * Converts a file system of a previous version to the current version, file by file 
+        * with a bounded buffer. Work is committed in batches, calling convert again with the
+        * same files after an interruption continues where the previous call stopped
+        * @param infile Path of the file system to convert
+        * @param outfile Path of the converted file system, different from infile
+        * @param logCallbackFunc Receives progress messages, optional
+        * @return True if all entries were converted
+        */
+        bool convert(std::string infile, std::string outfile, LogCallBackFunction* logCallbackFunc = NULL);
 
     private:
         
         std::fstream mInStream;       // Handle of file system to be converted
         std::fstream mOutStream;      // Handle of destination file system
 
-        bool _convertv13_v14(std::string infile, std::string outfile);
+        bool _convertv13_v14(std::string infile, std::string outfile, ofs64 source_size, LogCallBackFunction* logCallbackFunc);
     };
 
 }
\ No newline at end of file
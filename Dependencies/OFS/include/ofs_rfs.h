@@ -34,6 +34,8 @@
 
 #include "ofs_base.h"
 
+struct OfsWatchEvent;
+
 namespace OFS
 {
 
@@ -57,7 +59,7 @@ namespace OFS
         * @param _data User data to be passed to notification function
         * @return Result of operation, OFS_OK if successful
         */
-        OfsResult    addTrigger(void *_owner, CallBackType _type, CallBackFunction _func, void *_data = 0);
+        OfsResult    addTrigger(void *_owner, CallBackType _type, CallBackFunction _func, void *_data = 0, unsigned int _interval = 0);
         /**
         * Removes a file system trigger
         * @param _owner The owner class or id for the trigger
@@ -89,6 +91,35 @@ namespace OFS
         */
         OfsResult    defragFileSystemTo(const char *dest, LogCallBackFunction* logCallbackFunc = NULL);
         /**
+        * Compacts the file system in place by moving blocks from the end of the file into free
+        * space closer to its start, meant to be called repeatedly (eg. from an idle timer).
+        * Blocks of open files are left untouched, an interrupted move is completed on next mount
+        * @param max_blocks maximum number of blocks to move during this call
+        * @param progress receives the state of compaction after this call
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    compactFileSystem(unsigned int max_blocks, CompactionProgress& progress);
+        /**
+        * Starts a batch of operations which is committed atomically, writes done until the matching
+        * commitTransaction are rolled back on next mount if the application stops before committing.
+        * Calls can be nested, only the outermost commit makes the batch durable
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    beginTransaction();
+        /**
+        * Commits a batch of operations started with beginTransaction, the whole batch is rolled back
+        * instead if any of its nested calls was ended with abortTransaction
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    commitTransaction();
+        /**
+        * Ends a batch of operations started with beginTransaction and undoes all writes of the outermost batch,
+        * a nested batch is undone when the outermost one ends. The file system is reloaded from the restored file,
+        * this fails with OFS_ACCESS_DENIED and commits the batch instead if files are open
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    abortTransaction();
+        /**
         * Copies the current file system and switches to it
         * @param dest path of the destination file
         * @return Result of operation, OFS_OK if successful
@@ -241,6 +272,15 @@ namespace OFS
         */
         OfsResult    truncateFile(OFSHANDLE& handle, ofs64 file_size = -1);
         /**
+        * Reserves room for the contents of a file, so writes up to given size need no further
+        * allocation and the file stays contiguous. The file size is not changed, reserved space
+        * that was not written is given back when the last handle of the file is closed
+        * @param handle File Handle of the file, opened for writing
+        * @param size Number of content bytes to make room for, counted from the start of the file
+        * @return Result of operation, OFS_OK if successful
+        */
+        OfsResult    reserve(OFSHANDLE& handle, ofs64 size);
+        /**
         * List files/folders in a given directory
         * @param path path of the directory
         * @param file_flags Filters the results by given flag
@@ -429,6 +469,30 @@ namespace OFS
         */
         OfsResult    read(OFSHANDLE& handle, char *dest, unsigned int length, unsigned int *actual_read = NULL);
         /**
+        * Reads a batch of whole files, one file after another
+        * @param requests List of files to read, results are stored per request
+        * @return OFS_OK if all requests succeeded, otherwise the first failing result
+        */
+        OfsResult    readFiles(ReadRequestList& requests);
+        /**
+        * Imports files from the host file system, one file after another
+        * @param requests List of files to import, results are stored per request
+        * @param num_threads Ignored, files are copied on the calling thread
+        * @param callback Function to call after each request, NULL for none
+        * @param userData User data passed to callback
+        * @return OFS_OK if all requests succeeded, otherwise the first failing result
+        */
+        OfsResult    importFiles(ImportRequestList& requests, unsigned int num_threads = 0, ImportCallBackFunction callback = NULL, void *userData = NULL);
+        /**
+        * Extracts files to the host file system, one file after another
+        * @param requests List of files and directories to extract, results are stored per request
+        * @param num_threads Ignored, files are copied on the calling thread
+        * @param callback Function to call after each request, NULL for none
+        * @param userData User data passed to callback
+        * @return OFS_OK if all requests succeeded, otherwise the first failing result
+        */
+        OfsResult    extractFiles(ExtractRequestList& requests, unsigned int num_threads = 0, ExtractCallBackFunction callback = NULL, void *userData = NULL);
+        /**
         * Writes data to a given file (handle)
         * @param handle handle of the file
         * @param src Buffer to write data from
@@ -458,8 +522,18 @@ namespace OFS
         bool         eof(OFSHANDLE& handle);
 
     private:
+        typedef std::map<int, OfsEntryDesc*> WatchDescMap;
+        typedef std::map<OfsEntryDesc*, int> DescWatchMap;
+        typedef std::map<int, int> IdCountMap;
+
         int mNextAvailableId;
 
+        int            mWatcher;           // Change notifications of the host directory, -1 if changes are not followed
+        WatchDescMap   mWatchedDirs;       // Watched directories by watch
+        DescWatchMap   mDirWatches;        // Watches by directory
+        IdCountMap     mOwnCloses;         // Number of closes made through handles not yet reported by the host, by entry id
+        boost::thread *mTrackingThread;    // Applies changes made to the host directory by other programs
+
         /* Private Constructor */
         _OfsRfs();
         /* Private Destructor */
@@ -485,9 +559,9 @@ namespace OFS
         /* Retrieves directory descriptor of a given path, null if not found */
         OfsEntryDesc* _getDirectoryDesc(const char *filename);
         /* Retrieves file descriptor of a given file in a given directory, null if not found */
-        OfsEntryDesc* _getFileDesc(OfsEntryDesc *dir_desc, std::string filename);
+        OfsEntryDesc* _getFileDesc(OfsEntryDesc *dir_desc, const std::string& filename);
         /* Retrieves file descriptor of a given child in a given directory, null if not found */
-        OfsEntryDesc* _findChild(OfsEntryDesc *dir_desc, std::string child_name);
+        OfsEntryDesc* _findChild(OfsEntryDesc *dir_desc, const std::string& child_name);
         /* Retrieves filename from a given path */
         std::string   _extractFileName(const char *filename);
         /* Internal createDirectory implementation */
@@ -502,6 +576,31 @@ namespace OFS
         inline void   _setFileFlags(OfsEntryDesc *file, unsigned int flags);
         /* Internal  function to find an entry by id */
         OfsEntryDesc* _findDescById(OfsEntryDesc* base, int id);
+
+        /* Starts following changes made to the host directory by other programs */
+        void          _startTracking();
+        /* Stops following changes, must be called without holding the file system lock */
+        void          _stopTracking();
+        /* Tracking thread, waits for change notifications and applies them */
+        void          _trackChanges();
+        /* Applies a batch of change notifications to the tree */
+        void          _applyChanges(std::vector<OfsWatchEvent>& events);
+        /* Watches a directory and its subdirectories for changes */
+        void          _watchDirectory(OfsEntryDesc *dir);
+        /* Stops watching a single directory */
+        void          _unwatchDirectory(OfsEntryDesc *dir);
+        /* Brings the children of a directory in line with the host directory */
+        void          _syncDirectory(OfsEntryDesc *dir, bool recursive);
+        /* Brings a child of a directory in line with the host, content reports that the file was written */
+        void          _syncEntry(OfsEntryDesc *dir, const std::string& name, bool content);
+        /* Creates the descriptor of an entry which appeared in the host directory */
+        OfsEntryDesc* _addTrackedEntry(OfsEntryDesc *parent, const std::string& name, bool directory);
+        /* Removes the descriptor of an entry which disappeared from the host directory, false if it is in use */
+        bool          _dropTrackedEntry(OfsEntryDesc *desc, const std::string& path);
+        /* Releases watches, notifications and ids held by an entry and its children */
+        void          _untrackEntry(OfsEntryDesc *desc);
+        /* Checks if an entry or any of its children is open */
+        bool          _isEntryInUse(OfsEntryDesc *desc);
     };
 
 //------------------------------------------------------------------------------
@@ -34,6 +34,13 @@
 #include "file_ops.h"
 #include <boost/filesystem.hpp>
 
+#if defined( __linux__ )
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
 bool OfsDirectoryExists(const char *path)
 {
     return boost::filesystem::is_directory(path);
@@ -64,6 +71,59 @@ bool OfsRenameFile(const char *path, const char *new_path)
     return true;
 }
 
+bool OfsCreateDirectories(const char *path)
+{
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(path, ec);
+
+    return boost::filesystem::is_directory(path, ec);
+}
+
+bool OfsGetFileInfo(const char *path, OFS::ofs64& size, time_t& mod_time)
+{
+    boost::system::error_code ec;
+
+    if(!boost::filesystem::is_regular_file(path, ec))
+        return false;
+
+    size = boost::filesystem::file_size(path, ec);
+    if(ec)
+        return false;
+
+    mod_time = boost::filesystem::last_write_time(path, ec);
+
+    return !ec;
+}
+
+bool OfsSetModificationTime(const char *path, time_t mod_time)
+{
+    boost::system::error_code ec;
+    boost::filesystem::last_write_time(path, mod_time, ec);
+
+    return !ec;
+}
+
+bool OfsPathExists(const char *path)
+{
+    boost::system::error_code ec;
+
+    return boost::filesystem::exists(path, ec);
+}
+
+void OfsListDirectory(const char *path, std::vector<std::string>& names)
+{
+    boost::system::error_code ec;
+
+    boost::filesystem::directory_iterator it(path, ec);
+    boost::filesystem::directory_iterator end;
+
+    while( !ec && it != end )
+    {
+        names.push_back(it->path().filename().string());
+        it.increment(ec);
+    }
+}
+
 
 void OfsListContentsRecursive(OFS::_OfsBase *owner, OFS::_OfsBase::OfsEntryDesc *desc, int &id, const char *name, bool linkmode)
 {
@@ -84,7 +144,7 @@ void OfsListContentsRecursive(OFS::_OfsBase *owner, OFS::_OfsBase::OfsEntryDesc
           newdesc->UseCount = 0;
           newdesc->WriteLocked = false;
           newdesc->Uuid = OFS::UUID_ZERO;
-          desc->Children.push_back(newdesc);
+          OFS::_OfsBase::_addChild(desc, newdesc);
 
           if(linkmode)
               newdesc->Flags |= OFS::OFS_LINK;
@@ -104,7 +164,7 @@ void OfsListContentsRecursive(OFS::_OfsBase *owner, OFS::_OfsBase::OfsEntryDesc
           newdesc->UseCount = 0;
           newdesc->WriteLocked = false;
           newdesc->Uuid = OFS::UUID_ZERO;
-          desc->Children.push_back(newdesc);
+          OFS::_OfsBase::_addChild(desc, newdesc);
 
           if(linkmode)
               newdesc->Flags |= OFS::OFS_LINK;
@@ -134,3 +194,90 @@ void OfsListContents(OFS::_OfsBase *owner, OFS::_OfsBase::OfsEntryDesc *desc, in
           }
       }
 }
+
+int OfsWatchOpen()
+{
+#if defined( __linux__ )
+    return inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+    return -1;
+#endif
+}
+
+int OfsWatchAdd(int watcher, const char *path)
+{
+#if defined( __linux__ )
+    return inotify_add_watch(watcher, path, IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK);
+#else
+    return -1;
+#endif
+}
+
+void OfsWatchRemove(int watcher, int watch)
+{
+#if defined( __linux__ )
+    inotify_rm_watch(watcher, watch);
+#endif
+}
+
+bool OfsWatchRead(int watcher, std::vector<OfsWatchEvent>& events, int timeout)
+{
+#if defined( __linux__ )
+    pollfd pfd;
+    pfd.fd = watcher;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int ret = poll(&pfd, 1, timeout);
+
+    if( ret <= 0 )
+        return ret == 0 || errno == EINTR;
+
+    long buffer[8192];
+
+    while( true )
+    {
+        ssize_t length = read(watcher, buffer, sizeof(buffer));
+
+        if( length <= 0 )
+            return length < 0 && (errno == EAGAIN || errno == EINTR);
+
+        const char *pos = (const char*)buffer;
+        const char *end = pos + length;
+
+        while( pos < end )
+        {
+            const inotify_event *notify = (const inotify_event*)pos;
+
+            OfsWatchEvent event;
+            event.Watch = notify->wd;
+            event.Cookie = notify->cookie;
+            event.Type = 0;
+
+            if( notify->mask & IN_CREATE )      event.Type |= OFS_WATCH_CREATE;
+            if( notify->mask & IN_DELETE )      event.Type |= OFS_WATCH_DELETE;
+            if( notify->mask & IN_CLOSE_WRITE ) event.Type |= OFS_WATCH_CONTENT;
+            if( notify->mask & IN_MOVED_FROM )  event.Type |= OFS_WATCH_MOVED_FROM;
+            if( notify->mask & IN_MOVED_TO )    event.Type |= OFS_WATCH_MOVED_TO;
+            if( notify->mask & IN_IGNORED )     event.Type |= OFS_WATCH_IGNORED;
+            if( notify->mask & IN_Q_OVERFLOW )  event.Type |= OFS_WATCH_OVERFLOW;
+
+            if( notify->len > 0 )
+                event.Name = notify->name;
+
+            events.push_back(event);
+
+            pos += sizeof(inotify_event) + notify->len;
+        }
+    }
+#else
+    return false;
+#endif
+}
+
+void OfsWatchClose(int watcher)
+{
+#if defined( __linux__ )
+    close(watcher);
+#endif
+}
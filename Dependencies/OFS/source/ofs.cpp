@@ -35,6 +35,16 @@
 #include "ofs_rfs.h"
 #include <algorithm>
 #include <stdio.h>
+#include <zlib.h>
+
+#if (defined( __WIN32__ ) || defined( _WIN32 ))
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -44,75 +54,790 @@ namespace OFS
 
     _OfsBase::NameOfsHandleMap _OfsBase::mAllocatedHandles;
 
+    boost::detail::atomic_count _OfsBase::mTreeGeneration(0);
+
     const UUID UUID_ZERO(0,0,0,0,0,0,0,0,0,0,0);
 
-    const unsigned int MAX_BUFFER_SIZE = (16 * 1024 * 1024);
+    const unsigned int MAX_BUFFER_SIZE = (16 * 1024 * 1024);
+
+    const unsigned char UNDO_JOURNAL_ID[4] = {'O', 'F', 'S', 'J'};
+
+    const unsigned int UNDO_PAGE_SIZE = 4096;
+
+    /* Amount of saved pages the undo journal may hold before it is synced ahead of the batch commit */
+    const ofs64 UNDO_SYNC_SIZE = (4 * 1024 * 1024);
+
+    const unsigned int CACHE_PAGE_SIZE = 65536;
+
+    const ofs64 FILL_EXTEND_SIZE = 65536;
+
+    /* Beyond this many remembered lookups the path cache starts over */
+    const unsigned int PATH_CACHE_SIZE = 8192;
+
+#pragma pack(push)
+#pragma pack(4)
+
+    /* Undo Journal Header */
+    struct strUndoHeader
+    {
+        unsigned char ID[4];       /* The journal identifier */
+        unsigned int  PageSize;    /* Size of pages saved in the journal */
+        ofs64         BaseSize;    /* Size of the file when the batch of writes was started */
+    };
+
+    /* Header of a saved page, followed by the original contents of the page */
+    struct strUndoRecord
+    {
+        ofs64         Pos;         /* Position of the page in file */
+        unsigned int  Length;      /* Length of the saved contents */
+        unsigned int  Checksum;    /* CRC32 of position, length and contents */
+    };
+
+#pragma pack(pop)
+
+//------------------------------------------------------------------------------
+
+    static void syncFile( FILE *file )
+    {
+        fflush( file );
+
+#if (defined( __WIN32__ ) || defined( _WIN32 ))
+        _commit( _fileno( file ) );
+#else
+        fsync( fileno( file ) );
+#endif
+    }
+
+//------------------------------------------------------------------------------
+
+    static unsigned int undoChecksum( const strUndoRecord& record, const char *data )
+    {
+        uLong crc = crc32( 0L, (const Bytef *)&record.Pos, sizeof( ofs64 ) );
+        crc = crc32( crc, (const Bytef *)&record.Length, sizeof( unsigned int ) );
+        crc = crc32( crc, (const Bytef *)data, record.Length );
+
+        return (unsigned int)crc;
+    }
+
+//------------------------------------------------------------------------------
+
+    size_t FileStream::write( const void *data, size_t size )
+    {
+        assert( m_pFile != NULL );
+
+        if( !m_Barrier.empty() )
+            _fireBarrier();
+
+        if( m_pUndo != NULL )
+            _saveUndo( ftello( m_pFile ), size );
+
+        if( m_pCache != NULL )
+            m_pCache->invalidate( ftello( m_pFile ), size );
+
+        size_t actual_len =  fwrite( data, 1, size, m_pFile );
+        
+        assert(actual_len == size);
+
+        m_Dirty = true;
+        m_MapStale = true;
+        
+        return actual_len;
+    }
+
+
+    void FileStream::close()
+    {
+        _unmap();
+
+        commitUndoJournal();
+        m_Barrier.clear();
+
+        if( m_pFile != NULL )
+        {
+            fflush( m_pFile );
+            fclose( m_pFile );
+            m_pFile = NULL;
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::open( const char *file, const char *mode, int flag )
+    {
+        close();
+
+#if (defined( __WIN32__ ) || defined( _WIN32 )) && ! defined( __GNUC__ )
+		if( flag == 0)
+            flag = _SH_DENYNO;
+
+        m_pFile = _fsopen( file, mode, flag );
+#else
+        m_pFile = fopen( file, mode );
+#endif
+		
+	}
+
+//------------------------------------------------------------------------------
+	char fl_4k[ 4096 ];
+	char fl_32[ 32 ];
+	char fl_b = 0;
+
+
+    void FileStream::fill( ofs64 len )
+    {
+		ofs64 i;
+
+        assert( m_pFile != NULL );
+
+        if( !m_Barrier.empty() )
+        {
+            _fireBarrier();
+        }
+
+        if( m_pUndo != NULL )
+        {
+            _saveUndo( ftello( m_pFile ), len );
+        }
+
+        if( m_pCache != NULL )
+        {
+            m_pCache->invalidate( ftello( m_pFile ), len );
+        }
+
+        // Growing the file reads back as zeros too, without writing them
+        if( len >= FILL_EXTEND_SIZE && _extend( len ) )
+            return;
+
+		ofs64 fl4k = len >> 12;
+		ofs64 fl32 = ( len & 0xFFF ) >> 5; 
+		len = len & 0x1F;
+         
+	    for( i = 0; i < fl4k; i++ )
+		    fwrite( &fl_4k, 4096, 1, m_pFile );    
+
+	    for( i = 0; i < fl32; i++ )
+		    fwrite( &fl_32, 32, 1, m_pFile );    
+
+		for( i = 0; i < len; i++ )
+		    fwrite( &fl_b, 1, 1, m_pFile );    
+
+        m_Dirty = true;
+        m_MapStale = true;
+    }
+
+//------------------------------------------------------------------------------
+
+    bool FileStream::_extend( ofs64 len )
+    {
+        fflush( m_pFile );
+        m_Dirty = false;
+
+        ofs64 pos = ftello( m_pFile );
+
+        fseeko( m_pFile, 0, SEEK_END );
+
+        if( ftello( m_pFile ) != pos )
+        {
+            fseeko( m_pFile, pos, SEEK_SET );
+            return false;
+        }
+
+        // A mapped file can not be resized on Windows, it is mapped again when next needed
+        _unmap();
+        m_MapStale = true;
+
+#if (defined( __WIN32__ ) || defined( _WIN32 ))
+        bool ret = ( _chsize_s( _fileno( m_pFile ), pos + len ) == 0 );
+#else
+        bool ret = ( ftruncate( fileno( m_pFile ), pos + len ) == 0 );
+#endif
+
+        fseeko( m_pFile, ret ? ( pos + len ) : pos, SEEK_SET );
+
+        return ret;
+    }
+
+//------------------------------------------------------------------------------
+
+    size_t FileStream::readAt( ofs64 pos, void *data, size_t size )
+    {
+        assert( m_pFile != NULL );
+
+        // Positional reads bypass stdio, so pending buffered writes must reach the file first
+        if( m_Dirty )
+        {
+            fflush( m_pFile );
+            m_Dirty = false;
+        }
+
+#if (defined( __WIN32__ ) || defined( _WIN32 ))
+        HANDLE hFile = (HANDLE)_get_osfhandle( _fileno( m_pFile ) );
+        if( hFile == INVALID_HANDLE_VALUE )
+            return 0;
+
+        OVERLAPPED ov;
+        memset( &ov, 0, sizeof( OVERLAPPED ) );
+        ov.Offset = (DWORD)( (ULONGLONG)pos & 0xFFFFFFFF );
+        ov.OffsetHigh = (DWORD)( (ULONGLONG)pos >> 32 );
+
+        DWORD actual_len = 0;
+        if( !ReadFile( hFile, data, (DWORD)size, &actual_len, &ov ) )
+            return 0;
+
+        return actual_len;
+#else
+        size_t actual_len = 0;
+        int fd = fileno( m_pFile );
+
+        while( actual_len < size )
+        {
+            ssize_t ret = pread( fd, (char *)data + actual_len, size - actual_len, pos + actual_len );
+            if( ret <= 0 )
+                break;
+
+            actual_len += ret;
+        }
+
+        return actual_len;
+#endif
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::sync()
+    {
+        if( m_pFile == NULL )
+            return;
+
+        if( m_MapEnabled && m_MapStale )
+            _map();
+        else if( m_Dirty )
+        {
+            fflush( m_pFile );
+            m_Dirty = false;
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::commit()
+    {
+        assert( m_pFile != NULL );
+
+        // Original contents must be on disk before the new contents are
+        if( m_pUndo != NULL && m_UndoUnsynced > 0 )
+        {
+            syncFile( m_pUndo );
+            m_UndoUnsynced = 0;
+        }
+
+        syncFile( m_pFile );
+        m_Dirty = false;
+    }
+
+//------------------------------------------------------------------------------
+
+    bool FileStream::truncate( ofs64 size )
+    {
+        assert( m_pFile != NULL );
+
+        if( !m_Barrier.empty() )
+            _fireBarrier();
+
+        if( m_pUndo != NULL )
+            _saveUndo( size, m_UndoBase - size );
+
+        if( m_pCache != NULL )
+            m_pCache->invalidate( size, -1 );
+
+        // A mapped file can not be shrunk on Windows and pages past the end are invalid elsewhere
+        _unmap();
+
+        fflush( m_pFile );
+        m_Dirty = false;
+        m_MapStale = true;
+
+#if (defined( __WIN32__ ) || defined( _WIN32 ))
+        return ( _chsize_s( _fileno( m_pFile ), size ) == 0 );
+#else
+        return ( ftruncate( fileno( m_pFile ), size ) == 0 );
+#endif
+    }
+
+//------------------------------------------------------------------------------
+
+    bool FileStream::beginUndoJournal( const char *journal_file )
+    {
+        assert( m_pFile != NULL && m_pUndo == NULL );
+
+        // Original contents are read with positional reads, which do not see writes held in stdio buffers
+        fflush( m_pFile );
+        m_Dirty = false;
+
+        m_pUndo = fopen( journal_file, "wb" );
+        if( m_pUndo == NULL )
+            return false;
+
+        ofs64 pos = ftello( m_pFile );
+        fseeko( m_pFile, 0, SEEK_END );
+        m_UndoBase = ftello( m_pFile );
+        fseeko( m_pFile, pos, SEEK_SET );
+
+        strUndoHeader header;
+        memcpy( header.ID, UNDO_JOURNAL_ID, 4 );
+        header.PageSize = UNDO_PAGE_SIZE;
+        header.BaseSize = m_UndoBase;
+
+        fwrite( &header, sizeof( strUndoHeader ), 1, m_pUndo );
+        syncFile( m_pUndo );
+
+        m_UndoName = journal_file;
+        m_UndoPages.clear();
+        m_UndoUnsynced = 0;
+
+        return true;
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::commitUndoJournal()
+    {
+        if( m_pUndo == NULL )
+            return;
+
+        commit();
+
+        fclose( m_pUndo );
+        m_pUndo = NULL;
+
+        remove( m_UndoName.c_str() );
+        m_UndoPages.clear();
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::abortUndoJournal()
+    {
+        if( m_pUndo == NULL )
+            return;
+
+        // A pending barrier would be written over the restored contents
+        m_Barrier.clear();
+
+        fflush( m_pFile );
+        m_Dirty = false;
+
+        fclose( m_pUndo );
+        m_pUndo = NULL;
+        m_UndoPages.clear();
+
+        rollbackUndoJournal( m_UndoName.c_str() );
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::rollbackUndoJournal( const char *journal_file )
+    {
+        assert( m_pFile != NULL && m_pUndo == NULL );
+
+        FILE *undo = fopen( journal_file, "rb" );
+        if( undo == NULL )
+            return;
+
+        strUndoHeader header;
+
+        if( fread( &header, sizeof( strUndoHeader ), 1, undo ) == 1 && memcmp( header.ID, UNDO_JOURNAL_ID, 4 ) == 0 && header.PageSize == UNDO_PAGE_SIZE )
+        {
+            // Pages are restored with plain writes, nothing cached can be trusted afterwards
+            if( m_pCache != NULL )
+                m_pCache->invalidate( 0, -1 );
+
+            char page[ UNDO_PAGE_SIZE ];
+            strUndoRecord record;
+
+            // A page is only overwritten after its record reached the journal, so a torn record at the end saved nothing that changed
+            while( fread( &record, sizeof( strUndoRecord ), 1, undo ) == 1 && record.Length <= UNDO_PAGE_SIZE )
+            {
+                if( fread( page, 1, record.Length, undo ) != record.Length || undoChecksum( record, page ) != record.Checksum )
+                    break;
+
+                fseeko( m_pFile, record.Pos, SEEK_SET );
+                fwrite( page, 1, record.Length, m_pFile );
+            }
+
+            truncate( header.BaseSize );
+            commit();
+        }
+
+        fclose( undo );
+        remove( journal_file );
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::_saveUndo( ofs64 pos, ofs64 size )
+    {
+        ofs64 end = std::min( pos + size, m_UndoBase );
+        if( pos >= end )
+            return;
+
+        char page[ UNDO_PAGE_SIZE ];
+        bool saved = false;
+
+        for( ofs64 p = pos / UNDO_PAGE_SIZE; p <= ( end - 1 ) / UNDO_PAGE_SIZE; p++ )
+        {
+            if( !m_UndoPages.insert( p ).second )
+                continue;
+
+            strUndoRecord record;
+            record.Pos = p * UNDO_PAGE_SIZE;
+            record.Length = (unsigned int)std::min<ofs64>( UNDO_PAGE_SIZE, m_UndoBase - record.Pos );
+            record.Length = (unsigned int)readAt( record.Pos, page, record.Length );
+            record.Checksum = undoChecksum( record, page );
+
+            fwrite( &record, sizeof( strUndoRecord ), 1, m_pUndo );
+            fwrite( page, 1, record.Length, m_pUndo );
+            m_UndoUnsynced += sizeof( strUndoRecord ) + record.Length;
+            saved = true;
+        }
+
+        if( !saved )
+            return;
+
+        // Records only have to survive a crash of the process before the new contents reach the file,
+        // the journal is synced once per batch in commit() and in between only when it grew large
+        if( m_UndoUnsynced >= UNDO_SYNC_SIZE )
+        {
+            syncFile( m_pUndo );
+            m_UndoUnsynced = 0;
+        }
+        else
+            fflush( m_pUndo );
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::setWriteBarrier( ofs64 pos, const void *data, size_t size )
+    {
+        m_BarrierPos = pos;
+        m_Barrier.assign( (const char *)data, size );
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::_fireBarrier()
+    {
+        std::string patch;
+        patch.swap( m_Barrier );
+
+        ofs64 pos = ftello( m_pFile );
+
+        fseeko( m_pFile, m_BarrierPos, SEEK_SET );
+        write( patch.data(), patch.size() );
+        commit();
+
+        fseeko( m_pFile, pos, SEEK_SET );
+    }
+
+//------------------------------------------------------------------------------
+
+    bool FileStream::setMapped( bool enable )
+    {
+        m_MapEnabled = enable;
+
+        if( enable )
+            _map();
+        else
+            _unmap();
+
+        return ( m_pMap != NULL );
+    }
+
+//------------------------------------------------------------------------------
+
+    const char *FileStream::view( ofs64 pos, ofs64 size )
+    {
+        if( !m_MapEnabled || m_pFile == NULL )
+            return NULL;
+
+        // Written data is only visible to the mapping once stdio buffers are flushed,
+        // so map again lazily after any write or if the file grew past the mapping
+        if( m_MapStale || m_pMap == NULL || ( pos + size ) > m_MapSize )
+            _map();
+
+        if( m_pMap == NULL || pos < 0 || ( pos + size ) > m_MapSize )
+            return NULL;
+
+        return m_pMap + pos;
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::_map()
+    {
+        _unmap();
+
+        if( m_pFile == NULL )
+            return;
+
+        fflush( m_pFile );
+        m_Dirty = false;
+        m_MapStale = false;
+
+#if (defined( __WIN32__ ) || defined( _WIN32 ))
+        HANDLE hFile = (HANDLE)_get_osfhandle( _fileno( m_pFile ) );
+        LARGE_INTEGER file_size;
+
+        if( hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx( hFile, &file_size ) || file_size.QuadPart == 0 )
+            return;
+
+        HANDLE hMapping = CreateFileMapping( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+        if( hMapping == NULL )
+            return;
+
+        void *addr = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+        if( addr == NULL )
+        {
+            CloseHandle( hMapping );
+            return;
+        }
+
+        m_hMapping = hMapping;
+        m_pMap = (char *)addr;
+        m_MapSize = file_size.QuadPart;
+#else
+        struct stat st;
+
+        if( fstat( fileno( m_pFile ), &st ) != 0 || st.st_size == 0 )
+            return;
+
+        void *addr = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fileno( m_pFile ), 0 );
+        if( addr == MAP_FAILED )
+            return;
+
+        m_pMap = (char *)addr;
+        m_MapSize = st.st_size;
+#endif
+    }
+
+//------------------------------------------------------------------------------
+
+    void FileStream::_unmap()
+    {
+        if( m_pMap == NULL )
+            return;
+
+#if (defined( __WIN32__ ) || defined( _WIN32 ))
+        UnmapViewOfFile( m_pMap );
+        CloseHandle( (HANDLE)m_hMapping );
+        m_hMapping = NULL;
+#else
+        munmap( m_pMap, m_MapSize );
+#endif
+
+        m_pMap = NULL;
+        m_MapSize = 0;
+    }
+
+//------------------------------------------------------------------------------
+
+    void BlockCache::setCapacity( ofs64 capacity )
+    {
+        boost::mutex::scoped_lock lock( m_Mutex );
+
+        m_Capacity = capacity;
+
+        while( !m_Lru.empty() && (ofs64)m_Lru.size() * CACHE_PAGE_SIZE > m_Capacity )
+        {
+            m_Pages.erase( m_Lru.back() );
+            m_Lru.pop_back();
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    ofs64 BlockCache::getCapacity()
+    {
+        boost::mutex::scoped_lock lock( m_Mutex );
+
+        return m_Capacity;
+    }
+
+//------------------------------------------------------------------------------
+
+    size_t BlockCache::read( FileStream& stream, ofs64 pos, void *data, size_t size )
+    {
+        // Reads larger than a quarter of the cache would only push out everything else
+        if( (ofs64)size * 4 > getCapacity() )
+            return stream.readAt( pos, data, size );
+
+        char *dest = (char *)data;
+        size_t done = 0;
+        std::vector<char> page;
+
+        while( done < size )
+        {
+            ofs64 page_pos = ( ( pos + done ) / CACHE_PAGE_SIZE ) * CACHE_PAGE_SIZE;
+            size_t offset = (size_t)( pos + done - page_pos );
+            size_t amount = std::min( (size_t)CACHE_PAGE_SIZE - offset, size - done );
+            size_t available = 0;
+            bool found = false;
+
+            {
+                boost::mutex::scoped_lock lock( m_Mutex );
+
+                PageMap::iterator it = m_Pages.find( page_pos );
+
+                if( it != m_Pages.end() )
+                {
+                    found = true;
+                    ++m_Hits;
+                    m_Lru.splice( m_Lru.begin(), m_Lru, it->second.Lru );
+
+                    if( it->second.Data.size() > offset )
+                    {
+                        available = std::min( amount, it->second.Data.size() - offset );
+                        memcpy( dest + done, &it->second.Data[offset], available );
+                    }
+                }
+                else
+                    ++m_Misses;
+            }
+
+            // The page is loaded without holding the lock so that other readers are not held up
+            if( !found )
+            {
+                page.resize( CACHE_PAGE_SIZE );
+                page.resize( stream.readAt( page_pos, &page[0], CACHE_PAGE_SIZE ) );
+
+                if( page.size() > offset )
+                {
+                    available = std::min( amount, page.size() - offset );
+                    memcpy( dest + done, &page[offset], available );
+                }
+
+                boost::mutex::scoped_lock lock( m_Mutex );
+
+                _insert( page_pos, page.empty() ? NULL : &page[0], page.size() );
+            }
+
+            done += available;
+
+            // Short page, end of file reached
+            if( available < amount )
+                break;
+        }
+
+        return done;
+    }
+
+//------------------------------------------------------------------------------
+
+    void BlockCache::prefetch( FileStream& stream, ofs64 pos, ofs64 size )
+    {
+        if( size <= 0 )
+            return;
+
+        std::vector<ofs64> missing;
+
+        {
+            boost::mutex::scoped_lock lock( m_Mutex );
+
+            if( size * 4 > m_Capacity )
+                return;
+
+            for( ofs64 page_pos = ( pos / CACHE_PAGE_SIZE ) * CACHE_PAGE_SIZE; page_pos < pos + size; page_pos += CACHE_PAGE_SIZE )
+            {
+                if( m_Pages.find( page_pos ) == m_Pages.end() )
+                    missing.push_back( page_pos );
+            }
+        }
+
+        std::vector<char> buffer;
+        unsigned int first = 0;
+
+        while( first < missing.size() )
+        {
+            unsigned int last = first + 1;
+            while( last < missing.size() && missing[last] == missing[last - 1] + CACHE_PAGE_SIZE )
+                ++last;
+
+            buffer.resize( ( last - first ) * CACHE_PAGE_SIZE );
+            size_t length = stream.readAt( missing[first], &buffer[0], buffer.size() );
+
+            boost::mutex::scoped_lock lock( m_Mutex );
+
+            for( unsigned int i = first;i < last;i++ )
+            {
+                size_t offset = ( i - first ) * CACHE_PAGE_SIZE;
+                if( offset >= length )
+                    break;
+
+                _insert( missing[i], &buffer[offset], std::min( (size_t)CACHE_PAGE_SIZE, length - offset ) );
+            }
+
+            first = last;
+        }
+    }
 
 //------------------------------------------------------------------------------
 
-    size_t FileStream::write( const void *data, size_t size )
+    void BlockCache::invalidate( ofs64 pos, ofs64 size )
     {
-        assert( m_pFile != NULL );
+        boost::mutex::scoped_lock lock( m_Mutex );
 
-        size_t actual_len =  fwrite( data, 1, size, m_pFile );
-        
-        assert(actual_len == size);
-        
-        return actual_len;
-    }
+        if( m_Pages.empty() )
+            return;
 
+        PageMap::iterator it = m_Pages.lower_bound( ( pos / CACHE_PAGE_SIZE ) * CACHE_PAGE_SIZE );
 
-    void FileStream::close()
-    {
-        if( m_pFile != NULL )
+        while( it != m_Pages.end() && ( size < 0 || it->first < pos + size ) )
         {
-            fflush( m_pFile );
-            fclose( m_pFile );
-            m_pFile = NULL;
+            m_Lru.erase( it->second.Lru );
+            m_Pages.erase( it++ );
         }
     }
 
 //------------------------------------------------------------------------------
 
-    void FileStream::open( const char *file, const char *mode, int flag )
+    void BlockCache::clear()
     {
-        close();
-
-#if (defined( __WIN32__ ) || defined( _WIN32 )) && ! defined( __GNUC__ )
-		if( flag == 0)
-            flag = _SH_DENYNO;
+        boost::mutex::scoped_lock lock( m_Mutex );
 
-        m_pFile = _fsopen( file, mode, flag );
-#else
-        m_pFile = fopen( file, mode );
-#endif
-		
-	}
+        m_Pages.clear();
+        m_Lru.clear();
+        m_Hits = 0;
+        m_Misses = 0;
+    }
 
 //------------------------------------------------------------------------------
-	char fl_4k[ 4096 ];
-	char fl_32[ 32 ];
-	char fl_b = 0;
-
 
-    void FileStream::fill( ofs64 len )
+    void BlockCache::getCounters( ofs64& hits, ofs64& misses )
     {
-		ofs64 i;
+        boost::mutex::scoped_lock lock( m_Mutex );
 
-		ofs64 fl4k = len >> 12;
-		ofs64 fl32 = ( len & 0xFFF ) >> 5; 
-		len = len & 0x1F;
+        hits = m_Hits;
+        misses = m_Misses;
+    }
 
-        assert( m_pFile != NULL );
-         
-	    for( i = 0; i < fl4k; i++ )
-		    fwrite( &fl_4k, 4096, 1, m_pFile );    
+//------------------------------------------------------------------------------
 
-	    for( i = 0; i < fl32; i++ )
-		    fwrite( &fl_32, 32, 1, m_pFile );    
+    void BlockCache::_insert( ofs64 pos, const char *data, size_t size )
+    {
+        if( m_Capacity < CACHE_PAGE_SIZE || m_Pages.find( pos ) != m_Pages.end() )
+            return;
 
-		for( i = 0; i < len; i++ )
-		    fwrite( &fl_b, 1, 1, m_pFile );    
+        while( (ofs64)( m_Lru.size() + 1 ) * CACHE_PAGE_SIZE > m_Capacity )
+        {
+            m_Pages.erase( m_Lru.back() );
+            m_Lru.pop_back();
+        }
+
+        m_Lru.push_front( pos );
+
+        Page& page = m_Pages[pos];
+        page.Data.assign( data, data + size );
+        page.Lru = m_Lru.begin();
     }
 
 
@@ -122,13 +847,16 @@ namespace OFS
     {
         assert(mEntryDesc != NULL);
 
+        _OfsBase::OfsEntryDesc *desc = _dataDesc();
+
         mPos = 0;
         mBlock = 0;
-        mBlockEnd = mEntryDesc->UsedBlocks[0].Start + mEntryDesc->UsedBlocks[0].Length;
-        mRealPos = mEntryDesc->UsedBlocks[0].Start + sizeof(_Ofs::strMainEntryHeader);
+        mBlockEnd = desc->UsedBlocks[0].Start + desc->UsedBlocks[0].Length;
+        mRealPos = desc->UsedBlocks[0].Start + sizeof(_Ofs::strMainEntryHeader);
+        mReadAhead = 0;
 
         if(append)
-            _setPos(mEntryDesc->FileSize);
+            _setPos(desc->FileSize);
     }
 
 //------------------------------------------------------------------------------
@@ -137,12 +865,14 @@ namespace OFS
     {
         if(mPos != value)
         {
+            _OfsBase::OfsEntryDesc *desc = _dataDesc();
+
             mPos = value;
-            mBlockEnd = mEntryDesc->UsedBlocks[0].Start + mEntryDesc->UsedBlocks[0].Length;
+            mBlockEnd = desc->UsedBlocks[0].Start + desc->UsedBlocks[0].Length;
 
-            ofs64 block_size = mEntryDesc->UsedBlocks[0].Length - sizeof(_Ofs::strMainEntryHeader);
+            ofs64 block_size = desc->UsedBlocks[0].Length - sizeof(_Ofs::strMainEntryHeader);
             int i = 0;
-            ofs64 max_i = mEntryDesc->UsedBlocks.size();
+            ofs64 max_i = desc->UsedBlocks.size();
             while(block_size <= value)
             {
                 value -= block_size;
@@ -150,8 +880,8 @@ namespace OFS
 
                 if(i != max_i)
                 {
-                    block_size = mEntryDesc->UsedBlocks[i].Length - sizeof(_Ofs::strExtendedEntryHeader);
-                    mBlockEnd = mEntryDesc->UsedBlocks[i].Start + mEntryDesc->UsedBlocks[i].Length;
+                    block_size = desc->UsedBlocks[i].Length - sizeof(_Ofs::strExtendedEntryHeader);
+                    mBlockEnd = desc->UsedBlocks[i].Start + desc->UsedBlocks[i].Length;
                 }
                 else
                 {
@@ -162,11 +892,11 @@ namespace OFS
 
             mBlock = i;
             if(i == 0)
-                mRealPos = mEntryDesc->UsedBlocks[i].Start + sizeof(_Ofs::strMainEntryHeader) + value;
+                mRealPos = desc->UsedBlocks[i].Start + sizeof(_Ofs::strMainEntryHeader) + value;
             else if(i == max_i)
-                mRealPos = mEntryDesc->UsedBlocks[i - 1].Start + mEntryDesc->UsedBlocks[i - 1].Length;
+                mRealPos = desc->UsedBlocks[i - 1].Start + desc->UsedBlocks[i - 1].Length;
             else
-                mRealPos = mEntryDesc->UsedBlocks[i].Start + sizeof(_Ofs::strExtendedEntryHeader) + value;
+                mRealPos = desc->UsedBlocks[i].Start + sizeof(_Ofs::strExtendedEntryHeader) + value;
         }
     }
 
@@ -178,7 +908,7 @@ namespace OFS
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-    _OfsBase::_OfsBase( FileSystemType type ) : mFileSystemType(type), mActive(false), mUseCount(0), mRecoveryMode(false), mLinkMode(false)
+    _OfsBase::_OfsBase( FileSystemType type ) : mFileSystemType(type), mActive(false), mUseCount(0), mRecoveryMode(false), mLinkMode(false), mTriggerDepth(0)
     {
         mFileName           = "";
         mRootDir.Owner     = this;
@@ -228,14 +958,15 @@ namespace OFS
             {
                 name = mFileName;
                 doDelete = true;
-
-                if(mActive)
-                    _unmount();
             }
         }
 
         if(doDelete)
         {
+            /* Not under the lock, unmounting may wait for a background thread which takes it */
+            if(mActive)
+                _unmount();
+
             STATIC_LOCK_AUTO_MUTEX
             
             delete this;
@@ -257,6 +988,218 @@ namespace OFS
         return mActive; 
     }
 
+//------------------------------------------------------------------------------
+
+    void _OfsBase::beginTriggerBatch()
+    {
+        boost::mutex::scoped_lock lock(mTriggerMutex);
+
+        ++mTriggerDepth;
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::endTriggerBatch()
+    {
+        {
+            boost::mutex::scoped_lock lock(mTriggerMutex);
+
+            assert(mTriggerDepth > 0);
+
+            if(--mTriggerDepth > 0)
+                return;
+        }
+
+        _dispatchTriggers(false);
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::flushTriggers()
+    {
+        _dispatchTriggers(true);
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::deliverDueTriggers()
+    {
+        _dispatchTriggers(false);
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_fireTriggers(const std::vector<CallBackData>& triggers, CallBackType type, OfsEntryDesc *desc, const char *arg)
+    {
+        boost::mutex::scoped_lock lock(mTriggerMutex);
+
+        for(unsigned int i = 0;i < triggers.size();i++)
+        {
+            if(triggers[i].type != type)
+                continue;
+
+            PendingTrigger pending;
+            pending.Trigger = triggers[i];
+            pending.Desc = desc;
+            pending.HasArg = (arg != NULL);
+
+            if(arg != NULL)
+                pending.Arg = arg;
+
+            mPendingTriggers.push_back(pending);
+
+            if(desc != NULL)
+                ++mPendingDescs[desc];
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_retargetPendingTriggers(OfsEntryDesc *desc, OfsEntryDesc *replacement)
+    {
+        boost::mutex::scoped_lock lock(mTriggerMutex);
+
+        DescCountMap::iterator it = mPendingDescs.find(desc);
+
+        if(it == mPendingDescs.end())
+            return;
+
+        unsigned int count = it->second;
+        unsigned int pos = 0;
+
+        mPendingDescs.erase(it);
+
+        for(unsigned int i = 0;i < mPendingTriggers.size();i++)
+        {
+            if(mPendingTriggers[i].Desc != desc)
+                mPendingTriggers[pos++] = mPendingTriggers[i];
+            else if(replacement != NULL)
+            {
+                mPendingTriggers[i].Desc = replacement;
+                mPendingTriggers[pos++] = mPendingTriggers[i];
+            }
+        }
+
+        mPendingTriggers.resize(pos);
+
+        if(replacement != NULL)
+            mPendingDescs[replacement] += count;
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_dropPendingTriggers(void *owner, CallBackType type)
+    {
+        boost::mutex::scoped_lock lock(mTriggerMutex);
+
+        unsigned int pos = 0;
+
+        for(unsigned int i = 0;i < mPendingTriggers.size();i++)
+        {
+            const PendingTrigger& pending = mPendingTriggers[i];
+
+            if(pending.Trigger.owner != owner || pending.Trigger.type != type)
+                mPendingTriggers[pos++] = pending;
+            else if(pending.Desc != NULL && --mPendingDescs[pending.Desc] == 0)
+                mPendingDescs.erase(pending.Desc);
+        }
+
+        mPendingTriggers.resize(pos);
+
+        TriggerTimeMap::iterator it = mTriggerDeliveries.begin();
+
+        while(it != mTriggerDeliveries.end())
+        {
+            if(it->first.owner == owner && it->first.type == type)
+                mTriggerDeliveries.erase(it++);
+            else
+                ++it;
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_discardPendingTriggers()
+    {
+        boost::mutex::scoped_lock lock(mTriggerMutex);
+
+        mPendingTriggers.clear();
+        mPendingDescs.clear();
+        mTriggerDeliveries.clear();
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_dispatchTriggers(bool force)
+    {
+        std::vector<PendingTrigger> deliver;
+
+        {
+            boost::mutex::scoped_lock lock(mTriggerMutex);
+
+            if(mTriggerDepth > 0 || mPendingTriggers.empty())
+                return;
+
+            std::vector<PendingTrigger> pending;
+            pending.swap(mPendingTriggers);
+            mPendingDescs.clear();
+
+            /* The same notification is delivered once, at the place it was first raised */
+            std::set<PendingTrigger> seen;
+            std::map<CallBackData, PendingTrigger> limited;
+
+            for(unsigned int i = 0;i < pending.size();i++)
+            {
+                if(!seen.insert(pending[i]).second)
+                    continue;
+
+                if(pending[i].Trigger.interval == 0)
+                {
+                    deliver.push_back(pending[i]);
+                    continue;
+                }
+
+                /* Triggers with an interval get a single notification, without arguments if it stands for several */
+                std::pair<std::map<CallBackData, PendingTrigger>::iterator, bool> ret = limited.insert(std::make_pair(pending[i].Trigger, pending[i]));
+
+                if(!ret.second)
+                {
+                    ret.first->second.Desc = NULL;
+                    ret.first->second.HasArg = false;
+                    ret.first->second.Arg.clear();
+                }
+            }
+
+            boost::system_time now = boost::get_system_time();
+
+            for(std::map<CallBackData, PendingTrigger>::iterator it = limited.begin();it != limited.end();++it)
+            {
+                TriggerTimeMap::iterator last = mTriggerDeliveries.find(it->first);
+
+                /* Too early, held until a later dispatch or deliverDueTriggers */
+                if(!force && last != mTriggerDeliveries.end() && now < last->second + boost::posix_time::milliseconds(it->first.interval))
+                    mPendingTriggers.push_back(it->second);
+                else
+                {
+                    mTriggerDeliveries[it->first] = now;
+                    deliver.push_back(it->second);
+                }
+            }
+
+            for(unsigned int i = 0;i < mPendingTriggers.size();i++)
+            {
+                if(mPendingTriggers[i].Desc != NULL)
+                    ++mPendingDescs[mPendingTriggers[i].Desc];
+            }
+        }
+
+        for(unsigned int i = 0;i < deliver.size();i++)
+        {
+            const PendingTrigger& pending = deliver[i];
+
+            pending.Trigger.func(pending.Trigger.data, pending.Desc, pending.HasArg ? pending.Arg.c_str() : 0);
+        }
+    }
 
 //------------------------------------------------------------------------------
 
@@ -275,6 +1218,155 @@ namespace OFS
         }
     }
 
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_addChild(OfsEntryDesc *parent, OfsEntryDesc *child)
+    {
+        assert(parent != NULL && child != NULL);
+
+        /* Entries of linked file systems also sit in their own parent, their position is kept for that one */
+        if(child->Parent == parent)
+            child->ChildPos = parent->Children.size();
+
+        parent->Children.push_back(child);
+        parent->ChildIndex.insert(NameDescMap::value_type(child->Name, child));
+
+        ++mTreeGeneration;
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_removeChild(OfsEntryDesc *parent, OfsEntryDesc *child)
+    {
+        assert(parent != NULL && child != NULL);
+
+        std::vector<OfsEntryDesc*>& children = parent->Children;
+
+        /* Linked entries are not at their kept position, only those are searched for */
+        unsigned int pos = child->ChildPos;
+        if(pos >= children.size() || children[pos] != child)
+            pos = std::find(children.begin(), children.end(), child) - children.begin();
+
+        /* The last child fills the gap, so the order of children is not preserved */
+        if(pos < children.size())
+        {
+            children[pos] = children.back();
+            children.pop_back();
+
+            if(pos < children.size() && children[pos]->Parent == parent)
+                children[pos]->ChildPos = pos;
+        }
+
+        std::pair<NameDescMap::iterator, NameDescMap::iterator> range = parent->ChildIndex.equal_range(child->Name);
+        for(NameDescMap::iterator nit = range.first; nit != range.second; ++nit)
+        {
+            if(nit->second == child)
+            {
+                parent->ChildIndex.erase(nit);
+                break;
+            }
+        }
+
+        ++mTreeGeneration;
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_renameChild(OfsEntryDesc *child, const std::string& name)
+    {
+        assert(child != NULL);
+
+        OfsEntryDesc *parent = child->Parent;
+
+        if(parent != NULL)
+        {
+            std::pair<NameDescMap::iterator, NameDescMap::iterator> range = parent->ChildIndex.equal_range(child->Name);
+            for(NameDescMap::iterator nit = range.first; nit != range.second; ++nit)
+            {
+                if(nit->second == child)
+                {
+                    parent->ChildIndex.erase(nit);
+                    break;
+                }
+            }
+
+            parent->ChildIndex.insert(NameDescMap::value_type(name, child));
+        }
+
+        child->Name = name;
+
+        ++mTreeGeneration;
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_clearChildren(OfsEntryDesc *parent)
+    {
+        assert(parent != NULL);
+
+        parent->Children.clear();
+        parent->ChildIndex.clear();
+
+        ++mTreeGeneration;
+    }
+
+//------------------------------------------------------------------------------
+
+    bool _OfsBase::_lookupPathCache(const char *path, long generation, OfsEntryDesc*& desc)
+    {
+        boost::mutex::scoped_lock lock(mPathCacheMutex);
+
+        PathCacheMap::const_iterator it = mPathCache.find(path);
+
+        if(it == mPathCache.end() || it->second.Generation != generation)
+            return false;
+
+        desc = it->second.Desc;
+
+        return true;
+    }
+
+//------------------------------------------------------------------------------
+
+    _OfsBase::OfsEntryDesc* _OfsBase::_storePathCache(const char *path, long generation, OfsEntryDesc *desc)
+    {
+        boost::mutex::scoped_lock lock(mPathCacheMutex);
+
+        if(mPathCache.size() >= PATH_CACHE_SIZE)
+            mPathCache.clear();
+
+        PathCacheEntry& entry = mPathCache[path];
+        entry.Desc = desc;
+        entry.Generation = generation;
+
+        return desc;
+    }
+
+//------------------------------------------------------------------------------
+
+    void _OfsBase::_clearPathCache()
+    {
+        boost::mutex::scoped_lock lock(mPathCacheMutex);
+
+        mPathCache.clear();
+    }
+
+//------------------------------------------------------------------------------
+
+    _OfsBase::OfsEntryDesc* _OfsBase::_lookupChild(OfsEntryDesc *dir_desc, const std::string& name, unsigned int flags)
+    {
+        assert(dir_desc != NULL);
+
+        std::pair<NameDescMap::const_iterator, NameDescMap::const_iterator> range = dir_desc->ChildIndex.equal_range(name);
+        for(NameDescMap::const_iterator it = range.first; it != range.second; ++it)
+        {
+            if(it->second->Flags & flags)
+                return it->second;
+        }
+
+        return NULL;
+    }
+
 //------------------------------------------------------------------------------
 
     OfsResult _OfsBase::mount(_OfsBase** ptr, const char *file, unsigned int op)
@@ -321,6 +1413,9 @@ namespace OFS
             if((op & OFS_MOUNT_LINK) && (it->second->mLinkMode == false))
                 return OFS_ACCESS_DENIED;
 
+            if(op & OFS_MOUNT_MMAP)
+                it->second->_setMemoryMapped(true);
+
             if(op == OFS_MOUNT_CREATE)
             {
                 OFS_EXCEPT("_Ofs::mount, Cannot overwrite an archive in use.");
@@ -373,6 +1468,14 @@ namespace OFS
         mPtr = 0;
     }
 
+//------------------------------------------------------------------------------
+
+    void OfsPtr::setMemoryMapped(bool enable)
+    {
+        if(mPtr != 0)
+            mPtr->_setMemoryMapped(enable);
+    }
+
 //------------------------------------------------------------------------------------------
 //------------------------------------------------------------------------------------------
 //------------------------------------------------------------------------------------------
@@ -31,8 +31,11 @@
 ///////////////////////////////////////////////////////////////////////////////////*/
 
 #include "ofs14.h"
+#include "file_ops.h"
 #include <algorithm>
 #include <stdio.h>
+#include <zlib.h>
+#include <deque>
 
 using namespace std;
 
@@ -45,25 +48,82 @@ using namespace std;
 
 namespace OFS
 {
-//------------------------------------------------------------------------------
+    const unsigned char COMPRESSED_DATA_ID[4] = {'O', 'F', 'S', 'Z'};
+
+    const unsigned int COMPRESSED_CHUNK_SIZE = 65536;
+
+    const unsigned char COMPACT_JOURNAL_ID[4] = {'O', 'F', 'S', 'C'};
+
+    const unsigned int COMPACT_BUFFER_SIZE = 65536;
+
+    const unsigned char INDEX_ID[4] = {'O', 'F', 'S', 'I'};
+
+    const unsigned char DEDUP_REFERENCE_ID[4] = {'O', 'F', 'S', 'D'};
+
+    /* Smaller files are not worth the extra entry a shared file needs */
+    const ofs64 DEDUP_MIN_SIZE = 4096;
+
+    const unsigned int DEDUP_BUFFER_SIZE = 65536;
+
+    /* Seed of dedupHash, the initial values of CRC32 and Adler32 */
+    const ofs64 DEDUP_HASH_SEED = 1;
+
+    /* Files up to this size are held whole in memory by importFiles and extractFiles, larger ones are copied in chunks */
+    const ofs64 TRANSFER_MAX_BUFFERED = 16 * 1024 * 1024;
+
+    /* Limit of file contents held in memory by importFiles and extractFiles at once */
+    const ofs64 TRANSFER_MEMORY_BUDGET = 128 * 1024 * 1024;
+
+    const unsigned int TRANSFER_CHUNK_SIZE = 4 * 1024 * 1024;
+
+    /* Default size of the cache of recently read contents */
+    const ofs64 READ_CACHE_SIZE = 32 * 1024 * 1024;
+
+    /* Amount of data loaded into the cache past the end of a sequential read */
+    const ofs64 READ_AHEAD_SIZE = 256 * 1024;
+
+    /* A growing file gets a new block as large as what it already has, within these limits */
+    const ofs64 GROWTH_MIN_SIZE = 1024;
+
+    const ofs64 GROWTH_MAX_SIZE = 16 * 1024 * 1024;
 
-    bool BlockCompare ( _OfsBase::BlockData elem1, _OfsBase::BlockData elem2 )
+    /* Smaller unused space at the end of a file is not worth a free block of its own */
+    const ofs64 RELEASE_MIN_SIZE = 65536;
+
+    /* Builds the stored data of an OFS_COMPRESSED file (header, chunk offsets and compressed chunks) */
+    static bool compressContents(const char *data, ofs64 size, unsigned int chunk_size, std::vector<char>& stored);
+
+    /* Continues a 64 bit content hash made of CRC32 and Adler32 over the next piece of data */
+    static ofs64 dedupHash(ofs64 hash, const char *data, unsigned int length)
     {
-        if(elem1.Length < elem2.Length)
-            return true;
-        else if(elem1.Length == elem2.Length)
-            return (elem1.Start < elem2.Start);
+        uLong crc = (uLong)((unsigned long long)hash >> 32);
+        uLong adler = (uLong)((unsigned long long)hash & 0xFFFFFFFFULL);
 
-        return false;
-    }
+        crc = crc32(crc, (const Bytef*)data, length);
+        adler = adler32(adler, (const Bytef*)data, length);
 
+        return (ofs64)(((unsigned long long)crc << 32) | (unsigned long long)adler);
+    }
 
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-    _Ofs::_Ofs() : _OfsBase(OFS_PACKED)
+    _Ofs::_Ofs() : _OfsBase(OFS_PACKED), mTransactionDepth(0), mTransactionAborted(false), mDedupMode(false)
     {
+        memset(&mIndexBlock, 0, sizeof(BlockData));
+
+        mDedupRoot.Owner      = this;
+        mDedupRoot.Id         = DEDUP_DIRECTORY_ID;
+        mDedupRoot.ParentId   = DEDUP_DIRECTORY_ID;
+        mDedupRoot.Flags      = OFS_DIR;
+        mDedupRoot.FileSize   = 0;
+        mDedupRoot.SharedData = NULL;
+        mDedupRoot.ShareCount = 0;
+        mDedupRoot.UseCount   = 0;
+        mDedupRoot.WriteLocked = false;
+        mDedupRoot.Parent     = NULL;
+
+        mCache.setCapacity(READ_CACHE_SIZE);
+        mStream.setCache(&mCache);
     }
 
 //------------------------------------------------------------------------------
@@ -94,7 +154,7 @@ namespace OFS
 
     OfsResult _Ofs::rebuildUUIDMap()
     {
-        LOCK_AUTO_MUTEX
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -111,7 +171,7 @@ namespace OFS
 
     OfsResult _Ofs::linkFileSystem(const char *filename, const char *directory)
     {
-        LOCK_AUTO_MUTEX
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -175,7 +235,8 @@ namespace OFS
                     add_list.push_back( foreignDir->Children[i] );
             }
 
-            dirDesc->Children.insert( dirDesc->Children.end(), add_list.begin(), add_list.end() );
+            for( unsigned int i = 0; i < add_list.size(); i++ )
+                _addChild( dirDesc, add_list[i] );
 
             dirDesc->Links.insert( NameOfsPtrMap::value_type( filename, _ofsptr ) );
         }
@@ -187,7 +248,7 @@ namespace OFS
 
     OfsResult _Ofs::unlinkFileSystem(const char *filename, const char *directory)
     {
-        LOCK_AUTO_MUTEX
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -224,14 +285,7 @@ namespace OFS
 
             for( unsigned int i = 0; i < foreignDir->Children.size(); i++ )
             {
-                for( unsigned int k = 0; k < dirDesc->Children.size(); k++ )
-                {
-                    if( dirDesc->Children[k] == foreignDir->Children[i] )
-                    {
-                        dirDesc->Children.erase( dirDesc->Children.begin() + k );
-                        break;
-                    }
-                }
+                _removeChild( dirDesc, foreignDir->Children[i] );
             }
 
             dirDesc->Links.erase( it );
@@ -244,7 +298,7 @@ namespace OFS
 
     OfsResult _Ofs::getDirectoryLinks(const char *directory, NameOfsPtrMap& list)
     {
-        LOCK_AUTO_MUTEX
+        LOCK_SHARED_AUTO_MUTEX
 
         if(!mActive)
         {
@@ -294,15 +348,25 @@ namespace OFS
             stats.UsedAllocations++;
         }
 
-        stats.ActualFreeSpace += (total_alloc - desc->FileSize);
-        stats.FreeSpace += (total_alloc - desc->FileSize);
+        /* The data of an OFS_DEDUP file is only the reference to its shared contents */
+        ofs64 stored_size = (desc->Flags & OFS_DEDUP) ? sizeof(strDedupReference) : desc->FileSize;
+
+        stats.ActualFreeSpace += (total_alloc - stored_size);
+        stats.FreeSpace += (total_alloc - stored_size);
+    }
+
+//------------------------------------------------------------------------------
+
+    void _Ofs::setReadCacheSize(ofs64 size)
+    {
+        mCache.setCapacity(size);
     }
 
 //------------------------------------------------------------------------------
 
     OfsResult _Ofs::getFileSystemStats(FileSystemStats& stats)
     {
-        LOCK_AUTO_MUTEX
+        LOCK_SHARED_AUTO_MUTEX
 
         if(!mActive)
         {
@@ -314,12 +378,33 @@ namespace OFS
 
         _getFileSystemStatsRecursive(&mRootDir, stats);
 
+        /* Shared contents take space, but are neither files nor directories of their own */
+        FileSystemStats shared;
+        memset(&shared, 0, sizeof(FileSystemStats));
+
+        for(unsigned int i = 0;i < mDedupRoot.Children.size();i++)
+        {
+            OfsEntryDesc *desc = mDedupRoot.Children[i];
+
+            _getFileSystemStatsRecursive(desc, shared);
+
+            if(desc->ShareCount > 1)
+                stats.DedupSavedSpace += (desc->ShareCount - 1) * desc->FileSize;
+        }
+
+        stats.UsedAllocations += shared.UsedAllocations;
+        stats.ActualUsedSpace += shared.ActualUsedSpace;
+        stats.ActualFreeSpace += shared.ActualFreeSpace;
+        stats.FreeSpace += shared.FreeSpace;
+
         stats.FreeAllocations = mFreeBlocks.size();
 
-        for(unsigned int i = 0;i < mFreeBlocks.size();i++)
+        mCache.getCounters(stats.CacheHits, stats.CacheMisses);
+
+        for(PosBlockDataMap::const_iterator it = mFreeBlocks.begin();it != mFreeBlocks.end();++it)
         {
-            stats.FreeSpace += mFreeBlocks[i].Length + sizeof(strBlockHeader);
-            stats.ActualFreeSpace += mFreeBlocks[i].Length;
+            stats.FreeSpace += it->second.Length + sizeof(strBlockHeader);
+            stats.ActualFreeSpace += it->second.Length;
         }
 
         mStream.seek(0, OFS_SEEK_END);
@@ -343,7 +428,37 @@ namespace OFS
             }
         }
 
-        parent->Children.clear();
+        _clearChildren(parent);
+    }
+
+//------------------------------------------------------------------------------
+
+    void _Ofs::_insertFreeBlock(const BlockData& data)
+    {
+        mFreeBlocks.insert(PosBlockDataMap::value_type(data.Start, data));
+        mFreeBlocksBySize.insert(LengthPosSet::value_type(data.Length, data.Start));
+    }
+
+//------------------------------------------------------------------------------
+
+    void _Ofs::_eraseFreeBlock(const BlockData& data)
+    {
+        mFreeBlocks.erase(data.Start);
+        mFreeBlocksBySize.erase(LengthPosSet::value_type(data.Length, data.Start));
+    }
+
+//------------------------------------------------------------------------------
+
+    bool _Ofs::_findFreeBlock(ofs64 block_size, BlockData& data)
+    {
+        LengthPosSet::const_iterator it = mFreeBlocksBySize.lower_bound(LengthPosSet::value_type(block_size, 0));
+
+        if(it == mFreeBlocksBySize.end())
+            return false;
+
+        data = mFreeBlocks[it->second];
+
+        return true;
     }
 
 //------------------------------------------------------------------------------
@@ -354,7 +469,40 @@ namespace OFS
         data.NextBlock = 0;
         mStream.seek(data.Start - sizeof(strBlockHeader) + offsetof(strBlockHeader, Type), OFS_SEEK_BEGIN);
         mStream.write((char*)&(data.Type), sizeof(unsigned int));
-        mFreeBlocks.push_back(data);
+
+        /* Coalesce with physically adjacent free blocks, the absorbed block's header simply becomes free space */
+        bool merged = false;
+
+        PosBlockDataMap::iterator next = mFreeBlocks.find(data.Start + data.Length + sizeof(strBlockHeader));
+        if(next != mFreeBlocks.end())
+        {
+            BlockData nextData = next->second;
+            _eraseFreeBlock(nextData);
+            data.Length += sizeof(strBlockHeader) + nextData.Length;
+            merged = true;
+        }
+
+        PosBlockDataMap::iterator prev = mFreeBlocks.lower_bound(data.Start);
+        if(prev != mFreeBlocks.begin())
+        {
+            --prev;
+            if(prev->second.Start + prev->second.Length + (ofs64)sizeof(strBlockHeader) == data.Start)
+            {
+                BlockData prevData = prev->second;
+                _eraseFreeBlock(prevData);
+                prevData.Length += sizeof(strBlockHeader) + data.Length;
+                data = prevData;
+                merged = true;
+            }
+        }
+
+        if(merged)
+        {
+            mStream.seek(data.Start - sizeof(strBlockHeader) + offsetof(strBlockHeader, Length), OFS_SEEK_BEGIN);
+            mStream.write((char*)&(data.Length), sizeof(ofs64));
+        }
+
+        _insertFreeBlock(data);
     }
 
 //------------------------------------------------------------------------------
@@ -368,27 +516,20 @@ namespace OFS
         blHeader.Signature[1] = mHeader.BLOCK_HEADER_SIG[1];
 
         bool fill_needed = false;
-        int alloc_pos = -1;
+        BlockData freeBlock;
 
-        for(unsigned int i = 0;i < mFreeBlocks.size();i++)
+        if(_findFreeBlock(block_size, freeBlock))
         {
-            if(mFreeBlocks[i].Length >= block_size)
-            {
-                alloc_pos = i;
-                break;
-            }
-        }
+           _eraseFreeBlock(freeBlock);
 
-        if(alloc_pos != -1)
-        {
-           blockData = mFreeBlocks[alloc_pos];
+           blockData = freeBlock;
            blockData.Type = OFS_MAIN_BLOCK;
            blockData.NextBlock = 0;
            
            if(blockData.Length >= (1024 + sizeof(strBlockHeader) + block_size))
            {
-               mFreeBlocks[alloc_pos].Start += sizeof(strBlockHeader) + block_size;
-               mFreeBlocks[alloc_pos].Length -= sizeof(strBlockHeader) + block_size;
+               freeBlock.Start += sizeof(strBlockHeader) + block_size;
+               freeBlock.Length -= sizeof(strBlockHeader) + block_size;
                blockData.Length = block_size;
 
                blHeader.Type = OFS_MAIN_BLOCK;
@@ -398,18 +539,16 @@ namespace OFS
                mStream.write((char*)&mainEntry, sizeof(strMainEntryHeader));
                
                blHeader.Type = OFS_FREE_BLOCK;
-               blHeader.Length = mFreeBlocks[alloc_pos].Length;
+               blHeader.Length = freeBlock.Length;
                mStream.seek(block_size - sizeof(strMainEntryHeader), OFS_SEEK_CURRENT);
                mStream.write((char*)&blHeader, sizeof(strBlockHeader));
 
                desc->UsedBlocks.push_back(blockData);
 
-               if(alloc_pos != 0)
-                   std::sort(mFreeBlocks.begin(), mFreeBlocks.end(), BlockCompare);
+               _insertFreeBlock(freeBlock);
            }
            else
            {
-               mFreeBlocks.erase(mFreeBlocks.begin() + alloc_pos);
                blHeader.Type = OFS_MAIN_BLOCK;
                blHeader.Length = blockData.Length;
                mStream.seek(blockData.Start - sizeof(strBlockHeader), OFS_SEEK_BEGIN);
@@ -475,27 +614,20 @@ namespace OFS
         blHeader.Signature[1] = mHeader.BLOCK_HEADER_SIG[1];
 
         bool fill_needed = false;
-        int alloc_pos = -1;
+        BlockData freeBlock;
 
-        for(unsigned int i = 0;i < mFreeBlocks.size();i++)
+        if(_findFreeBlock(block_size, freeBlock))
         {
-            if(mFreeBlocks[i].Length >= block_size)
-            {
-                alloc_pos = i;
-                break;
-            }
-        }
+           _eraseFreeBlock(freeBlock);
 
-        if(alloc_pos != -1)
-        {
-           blockData = mFreeBlocks[alloc_pos];
+           blockData = freeBlock;
            blockData.Type = OFS_EXTENDED_BLOCK;
            blockData.NextBlock = 0;
            
            if(blockData.Length >= (1024 + sizeof(strBlockHeader) + block_size))
            {
-               mFreeBlocks[alloc_pos].Start += sizeof(strBlockHeader) + block_size;
-               mFreeBlocks[alloc_pos].Length -= sizeof(strBlockHeader) + block_size;
+               freeBlock.Start += sizeof(strBlockHeader) + block_size;
+               freeBlock.Length -= sizeof(strBlockHeader) + block_size;
                blockData.Length = block_size;
 
                blHeader.Type = OFS_EXTENDED_BLOCK;
@@ -505,18 +637,16 @@ namespace OFS
                mStream.write((char*)&extendedHeader, sizeof(strExtendedEntryHeader));
                
                blHeader.Type = OFS_FREE_BLOCK;
-               blHeader.Length = mFreeBlocks[alloc_pos].Length;
+               blHeader.Length = freeBlock.Length;
                mStream.seek(block_size - sizeof(strExtendedEntryHeader), OFS_SEEK_CURRENT);
                mStream.write((char*)&blHeader, sizeof(strBlockHeader));
 
                desc->UsedBlocks.push_back(blockData);
 
-               if(alloc_pos != 0)
-                   std::sort(mFreeBlocks.begin(), mFreeBlocks.end(), BlockCompare);
+               _insertFreeBlock(freeBlock);
            }
            else
            {
-               mFreeBlocks.erase(mFreeBlocks.begin() + alloc_pos);
                blHeader.Type = OFS_EXTENDED_BLOCK;
                blHeader.Length = blockData.Length;
                mStream.seek(blockData.Start - sizeof(strBlockHeader), OFS_SEEK_BEGIN);
@@ -581,7 +711,7 @@ namespace OFS
 
     OfsResult _Ofs::_mount(const char *file, unsigned int op)
     {
-        LOCK_AUTO_MUTEX
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(mActive)
         {
@@ -599,6 +729,9 @@ namespace OFS
         if(op & OFS_MOUNT_LINK)
             mLinkMode = true;
 
+        if(op & OFS_MOUNT_DEDUP)
+            mDedupMode = true;
+
         if(op & OFS_MOUNT_OPEN)
         {
             OPEN_STREAM(mStream, mFileName.c_str(), "rb+");
@@ -606,10 +739,17 @@ namespace OFS
             {
                 mActive = true;
                 ret = _readHeader();
+
+                if(ret == OFS_OK)
+                    _linkSharedFiles();
             }
         }
         else
         {
+            /* Journals left behind by an earlier file with the same name do not belong to the new one */
+            remove(_getTransactionJournalName().c_str());
+            remove(_getCompactJournalName().c_str());
+
             OPEN_STREAM(mStream, mFileName.c_str(), "wb+");
             if(!mStream.fail())
             {
@@ -638,15 +778,29 @@ namespace OFS
         {
             _clear();
         }
+        else if(op & OFS_MOUNT_MMAP)
+        {
+            mStream.setMapped(true);
+        }
         
         return ret;
     }
 
+//------------------------------------------------------------------------------
+
+    void _Ofs::_setMemoryMapped(bool enable)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(mActive)
+            mStream.setMapped(enable);
+    }
+
 //------------------------------------------------------------------------------
 
     void _Ofs::_unmount()
     {
-        LOCK_AUTO_MUTEX
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -654,6 +808,10 @@ namespace OFS
             return;
         }
 
+        /* The barrier is still armed if nothing changed since the index was read or written */
+        if(!mStream.isWriteBarrierArmed())
+            _writeIndex();
+
         _clear();
     }
 
@@ -663,6 +821,8 @@ namespace OFS
     {
         mActive = false;
 
+        mStream.setMapped(false);
+
         if(!mStream.fail())
         {
             mStream.flush();
@@ -675,13 +835,22 @@ namespace OFS
         mRootDir.UsedBlocks.clear();
         _deallocateChildren(&mRootDir);
         _deallocateChildren(&mRecycleBinRoot);
+        _deallocateChildren(&mDedupRoot);
 
         mFreeBlocks.clear();
+        mFreeBlocksBySize.clear();
         mActiveFiles.clear();
         mUuidMap.clear();
         mTriggers.clear();
+        _discardPendingTriggers();
+        _clearPathCache();
         mRecoveryMode = false;
         mLinkMode = false;
+        mDedupMode = false;
+        mTransactionDepth = 0;
+        mTransactionAborted = false;
+        memset(&mIndexBlock, 0, sizeof(BlockData));
+        mCache.clear();
     }
 
 //------------------------------------------------------------------------------
@@ -690,6 +859,9 @@ namespace OFS
     {
         assert(mActive);
 
+        /* Discard writes of a transaction which was never committed */
+        mStream.rollbackUndoJournal(_getTransactionJournalName().c_str());
+
         mStream.seek(0, OFS_SEEK_END);
         ofs64 file_size = mStream.tell();
 
@@ -714,6 +886,26 @@ namespace OFS
         else if(version_diff < 0)
             return OFS_UNKNOWN_VERSION;
 
+        /* The index is only valid until the next write, which clears its position in the file header first.
+           Any write from now on, including a replayed compaction move, makes it stale */
+        ofs64 index_pos = mHeader.INDEX_POS;
+        mHeader.INDEX_POS = 0;
+
+        if(index_pos != 0)
+            _armIndexBarrier();
+
+        _replayCompactJournal();
+
+        if(index_pos != 0)
+        {
+            if(mStream.isWriteBarrierArmed() && !mRecoveryMode && _readIndex(index_pos, file_size))
+                return OFS_OK;
+
+            _writeHeader();
+        }
+
+        mStream.seek(HeaderSize, OFS_SEEK_BEGIN);
+
         ofs64 current_loc = mStream.tell();
 
         if(current_loc == file_size)
@@ -727,9 +919,11 @@ namespace OFS
         IdDescMap::iterator dait;
         IdDescMap DirMap;
         IdDescMap FileMap;
+        BlockDataVector StaleIndexBlocks;
 
         DirMap.insert(IdDescMap::value_type(mRootDir.Id, &mRootDir));
         DirMap.insert(IdDescMap::value_type(mRecycleBinRoot.Id, &mRecycleBinRoot));
+        DirMap.insert(IdDescMap::value_type(mDedupRoot.Id, &mDedupRoot));
 
         ofs64 skipped = 0;
 
@@ -769,7 +963,7 @@ namespace OFS
                 blockData.Length = blHeader.Length;
                 blockData.NextBlock = 0;
 
-                mFreeBlocks.push_back(blockData);
+                _insertFreeBlock(blockData);
                 mStream.seek(blockData.Length, OFS_SEEK_CURRENT);
             }
             else if(blHeader.Type == OFS_MAIN_BLOCK)
@@ -816,6 +1010,7 @@ namespace OFS
                 entryDesc->Flags = mainEntry.Flags;
                 entryDesc->Name = mainEntry.Name;
                 entryDesc->FileSize = mainEntry.FileSize;
+                entryDesc->UncompressedSize = (mainEntry.Flags & OFS_COMPRESSED) ? mainEntry.UncompressedSize : 0;
                 entryDesc->CreationTime = mainEntry.CreationTime;
                 entryDesc->UseCount = 0;
                 entryDesc->WriteLocked = false;
@@ -849,7 +1044,7 @@ namespace OFS
                     entryDesc->OldParentId = ROOT_DIRECTORY_ID;
                 
                 entryDesc->Parent = it->second;
-                it->second->Children.push_back(entryDesc);
+                _addChild(it->second, entryDesc);
 
                 mStream.seek(blockData.Length - sizeof(strMainEntryHeader), OFS_SEEK_CURRENT);
             }
@@ -882,177 +1077,471 @@ namespace OFS
 
                 mStream.seek(blockData.Length - sizeof(strExtendedEntryHeader), OFS_SEEK_CURRENT);
             }
+            else if(blHeader.Type == OFS_INDEX_BLOCK)
+            {
+                blockData.Type = blHeader.Type;
+                blockData.Start = mStream.tell();
+                blockData.Length = blHeader.Length;
+                blockData.NextBlock = 0;
+
+                StaleIndexBlocks.push_back(blockData);
+                mStream.seek(blockData.Length, OFS_SEEK_CURRENT);
+            }
             else
                 return OFS_FILE_CORRUPT;
         }
 
-        std::sort(mFreeBlocks.begin(), mFreeBlocks.end(), BlockCompare);
+        /* An index block found by the scan was not used, it is stale */
+        for(unsigned int i = 0;i < StaleIndexBlocks.size();i++)
+            _markUnused(StaleIndexBlocks[i]);
 
         return OFS_OK;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::_writeHeader()
+    bool _Ofs::_readIndex(ofs64 index_pos, ofs64 file_size)
     {
-        assert(mActive);
+        strBlockHeader blHeader;
+        strIndexHeader indexHeader;
 
-        mStream.seek(0, OFS_SEEK_BEGIN);
-        
-        mStream.write((char *)&mHeader, sizeof(strFileHeader));
-        
-        mStream.flush();
+        if(index_pos < (ofs64)(sizeof(strFileHeader) + sizeof(strBlockHeader)) || index_pos >= file_size)
+            return false;
 
-        return OFS_OK;
-    }
+        mStream.seek(index_pos - sizeof(strBlockHeader), OFS_SEEK_BEGIN);
 
-//------------------------------------------------------------------------------
+        if(mStream.read((char*)&blHeader, sizeof(strBlockHeader)) != sizeof(strBlockHeader))
+            return false;
 
-    _Ofs::OfsEntryDesc* _Ofs::_getDirectoryDesc(const char *filename)
-    {
-        if(*filename == '/')
-            ++filename;
+        if(blHeader.Signature[0] != mHeader.BLOCK_HEADER_SIG[0] || blHeader.Signature[1] != mHeader.BLOCK_HEADER_SIG[1] || blHeader.Type != OFS_INDEX_BLOCK)
+            return false;
 
-        std::string dir;
-        std::string tmp = filename;
-        const char *pos = filename;
-        const char *name_st  = filename;
+        if(mStream.read((char*)&indexHeader, sizeof(strIndexHeader)) != sizeof(strIndexHeader))
+            return false;
 
-        OfsEntryDesc *curDesc = &mRootDir;
+        if(memcmp(indexHeader.ID, INDEX_ID, 4) != 0 || indexHeader.FileSize != file_size || indexHeader.DataSize > (blHeader.Length - (ofs64)sizeof(strIndexHeader)))
+            return false;
 
-        while(*filename != 0)
-        {
-            if(*filename == '/')
-            {
-                if(filename > pos)
-                {
-                    dir = tmp.substr(pos - name_st, filename - pos);
+        std::vector<char> data((size_t)indexHeader.DataSize + 1);
 
-                    OfsEntryDesc *tmpDesc = NULL;
+        if(mStream.read(&data[0], (size_t)indexHeader.DataSize) != (size_t)indexHeader.DataSize)
+            return false;
 
-                    for(unsigned int i = 0;i < curDesc->Children.size();i++)
-                    {
-                        if((curDesc->Children[i]->Flags & OFS_DIR) && curDesc->Children[i]->Name == dir)
-                        {
-                            tmpDesc = curDesc->Children[i];
-                            break;
-                        }
-                    }
+        if(crc32(0L, (const Bytef*)&data[0], (uInt)indexHeader.DataSize) != indexHeader.Checksum)
+            return false;
 
-                    if(tmpDesc == NULL)
-                        return NULL;
-                    else
-                        curDesc = tmpDesc;
-                }
+        const char *pos = &data[0];
+        const char *end = pos + indexHeader.DataSize;
 
-                pos = (filename + 1);
-            }
+        IdDescMap DirMap;
+        IdDescMap::iterator it;
 
-            ++filename;
-        }
+        DirMap.insert(IdDescMap::value_type(mRootDir.Id, &mRootDir));
+        DirMap.insert(IdDescMap::value_type(mRecycleBinRoot.Id, &mRecycleBinRoot));
+        DirMap.insert(IdDescMap::value_type(mDedupRoot.Id, &mDedupRoot));
 
-        if(filename > pos)
+        bool valid = true;
+
+        /* Entries are stored parent first, so a parent is always known before its children */
+        for(unsigned int i = 0;valid && i < indexHeader.NumEntries;i++)
         {
-            dir = tmp.substr(pos - name_st, filename - pos);
+            strIndexEntry entry;
 
-            OfsEntryDesc *tmpDesc = NULL;
+            if((end - pos) < (ptrdiff_t)sizeof(strIndexEntry))
+            {
+                valid = false;
+                break;
+            }
+
+            memcpy((char*)&entry, pos, sizeof(strIndexEntry));
+            pos += sizeof(strIndexEntry);
 
-            for(unsigned int i = 0;i < curDesc->Children.size();i++)
+            it = DirMap.find(entry.ParentId);
+
+            if(it == DirMap.end() || (ofs64)(end - pos) < (ofs64)entry.NameLength + (ofs64)entry.NumBlocks * (ofs64)sizeof(strIndexBlock))
             {
-                if((curDesc->Children[i]->Flags & OFS_DIR) && curDesc->Children[i]->Name == dir)
-                {
-                    tmpDesc = curDesc->Children[i];
-                    break;
-                }
+                valid = false;
+                break;
             }
 
-            if(tmpDesc != NULL)
-                curDesc = tmpDesc;
-        }
+            OfsEntryDesc *entryDesc = new OfsEntryDesc();
 
-        return curDesc;
-    }
+            entryDesc->Owner = this;
+            entryDesc->Id = entry.Id;
+            entryDesc->ParentId = entry.ParentId;
+            entryDesc->Flags = entry.Flags;
+            entryDesc->OldParentId = entry.OldParentId;
+            entryDesc->Name.assign(pos, entry.NameLength);
+            entryDesc->FileSize = entry.FileSize;
+            entryDesc->UncompressedSize = entry.UncompressedSize;
+            entryDesc->CreationTime = entry.CreationTime;
+            entryDesc->UseCount = 0;
+            entryDesc->WriteLocked = false;
+            entryDesc->Uuid = entry.Uuid;
 
-//------------------------------------------------------------------------------
+            if(mLinkMode)
+                entryDesc->Flags |= OFS_LINK;
 
-    _Ofs::OfsEntryDesc* _Ofs::_getFileDesc(OfsEntryDesc *dir_desc, std::string filename)
-    {
-        for(unsigned int i = 0;i < dir_desc->Children.size();i++)
-        {
-            if((dir_desc->Children[i]->Flags & OFS_FILE) && dir_desc->Children[i]->Name == filename)
+            pos += entry.NameLength;
+
+            for(unsigned int b = 0;b < entry.NumBlocks;b++)
             {
-                return dir_desc->Children[i];
+                strIndexBlock block;
+                memcpy(&block, pos, sizeof(strIndexBlock));
+                pos += sizeof(strIndexBlock);
+
+                BlockData blockData;
+                blockData.Type = block.Type;
+                blockData.Start = block.Start;
+                blockData.Length = block.Length;
+                blockData.NextBlock = block.NextBlock;
+
+                entryDesc->UsedBlocks.push_back(blockData);
             }
+
+            if((entry.ParentId != RECYCLEBIN_DIRECTORY_ID) && (entry.Uuid != UUID_ZERO))
+                mUuidMap.insert(UuidDescMap::value_type(entry.Uuid, entryDesc));
+
+            entryDesc->Parent = it->second;
+            _addChild(it->second, entryDesc);
+
+            if(entry.Flags & OFS_DIR)
+                DirMap.insert(IdDescMap::value_type(entry.Id, entryDesc));
         }
-        return NULL;
-    }
 
-//------------------------------------------------------------------------------
-    
-    _Ofs::OfsEntryDesc* _Ofs::_findChild(OfsEntryDesc *dir_desc, std::string child_name)
-    {
-        for(unsigned int i = 0;i < dir_desc->Children.size();i++)
+        if(valid && (ofs64)(end - pos) < (ofs64)indexHeader.NumFreeBlocks * (ofs64)sizeof(strIndexBlock))
+            valid = false;
+
+        for(unsigned int i = 0;valid && i < indexHeader.NumFreeBlocks;i++)
         {
-            if(dir_desc->Children[i]->Name == child_name)
-            {
-                return dir_desc->Children[i];
-            }
+            strIndexBlock block;
+            memcpy(&block, pos, sizeof(strIndexBlock));
+            pos += sizeof(strIndexBlock);
+
+            BlockData blockData;
+            blockData.Type = block.Type;
+            blockData.Start = block.Start;
+            blockData.Length = block.Length;
+            blockData.NextBlock = 0;
+
+            _insertFreeBlock(blockData);
         }
-        return NULL;
+
+        if(!valid)
+        {
+            _deallocateChildren(&mRootDir);
+            _deallocateChildren(&mRecycleBinRoot);
+            _deallocateChildren(&mDedupRoot);
+            mFreeBlocks.clear();
+            mFreeBlocksBySize.clear();
+            mUuidMap.clear();
+            return false;
+        }
+
+        mIndexBlock.Type = OFS_INDEX_BLOCK;
+        mIndexBlock.Start = index_pos;
+        mIndexBlock.Length = blHeader.Length;
+        mIndexBlock.NextBlock = 0;
+
+        return true;
     }
 
 //------------------------------------------------------------------------------
 
-    std::string   _Ofs::_extractFileName(const char *filename)
+    void _Ofs::_writeIndexEntries(OfsEntryDesc *desc, std::vector<char>& buffer, unsigned int& count)
     {
-        const char *pos = filename;
-        const char *str = filename;
+        if(desc->Owner != this)
+            return;
 
-        while(*str != 0)
+        strIndexEntry entry;
+        entry.Id = desc->Id;
+        entry.ParentId = desc->ParentId;
+        entry.Flags = desc->Flags;
+        entry.OldParentId = desc->OldParentId;
+        entry.UncompressedSize = desc->UncompressedSize;
+        entry.FileSize = desc->FileSize;
+        entry.CreationTime = desc->CreationTime;
+        entry.Uuid = desc->Uuid;
+        entry.NameLength = desc->Name.size();
+        entry.NumBlocks = desc->UsedBlocks.size();
+
+        if(mLinkMode)
+            entry.Flags &= ~OFS_LINK;
+
+        buffer.insert(buffer.end(), (const char*)&entry, (const char*)&entry + sizeof(strIndexEntry));
+        buffer.insert(buffer.end(), desc->Name.begin(), desc->Name.end());
+
+        for(unsigned int b = 0;b < desc->UsedBlocks.size();b++)
         {
-            if(*str == '/')
-                pos = (str + 1);
+            strIndexBlock block;
+            block.Type = desc->UsedBlocks[b].Type;
+            block.Reserved = 0;
+            block.Start = desc->UsedBlocks[b].Start;
+            block.Length = desc->UsedBlocks[b].Length;
+            block.NextBlock = desc->UsedBlocks[b].NextBlock;
 
-            ++str;
+            buffer.insert(buffer.end(), (const char*)&block, (const char*)&block + sizeof(strIndexBlock));
         }
 
-        return std::string(pos);
+        count++;
+
+        for(unsigned int i = 0;i < desc->Children.size();i++)
+            _writeIndexEntries(desc->Children[i], buffer, count);
     }
 
 //------------------------------------------------------------------------------
 
-    _Ofs::OfsEntryDesc* _Ofs::_createDirectory(OfsEntryDesc *parent, const std::string& name, const UUID& uuid)
+    void _Ofs::_writeIndex()
     {
-        assert(parent != NULL);
-
-        for(unsigned int i = 0; i < parent->Children.size();i++)
+        if(mIndexBlock.Start != 0)
         {
-            if(parent->Children[i]->Name == name)
-                return parent->Children[i];
+            _markUnused(mIndexBlock);
+            mIndexBlock.Start = 0;
         }
 
-        OfsEntryDesc *dir = new OfsEntryDesc();
+        std::vector<char> buffer(sizeof(strIndexHeader));
+        unsigned int num_entries = 0;
 
-        if(uuid != UUID_ZERO)
+        for(unsigned int i = 0;i < mRootDir.Children.size();i++)
+            _writeIndexEntries(mRootDir.Children[i], buffer, num_entries);
+
+        for(unsigned int i = 0;i < mRecycleBinRoot.Children.size();i++)
+            _writeIndexEntries(mRecycleBinRoot.Children[i], buffer, num_entries);
+
+        for(unsigned int i = 0;i < mDedupRoot.Children.size();i++)
+            _writeIndexEntries(mDedupRoot.Children[i], buffer, num_entries);
+
+        /* Allocating the index block itself never adds a free block, so the current count is an upper bound */
+        ofs64 block_size = buffer.size() + mFreeBlocks.size() * sizeof(strIndexBlock);
+
+        strBlockHeader blHeader;
+        blHeader.Signature[0] = mHeader.BLOCK_HEADER_SIG[0];
+        blHeader.Signature[1] = mHeader.BLOCK_HEADER_SIG[1];
+        blHeader.Reserved = 0;
+
+        BlockData blockData;
+        blockData.Type = OFS_INDEX_BLOCK;
+        blockData.NextBlock = 0;
+
+        BlockData freeBlock;
+
+        if(_findFreeBlock(block_size, freeBlock))
         {
-            UuidDescMap::const_iterator it = mUuidMap.find(uuid);
+            _eraseFreeBlock(freeBlock);
 
-            if(it != mUuidMap.end())
+            blockData.Start = freeBlock.Start;
+            blockData.Length = freeBlock.Length;
+
+            if(freeBlock.Length > (ofs64)(block_size + sizeof(strBlockHeader)))
             {
-                delete dir;
+                freeBlock.Start += block_size + sizeof(strBlockHeader);
+                freeBlock.Length -= block_size + sizeof(strBlockHeader);
+                blockData.Length = block_size;
 
-                OFS_EXCEPT("_Ofs::_createDirectory, The UUID supplied already exists.");
+                blHeader.Type = OFS_FREE_BLOCK;
+                blHeader.Length = freeBlock.Length;
+                mStream.seek(freeBlock.Start - sizeof(strBlockHeader), OFS_SEEK_BEGIN);
+                mStream.write((char*)&blHeader, sizeof(strBlockHeader));
 
-                return NULL;
-            }
-            else
-            {
-                mUuidMap.insert(UuidDescMap::value_type(uuid, dir));
+                _insertFreeBlock(freeBlock);
             }
         }
+        else
+        {
+            mStream.seek(0, OFS_SEEK_END);
+            blockData.Start = mStream.tell();
+            blockData.Start += sizeof(strBlockHeader);
+            blockData.Length = block_size;
+        }
 
+        for(PosBlockDataMap::const_iterator it = mFreeBlocks.begin();it != mFreeBlocks.end();++it)
+        {
+            strIndexBlock block;
+            block.Type = it->second.Type;
+            block.Reserved = 0;
+            block.Start = it->second.Start;
+            block.Length = it->second.Length;
+            block.NextBlock = 0;
 
-        dir->Owner = this;
+            buffer.insert(buffer.end(), (const char*)&block, (const char*)&block + sizeof(strIndexBlock));
+        }
+
+        mStream.seek(0, OFS_SEEK_END);
+        ofs64 file_size = mStream.tell();
+        if(file_size < blockData.Start + blockData.Length)
+            file_size = blockData.Start + blockData.Length;
+
+        strIndexHeader indexHeader;
+        memcpy(indexHeader.ID, INDEX_ID, 4);
+        indexHeader.NumEntries = num_entries;
+        indexHeader.NumFreeBlocks = mFreeBlocks.size();
+        indexHeader.FileSize = file_size;
+        indexHeader.DataSize = buffer.size() - sizeof(strIndexHeader);
+        indexHeader.Checksum = crc32(0L, (const Bytef*)&buffer[sizeof(strIndexHeader)], (uInt)indexHeader.DataSize);
+        memcpy(&buffer[0], &indexHeader, sizeof(strIndexHeader));
+
+        blHeader.Type = OFS_INDEX_BLOCK;
+        blHeader.Length = blockData.Length;
+        mStream.seek(blockData.Start - sizeof(strBlockHeader), OFS_SEEK_BEGIN);
+        mStream.write((char*)&blHeader, sizeof(strBlockHeader));
+        mStream.write(&buffer[0], buffer.size());
+
+        /* The index must be on disk before the header points to it */
+        mStream.commit();
+
+        mHeader.INDEX_POS = blockData.Start;
+        _writeHeader();
+        mStream.commit();
+        mHeader.INDEX_POS = 0;
+
+        mIndexBlock = blockData;
+        _armIndexBarrier();
+    }
+
+//------------------------------------------------------------------------------
+
+    void _Ofs::_armIndexBarrier()
+    {
+        ofs64 index_pos = 0;
+        mStream.setWriteBarrier(offsetof(strFileHeader, INDEX_POS), &index_pos, sizeof(ofs64));
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::_writeHeader()
+    {
+        assert(mActive);
+
+        mStream.seek(0, OFS_SEEK_BEGIN);
+        
+        mStream.write((char *)&mHeader, sizeof(strFileHeader));
+        
+        mStream.flush();
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    _Ofs::OfsEntryDesc* _Ofs::_getDirectoryDesc(const char *filename)
+    {
+        if(*filename == '/')
+            ++filename;
+
+        /* Paths are resolved once, including those crossing into linked file systems, until any tree changes */
+        long generation = mTreeGeneration;
+        OfsEntryDesc *cached;
+
+        if(_lookupPathCache(filename, generation, cached))
+            return cached;
+
+        std::string dir;
+        std::string tmp = filename;
+        const char *pos = filename;
+        const char *name_st  = filename;
+
+        OfsEntryDesc *curDesc = &mRootDir;
+
+        while(*filename != 0)
+        {
+            if(*filename == '/')
+            {
+                if(filename > pos)
+                {
+                    dir = tmp.substr(pos - name_st, filename - pos);
+
+                    OfsEntryDesc *tmpDesc = _lookupChild(curDesc, dir, OFS_DIR);
+
+                    if(tmpDesc == NULL)
+                        return _storePathCache(name_st, generation, NULL);
+                    else
+                        curDesc = tmpDesc;
+                }
+
+                pos = (filename + 1);
+            }
+
+            ++filename;
+        }
+
+        if(filename > pos)
+        {
+            dir = tmp.substr(pos - name_st, filename - pos);
+
+            OfsEntryDesc *tmpDesc = _lookupChild(curDesc, dir, OFS_DIR);
+
+            if(tmpDesc != NULL)
+                curDesc = tmpDesc;
+        }
+
+        return _storePathCache(name_st, generation, curDesc);
+    }
+
+//------------------------------------------------------------------------------
+
+    _Ofs::OfsEntryDesc* _Ofs::_getFileDesc(OfsEntryDesc *dir_desc, const std::string& filename)
+    {
+        return _lookupChild(dir_desc, filename, OFS_FILE);
+    }
+
+//------------------------------------------------------------------------------
+    
+    _Ofs::OfsEntryDesc* _Ofs::_findChild(OfsEntryDesc *dir_desc, const std::string& child_name)
+    {
+        return _lookupChild(dir_desc, child_name);
+    }
+
+//------------------------------------------------------------------------------
+
+    std::string   _Ofs::_extractFileName(const char *filename)
+    {
+        const char *pos = filename;
+        const char *str = filename;
+
+        while(*str != 0)
+        {
+            if(*str == '/')
+                pos = (str + 1);
+
+            ++str;
+        }
+
+        return std::string(pos);
+    }
+
+//------------------------------------------------------------------------------
+
+    _Ofs::OfsEntryDesc* _Ofs::_createDirectory(OfsEntryDesc *parent, const std::string& name, const UUID& uuid)
+    {
+        assert(parent != NULL);
+
+        OfsEntryDesc *existing = _lookupChild(parent, name);
+
+        if(existing != NULL)
+            return existing;
+
+        OfsEntryDesc *dir = new OfsEntryDesc();
+
+        if(uuid != UUID_ZERO)
+        {
+            UuidDescMap::const_iterator it = mUuidMap.find(uuid);
+
+            if(it != mUuidMap.end())
+            {
+                delete dir;
+
+                OFS_EXCEPT("_Ofs::_createDirectory, The UUID supplied already exists.");
+
+                return NULL;
+            }
+            else
+            {
+                mUuidMap.insert(UuidDescMap::value_type(uuid, dir));
+            }
+        }
+
+
+        dir->Owner = this;
         dir->Id = mHeader.LAST_ID++;
         dir->ParentId = parent->Id;
         dir->Flags = OFS_DIR;
@@ -1065,7 +1554,7 @@ namespace OFS
         dir->WriteLocked = false;
         dir->Uuid = uuid;
 
-        parent->Children.push_back(dir);
+        _addChild(parent, dir);
 
         BlockData dirData;
         strBlockHeader fileData;
@@ -1076,6 +1565,7 @@ namespace OFS
         fileHeader.Flags = dir->Flags;
         fileHeader.OldParentId = ROOT_DIRECTORY_ID;
         fileHeader.NextBlock = 0;
+        fileHeader.UncompressedSize = 0;
         fileHeader.FileSize = 0;
         fileHeader.CreationTime = dir->CreationTime;
         int sz = dir->Name.length();
@@ -1088,15 +1578,19 @@ namespace OFS
         fileData.Signature[0] = mHeader.BLOCK_HEADER_SIG[0];
         fileData.Signature[1] = mHeader.BLOCK_HEADER_SIG[1];
 
-        if(mFreeBlocks.size() > 0)
+        BlockData freeBlock;
+
+        if(_findFreeBlock(sizeof(strMainEntryHeader), freeBlock))
         {
-           dirData = mFreeBlocks[0];
+           _eraseFreeBlock(freeBlock);
+
+           dirData = freeBlock;
            dirData.Type = OFS_MAIN_BLOCK;
            dirData.NextBlock = 0;
            if(dirData.Length >= (1024 + sizeof(strBlockHeader) + sizeof(strMainEntryHeader)))
            {
-               mFreeBlocks[0].Start += sizeof(strBlockHeader) + sizeof(strMainEntryHeader);
-               mFreeBlocks[0].Length -= sizeof(strBlockHeader) + sizeof(strMainEntryHeader);
+               freeBlock.Start += sizeof(strBlockHeader) + sizeof(strMainEntryHeader);
+               freeBlock.Length -= sizeof(strBlockHeader) + sizeof(strMainEntryHeader);
                dirData.Length = sizeof(strMainEntryHeader);
 
                fileData.Type = OFS_MAIN_BLOCK;
@@ -1106,14 +1600,15 @@ namespace OFS
                mStream.write((char*)&fileHeader, sizeof(strMainEntryHeader));
                
                fileData.Type = OFS_FREE_BLOCK;
-               fileData.Length = mFreeBlocks[0].Length;
+               fileData.Length = freeBlock.Length;
                mStream.write((char*)&fileData, sizeof(strBlockHeader));
 
                dir->UsedBlocks.push_back(dirData);
+
+               _insertFreeBlock(freeBlock);
            }
            else
            {
-               mFreeBlocks.erase(mFreeBlocks.begin());
                fileData.Type = OFS_MAIN_BLOCK;
                fileData.Length = dirData.Length;
                mStream.seek(dirData.Start - sizeof(strBlockHeader), OFS_SEEK_BEGIN);
@@ -1163,7 +1658,7 @@ namespace OFS
         file->WriteLocked = false;
         file->Uuid = uuid;
 
-        parent->Children.push_back(file);
+        _addChild(parent, file);
 
         if(uuid != UUID_ZERO)
             mUuidMap.insert(UuidDescMap::value_type(uuid, file));
@@ -1175,6 +1670,7 @@ namespace OFS
         fileHeader.Flags = file->Flags;
         fileHeader.OldParentId = ROOT_DIRECTORY_ID;
         fileHeader.NextBlock = 0;
+        fileHeader.UncompressedSize = 0;
         fileHeader.FileSize = file->FileSize;
         fileHeader.CreationTime = file->CreationTime;
 
@@ -1203,7 +1699,9 @@ namespace OFS
     {
         assert(path != NULL);
 
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -1254,14 +1752,7 @@ namespace OFS
 
                 for( unsigned int i = 0; i < foreignDir->Children.size(); i++ )
                 {
-                    for( unsigned int k = 0; k < dirDesc->Children.size(); k++ )
-                    {
-                        if( dirDesc->Children[k] == foreignDir->Children[i] )
-                        {
-                            dirDesc->Children.erase( dirDesc->Children.begin() + k );
-                            break;
-                        }
-                    }
+                    _removeChild( dirDesc, foreignDir->Children[i] );
                 }
 
                 it++;
@@ -1271,17 +1762,8 @@ namespace OFS
 
             mStream.flush();
 
-            std::sort(mFreeBlocks.begin(), mFreeBlocks.end(), BlockCompare);
-
-            std::string fName = _extractFileName(path);
-            OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
-            for(unsigned int i = 0;i < mTriggers.size();i++)
-            {
-                if(mTriggers[i].type == CLBK_DELETE)
-                {
-                    mTriggers[i].func(mTriggers[i].data, fileDesc, 0);
-                }
-            }
+            /* The directory is gone by the time the notification is delivered, only its path is passed */
+            _fireTriggers(mTriggers, CLBK_DELETE, 0, path);
 
             return ret;
         }
@@ -1320,14 +1802,7 @@ namespace OFS
             }
         }
 
-        for(unsigned int i = 0;i < dir->Parent->Children.size();i++)
-        {
-            if(dir->Parent->Children[i]->Id == dir->Id)
-            {
-                dir->Parent->Children.erase(dir->Parent->Children.begin() + i);
-                break;
-            }
-        }
+        _removeChild(dir->Parent, dir);
 
         _markUnused(dir->UsedBlocks[0]);
 
@@ -1339,6 +1814,8 @@ namespace OFS
                mUuidMap.erase( uit );
         }
 
+        _retargetPendingTriggers(dir, NULL);
+
         delete dir;
 
         return OFS_OK;
@@ -1350,7 +1827,9 @@ namespace OFS
     {
         assert(filename != NULL);
 
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -1381,23 +1860,9 @@ namespace OFS
 
         if(ret == OFS_OK)
         {
-            std::sort(mFreeBlocks.begin(), mFreeBlocks.end(), BlockCompare);
-
-            for(unsigned int i = 0;i < saveTrigs.size();i++)
-            {
-                if(saveTrigs[i].type == CLBK_DELETE)
-                {
-                    saveTrigs[i].func(saveTrigs[i].data, 0, filename);
-                }
-            }
+            _fireTriggers(saveTrigs, CLBK_DELETE, 0, filename);
 
-            for(unsigned int i = 0;i < mTriggers.size();i++)
-            {
-                if(mTriggers[i].type == CLBK_DELETE)
-                {
-                    mTriggers[i].func(mTriggers[i].data, 0, filename);
-                }
-            }
+            _fireTriggers(mTriggers, CLBK_DELETE, 0, filename);
         }
 
         return ret;
@@ -1416,14 +1881,8 @@ namespace OFS
             return OFS_ACCESS_DENIED;
         }
 
-        for(unsigned int i = 0;i < file->Parent->Children.size();i++)
-        {
-            if(file->Parent->Children[i]->Id == file->Id)
-            {
-                file->Parent->Children.erase(file->Parent->Children.begin() + i);
-                break;
-            }
-        }
+        _removeChild(file->Parent, file);
+        _releaseShared(file);
 
         for(unsigned int i = 0;i < file->UsedBlocks.size();i++)
         {
@@ -1438,6 +1897,8 @@ namespace OFS
                mUuidMap.erase( uit );
         }
 
+        _retargetPendingTriggers(file, NULL);
+
         delete file;
 
         return OFS_OK;
@@ -1449,7 +1910,9 @@ namespace OFS
     {
         assert(filename != NULL);
 
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -1483,15 +1946,7 @@ namespace OFS
             {
                 dir = tmp.substr(pos - name_st, filename - pos);
 
-                OfsEntryDesc *tmpDesc = NULL;
-                for(unsigned int i = 0;i < curDesc->Children.size();i++)
-                {
-                    if((curDesc->Children[i]->Flags & OFS_DIR) && curDesc->Children[i]->Name == dir)
-                    {
-                        tmpDesc = curDesc->Children[i];
-                        break;
-                    }
-                }
+                OfsEntryDesc *tmpDesc = _lookupChild(curDesc, dir, OFS_DIR);
 
                 if(tmpDesc == NULL)
                 {
@@ -1519,7 +1974,9 @@ namespace OFS
             if(curDesc->Flags & OFS_LINK)
                 return OFS_ACCESS_DENIED;
 
-            _createDirectory(curDesc, dir, uuid);
+            curDesc = _createDirectory(curDesc, dir, uuid);
+
+            _fireTriggers(mTriggers, CLBK_CREATE, curDesc, 0);
         }
 
         return OFS_OK;
@@ -1531,7 +1988,9 @@ namespace OFS
     {
         assert(filename != NULL);
 
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -1563,28 +2022,16 @@ namespace OFS
         if(_getFileDesc(dirDesc, nName) != NULL || fileDesc->WriteLocked || (fileDesc->Flags & OFS_READONLY))
             return OFS_ACCESS_DENIED;
 
-        fileDesc->Name = nName;
+        _renameChild(fileDesc, nName);
 
         mStream.seek(fileDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Name), OFS_SEEK_BEGIN);
         mStream.write(fileDesc->Name.c_str(), fileDesc->Name.length() + 1);
 
         mStream.flush();
 
-        for(unsigned int i = 0;i < fileDesc->Triggers.size();i++)
-        {
-            if(fileDesc->Triggers[i].type == CLBK_RENAME)
-            {
-                fileDesc->Triggers[i].func(fileDesc->Triggers[i].data, fileDesc, filename);
-            }
-        }
+        _fireTriggers(fileDesc->Triggers, CLBK_RENAME, fileDesc, filename);
 
-        for(unsigned int i = 0;i < mTriggers.size();i++)
-        {
-            if(mTriggers[i].type == CLBK_RENAME)
-            {
-                mTriggers[i].func(mTriggers[i].data, fileDesc, filename);
-            }
-        }
+        _fireTriggers(mTriggers, CLBK_RENAME, fileDesc, filename);
 
         return OFS_OK;
     }
@@ -1595,7 +2042,9 @@ namespace OFS
     {
         assert(dirname != NULL);
 
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -1635,22 +2084,21 @@ namespace OFS
             if(sz > 251)
                 nName.erase(251, sz - 251);
 
-            for(unsigned int i = 0;i < dirDesc->Parent->Children.size();i++)
-            {
-                if(dirDesc->Parent->Children[i]->Name == nName)
-                    return OFS_ACCESS_DENIED;
-            }
+            if(_lookupChild(dirDesc->Parent, nName) != NULL)
+                return OFS_ACCESS_DENIED;
 
             if(dirDesc->WriteLocked || (dirDesc->Flags & OFS_READONLY))
                 return OFS_ACCESS_DENIED;
 
-            dirDesc->Name = nName;
+            _renameChild(dirDesc, nName);
 
             mStream.seek(dirDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Name), OFS_SEEK_BEGIN);
             mStream.write(dirDesc->Name.c_str(), dirDesc->Name.length() + 1);
 
             mStream.flush();
 
+            _fireTriggers(mTriggers, CLBK_RENAME, dirDesc, dirname);
+
             return OFS_OK;
         }
         else
@@ -1661,7 +2109,9 @@ namespace OFS
 
     OfsResult _Ofs::moveDirectory(const char *dirname, const char *dest)
     {
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         OFSHANDLE srcHandle;
         OfsResult ret = OFS_OK;
@@ -1718,7 +2168,9 @@ namespace OFS
     {
         assert(filename != NULL);
 
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_SELECT_AUTO_MUTEX((open_mode & OFS_WRITE) != 0, &mStream)
 
         if(!mActive)
         {
@@ -1741,6 +2193,8 @@ namespace OFS
         }
         else
         {
+            boost::mutex::scoped_lock activeLock(mActiveFilesMutex);
+
             if(fileDesc->WriteLocked)
                 return OFS_ACCESS_DENIED;
 
@@ -1751,6 +2205,10 @@ namespace OFS
 
                 fileDesc->WriteLocked = true;
 
+                /* Appending writes unshare the contents on first write, anything else discards them */
+                if(!(open_mode & OFS_APPEND) && (fileDesc->Flags & OFS_DEDUP))
+                    _unshareFile(fileDesc, false);
+
                 if(!(open_mode & OFS_APPEND))
                 {
                     for(unsigned int i = 1;i < fileDesc->UsedBlocks.size();i++)
@@ -1763,6 +2221,7 @@ namespace OFS
 
                     fileDesc->UsedBlocks[0].NextBlock = 0;
                     fileDesc->FileSize = 0;
+                    fileDesc->UncompressedSize = 0;
 
                     strMainEntryHeader fileHeader;
 
@@ -1771,6 +2230,7 @@ namespace OFS
                     fileHeader.Flags = fileDesc->Flags;
                     fileHeader.OldParentId = ROOT_DIRECTORY_ID;
                     fileHeader.NextBlock = 0;
+                    fileHeader.UncompressedSize = 0;
                     fileHeader.FileSize = 0;
                     fileHeader.CreationTime = fileDesc->CreationTime;
                     int sz = fileDesc->Name.length();
@@ -1784,20 +2244,34 @@ namespace OFS
                     mStream.write((char*)&fileHeader, sizeof(strMainEntryHeader)); 
 
                     mStream.flush();
-
-                    std::sort(mFreeBlocks.begin(), mFreeBlocks.end(), BlockCompare);
                 }
             }
-        } 
 
-        if(fileDesc->UseCount == 0)
-            mActiveFiles.insert(IdHandleMap::value_type(fileDesc->Id, &handle));
+            if(fileDesc->UseCount == 0)
+                mActiveFiles.insert(IdHandleMap::value_type(fileDesc->Id, &handle));
+
+            fileDesc->UseCount++;
+
+            /* Shared contents must stay in place while read through the handle */
+            if(fileDesc->SharedData != NULL)
+                fileDesc->SharedData->UseCount++;
+        } 
 
-        fileDesc->UseCount++;
         handle.mEntryDesc = fileDesc;
+        handle.mDataDesc = fileDesc->SharedData;
         handle.mAccessFlags = open_mode;
         handle._preparePointers((open_mode & OFS_APPEND) != 0);
 
+        if(fileDesc->Flags & OFS_COMPRESSED)
+        {
+            OfsResult ret = _openCompressed(handle);
+            if(ret != OFS_OK)
+            {
+                closeFile(handle);
+                return ret;
+            }
+        }
+
         return OFS_OK;
     }
 
@@ -1805,7 +2279,9 @@ namespace OFS
 
     OfsResult _Ofs::openFile(OFSHANDLE& handle, const UUID& uuid, unsigned int open_mode)
     {
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_SELECT_AUTO_MUTEX((open_mode & OFS_WRITE) != 0, &mStream)
 
         if(!mActive)
         {
@@ -1822,6 +2298,8 @@ namespace OFS
 
         OfsEntryDesc *fileDesc = it->second;
 
+        boost::mutex::scoped_lock activeLock(mActiveFilesMutex);
+
         if(fileDesc->WriteLocked)
             return OFS_ACCESS_DENIED;
 
@@ -1832,6 +2310,9 @@ namespace OFS
 
             fileDesc->WriteLocked = true;
 
+            if(!(open_mode & OFS_APPEND) && (fileDesc->Flags & OFS_DEDUP))
+                _unshareFile(fileDesc, false);
+
             if(!(open_mode & OFS_APPEND))
             {
                 for(unsigned int i = 1;i < fileDesc->UsedBlocks.size();i++)
@@ -1844,6 +2325,7 @@ namespace OFS
 
                 fileDesc->UsedBlocks[0].NextBlock = 0;
                 fileDesc->FileSize = 0;
+                fileDesc->UncompressedSize = 0;
 
                 strMainEntryHeader fileHeader;
 
@@ -1852,6 +2334,7 @@ namespace OFS
                 fileHeader.Flags = fileDesc->Flags;
                 fileHeader.OldParentId = ROOT_DIRECTORY_ID;
                 fileHeader.NextBlock = 0;
+                fileHeader.UncompressedSize = 0;
                 fileHeader.FileSize = 0;
                 fileHeader.CreationTime = fileDesc->CreationTime;
                 int sz = fileDesc->Name.length();
@@ -1865,8 +2348,6 @@ namespace OFS
                 mStream.write((char*)&fileHeader, sizeof(strMainEntryHeader)); 
 
                 mStream.flush();
-
-                std::sort(mFreeBlocks.begin(), mFreeBlocks.end(), BlockCompare);
             }
         }
 
@@ -1874,10 +2355,25 @@ namespace OFS
             mActiveFiles.insert(IdHandleMap::value_type(fileDesc->Id, &handle));
 
         fileDesc->UseCount++;
+
+        if(fileDesc->SharedData != NULL)
+            fileDesc->SharedData->UseCount++;
+
         handle.mEntryDesc = fileDesc;
+        handle.mDataDesc = fileDesc->SharedData;
         handle.mAccessFlags = open_mode;
         handle._preparePointers((open_mode & OFS_APPEND) != 0);
 
+        if(fileDesc->Flags & OFS_COMPRESSED)
+        {
+            OfsResult ret = _openCompressed(handle);
+            if(ret != OFS_OK)
+            {
+                closeFile(handle);
+                return ret;
+            }
+        }
+
         return OFS_OK;
     }
 
@@ -1887,7 +2383,9 @@ namespace OFS
     {
         assert(filename != NULL);
 
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -1921,12 +2419,27 @@ namespace OFS
                 }
             }
 
-            fileDesc = _createFile(dirDesc, fName, file_size, uuid, data_size, data);
+            OfsEntryDesc *shared = NULL;
+
+            /* Contents given in full can be matched right away, without writing them again */
+            if(mDedupMode && data != NULL && (ofs64)data_size == file_size && file_size >= DEDUP_MIN_SIZE)
+            {
+                std::string sharedName = _getSharedName(dedupHash(DEDUP_HASH_SEED, data, data_size), file_size);
+                shared = _findSharedContents(sharedName, NULL, data, file_size);
+            }
+
+            if(shared != NULL)
+                fileDesc = _createSharedFile(dirDesc, fName, uuid, time(NULL), 0, shared);
+            else
+                fileDesc = _createFile(dirDesc, fName, file_size, uuid, data_size, data);
 
             if(fileDesc != NULL)
             {
                 mActiveFiles.insert(IdHandleMap::value_type(fileDesc->Id, &handle));
                 fileDesc->UseCount++;
+
+                if(fileDesc->SharedData != NULL)
+                    fileDesc->SharedData->UseCount++;
             }
         }
         else 
@@ -1950,16 +2463,11 @@ namespace OFS
         fileDesc->WriteLocked = true;
 
         handle.mEntryDesc = fileDesc;
+        handle.mDataDesc = fileDesc->SharedData;
         handle.mAccessFlags = OFS_READWRITE;
         handle._preparePointers(true);
 
-        for(unsigned int i = 0;i < mTriggers.size();i++)
-        {
-            if(mTriggers[i].type == CLBK_CREATE)
-            {
-                mTriggers[i].func(mTriggers[i].data, fileDesc, 0);
-            }
-        }
+        _fireTriggers(mTriggers, CLBK_CREATE, fileDesc, 0);
 
         return OFS_OK;
     }
@@ -1968,7 +2476,9 @@ namespace OFS
 
     OfsResult _Ofs::closeFile(OFSHANDLE& handle)
     {
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_SELECT_AUTO_MUTEX((handle.mAccessFlags & OFS_WRITE) != 0, &mStream)
 
         if(!mActive)
         {
@@ -1985,69 +2495,72 @@ namespace OFS
         if(handle.mEntryDesc->Owner != this)
             return handle.mEntryDesc->Owner->closeFile(handle);
 
-        IdHandleMap::iterator it = mActiveFiles.find(handle.mEntryDesc->Id);
-
-        if(it != mActiveFiles.end())
+        if(handle.mCompressed != NULL)
         {
-            handle.mEntryDesc->UseCount--; 
-            if(handle.mEntryDesc->UseCount == 0)
-            {
-                handle.mEntryDesc->WriteLocked = false;
-                mActiveFiles.erase(it);
-            }
+            if(handle.mAccessFlags & OFS_WRITE)
+                _storeCompressed(handle);
+
+            delete handle.mCompressed;
+            handle.mCompressed = NULL;
         }
 
-        if(handle.mAccessFlags & OFS_WRITE)
         {
-            for(unsigned int i = 0;i < handle.mEntryDesc->Triggers.size();i++)
-            {
-                if(handle.mEntryDesc->Triggers[i].type == CLBK_CONTENT)
-                {
-                    handle.mEntryDesc->Triggers[i].func(handle.mEntryDesc->Triggers[i].data, handle.mEntryDesc, 0);
-                }
-            }
+            boost::mutex::scoped_lock activeLock(mActiveFilesMutex);
 
-            for(unsigned int i = 0;i < mTriggers.size();i++)
+            IdHandleMap::iterator it = mActiveFiles.find(handle.mEntryDesc->Id);
+
+            if(it != mActiveFiles.end())
             {
-                if(mTriggers[i].type == CLBK_CONTENT)
+                handle.mEntryDesc->UseCount--; 
+                if(handle.mEntryDesc->UseCount == 0)
                 {
-                    mTriggers[i].func(mTriggers[i].data, handle.mEntryDesc, 0);
+                    handle.mEntryDesc->WriteLocked = false;
+                    mActiveFiles.erase(it);
                 }
             }
+
+            /* The last reference may have been dropped by a forced write open while this handle was reading */
+            if(handle.mDataDesc != NULL && --handle.mDataDesc->UseCount == 0 && handle.mDataDesc->ShareCount == 0)
+                _freeShared(handle.mDataDesc);
         }
 
-        handle.mEntryDesc = NULL;
-        handle.mAccessFlags = 0;
+        if(handle.mAccessFlags & OFS_WRITE)
+        {
+            OfsEntryDesc *desc = handle.mEntryDesc;
 
-        return OFS_OK;
-    }
+            /* Entries have a single time stamp, it is what getModificationTime reports so writes bring it forward */
+            OTIME mod_time(time(NULL));
 
-//------------------------------------------------------------------------------
+            desc->CreationTime = mod_time;
 
-    OfsResult _Ofs::truncateFile(OFSHANDLE& handle, ofs64 file_size)
-    {
-        LOCK_AUTO_MUTEX
+            mStream.seek(desc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, CreationTime), OFS_SEEK_BEGIN);
+            mStream.write((char*)&mod_time, sizeof(OTIME));
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::closeFile, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+            if(desc->UseCount == 0)
+                _releaseUnusedSpace(desc);
 
-        if(!handle._valid())
-        {
-            OFS_EXCEPT("_Ofs::truncateFile, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
+            mStream.flush();
+
+            /* Written contents are shared once the last handle is gone, the file may get a new entry */
+            if(mDedupMode && desc->UseCount == 0 && _canShare(desc))
+                desc = _dedupFile(desc);
+
+            _fireTriggers(desc->Triggers, CLBK_CONTENT, desc, 0);
+
+            _fireTriggers(mTriggers, CLBK_CONTENT, desc, 0);
         }
 
-        if(!(handle.mAccessFlags & OFS_WRITE) || (handle.mAccessFlags & OFS_LINK))
-            return OFS_ACCESS_DENIED;
+        handle.mEntryDesc = NULL;
+        handle.mDataDesc = NULL;
+        handle.mAccessFlags = 0;
 
-        ofs64 trunc_pos = file_size;
+        return OFS_OK;
+    }
 
-        if(file_size < 0)
-            trunc_pos = handle.mPos;
+//------------------------------------------------------------------------------
 
+    void _Ofs::_truncateRaw(OFSHANDLE& handle, ofs64 trunc_pos)
+    {
         if(trunc_pos < handle.mEntryDesc->FileSize)
         {
             OfsEntryDesc *desc = handle.mEntryDesc;
@@ -2062,8 +2575,6 @@ namespace OFS
             while((handle.mBlock + 1) < desc->UsedBlocks.size())
                 desc->UsedBlocks.erase(desc->UsedBlocks.begin() + (handle.mBlock + 1));
 
-            std::sort(mFreeBlocks.begin(), mFreeBlocks.end(), BlockCompare);
-
             mStream.seek(desc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, FileSize), OFS_SEEK_BEGIN);
             mStream.write((char*)&trunc_pos, sizeof(ofs64)); 
 
@@ -2076,6 +2587,154 @@ namespace OFS
             mStream.write((char*)&trunc_pos, sizeof(ofs64)); 
             mStream.flush();
         }
+    }
+
+//------------------------------------------------------------------------------
+
+    ofs64 _Ofs::_getAllocatedSize(OfsEntryDesc *desc)
+    {
+        ofs64 allocated = desc->UsedBlocks[0].Length - sizeof(strMainEntryHeader);
+
+        for(unsigned int i = 1;i < desc->UsedBlocks.size();i++)
+            allocated += desc->UsedBlocks[i].Length - sizeof(strExtendedEntryHeader);
+
+        return allocated;
+    }
+
+//------------------------------------------------------------------------------
+
+    void _Ofs::_releaseUnusedSpace(OfsEntryDesc *desc)
+    {
+        unsigned int last = desc->UsedBlocks.size() - 1;
+        ofs64 header_size = (last == 0) ? sizeof(strMainEntryHeader) : sizeof(strExtendedEntryHeader);
+        ofs64 last_size = desc->UsedBlocks[last].Length - header_size;
+
+        /* The stored data of an OFS_DEDUP file is only the reference to its shared contents */
+        ofs64 stored_size = (desc->Flags & OFS_DEDUP) ? sizeof(strDedupReference) : desc->FileSize;
+        ofs64 used = stored_size - (_getAllocatedSize(desc) - last_size);
+
+        if(used <= 0 || (last_size - used) < (RELEASE_MIN_SIZE + (ofs64)sizeof(strBlockHeader)))
+            return;
+
+        BlockData& block = desc->UsedBlocks[last];
+
+        BlockData tail;
+        tail.Start = block.Start + header_size + used + sizeof(strBlockHeader);
+        tail.Length = block.Length - header_size - used - sizeof(strBlockHeader);
+        tail.Type = OFS_FREE_BLOCK;
+        tail.NextBlock = 0;
+
+        /* The tail gets its header before the block is shortened, a crash in between only loses the free space */
+        strBlockHeader blHeader;
+        blHeader.Signature[0] = mHeader.BLOCK_HEADER_SIG[0];
+        blHeader.Signature[1] = mHeader.BLOCK_HEADER_SIG[1];
+        blHeader.Type = OFS_FREE_BLOCK;
+        blHeader.Reserved = 0;
+        blHeader.Length = tail.Length;
+
+        mStream.seek(tail.Start - sizeof(strBlockHeader), OFS_SEEK_BEGIN);
+        mStream.write((char*)&blHeader, sizeof(strBlockHeader));
+
+        block.Length = header_size + used;
+
+        mStream.seek(block.Start - sizeof(strBlockHeader) + offsetof(strBlockHeader, Length), OFS_SEEK_BEGIN);
+        mStream.write((char*)&(block.Length), sizeof(ofs64));
+
+        _markUnused(tail);
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::reserve(OFSHANDLE& handle, ofs64 size)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::reserve, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::reserve, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        if(!(handle.mAccessFlags & OFS_WRITE) || (handle.mAccessFlags & OFS_LINK))
+            return OFS_ACCESS_DENIED;
+
+        if(handle.mDataDesc != NULL)
+            _unshareHandle(handle);
+
+        /* Compressed files are written to memory, their blocks are only allocated when the handle is closed */
+        if(handle.mCompressed != NULL)
+        {
+            if(size > 0 && (ofs64)handle.mCompressed->Buffer.capacity() < size)
+                handle.mCompressed->Buffer.reserve((size_t)size);
+
+            return OFS_OK;
+        }
+
+        OfsEntryDesc *desc = handle.mEntryDesc;
+
+        ofs64 allocated = _getAllocatedSize(desc);
+
+        if(allocated < size)
+        {
+            _allocateExtendedFileBlock(desc, sizeof(strExtendedEntryHeader) + (size - allocated));
+
+            /* Block boundaries of the handle's position may have changed */
+            ofs64 pos = handle.mPos;
+            handle.mPos = -1;
+            handle._setPos(pos);
+        }
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::truncateFile(OFSHANDLE& handle, ofs64 file_size)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::closeFile, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::truncateFile, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        if(!(handle.mAccessFlags & OFS_WRITE) || (handle.mAccessFlags & OFS_LINK))
+            return OFS_ACCESS_DENIED;
+
+        if(handle.mDataDesc != NULL)
+            _unshareHandle(handle);
+
+        if(handle.mCompressed != NULL)
+        {
+            CompressedData *data = handle.mCompressed;
+
+            ofs64 trunc_pos = file_size;
+
+            if(file_size < 0)
+                trunc_pos = data->Pos;
+
+            if(trunc_pos < data->Size)
+            {
+                data->Size = trunc_pos;
+                data->Buffer.resize((size_t)trunc_pos);
+                data->Pos = trunc_pos;
+            }
+        }
+        else
+            _truncateRaw(handle, (file_size < 0) ? handle.mPos : file_size);
 
         return OFS_OK;
     }
@@ -2087,7 +2746,7 @@ namespace OFS
         assert(file != NULL);
 
         flags &= (OFS_READONLY | OFS_HIDDEN);
-        file->Flags = (file->Flags & (OFS_FILE | OFS_DIR)) | flags;
+        file->Flags = (file->Flags & (OFS_FILE | OFS_DIR | OFS_COMPRESSED | OFS_DEDUP)) | flags;
 
         mStream.seek(file->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Flags), OFS_SEEK_BEGIN);
         mStream.write((char *)&(file->Flags), sizeof(unsigned int));
@@ -2107,7 +2766,7 @@ namespace OFS
     {
         assert(path != NULL);
 
-        LOCK_AUTO_MUTEX
+        LOCK_SHARED_AUTO_MUTEX
 
         FileList output;
 
@@ -2145,7 +2804,7 @@ namespace OFS
                 entry.name = dirDesc->Children[i]->Name;
                 entry.flags = dirDesc->Children[i]->Flags;
                 entry.uuid = dirDesc->Children[i]->Uuid;
-                entry.file_size = dirDesc->Children[i]->FileSize;
+                entry.file_size = _getContentSize(dirDesc->Children[i]);
                 entry.create_time = dirDesc->Children[i]->CreationTime;
                 entry.modified_time = dirDesc->Children[i]->CreationTime;
 
@@ -2160,7 +2819,7 @@ namespace OFS
 
     FileList _Ofs::listRecycleBinFiles()
     {
-        LOCK_AUTO_MUTEX
+        LOCK_SHARED_AUTO_MUTEX
 
         FileList output;
 
@@ -2178,7 +2837,7 @@ namespace OFS
             entry.name = mRecycleBinRoot.Children[i]->Name;
             entry.flags = mRecycleBinRoot.Children[i]->Flags;
             entry.uuid = mRecycleBinRoot.Children[i]->Uuid;
-            entry.file_size = mRecycleBinRoot.Children[i]->FileSize;
+            entry.file_size = _getContentSize(mRecycleBinRoot.Children[i]);
             entry.create_time = mRecycleBinRoot.Children[i]->CreationTime;
             entry.modified_time = mRecycleBinRoot.Children[i]->CreationTime;
 
@@ -2190,1488 +2849,3676 @@ namespace OFS
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::read(OFSHANDLE& handle, char *dest, unsigned int length, unsigned int *actual_read)
+    ofs64 _Ofs::_getContentSize(OfsEntryDesc *desc)
     {
-        assert(dest != NULL);
+        if(desc->Flags & OFS_COMPRESSED)
+            return desc->UncompressedSize;
 
-        LOCK_AUTO_MUTEX
+        return desc->FileSize;
+    }
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::read, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+//------------------------------------------------------------------------------
 
-        if(!handle._valid())
-        {
-            OFS_EXCEPT("_Ofs::read, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
-        }
+    void _Ofs::_writeUncompressedSize(OfsEntryDesc *desc)
+    {
+        mStream.seek(desc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, UncompressedSize), OFS_SEEK_BEGIN);
+        mStream.write((char*)&(desc->UncompressedSize), sizeof(ofs64));
+    }
 
-        if(handle.mEntryDesc->Owner != this)
-            return handle.mEntryDesc->Owner->read(handle, dest, length, actual_read);
+//------------------------------------------------------------------------------
 
-        if(!(handle.mAccessFlags & OFS_READ))
-            return OFS_ACCESS_DENIED;
+    OfsResult _Ofs::_openCompressed(OFSHANDLE& handle)
+    {
+        CompressedData *data = new CompressedData();
+        data->Pos = 0;
+        data->Size = 0;
+        data->ChunkSize = COMPRESSED_CHUNK_SIZE;
+        data->CachedChunk = -1;
 
-        OfsEntryDesc *desc = handle.mEntryDesc;
+        handle.mCompressed = data;
 
-        if(desc->FileSize < (handle.mPos + length))
-            length = (unsigned int)(desc->FileSize - handle.mPos);
+        OfsResult ret = _readCompressedIndex(handle);
 
-        if(length > 0)
+        if(ret == OFS_OK)
         {
-            ofs64 can_read = handle.mBlockEnd - handle.mRealPos;
-            unsigned int tmp_len = length;
-
-            bool done = false;
-            while(!done && (can_read > 0))
+            if(handle.mAccessFlags & OFS_WRITE)
             {
-                if(can_read >= tmp_len)
-                {
-                    mStream.seek(handle.mRealPos, OFS_SEEK_BEGIN);
-                    mStream.read(dest, tmp_len);
-                    handle._setPos(handle.mPos + tmp_len);
-                    done = true;
-                }
-                else
-                {
-                    mStream.seek(handle.mRealPos, OFS_SEEK_BEGIN);
-                    mStream.read(dest, (unsigned int)can_read);
-                    handle._setPos(handle.mPos + can_read);
-                    tmp_len -= (unsigned int)can_read;
-                    dest += can_read;
+                // Write handles work on whole contents in memory, which are compressed again on close
+                data->Buffer.resize((size_t)data->Size);
 
-                    can_read = handle.mBlockEnd - handle.mRealPos;
-                }
+                for(unsigned int i = 0;(ret == OFS_OK) && (i + 1 < data->ChunkOffsets.size());i++)
+                    ret = _decompressChunk(handle, i, &data->Buffer[0] + ((size_t)i * data->ChunkSize));
+
+                if(handle.mAccessFlags & OFS_APPEND)
+                    data->Pos = data->Size;
             }
+            else
+                data->Buffer.resize(data->ChunkSize);
         }
 
-        if(actual_read != NULL)
-            *actual_read = length;
+        if(ret != OFS_OK)
+        {
+            delete data;
+            handle.mCompressed = NULL;
+        }
 
-        return OFS_OK;
+        return ret;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::write(OFSHANDLE& handle, const char *src, unsigned int length)
+    OfsResult _Ofs::_readCompressedIndex(OFSHANDLE& handle)
     {
-        assert(src != NULL);
+        CompressedData *data = handle.mCompressed;
+        OfsEntryDesc *desc = handle.mEntryDesc;
 
-        LOCK_AUTO_MUTEX
+        data->Size = 0;
+        data->ChunkOffsets.clear();
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::write, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+        // Compressed files which were never written have no stored data at all
+        if(desc->FileSize == 0)
+            return OFS_OK;
 
-        if(!handle._valid())
-        {
-            OFS_EXCEPT("_Ofs::write, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
-        }
+        strCompressedHeader header;
 
-        if(!(handle.mAccessFlags & OFS_WRITE))
-            return OFS_ACCESS_DENIED;
+        handle._setPos(0);
+        if(_readRaw(handle, (char*)&header, sizeof(strCompressedHeader)) != sizeof(strCompressedHeader))
+            return OFS_FILE_CORRUPT;
 
-        OfsEntryDesc *desc = handle.mEntryDesc;
-        if(length > 0)
-        {
-            ofs64 total_alloc = desc->UsedBlocks[0].Length - sizeof(strMainEntryHeader);
-            for(unsigned int i = 1;i < desc->UsedBlocks.size();i++)
-                total_alloc += desc->UsedBlocks[i].Length - sizeof(strExtendedEntryHeader);
+        if(memcmp(header.ID, COMPRESSED_DATA_ID, 4) != 0 || header.ChunkSize == 0)
+            return OFS_FILE_CORRUPT;
 
-            total_alloc -= handle.mPos;
-            unsigned int output_amount = length;
+        ofs64 num_chunks = (header.Size + header.ChunkSize - 1) / header.ChunkSize;
+        ofs64 table_size = ((ofs64)header.NumChunks + 1) * sizeof(ofs64);
 
-            if(total_alloc < length)
-            {
-                unsigned int space_needed = length - (unsigned int)total_alloc;
-                unsigned int alloc_size =  sizeof(strExtendedEntryHeader);
-                
-                if(space_needed < 1024)
-                    alloc_size += 1024;
-                else
-                    alloc_size += space_needed;
+        if(num_chunks != header.NumChunks || ((ofs64)sizeof(strCompressedHeader) + table_size) > desc->FileSize)
+            return OFS_FILE_CORRUPT;
 
-                _allocateExtendedFileBlock(desc, alloc_size, space_needed, (src + total_alloc));
+        data->ChunkSize = header.ChunkSize;
+        data->ChunkOffsets.resize(header.NumChunks + 1);
 
-                output_amount = (unsigned int)total_alloc; 
-            }
+        if(_readRaw(handle, (char*)&data->ChunkOffsets[0], (unsigned int)table_size) != table_size)
+            return OFS_FILE_CORRUPT;
 
-            ofs64 write_pos_save = handle.mPos;
+        if(data->ChunkOffsets[header.NumChunks] > desc->FileSize)
+            return OFS_FILE_CORRUPT;
 
-            ofs64 can_write = handle.mBlockEnd - handle.mRealPos;
+        data->Size = header.Size;
 
-            bool done = false;
-            while(!done)
-            {
-                if(can_write >= output_amount)
-                {
-                    mStream.seek(handle.mRealPos, OFS_SEEK_BEGIN);
-                    mStream.write(src, output_amount);
-                    handle._setPos(handle.mPos + output_amount);
-                    done = true;
-                }
-                else
-                {
-                    mStream.seek(handle.mRealPos, OFS_SEEK_BEGIN);
-                    mStream.write(src, (unsigned int)can_write);
-                    handle._setPos(handle.mPos + can_write);
-                    output_amount -= (unsigned int)can_write;
-                    src += can_write;
+        return OFS_OK;
+    }
 
-                    can_write = handle.mBlockEnd - handle.mRealPos;
-                }
-            }
+//------------------------------------------------------------------------------
 
-            if(write_pos_save + length > desc->FileSize)
-            {
-                desc->FileSize = write_pos_save + length;
-                mStream.seek(desc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, FileSize), OFS_SEEK_BEGIN);
-                mStream.write((char*)&(desc->FileSize), sizeof(ofs64));
-                mStream.flush();
-            }
+    OfsResult _Ofs::_decompressChunk(OFSHANDLE& handle, unsigned int chunk, char *dest)
+    {
+        CompressedData *data = handle.mCompressed;
 
-            handle._setPos(write_pos_save + length);
-        }
+        ofs64 start = data->ChunkOffsets[chunk];
+        ofs64 remaining = data->Size - ((ofs64)chunk * data->ChunkSize);
+
+        if(data->ChunkOffsets[chunk + 1] <= start)
+            return OFS_FILE_CORRUPT;
+
+        unsigned int stored_size = (unsigned int)(data->ChunkOffsets[chunk + 1] - start);
+        uLongf expected = (remaining < data->ChunkSize) ? (uLongf)remaining : (uLongf)data->ChunkSize;
+
+        std::vector<char> stored(stored_size);
+
+        handle._setPos(start);
+        if(_readRaw(handle, &stored[0], stored_size) != stored_size)
+            return OFS_FILE_CORRUPT;
+
+        uLongf actual = expected;
+        if(uncompress((Bytef*)dest, &actual, (const Bytef*)&stored[0], stored_size) != Z_OK || actual != expected)
+            return OFS_FILE_CORRUPT;
 
         return OFS_OK;
     }
 
 //------------------------------------------------------------------------------
 
-    ofs64 _Ofs::seek(OFSHANDLE& handle, ofs64 pos, SeekDirection dir)
+    static bool compressContents(const char *data, ofs64 size, unsigned int chunk_size, std::vector<char>& stored)
     {
-        LOCK_AUTO_MUTEX
+        unsigned int num_chunks = (unsigned int)((size + chunk_size - 1) / chunk_size);
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::seekr, Operation called on an unmounted file system.");
-            return 0;
-        }
+        std::vector<ofs64> offsets(num_chunks + 1);
+        stored.resize(sizeof(_Ofs::strCompressedHeader) + (offsets.size() * sizeof(ofs64)));
 
-        if(!handle._valid())
+        for(unsigned int i = 0;i < num_chunks;i++)
         {
-            OFS_EXCEPT("_Ofs::seekr, Supplied OfsHandle is not valid.");
-            return 0;
+            ofs64 chunk_start = (ofs64)i * chunk_size;
+            uLong length = (uLong)std::min((ofs64)chunk_size, size - chunk_start);
+            uLongf stored_size = compressBound(length);
+
+            offsets[i] = stored.size();
+            stored.resize(stored.size() + stored_size);
+
+            if(compress2((Bytef*)&stored[(size_t)offsets[i]], &stored_size, (const Bytef*)(data + chunk_start), length, Z_DEFAULT_COMPRESSION) != Z_OK)
+                return false;
+
+            stored.resize((size_t)offsets[i] + stored_size);
         }
 
-        switch(dir)
-        {
-        case OFS_SEEK_BEGIN:if(pos < 0) pos = 0;
-                            break;
-        case OFS_SEEK_CURRENT:pos += handle.mPos;
-                              if(pos < 0) pos = 0;
-                              break;
-        case OFS_SEEK_END:pos += handle.mEntryDesc->FileSize;
-                          if(pos < 0) pos = 0;
-                          break;
-        }
+        offsets[num_chunks] = stored.size();
 
-        handle._setPos(pos);
-        return handle.mPos;
+        _Ofs::strCompressedHeader header;
+        memcpy(header.ID, COMPRESSED_DATA_ID, 4);
+        header.ChunkSize = chunk_size;
+        header.NumChunks = num_chunks;
+        header.RESERVED = 0;
+        header.Size = size;
+
+        memcpy(&stored[0], &header, sizeof(_Ofs::strCompressedHeader));
+        memcpy(&stored[sizeof(_Ofs::strCompressedHeader)], &offsets[0], offsets.size() * sizeof(ofs64));
+
+        return true;
     }
 
 //------------------------------------------------------------------------------
 
-    ofs64 _Ofs::tell(OFSHANDLE& handle)
+    OfsResult _Ofs::_storeCompressed(OFSHANDLE& handle)
     {
-        LOCK_AUTO_MUTEX
+        CompressedData *data = handle.mCompressed;
+        OfsEntryDesc *desc = handle.mEntryDesc;
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::tellw, Operation called on an unmounted file system.");
-            return 0;
-        }
+        std::vector<char> stored;
 
-        if(!handle._valid())
-        {
-            OFS_EXCEPT("_Ofs::tellw, Supplied OfsHandle is not valid.");
-            return 0;
-        }
+        if(!compressContents(data->Size > 0 ? &data->Buffer[0] : NULL, data->Size, data->ChunkSize, stored))
+            return OFS_IO_ERROR;
 
-        return handle.mPos;
+        handle._setPos(0);
+        _writeRaw(handle, &stored[0], (unsigned int)stored.size());
+        _truncateRaw(handle, stored.size());
+
+        desc->UncompressedSize = data->Size;
+        _writeUncompressedSize(desc);
+        mStream.flush();
+
+        data->CachedChunk = -1;
+
+        return OFS_OK;
     }
 
 //------------------------------------------------------------------------------
 
-    bool _Ofs::eof(OFSHANDLE& handle)
+    OfsResult _Ofs::_setCompressed(OFSHANDLE& handle, bool compress)
     {
-        LOCK_AUTO_MUTEX
-
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::eof, Operation called on an unmounted file system.");
-            return 0;
-        }
+        OfsEntryDesc *desc = handle.mEntryDesc;
 
-        if(!handle._valid())
+        if(compress)
         {
-            OFS_EXCEPT("_Ofs::eof, Supplied OfsHandle is not valid.");
-            return 0;
-        }
+            if(handle.mCompressed != NULL)
+                return OFS_OK;
 
-        return (handle.mPos >= handle.mEntryDesc->FileSize);
-    }
+            CompressedData *data = new CompressedData();
+            data->Pos = handle.mPos;
+            data->Size = desc->FileSize;
+            data->ChunkSize = COMPRESSED_CHUNK_SIZE;
+            data->CachedChunk = -1;
+            data->Buffer.resize((size_t)data->Size);
 
-//------------------------------------------------------------------------------
+            if(data->Size > 0)
+            {
+                handle._setPos(0);
+                _readRaw(handle, &data->Buffer[0], (unsigned int)data->Size);
+            }
 
-    OfsResult _Ofs::getFileName(OFSHANDLE& handle, std::string& filename)
-    {
-        LOCK_AUTO_MUTEX
+            handle.mCompressed = data;
+            desc->Flags |= OFS_COMPRESSED;
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::getFileName, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
+            return _storeCompressed(handle);
         }
-
-        if(!handle._valid())
+        else
         {
-            OFS_EXCEPT("_Ofs::getFileName, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
-        }
+            if(handle.mCompressed == NULL)
+                return OFS_OK;
 
-        filename = handle.mEntryDesc->Name;
+            CompressedData *data = handle.mCompressed;
+            handle.mCompressed = NULL;
 
-        return OFS_OK;
-    }
+            handle._setPos(0);
+            if(data->Size > 0)
+                _writeRaw(handle, &data->Buffer[0], (unsigned int)data->Size);
+            _truncateRaw(handle, data->Size);
+            handle._setPos(data->Pos);
 
-//------------------------------------------------------------------------------
+            desc->Flags &= ~OFS_COMPRESSED;
+            desc->UncompressedSize = 0;
 
-    OfsResult _Ofs::getDirEntry(const char *path, FileEntry& entry)
-    {
-        LOCK_AUTO_MUTEX
+            delete data;
+            mStream.flush();
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::getDirEntry, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
+            return OFS_OK;
         }
+    }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(path);
+//------------------------------------------------------------------------------
 
-        if(dirDesc != NULL)
-        {
-            entry.id = dirDesc->Id;
-            entry.name = dirDesc->Name;
-            entry.flags = dirDesc->Flags;
-            entry.uuid = dirDesc->Uuid;
-            entry.file_size = dirDesc->FileSize;
-            entry.create_time = dirDesc->CreationTime;
-            entry.modified_time = dirDesc->CreationTime;
-            
-            return OFS_OK;
-        }
+    void _Ofs::_readData(ofs64 pos, char *dest, unsigned int length)
+    {
+        const char *mapped = mStream.view(pos, length);
+
+        if(mapped != NULL)
+            memcpy(dest, mapped, length);
         else
-            return OFS_FILE_NOT_FOUND;
+            mCache.read(mStream, pos, dest, length);
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::getFileEntry(const char *filename, FileEntry& entry)
+    void _Ofs::_readAhead(OFSHANDLE& handle, unsigned int length)
     {
-        LOCK_AUTO_MUTEX
+        /* Only reads continuing from the previous one trigger a read ahead, random access does not */
+        ofs64 end = handle.mPos + length;
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::getFileEntry, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+        if(handle.mPos > handle.mReadAhead || end <= handle.mReadAhead || mStream.isMapped())
+            return;
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+        OfsEntryDesc *desc = handle._dataDesc();
 
-        if(dirDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
+        ofs64 from = handle.mReadAhead;
+        ofs64 to = std::min(desc->FileSize, end + READ_AHEAD_SIZE);
 
-        std::string fName = _extractFileName(filename);
+        handle.mReadAhead = to;
 
-        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+        ofs64 block_pos = 0;
 
-        if(fileDesc != NULL)
+        for(unsigned int i = 0;i < desc->UsedBlocks.size() && block_pos < to;i++)
         {
-            entry.id = fileDesc->Id;
-            entry.name = fileDesc->Name;
-            entry.flags = fileDesc->Flags;
-            entry.uuid = fileDesc->Uuid;
-            entry.file_size = fileDesc->FileSize;
-            entry.create_time = fileDesc->CreationTime;
-            entry.modified_time = fileDesc->CreationTime;
-            
-            return OFS_OK;
+            ofs64 header_size = (i == 0) ? sizeof(strMainEntryHeader) : sizeof(strExtendedEntryHeader);
+            ofs64 block_size = desc->UsedBlocks[i].Length - header_size;
+
+            ofs64 start = std::max(from, block_pos);
+            ofs64 stop = std::min(to, block_pos + block_size);
+
+            if(start < stop)
+                mCache.prefetch(mStream, desc->UsedBlocks[i].Start + header_size + (start - block_pos), stop - start);
+
+            block_pos += block_size;
         }
-        else
-            return OFS_FILE_NOT_FOUND;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::getFileEntry(OFSHANDLE& handle, FileEntry& entry)
+    unsigned int _Ofs::_readRaw(OFSHANDLE& handle, char *dest, unsigned int length)
     {
-        LOCK_AUTO_MUTEX
+        OfsEntryDesc *desc = handle._dataDesc();
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::getFileEntry, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+        if(desc->FileSize < (handle.mPos + length))
+            length = (unsigned int)(desc->FileSize - handle.mPos);
 
-        if(!handle._valid())
+        if(length > 0)
         {
-            OFS_EXCEPT("_Ofs::getFileEntry, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
-        }
+            _readAhead(handle, length);
 
-        entry.id = handle.mEntryDesc->Id;
-        entry.name = handle.mEntryDesc->Name;
-        entry.flags = handle.mEntryDesc->Flags;
-        entry.uuid = handle.mEntryDesc->Uuid;
-        entry.file_size = handle.mEntryDesc->FileSize;
-        entry.create_time = handle.mEntryDesc->CreationTime;
-        entry.modified_time = handle.mEntryDesc->CreationTime;
+            ofs64 can_read = handle.mBlockEnd - handle.mRealPos;
+            unsigned int tmp_len = length;
 
-        return OFS_OK;
+            bool done = false;
+            while(!done && (can_read > 0))
+            {
+                if(can_read >= tmp_len)
+                {
+                    _readData(handle.mRealPos, dest, tmp_len);
+                    handle._setPos(handle.mPos + tmp_len);
+                    done = true;
+                }
+                else
+                {
+                    _readData(handle.mRealPos, dest, (unsigned int)can_read);
+                    handle._setPos(handle.mPos + can_read);
+                    tmp_len -= (unsigned int)can_read;
+                    dest += can_read;
+
+                    can_read = handle.mBlockEnd - handle.mRealPos;
+                }
+            }
+        }
+
+        return length;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::getCreationTime(const char *filename, time_t& creation_time)
+    OfsResult _Ofs::read(OFSHANDLE& handle, char *dest, unsigned int length, unsigned int *actual_read)
     {
-        LOCK_AUTO_MUTEX
+        assert(dest != NULL);
+
+        LOCK_SHARED_AUTO_MUTEX
 
         if(!mActive)
         {
-            OFS_EXCEPT("_Ofs::getCreationTime, Operation called on an unmounted file system.");
+            OFS_EXCEPT("_Ofs::read, Operation called on an unmounted file system.");
             return OFS_IO_ERROR;
         }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
-
-        if(dirDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::read, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
 
-        std::string fName = _extractFileName(filename);
+        if(handle.mEntryDesc->Owner != this)
+            return handle.mEntryDesc->Owner->read(handle, dest, length, actual_read);
 
-        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+        if(!(handle.mAccessFlags & OFS_READ))
+            return OFS_ACCESS_DENIED;
 
-        if(fileDesc != NULL)
+        if(handle.mCompressed != NULL)
         {
-            creation_time = fileDesc->CreationTime;
-            return OFS_OK;
-        }
-        else
-            return OFS_FILE_NOT_FOUND;
-    }
+            CompressedData *data = handle.mCompressed;
 
-//------------------------------------------------------------------------------
+            if(data->Size < (data->Pos + length))
+                length = (unsigned int)(data->Size - data->Pos);
 
-    OfsResult _Ofs::getModificationTime(const char *filename, time_t& mod_time)
-    {
-        LOCK_AUTO_MUTEX
+            unsigned int done = 0;
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::getModificationTime, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+            if(handle.mAccessFlags & OFS_WRITE)
+            {
+                if(length > 0)
+                    memcpy(dest, &data->Buffer[(size_t)data->Pos], length);
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+                done = length;
+                data->Pos += length;
+            }
 
-        if(dirDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
+            while(done < length)
+            {
+                unsigned int chunk = (unsigned int)(data->Pos / data->ChunkSize);
 
-        std::string fName = _extractFileName(filename);
+                if((int)chunk != data->CachedChunk)
+                {
+                    data->CachedChunk = -1;
 
-        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+                    OfsResult ret = _decompressChunk(handle, chunk, &data->Buffer[0]);
+                    if(ret != OFS_OK)
+                    {
+                        if(actual_read != NULL)
+                            *actual_read = done;
 
-        if(fileDesc != NULL)
-        {
-            mod_time = fileDesc->CreationTime;
-            return OFS_OK;
+                        return ret;
+                    }
+
+                    data->CachedChunk = chunk;
+                }
+
+                unsigned int offset = (unsigned int)(data->Pos - ((ofs64)chunk * data->ChunkSize));
+                unsigned int amount = std::min(data->ChunkSize - offset, length - done);
+
+                memcpy(dest + done, &data->Buffer[offset], amount);
+                done += amount;
+                data->Pos += amount;
+            }
         }
         else
-            return OFS_FILE_NOT_FOUND;
+            length = _readRaw(handle, dest, length);
+
+        if(actual_read != NULL)
+            *actual_read = length;
+
+        return OFS_OK;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::getFileSize(const char *filename, ofs64& size)
+    OfsResult _Ofs::_readFileThroughHandle(ReadRequest& request)
     {
-        LOCK_AUTO_MUTEX
+        OFSHANDLE handle;
 
-        if(!mActive)
+        OfsResult ret;
+        if(request.Uuid != UUID_ZERO)
+            ret = openFile(handle, request.Uuid, OFS_READ);
+        else
+            ret = openFile(handle, request.Name.c_str(), OFS_READ);
+
+        if(ret != OFS_OK)
+            return ret;
+
+        getFileSize(handle, request.FileSize);
+
+        if(request.Buffer != NULL)
         {
-            OFS_EXCEPT("_Ofs::getFileSize, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
+            unsigned int length = (unsigned int)std::min(request.FileSize, (ofs64)request.BufferSize);
+            ret = read(handle, request.Buffer, length, &request.BytesRead);
         }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+        closeFile(handle);
 
-        if(dirDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
+        return ret;
+    }
 
-        std::string fName = _extractFileName(filename);
+//------------------------------------------------------------------------------
 
-        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+    struct ReadSegment
+    {
+        ofs64        Pos;
+        char        *Dest;
+        unsigned int Length;
 
-        if(fileDesc != NULL)
+        bool operator<(const ReadSegment& other) const
         {
-            size = fileDesc->FileSize;
-            return OFS_OK;
+            return Pos < other.Pos;
         }
-        else
-            return OFS_FILE_NOT_FOUND;
-    }
+    };
 
-//------------------------------------------------------------------------------
-
-    OfsResult _Ofs::setFileFlags(const char *filename, unsigned int flags)
+    OfsResult _Ofs::readFiles(ReadRequestList& requests)
     {
-        LOCK_AUTO_MUTEX
+        TriggerBatch batch(this);
+
+        LOCK_SHARED_AUTO_MUTEX
 
         if(!mActive)
         {
-            OFS_EXCEPT("_Ofs::setFileFlags, Operation called on an unmounted file system.");
+            OFS_EXCEPT("_Ofs::readFiles, Operation called on an unmounted file system.");
             return OFS_IO_ERROR;
         }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+        OfsResult result = OFS_OK;
+        std::vector<ReadSegment> segments;
 
-        if(dirDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
+        for(unsigned int i = 0;i < requests.size();i++)
+        {
+            ReadRequest& request = requests[i];
 
-        std::string fName = _extractFileName(filename);
+            request.BytesRead = 0;
+            request.FileSize = 0;
 
-        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+            OfsEntryDesc *fileDesc = NULL;
 
-        if(fileDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
-        else if( fileDesc->Flags & OFS_LINK )
-            return OFS_ACCESS_DENIED;
-        else
-        {
-            if(fileDesc->WriteLocked)
-                return OFS_ACCESS_DENIED;
+            if(request.Uuid != UUID_ZERO)
+            {
+                UuidDescMap::const_iterator it = mUuidMap.find(request.Uuid);
+                if(it != mUuidMap.end())
+                    fileDesc = it->second;
+            }
+            else
+            {
+                OfsEntryDesc *dirDesc = _getDirectoryDesc(request.Name.c_str());
+                if(dirDesc != NULL)
+                    fileDesc = _getFileDesc(dirDesc, _extractFileName(request.Name.c_str()));
+            }
 
-            _setFileFlags(fileDesc, flags);
-            mStream.flush();
-            return OFS_OK;
-        }
-    }
+            if(fileDesc == NULL || !(fileDesc->Flags & OFS_FILE))
+                request.Result = OFS_FILE_NOT_FOUND;
+            else if((fileDesc->Owner != this) || (fileDesc->Flags & OFS_COMPRESSED))
+                request.Result = _readFileThroughHandle(request);
+            else
+            {
+                boost::mutex::scoped_lock activeLock(mActiveFilesMutex);
 
-//------------------------------------------------------------------------------
+                if(fileDesc->WriteLocked)
+                    request.Result = OFS_ACCESS_DENIED;
+                else
+                {
+                    /* Contents of an OFS_DEDUP file are read from the shared entry */
+                    if(fileDesc->SharedData != NULL)
+                        fileDesc = fileDesc->SharedData;
 
-    OfsResult _Ofs::setFileFlags(OFSHANDLE& handle, unsigned int flags)
-    {
-        LOCK_AUTO_MUTEX
+                    request.Result = OFS_OK;
+                    request.FileSize = fileDesc->FileSize;
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::setFileFlags, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+                    if(request.Buffer != NULL)
+                    {
+                        unsigned int remaining = (unsigned int)std::min(fileDesc->FileSize, (ofs64)request.BufferSize);
+                        char *dest = request.Buffer;
 
-        if(!handle._valid())
-        {
-            OFS_EXCEPT("_Ofs::setFileFlags, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
+                        request.BytesRead = remaining;
+
+                        for(unsigned int b = 0;(b < fileDesc->UsedBlocks.size()) && (remaining > 0);b++)
+                        {
+                            const BlockData& block = fileDesc->UsedBlocks[b];
+                            unsigned int header = (b == 0) ? sizeof(strMainEntryHeader) : sizeof(strExtendedEntryHeader);
+
+                            ReadSegment segment;
+                            segment.Pos = block.Start + header;
+                            segment.Dest = dest;
+                            segment.Length = (unsigned int)std::min((ofs64)remaining, block.Length - header);
+
+                            if(segment.Length > 0)
+                                segments.push_back(segment);
+
+                            dest += segment.Length;
+                            remaining -= segment.Length;
+                        }
+                    }
+                }
+            }
+
+            if(result == OFS_OK && request.Result != OFS_OK)
+                result = request.Result;
         }
 
-        if( handle.mEntryDesc->Flags & OFS_LINK )
-            return OFS_ACCESS_DENIED;
+        /* Issue all reads in ascending disk order so the device sees one forward sweep */
+        std::sort(segments.begin(), segments.end());
 
-        _setFileFlags(handle.mEntryDesc, flags);
-        mStream.flush();
+        for(unsigned int i = 0;i < segments.size();i++)
+            _readData(segments[i].Pos, segments[i].Dest, segments[i].Length);
 
-        return OFS_OK;
+        return result;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::getFileFlags(const char *filename, unsigned int& flags)
+    /* State shared by importFiles and its reading threads */
+    struct ImportQueue
     {
-        LOCK_AUTO_MUTEX
-
-        if(!mActive)
+        boost::mutex                     Mutex;
+        boost::condition_variable        ItemReady;     /* Signalled when an item is added to Ready */
+        boost::condition_variable        SpaceFree;     /* Signalled when buffered contents are released */
+        const ImportRequestList         *Requests;
+        std::vector<unsigned int>        Files;         /* Indices of requests importing a host file */
+        unsigned int                     NextFile;      /* Next entry of Files to be read */
+        std::deque<_Ofs::ImportItem*>    Ready;         /* Items read and waiting to be stored */
+        ofs64                            Buffered;      /* Size of host files held by items in memory */
+        bool                             Hash;          /* Are contents hashed for deduplication? */
+        bool                             Abort;
+    };
+
+    /* Reading thread of importFiles, reads, compresses and hashes host files until none are left */
+    static void importReader(ImportQueue *queue)
+    {
+        for(;;)
         {
-            OFS_EXCEPT("_Ofs::getFileFlags, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+            unsigned int index;
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+            {
+                boost::mutex::scoped_lock lock(queue->Mutex);
 
-        if(dirDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
+                if(queue->Abort || queue->NextFile >= queue->Files.size())
+                    return;
 
-        std::string fName = _extractFileName(filename);
+                index = queue->Files[queue->NextFile++];
+            }
 
-        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+            const ImportRequest& request = (*queue->Requests)[index];
 
-        if(fileDesc != NULL)
-        {
-            flags = fileDesc->Flags;
+            _Ofs::ImportItem *item = new _Ofs::ImportItem();
+            item->Index = index;
+            item->Size = 0;
+            item->Hash = 0;
+            item->Hashed = false;
+            item->Streamed = false;
+            item->Result = OFS_OK;
 
-            return OFS_OK;
+            std::ifstream stream(request.SourcePath.c_str(), std::fstream::in | std::fstream::binary);
+
+            if(!stream.is_open())
+                item->Result = OFS_FILE_NOT_FOUND;
+            else
+            {
+                stream.seekg(0, std::fstream::end);
+                std::streamoff size = stream.tellg();
+                stream.seekg(0, std::fstream::beg);
+
+                /* Directories and unreadable files open but report no usable size, only their request fails */
+                if(size < 0 || stream.fail() || OfsDirectoryExists(request.SourcePath.c_str()))
+                    item->Result = OFS_IO_ERROR;
+                else
+                {
+                    item->Size = (ofs64)size;
+
+                    if(item->Size > TRANSFER_MAX_BUFFERED && !(request.Flags & OFS_COMPRESSED))
+                        item->Streamed = true;
+                    else
+                    {
+                        {
+                            /* A single file larger than the budget is still let through when nothing else is held */
+                            boost::mutex::scoped_lock lock(queue->Mutex);
+
+                            while(!queue->Abort && queue->Buffered > 0 && queue->Buffered + item->Size > TRANSFER_MEMORY_BUDGET)
+                                queue->SpaceFree.wait(lock);
+
+                            queue->Buffered += item->Size;
+                        }
+
+                        item->Data.resize((size_t)item->Size);
+
+                        if(item->Size > 0 && !stream.read(&item->Data[0], (std::streamsize)item->Size))
+                            item->Result = OFS_IO_ERROR;
+                        else if(request.Flags & OFS_COMPRESSED)
+                        {
+                            std::vector<char> stored;
+
+                            if(compressContents(item->Size > 0 ? &item->Data[0] : NULL, item->Size, COMPRESSED_CHUNK_SIZE, stored))
+                                item->Data.swap(stored);
+                            else
+                                item->Result = OFS_IO_ERROR;
+                        }
+                        else if(queue->Hash && item->Size >= DEDUP_MIN_SIZE)
+                        {
+                            item->Hash = dedupHash(DEDUP_HASH_SEED, &item->Data[0], (unsigned int)item->Size);
+                            item->Hashed = true;
+                        }
+                    }
+                }
+            }
+
+            boost::mutex::scoped_lock lock(queue->Mutex);
+
+            queue->Ready.push_back(item);
+            queue->ItemReady.notify_one();
         }
-        else
-            return OFS_FILE_NOT_FOUND;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::getFileFlags(OFSHANDLE& handle, unsigned int& flags)
+    OfsResult _Ofs::importFiles(ImportRequestList& requests, unsigned int num_threads, ImportCallBackFunction callback, void *userData)
     {
-        LOCK_AUTO_MUTEX
+        ImportQueue queue;
+        queue.Requests = &requests;
+        queue.NextFile = 0;
+        queue.Buffered = 0;
+        queue.Abort = false;
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::getFileFlags, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+        OfsResult result = OFS_OK;
 
-        if(!handle._valid())
         {
-            OFS_EXCEPT("_Ofs::getFileFlags, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
-        }
+            TriggerBatch batch(this);
 
-        flags = handle.mEntryDesc->Flags;
+            LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
-        return OFS_OK;
-    }
+            if(!mActive)
+            {
+                OFS_EXCEPT("_Ofs::importFiles, Operation called on an unmounted file system.");
+                return OFS_IO_ERROR;
+            }
 
-//------------------------------------------------------------------------------
+            queue.Hash = mDedupMode;
 
-    OfsResult _Ofs::setFileUUID(const char *filename, const UUID& uuid)
-    {
-        LOCK_AUTO_MUTEX
+            /* Directories are made up front, files are stored in whatever order they are read */
+            for(unsigned int i = 0;i < requests.size();i++)
+            {
+                if(!requests[i].SourcePath.empty())
+                {
+                    queue.Files.push_back(i);
+                    continue;
+                }
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::setFileUUID, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
+                requests[i].FileSize = 0;
+                requests[i].Result = createDirectory(requests[i].Name.c_str(), true);
+
+                if(result == OFS_OK && requests[i].Result != OFS_OK)
+                    result = requests[i].Result;
+
+                if(callback != NULL)
+                    callback(userData, requests[i]);
+            }
         }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+        if(queue.Files.empty())
+            return result;
 
-        if(dirDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
+        if(num_threads == 0)
+            num_threads = std::max(boost::thread::hardware_concurrency(), 1U);
 
-        std::string fName = _extractFileName(filename);
+        num_threads = std::min(num_threads, (unsigned int)queue.Files.size());
 
-        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+        boost::thread_group readers;
 
-        if(fileDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
-        else if( fileDesc->Flags & OFS_LINK )
-            return OFS_ACCESS_DENIED;
-        else
+        for(unsigned int i = 0;i < num_threads;i++)
+            readers.add_thread(new boost::thread(&importReader, &queue));
+
+        unsigned int remaining = queue.Files.size();
+
+        try
         {
-            if(fileDesc->Uuid != uuid)
+            while(remaining > 0)
             {
-                if(fileDesc->WriteLocked)
-                    return OFS_ACCESS_DENIED;
+                std::deque<ImportItem*> batch;
 
-                if(fileDesc->Uuid != UUID_ZERO)
                 {
-                    UuidDescMap::iterator it = mUuidMap.find(fileDesc->Uuid);
+                    boost::mutex::scoped_lock lock(queue.Mutex);
 
-                    assert(it != mUuidMap.end());
+                    while(queue.Ready.empty())
+                        queue.ItemReady.wait(lock);
 
-                    mUuidMap.erase(it);
+                    batch.swap(queue.Ready);
                 }
 
-                if(uuid != UUID_ZERO)
-                    mUuidMap.insert(UuidDescMap::value_type(uuid, fileDesc));
+                /* Everything read so far is stored under a single lock, the file system stays available in between */
+                {
+                    LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
-                fileDesc->Uuid = uuid;
-                mStream.seek(fileDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Uuid), OFS_SEEK_BEGIN);
-                mStream.write((char*)&(fileDesc->Uuid), sizeof(UUID));
-                mStream.flush();
-            }
-            
-            return OFS_OK;
-        }
-    }
+                    for(unsigned int i = 0;i < batch.size();i++)
+                    {
+                        if(batch[i]->Result == OFS_OK && !batch[i]->Streamed)
+                            batch[i]->Result = _storeImported(requests[batch[i]->Index], *batch[i]);
+                    }
+                }
 
-//------------------------------------------------------------------------------
+                while(!batch.empty())
+                {
+                    ImportItem *item = batch.front();
+                    batch.pop_front();
 
-    OfsResult _Ofs::setFileUUID(OFSHANDLE& handle, const UUID& uuid)
-    {
-        LOCK_AUTO_MUTEX
+                    if(item->Result == OFS_OK && item->Streamed)
+                        item->Result = _storeImportedStreamed(requests[item->Index], *item);
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::setFileUUID, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+                    ImportRequest& request = requests[item->Index];
+                    request.FileSize = item->Size;
+                    request.Result = item->Result;
 
-        if(!handle._valid())
-        {
-            OFS_EXCEPT("_Ofs::setFileUUID, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
-        }
+                    if(!item->Streamed)
+                    {
+                        boost::mutex::scoped_lock lock(queue.Mutex);
 
-        if( handle.mEntryDesc->Flags & OFS_LINK )
-            return OFS_ACCESS_DENIED;
+                        queue.Buffered -= item->Size;
+                        queue.SpaceFree.notify_all();
+                    }
 
-        if(handle.mEntryDesc->Uuid != uuid)
+                    delete item;
+                    --remaining;
+
+                    if(result == OFS_OK && request.Result != OFS_OK)
+                        result = request.Result;
+
+                    if(callback != NULL)
+                        callback(userData, request);
+                }
+            }
+        }
+        catch(...)
         {
-            if(handle.mEntryDesc->Uuid != UUID_ZERO)
             {
-                UuidDescMap::iterator it = mUuidMap.find(handle.mEntryDesc->Uuid);
-
-                assert(it != mUuidMap.end());
+                boost::mutex::scoped_lock lock(queue.Mutex);
 
-                mUuidMap.erase(it);
+                queue.Abort = true;
+                queue.SpaceFree.notify_all();
             }
 
-            if(uuid != UUID_ZERO)
-                mUuidMap.insert(UuidDescMap::value_type(uuid, handle.mEntryDesc));
+            readers.join_all();
 
-            handle.mEntryDesc->Uuid = uuid;
-            mStream.seek(handle.mEntryDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Uuid), OFS_SEEK_BEGIN);
-            mStream.write((char*)&(handle.mEntryDesc->Uuid), sizeof(UUID));
-            mStream.flush();
+            for(unsigned int i = 0;i < queue.Ready.size();i++)
+                delete queue.Ready[i];
+
+            throw;
         }
 
-        return OFS_OK;
+        readers.join_all();
+
+        return result;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::getFileUUID(const char *filename, UUID& uuid)
+    void _Ofs::_createImportPath(const std::string& name)
     {
-        LOCK_AUTO_MUTEX
+        std::string::size_type pos = name.find_last_of('/');
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::getFileUUID, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+        if(pos != std::string::npos && pos > 0 && _getDirectoryDesc(name.c_str()) == NULL)
+            createDirectory(name.substr(0, pos + 1).c_str(), true);
+    }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::_storeImported(const ImportRequest& request, ImportItem& item)
+    {
+        _createImportPath(request.Name);
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(request.Name.c_str());
 
         if(dirDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
+            return OFS_INVALID_PATH;
 
-        std::string fName = _extractFileName(filename);
+        if(dirDesc->Flags & OFS_LINK)
+            return OFS_ACCESS_DENIED;
+
+        std::string fName = _extractFileName(request.Name.c_str());
 
+        if(fName.empty())
+            return OFS_INVALID_PATH;
+
+        /* An existing file is replaced, keeping its UUID as overwriting it would */
+        UUID uuid = UUID_ZERO;
         OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
 
         if(fileDesc != NULL)
         {
             uuid = fileDesc->Uuid;
 
-            return OFS_OK;
+            OfsResult ret = _deleteFile(fileDesc);
+            if(ret != OFS_OK)
+                return ret;
         }
-        else
-            return OFS_FILE_NOT_FOUND;
-    }
-
-//------------------------------------------------------------------------------
+        else if(_findChild(dirDesc, fName) != NULL)
+            return OFS_ACCESS_DENIED;
 
-    OfsResult _Ofs::getFileUUID(OFSHANDLE& handle, UUID& uuid)
-    {
-        LOCK_AUTO_MUTEX
+        ofs64 stored_size = item.Data.size();
+        const char *data = (stored_size > 0) ? &item.Data[0] : NULL;
 
-        if(!mActive)
+        if(item.Hashed)
         {
-            OFS_EXCEPT("_Ofs::getFileUUID, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+            std::string sharedName = _getSharedName(item.Hash, stored_size);
+            OfsEntryDesc *shared = _findSharedContents(sharedName, NULL, data, stored_size);
 
-        if(!handle._valid())
+            if(shared == NULL)
+                shared = _createFile(&mDedupRoot, sharedName, stored_size, UUID_ZERO, (unsigned int)stored_size, data);
+
+            fileDesc = _createSharedFile(dirDesc, fName, uuid, time(NULL), 0, shared);
+        }
+        else
         {
-            OFS_EXCEPT("_Ofs::getFileUUID, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
+            fileDesc = _createFile(dirDesc, fName, stored_size, uuid, (unsigned int)stored_size, data);
+
+            if(request.Flags & OFS_COMPRESSED)
+            {
+                fileDesc->Flags |= OFS_COMPRESSED;
+                fileDesc->UncompressedSize = item.Size;
+
+                mStream.seek(fileDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Flags), OFS_SEEK_BEGIN);
+                mStream.write((char*)&(fileDesc->Flags), sizeof(unsigned int));
+                _writeUncompressedSize(fileDesc);
+                mStream.flush();
+            }
         }
 
-        uuid = handle.mEntryDesc->Uuid;
+        _fireTriggers(mTriggers, CLBK_CREATE, fileDesc, 0);
+        _fireTriggers(mTriggers, CLBK_CONTENT, fileDesc, 0);
 
         return OFS_OK;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::setDirUUID(const char *dirpath, const UUID& uuid)
+    OfsResult _Ofs::_storeImportedStreamed(const ImportRequest& request, ImportItem& item)
     {
-        LOCK_AUTO_MUTEX
+        std::ifstream stream(request.SourcePath.c_str(), std::fstream::in | std::fstream::binary);
+
+        if(!stream.is_open())
+            return OFS_FILE_NOT_FOUND;
 
-        if(!mActive)
         {
-            OFS_EXCEPT("_Ofs::setDirUUID, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
+            LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+            _createImportPath(request.Name);
         }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(dirpath);
+        /* The whole file is allocated at once, so it ends up in a single block */
+        OFSHANDLE handle;
+        OfsResult ret = createFile(handle, request.Name.c_str(), item.Size);
 
-        if(dirDesc == NULL)
-            return OFS_INVALID_PATH;
-        else if( dirDesc->Flags & OFS_LINK )
-            return OFS_ACCESS_DENIED;
-        else
-        {
-            if(dirDesc->Uuid != uuid)
-            {
-                if(dirDesc->Uuid != UUID_ZERO)
-                {
-                    UuidDescMap::iterator it = mUuidMap.find(dirDesc->Uuid);
+        if(ret != OFS_OK)
+            return ret;
 
-                    assert(it != mUuidMap.end());
+        seek(handle, 0, OFS_SEEK_BEGIN);
 
-                    mUuidMap.erase(it);
-                }
+        std::vector<char> buffer(TRANSFER_CHUNK_SIZE);
+        ofs64 remaining = item.Size;
 
-                if(uuid != UUID_ZERO)
-                    mUuidMap.insert(UuidDescMap::value_type(uuid, dirDesc));
+        while(ret == OFS_OK && remaining > 0)
+        {
+            unsigned int length = (unsigned int)std::min(remaining, (ofs64)TRANSFER_CHUNK_SIZE);
 
-                dirDesc->Uuid = uuid;
-                mStream.seek(dirDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Uuid), OFS_SEEK_BEGIN);
-                mStream.write((char*)&(dirDesc->Uuid), sizeof(UUID));
-                mStream.flush();
-            }
-            
-            return OFS_OK;
+            if(!stream.read(&buffer[0], length))
+                ret = OFS_IO_ERROR;
+            else
+                ret = write(handle, &buffer[0], length);
+
+            remaining -= length;
         }
+
+        closeFile(handle);
+
+        return ret;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::getDirUUID(const char *dirpath, UUID& uuid)
+    /* File of an extractFiles request, read by the calling thread and written by a writing thread */
+    struct ExtractItem
     {
-        LOCK_AUTO_MUTEX
+        unsigned int      Index;      /* Index of the request */
+        ofs64             Position;   /* Where the contents start in the file system, reads are made in this order */
+        ofs64             Size;
+        time_t            Time;       /* Modification time given to the host file */
+        bool              Streamed;   /* Too large to hold whole, the writing thread copies it in chunks */
+        std::vector<char> Data;
+        OfsResult         Result;
+    };
+
+    static bool compareExtractItems(const ExtractItem *a, const ExtractItem *b)
+    {
+        return a->Position < b->Position;
+    }
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::getDirUUID, Operation called on an unmounted file system.");
+    /* State shared by extractFiles and its writing threads */
+    struct ExtractQueue
+    {
+        boost::mutex                     Mutex;
+        boost::condition_variable        ItemReady;     /* Signalled when an item is added to Pending or reading is over */
+        boost::condition_variable        ItemDone;      /* Signalled when an item is added to Done */
+        _OfsBase                        *Owner;
+        const ExtractRequestList        *Requests;
+        std::deque<ExtractItem*>         Pending;       /* Items read and waiting to be written */
+        std::deque<ExtractItem*>         Done;          /* Items written and waiting to be reported */
+        ofs64                            Buffered;      /* Size of contents held by items in memory */
+        bool                             Finished;      /* No more items will be added to Pending */
+    };
+
+    static OfsResult writeExtracted(_OfsBase *owner, const ExtractRequest& request, ExtractItem& item)
+    {
+        std::string::size_type pos = request.DestPath.find_last_of("/\\");
+
+        if(pos != std::string::npos && pos > 0)
+            OfsCreateDirectories(request.DestPath.substr(0, pos).c_str());
+
+        std::ofstream stream(request.DestPath.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+
+        if(!stream.is_open())
             return OFS_IO_ERROR;
-        }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(dirpath);
+        OfsResult ret = OFS_OK;
 
-        if(dirDesc == NULL)
-            return OFS_INVALID_PATH;
-        else
+        if(!item.Streamed)
         {
-            uuid = dirDesc->Uuid;
+            if(!item.Data.empty())
+                stream.write(&item.Data[0], item.Data.size());
 
-            return OFS_OK;
+            std::vector<char>().swap(item.Data);
         }
-    }
+        else
+        {
+            OFSHANDLE handle;
 
-//------------------------------------------------------------------------------
+            try
+            {
+                ret = owner->openFile(handle, request.Name.c_str(), OFS_READ);
 
-    OfsResult _Ofs::setDirFlags(const char *dirpath, unsigned int flags)
-    {
-        LOCK_AUTO_MUTEX
+                if(ret == OFS_OK)
+                {
+                    std::vector<char> buffer(TRANSFER_CHUNK_SIZE);
+                    unsigned int length = 0;
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::setDirFlags, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
+                    while((ret = owner->read(handle, &buffer[0], TRANSFER_CHUNK_SIZE, &length)) == OFS_OK && length > 0)
+                        stream.write(&buffer[0], length);
+
+                    owner->closeFile(handle);
+                }
+            }
+            catch(Exception&)
+            {
+                ret = OFS_IO_ERROR;
+            }
         }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(dirpath);
+        stream.close();
 
-        if(dirDesc == NULL)
-            return OFS_INVALID_PATH;
-        else if( dirDesc->Flags & OFS_LINK )
-            return OFS_ACCESS_DENIED;
-        else
-        {
-            _setFileFlags(dirDesc, flags);
-            mStream.flush();
+        if(ret == OFS_OK && stream.fail())
+            ret = OFS_IO_ERROR;
 
-            return OFS_OK;
-        }
-    }
+        /* Matching times let the next extraction skip this file */
+        if(ret == OFS_OK)
+            OfsSetModificationTime(request.DestPath.c_str(), item.Time);
 
-//------------------------------------------------------------------------------
+        return ret;
+    }
 
-    OfsResult _Ofs::getDirFlags(const char *dirpath, unsigned int& flags)
+    /* Writing thread of extractFiles, writes read items until reading is over and none are left */
+    static void extractWriter(ExtractQueue *queue)
     {
-        LOCK_AUTO_MUTEX
-
-        if(!mActive)
+        for(;;)
         {
-            OFS_EXCEPT("_Ofs::getDirFlags, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+            ExtractItem *item;
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(dirpath);
+            {
+                boost::mutex::scoped_lock lock(queue->Mutex);
 
-        if(dirDesc == NULL)
-            return OFS_INVALID_PATH;
-        else
-        {
-            flags = dirDesc->Flags;
+                while(queue->Pending.empty() && !queue->Finished)
+                    queue->ItemReady.wait(lock);
 
-            return OFS_OK;
+                if(queue->Pending.empty())
+                    return;
+
+                item = queue->Pending.front();
+                queue->Pending.pop_front();
+            }
+
+            if(item->Result == OFS_OK)
+                item->Result = writeExtracted(queue->Owner, (*queue->Requests)[item->Index], *item);
+            else
+                std::vector<char>().swap(item->Data);
+
+            boost::mutex::scoped_lock lock(queue->Mutex);
+
+            if(!item->Streamed)
+                queue->Buffered -= item->Size;
+
+            queue->Done.push_back(item);
+            queue->ItemDone.notify_all();
         }
     }
 
-//------------------------------------------------------------------------------
-
-    OfsResult _Ofs::getCreationTime(OFSHANDLE& handle, time_t& creation_time)
+    /* Reports items taken from the Done list of an ExtractQueue, returns how many there were */
+    static unsigned int reportExtracted(std::deque<ExtractItem*>& done, ExtractRequestList& requests, ExtractCallBackFunction callback, void *userData, OfsResult& result)
     {
-        LOCK_AUTO_MUTEX
+        unsigned int count = done.size();
 
-        if(!mActive)
+        for(unsigned int i = 0;i < count;i++)
         {
-            OFS_EXCEPT("_Ofs::getCreationTime, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+            ExtractRequest& request = requests[done[i]->Index];
+            request.FileSize = done[i]->Size;
+            request.Result = done[i]->Result;
 
-        if(!handle._valid())
-        {
-            OFS_EXCEPT("_Ofs::getCreationTime, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
+            if(result == OFS_OK && request.Result != OFS_OK)
+                result = request.Result;
+
+            if(callback != NULL)
+                callback(userData, request);
         }
 
-        creation_time = handle.mEntryDesc->CreationTime;
+        done.clear();
 
-        return OFS_OK;
+        return count;
     }
 
 //------------------------------------------------------------------------------
 
-    OfsResult _Ofs::getModificationTime(OFSHANDLE& handle, time_t& mod_time) 
+    OfsResult _Ofs::extractFiles(ExtractRequestList& requests, unsigned int num_threads, ExtractCallBackFunction callback, void *userData)
     {
-        LOCK_AUTO_MUTEX
+        OfsResult result = OFS_OK;
+        std::vector<ExtractItem> items;
+        std::vector<unsigned int> finished;
 
-        if(!mActive)
         {
-            OFS_EXCEPT("_Ofs::getModificationTime, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+            LOCK_SHARED_AUTO_MUTEX
 
-        if(!handle._valid())
-        {
-            OFS_EXCEPT("_Ofs::getModificationTime, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
-        }
+            if(!mActive)
+            {
+                OFS_EXCEPT("_Ofs::extractFiles, Operation called on an unmounted file system.");
+                return OFS_IO_ERROR;
+            }
 
-        mod_time = handle.mEntryDesc->CreationTime;
+            items.reserve(requests.size());
 
-        return OFS_OK;
-    }
+            for(unsigned int i = 0;i < requests.size();i++)
+            {
+                ExtractRequest& request = requests[i];
 
-//------------------------------------------------------------------------------
+                request.FileSize = 0;
+                request.Skipped = false;
+                request.Result = OFS_OK;
 
-    OfsResult _Ofs::getFileSize(OFSHANDLE& handle, ofs64& size)
-    {
-        LOCK_AUTO_MUTEX
+                std::string path = request.Name;
+                OfsEntryDesc *fileDesc = NULL;
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::getFileSize, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+                if(!path.empty() && path[path.length() - 1] != '/')
+                {
+                    OfsEntryDesc *dirDesc = _getDirectoryDesc(path.c_str());
 
-        if(!handle._valid())
-        {
-            OFS_EXCEPT("_Ofs::getFileSize, Supplied OfsHandle is not valid.");
-            return OFS_INVALID_FILE;
-        }
+                    if(dirDesc != NULL)
+                        fileDesc = _getFileDesc(dirDesc, _extractFileName(path.c_str()));
 
-        size = handle.mEntryDesc->FileSize;
+                    path += "/";
+                }
 
-        return OFS_OK;
-    }
+                if(fileDesc == NULL)
+                {
+                    /* With a trailing slash every part of the path has to be an existing directory */
+                    if(_getDirectoryDesc(path.c_str()) == NULL)
+                        request.Result = OFS_FILE_NOT_FOUND;
+                    else if(!OfsCreateDirectories(request.DestPath.c_str()))
+                        request.Result = OFS_IO_ERROR;
 
-//------------------------------------------------------------------------------
+                    finished.push_back(i);
+                    continue;
+                }
 
-    bool _Ofs::exists(const char *filename)
-    {
-        LOCK_AUTO_MUTEX
+                ExtractItem item;
+                item.Index = i;
+                item.Position = 0;
+                item.Size = _getContentSize(fileDesc);
+                item.Time = fileDesc->CreationTime;
+                item.Streamed = item.Size > TRANSFER_MAX_BUFFERED;
+                item.Result = OFS_OK;
 
-        if(!mActive)
+                if(fileDesc->Owner == this)
+                {
+                    OfsEntryDesc *dataDesc = (fileDesc->SharedData != NULL) ? fileDesc->SharedData : fileDesc;
+                    item.Position = dataDesc->UsedBlocks[0].Start;
+                }
+
+                items.push_back(item);
+            }
+        }
+
+        for(unsigned int i = 0;i < finished.size();i++)
         {
-            OFS_EXCEPT("_Ofs::exists, Operation called on an unmounted file system.");
-            return false;
+            ExtractRequest& request = requests[finished[i]];
+
+            if(result == OFS_OK && request.Result != OFS_OK)
+                result = request.Result;
+
+            if(callback != NULL)
+                callback(userData, request);
         }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+        std::vector<ExtractItem*> pending;
 
-        if(dirDesc == NULL)
-            return false;
+        for(unsigned int i = 0;i < items.size();i++)
+        {
+            ExtractRequest& request = requests[items[i].Index];
+            ofs64 size;
+            time_t mod_time;
 
-        std::string fName = _extractFileName(filename);
+            if(OfsGetFileInfo(request.DestPath.c_str(), size, mod_time) && size == items[i].Size && mod_time == items[i].Time)
+            {
+                request.FileSize = size;
+                request.Skipped = true;
 
-        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+                if(callback != NULL)
+                    callback(userData, request);
+            }
+            else
+                pending.push_back(&items[i]);
+        }
 
-        return (fileDesc != NULL);
-    }
+        if(pending.empty())
+            return result;
 
-//------------------------------------------------------------------------------
+        std::sort(pending.begin(), pending.end(), compareExtractItems);
 
-    OfsResult _Ofs::copyFile(const char *src, const char *dest)
-    {
-        LOCK_AUTO_MUTEX
+        ExtractQueue queue;
+        queue.Owner = this;
+        queue.Requests = &requests;
+        queue.Buffered = 0;
+        queue.Finished = false;
 
-        OFSHANDLE srcHandle, destHandle;
-        OfsResult ret = OFS_OK;
+        if(num_threads == 0)
+            num_threads = std::max(boost::thread::hardware_concurrency(), 1U);
 
-        if((ret = openFile(srcHandle, src)) != OFS_OK)
-            return ret;
+        num_threads = std::min(num_threads, (unsigned int)pending.size());
 
-        ofs64 file_size = 0;
+        boost::thread_group writers;
 
-        getFileSize(srcHandle, file_size);
+        for(unsigned int i = 0;i < num_threads;i++)
+            writers.add_thread(new boost::thread(&extractWriter, &queue));
 
-        if(file_size < 1024 * 1024 * 64)
+        unsigned int reported = 0;
+        std::deque<ExtractItem*> done;
+
+        try
         {
-            UUID uuid;
+            unsigned int next = 0;
 
-            char *buffer = new char[(unsigned int)file_size];
-            read(srcHandle, buffer, (unsigned int)file_size);
-            closeFile(srcHandle);
+            while(next < pending.size())
+            {
+                /* Neighbouring small files are read together, readFiles sweeps over them in one pass */
+                std::vector<ExtractItem*> batch;
+                ofs64 batch_size = 0;
 
-            ret = createFileUUID(destHandle, dest, UUID_ZERO, file_size, (unsigned int)file_size, buffer);
-            
-            delete [] buffer;
+                while(next < pending.size())
+                {
+                    ExtractItem *item = pending[next];
 
-            if(ret == OFS_OK)
-                closeFile(destHandle);
-            
-            return ret;
-        }
+                    if(!batch.empty() && (item->Streamed || batch_size + item->Size > TRANSFER_MAX_BUFFERED))
+                        break;
 
-        closeFile(srcHandle);
-        return OFS_IO_ERROR;
-    }
+                    batch.push_back(item);
+                    batch_size += item->Size;
+                    ++next;
 
-//------------------------------------------------------------------------------------------
+                    if(item->Streamed)
+                        break;
+                }
 
-    OfsResult _Ofs::moveFile(const char *src, const char *dest)
-    {
-        LOCK_AUTO_MUTEX
+                if(!batch[0]->Streamed)
+                {
+                    for(;;)
+                    {
+                        bool space;
 
-        OFSHANDLE srcHandle;
-        OfsResult ret = OFS_OK;
+                        {
+                            boost::mutex::scoped_lock lock(queue.Mutex);
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(dest);
+                            while(queue.Done.empty() && queue.Buffered > 0 && queue.Buffered + batch_size > TRANSFER_MEMORY_BUDGET)
+                                queue.ItemDone.wait(lock);
 
-        if(dirDesc == NULL)
-            return OFS_INVALID_PATH;            
+                            space = (queue.Buffered == 0 || queue.Buffered + batch_size <= TRANSFER_MEMORY_BUDGET);
 
-        if((ret = openFile(srcHandle, src)) != OFS_OK)
-            return OFS_INVALID_FILE;
+                            if(space)
+                                queue.Buffered += batch_size;
 
-        OfsEntryDesc *srcDesc = srcHandle.mEntryDesc;
+                            done.swap(queue.Done);
+                        }
 
-        if( srcDesc->Flags & OFS_READONLY || srcDesc->Flags & OFS_LINK )
-        {
-            closeFile(srcHandle);
-            return OFS_ACCESS_DENIED;
-        }
+                        reported += reportExtracted(done, requests, callback, userData, result);
 
-        closeFile(srcHandle);
+                        if(space)
+                            break;
+                    }
 
-        ret = deleteFile(dest);
+                    ReadRequestList reads(batch.size());
 
-        if(ret == OFS_OK || ret == OFS_FILE_NOT_FOUND)
-        {
-            for(unsigned int i = 0;i < srcDesc->Parent->Children.size();i++)
-            {
-                if(srcDesc->Parent->Children[i] == srcDesc)
-                {
-                    srcDesc->Parent->Children.erase(srcDesc->Parent->Children.begin() + i);
-                    break;
+                    for(unsigned int i = 0;i < batch.size();i++)
+                    {
+                        batch[i]->Data.resize((size_t)batch[i]->Size);
+
+                        reads[i].Name = requests[batch[i]->Index].Name;
+                        reads[i].Buffer = batch[i]->Data.empty() ? NULL : &batch[i]->Data[0];
+                        reads[i].BufferSize = (unsigned int)batch[i]->Size;
+                    }
+
+                    readFiles(reads);
+
+                    for(unsigned int i = 0;i < batch.size();i++)
+                    {
+                        if(reads[i].Result != OFS_OK)
+                            batch[i]->Result = reads[i].Result;
+                        else if(reads[i].BytesRead != batch[i]->Size)
+                            batch[i]->Result = OFS_IO_ERROR;
+                    }
                 }
-            }
 
-            dirDesc->Children.push_back(srcDesc);
+                boost::mutex::scoped_lock lock(queue.Mutex);
 
-            srcDesc->ParentId = dirDesc->Id;
-            srcDesc->Parent = dirDesc;
+                queue.Pending.insert(queue.Pending.end(), batch.begin(), batch.end());
+                queue.ItemReady.notify_all();
+            }
 
-            std::string nName = _extractFileName(dest);
-            if( nName == "" || srcDesc->Name == nName )
             {
-                mStream.seek(srcDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, ParentId), OFS_SEEK_BEGIN);
-                mStream.write((char*)&(srcDesc->ParentId), sizeof(unsigned int));
-                mStream.flush();
+                boost::mutex::scoped_lock lock(queue.Mutex);
+
+                queue.Finished = true;
+                queue.ItemReady.notify_all();
             }
-            else
+
+            while(reported < pending.size())
             {
-                int sz = nName.length();
-                if(sz > 251)
-                    nName.erase(251, sz - 251);
+                {
+                    boost::mutex::scoped_lock lock(queue.Mutex);
 
-                srcDesc->Name = nName;
+                    while(queue.Done.empty())
+                        queue.ItemDone.wait(lock);
 
-                mStream.seek(srcDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Name), OFS_SEEK_BEGIN);
-                mStream.write(srcDesc->Name.c_str(), srcDesc->Name.length() + 1);
-                mStream.flush();
+                    done.swap(queue.Done);
+                }
 
-                mStream.seek(srcDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, ParentId), OFS_SEEK_BEGIN);
-                mStream.write((char*)&(srcDesc->ParentId), sizeof(unsigned int));
-                mStream.flush();
+                reported += reportExtracted(done, requests, callback, userData, result);
             }
-
-            ret = OFS_OK;
         }
+        catch(...)
+        {
+            {
+                boost::mutex::scoped_lock lock(queue.Mutex);
 
-        return ret;
-    }
-
-//------------------------------------------------------------------------------------------
-    
-    OfsResult _Ofs::moveToRecycleBin(const char *path)
-    {
-        assert(path != NULL);
+                queue.Pending.clear();
+                queue.Finished = true;
+                queue.ItemReady.notify_all();
+            }
 
-        LOCK_AUTO_MUTEX
+            writers.join_all();
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::moveToRecycleBin, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
+            throw;
         }
 
-        OfsEntryDesc *dirDesc = _getDirectoryDesc(path);
+        writers.join_all();
 
-        if(dirDesc == NULL)
-            return OFS_FILE_NOT_FOUND;
+        return result;
+    }
 
-        std::string fName = _extractFileName(path);
+//------------------------------------------------------------------------------
 
-        if( fName.size() > 0 )
+    void _Ofs::_writeRaw(OFSHANDLE& handle, const char *src, unsigned int length)
+    {
+        OfsEntryDesc *desc = handle.mEntryDesc;
+        if(length > 0)
         {
-            OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+            ofs64 allocated = _getAllocatedSize(desc);
+            ofs64 total_alloc = allocated - handle.mPos;
+            unsigned int output_amount = length;
 
-            if(fileDesc == NULL)
-                return OFS_FILE_NOT_FOUND;
+            if(total_alloc < length)
+            {
+                unsigned int space_needed = length - (unsigned int)total_alloc;
 
-            dirDesc = fileDesc;
-        }
-            
-        if(dirDesc->Flags & OFS_LINK)
-            return OFS_ACCESS_DENIED;
+                /* Geometric growth keeps files written in many small appends down to a few blocks */
+                ofs64 growth = std::min(std::max(allocated, GROWTH_MIN_SIZE), GROWTH_MAX_SIZE);
+                ofs64 alloc_size = sizeof(strExtendedEntryHeader) + std::max((ofs64)space_needed, growth);
 
-        std::vector<_Ofs::CallBackData> saveTrigs = dirDesc->Triggers;
+                _allocateExtendedFileBlock(desc, alloc_size, space_needed, (src + total_alloc));
 
-        IdHandleMap::const_iterator it = mActiveFiles.find(dirDesc->Id);
+                output_amount = (unsigned int)total_alloc; 
+            }
 
-        if(it != mActiveFiles.end())
-            return OFS_ACCESS_DENIED;
+            ofs64 write_pos_save = handle.mPos;
 
-        for(unsigned int i = 0;i < dirDesc->Parent->Children.size();i++)
-        {
-            if(dirDesc->Parent->Children[i]->Id == dirDesc->Id)
+            ofs64 can_write = handle.mBlockEnd - handle.mRealPos;
+
+            bool done = false;
+            while(!done)
             {
-                dirDesc->Parent->Children.erase(dirDesc->Parent->Children.begin() + i);
-                break;
+                if(can_write >= output_amount)
+                {
+                    mStream.seek(handle.mRealPos, OFS_SEEK_BEGIN);
+                    mStream.write(src, output_amount);
+                    handle._setPos(handle.mPos + output_amount);
+                    done = true;
+                }
+                else
+                {
+                    mStream.seek(handle.mRealPos, OFS_SEEK_BEGIN);
+                    mStream.write(src, (unsigned int)can_write);
+                    handle._setPos(handle.mPos + can_write);
+                    output_amount -= (unsigned int)can_write;
+                    src += can_write;
+
+                    can_write = handle.mBlockEnd - handle.mRealPos;
+                }
+            }
+
+            if(write_pos_save + length > desc->FileSize)
+            {
+                desc->FileSize = write_pos_save + length;
+                mStream.seek(desc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, FileSize), OFS_SEEK_BEGIN);
+                mStream.write((char*)&(desc->FileSize), sizeof(ofs64));
+                mStream.flush();
             }
+
+            handle._setPos(write_pos_save + length);
         }
+    }
 
-        dirDesc->OldParentId = dirDesc->ParentId;
-        dirDesc->Parent = &mRecycleBinRoot;
-        dirDesc->ParentId = mRecycleBinRoot.Id;
-        mRecycleBinRoot.Children.push_back( dirDesc );
+//------------------------------------------------------------------------------
 
-        mStream.seek(dirDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, ParentId), OFS_SEEK_BEGIN);
-        mStream.write((char*)&(dirDesc->ParentId), sizeof(unsigned int));
-        mStream.seek(dirDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, OldParentId), OFS_SEEK_BEGIN);
-        mStream.write((char*)&(dirDesc->OldParentId), sizeof(unsigned int));
-        mStream.flush();
+    OfsResult _Ofs::write(OFSHANDLE& handle, const char *src, unsigned int length)
+    {
+        assert(src != NULL);
 
-        for(unsigned int i = 0;i < saveTrigs.size();i++)
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
         {
-            if(saveTrigs[i].type == CLBK_DELETE)
-            {
-                saveTrigs[i].func(saveTrigs[i].data, 0, path);
-            }
+            OFS_EXCEPT("_Ofs::write, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
         }
 
-        for(unsigned int i = 0;i < mTriggers.size();i++)
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::write, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        if(!(handle.mAccessFlags & OFS_WRITE))
+            return OFS_ACCESS_DENIED;
+
+        /* Copy on write, the shared contents are left untouched for other files */
+        if(handle.mDataDesc != NULL && length > 0)
+            _unshareHandle(handle);
+
+        if(handle.mCompressed != NULL)
         {
-            if(mTriggers[i].type == CLBK_DELETE)
+            CompressedData *data = handle.mCompressed;
+
+            if(length > 0)
             {
-                mTriggers[i].func(mTriggers[i].data, 0, path);
+                if(data->Size < (data->Pos + length))
+                {
+                    data->Size = data->Pos + length;
+                    data->Buffer.resize((size_t)data->Size);
+                }
+
+                memcpy(&data->Buffer[(size_t)data->Pos], src, length);
+                data->Pos += length;
             }
         }
+        else
+            _writeRaw(handle, src, length);
 
         return OFS_OK;
     }
 
-//------------------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
 
-    _Ofs::OfsEntryDesc* _Ofs::_findDescById( _Ofs::OfsEntryDesc* base, int id )
+    ofs64 _Ofs::seek(OFSHANDLE& handle, ofs64 pos, SeekDirection dir)
     {
-        std::vector<OfsEntryDesc*> list;
-        OfsEntryDesc* desc;
+        LOCK_SHARED_AUTO_MUTEX
 
-        for( unsigned int i = 0; i < base->Children.size(); i++)
+        if(!mActive)
         {
-            desc = base->Children[i];
-            if( (desc->Flags & OFS_DIR) && !(desc->Flags & OFS_LINK))
-            {
-                if( desc->Id == id  )
-                    return desc;
-                else
-                    list.push_back( desc );
-            }
+            OFS_EXCEPT("_Ofs::seekr, Operation called on an unmounted file system.");
+            return 0;
         }
 
-        for( unsigned int i = 0; i < list.size(); i++)
+        if(!handle._valid())
         {
-            desc = _findDescById( base->Children[i], id );
-            if( desc != NULL ) 
-                return desc;
+            OFS_EXCEPT("_Ofs::seekr, Supplied OfsHandle is not valid.");
+            return 0;
         }
 
-        return NULL;
-    }
-
-//------------------------------------------------------------------------------------------
-
-    OfsResult _Ofs::restoreFromRecycleBin(int id)
-    {
-        LOCK_AUTO_MUTEX
+        CompressedData *data = handle.mCompressed;
 
-        if(!mActive)
+        switch(dir)
         {
-            OFS_EXCEPT("_Ofs::restoreFromRecycleBin, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
+        case OFS_SEEK_BEGIN:if(pos < 0) pos = 0;
+                            break;
+        case OFS_SEEK_CURRENT:pos += (data != NULL) ? data->Pos : handle.mPos;
+                              if(pos < 0) pos = 0;
+                              break;
+        case OFS_SEEK_END:pos += (data != NULL) ? data->Size : handle.mEntryDesc->FileSize;
+                          if(pos < 0) pos = 0;
+                          break;
         }
 
-        OfsEntryDesc *sourceDesc = NULL, *destDesc = NULL;
-
-        for( unsigned int i = 0; i < mRecycleBinRoot.Children.size(); i++)
+        if(data != NULL)
         {
-            if( mRecycleBinRoot.Children[i]->Id == id )
-            {
-                sourceDesc = mRecycleBinRoot.Children[i];
-                break;
-            }
+            data->Pos = (pos < data->Size) ? pos : data->Size;
+            return data->Pos;
         }
 
-        if( sourceDesc == NULL )
-            return OFS_FILE_NOT_FOUND;
+        handle._setPos(pos);
+        return handle.mPos;
+    }
 
-        destDesc = _findDescById( &mRootDir, sourceDesc->OldParentId );
+//------------------------------------------------------------------------------
 
-        if( destDesc == NULL )
-            destDesc = &mRootDir;
+    ofs64 _Ofs::tell(OFSHANDLE& handle)
+    {
+        LOCK_SHARED_AUTO_MUTEX
 
-        for( unsigned int i = 0; i < destDesc->Children.size(); i++)
+        if(!mActive)
         {
-            if( destDesc->Children[i]->Name == sourceDesc->Name )
-                return OFS_ACCESS_DENIED;
+            OFS_EXCEPT("_Ofs::tellw, Operation called on an unmounted file system.");
+            return 0;
         }
 
-        for( unsigned int i = 0; i < mRecycleBinRoot.Children.size(); i++)
+        if(!handle._valid())
         {
-            if( mRecycleBinRoot.Children[i]->Id == id )
-            {
-                mRecycleBinRoot.Children.erase(mRecycleBinRoot.Children.begin() + i);
-                break;
-            }
+            OFS_EXCEPT("_Ofs::tellw, Supplied OfsHandle is not valid.");
+            return 0;
         }
 
-        sourceDesc->OldParentId = ROOT_DIRECTORY_ID;
-        sourceDesc->Parent = destDesc;
-        sourceDesc->ParentId = destDesc->Id;
-        destDesc->Children.push_back( sourceDesc );
-
-        mStream.seek(sourceDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, ParentId), OFS_SEEK_BEGIN);
-        mStream.write((char*)&(sourceDesc->ParentId), sizeof(unsigned int));
-        mStream.seek(sourceDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, OldParentId), OFS_SEEK_BEGIN);
-        mStream.write((char*)&(sourceDesc->OldParentId), sizeof(unsigned int));
-        mStream.flush();
+        if(handle.mCompressed != NULL)
+            return handle.mCompressed->Pos;
 
-        return OFS_OK;
+        return handle.mPos;
     }
 
-//------------------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
 
-    void _Ofs::_deleteRecycleBinDesc(OfsEntryDesc *desc)
+    bool _Ofs::eof(OFSHANDLE& handle)
     {
-        unsigned int i;
+        LOCK_SHARED_AUTO_MUTEX
 
-        for(i = 0;i < desc->UsedBlocks.size();i++)
+        if(!mActive)
         {
-            _markUnused(desc->UsedBlocks[i]);
+            OFS_EXCEPT("_Ofs::eof, Operation called on an unmounted file system.");
+            return 0;
         }
 
-
-        for(i = 0; i < desc->Children.size(); i++)
+        if(!handle._valid())
         {
-            _deleteRecycleBinDesc(desc->Children[i]);
+            OFS_EXCEPT("_Ofs::eof, Supplied OfsHandle is not valid.");
+            return 0;
         }
+
+        if(handle.mCompressed != NULL)
+            return (handle.mCompressed->Pos >= handle.mCompressed->Size);
+
+        return (handle.mPos >= handle.mEntryDesc->FileSize);
     }
 
-//------------------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
 
-    OfsResult _Ofs::emptyRecycleBin()
+    OfsResult _Ofs::getFileName(OFSHANDLE& handle, std::string& filename)
     {
-        LOCK_AUTO_MUTEX
+        LOCK_SHARED_AUTO_MUTEX
 
         if(!mActive)
         {
-            OFS_EXCEPT("_Ofs::emptyRecycleBin, Operation called on an unmounted file system.");
+            OFS_EXCEPT("_Ofs::getFileName, Operation called on an unmounted file system.");
             return OFS_IO_ERROR;
         }
 
-        for( unsigned int i = 0; i < mRecycleBinRoot.Children.size(); i++)
+        if(!handle._valid())
         {
-            _deleteRecycleBinDesc(mRecycleBinRoot.Children[i]);
+            OFS_EXCEPT("_Ofs::getFileName, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
         }
 
-        _deallocateChildren(&mRecycleBinRoot);
+        filename = handle.mEntryDesc->Name;
 
         return OFS_OK;
     }
 
-//------------------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
 
-    OfsResult _Ofs::moveFileSystemTo(const char *dest)
+    OfsResult _Ofs::getDirEntry(const char *path, FileEntry& entry)
     {
-        LOCK_AUTO_MUTEX
+        LOCK_SHARED_AUTO_MUTEX
 
         if(!mActive)
         {
-            OFS_EXCEPT("_Ofs::moveFileSystemTo, Operation called on an unmounted file system.");
+            OFS_EXCEPT("_Ofs::getDirEntry, Operation called on an unmounted file system.");
             return OFS_IO_ERROR;
         }
 
-        OfsResult ret = OFS_INVALID_FILE;
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(path);
 
+        if(dirDesc != NULL)
         {
-            STATIC_LOCK_AUTO_MUTEX
-
-            NameOfsHandleMap::iterator it = mAllocatedHandles.find(std::string(dest));
-
-            if(it != mAllocatedHandles.end())
-                return ret;
-        }
-
-        FileStream destStream;
-        OPEN_STREAM(destStream, dest, "wb+");
+            entry.id = dirDesc->Id;
+            entry.name = dirDesc->Name;
+            entry.flags = dirDesc->Flags;
+            entry.uuid = dirDesc->Uuid;
+            entry.file_size = dirDesc->FileSize;
+            entry.create_time = dirDesc->CreationTime;
+            entry.modified_time = dirDesc->CreationTime;
+            
+            return OFS_OK;
+        }
+        else
+            return OFS_FILE_NOT_FOUND;
+    }
 
-        if(!destStream.fail())
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getFileEntry(const char *filename, FileEntry& entry)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
         {
-            mStream.seek(0, OFS_SEEK_END);
-            ofs64 total_amount = mStream.tell();
+            OFS_EXCEPT("_Ofs::getFileEntry, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
 
-            mStream.seek(0, OFS_SEEK_BEGIN);
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
 
-            char *buffer = new char[65536];
+        if(dirDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
 
-            while(total_amount > 0)
+        std::string fName = _extractFileName(filename);
+
+        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+        if(fileDesc != NULL)
+        {
+            entry.id = fileDesc->Id;
+            entry.name = fileDesc->Name;
+            entry.flags = fileDesc->Flags;
+            entry.uuid = fileDesc->Uuid;
+            entry.file_size = _getContentSize(fileDesc);
+            entry.create_time = fileDesc->CreationTime;
+            entry.modified_time = fileDesc->CreationTime;
+            
+            return OFS_OK;
+        }
+        else
+            return OFS_FILE_NOT_FOUND;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getFileEntry(OFSHANDLE& handle, FileEntry& entry)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getFileEntry, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::getFileEntry, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        entry.id = handle.mEntryDesc->Id;
+        entry.name = handle.mEntryDesc->Name;
+        entry.flags = handle.mEntryDesc->Flags;
+        entry.uuid = handle.mEntryDesc->Uuid;
+        if(handle.mCompressed != NULL)
+            entry.file_size = handle.mCompressed->Size;
+        else
+            entry.file_size = handle.mEntryDesc->FileSize;
+        entry.create_time = handle.mEntryDesc->CreationTime;
+        entry.modified_time = handle.mEntryDesc->CreationTime;
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getCreationTime(const char *filename, time_t& creation_time)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getCreationTime, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+
+        if(dirDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+
+        std::string fName = _extractFileName(filename);
+
+        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+        if(fileDesc != NULL)
+        {
+            creation_time = fileDesc->CreationTime;
+            return OFS_OK;
+        }
+        else
+            return OFS_FILE_NOT_FOUND;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getModificationTime(const char *filename, time_t& mod_time)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getModificationTime, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+
+        if(dirDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+
+        std::string fName = _extractFileName(filename);
+
+        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+        if(fileDesc != NULL)
+        {
+            mod_time = fileDesc->CreationTime;
+            return OFS_OK;
+        }
+        else
+            return OFS_FILE_NOT_FOUND;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getFileSize(const char *filename, ofs64& size)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getFileSize, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+
+        if(dirDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+
+        std::string fName = _extractFileName(filename);
+
+        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+        if(fileDesc != NULL)
+        {
+            size = _getContentSize(fileDesc);
+            return OFS_OK;
+        }
+        else
+            return OFS_FILE_NOT_FOUND;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::setFileFlags(const char *filename, unsigned int flags)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::setFileFlags, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+
+        if(dirDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+
+        std::string fName = _extractFileName(filename);
+
+        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+        if(fileDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+        else if( fileDesc->Flags & OFS_LINK )
+            return OFS_ACCESS_DENIED;
+        else
+        {
+            if(fileDesc->WriteLocked)
+                return OFS_ACCESS_DENIED;
+
+            if((fileDesc->Flags ^ flags) & OFS_COMPRESSED)
             {
-                if(total_amount > 65536)
+                // Open handles hold views of the current storage, so it can not be converted under them
+                if(fileDesc->UseCount > 0)
+                    return OFS_ACCESS_DENIED;
+
+                if(fileDesc->Flags & OFS_DEDUP)
+                    _unshareFile(fileDesc, true);
+
+                OFSHANDLE handle;
+                handle.mEntryDesc = fileDesc;
+                handle.mAccessFlags = OFS_READWRITE;
+                handle._preparePointers(false);
+
+                OfsResult ret = OFS_OK;
+
+                if(fileDesc->Flags & OFS_COMPRESSED)
                 {
-                    mStream.read(buffer, 65536);
-                    destStream.write(buffer, 65536);
-                    total_amount -= 65536;
+                    if((ret = _openCompressed(handle)) == OFS_OK)
+                        ret = _setCompressed(handle, false);
                 }
                 else
-                {
-                    mStream.read(buffer, (unsigned int)total_amount);
-                    destStream.write(buffer, (unsigned int)total_amount);
-                    total_amount = 0;
-                }
+                    ret = _setCompressed(handle, true);
+
+                if(ret != OFS_OK)
+                    return ret;
             }
 
-            delete [] buffer;
+            _setFileFlags(fileDesc, flags);
+            mStream.flush();
+            return OFS_OK;
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::setFileFlags(OFSHANDLE& handle, unsigned int flags)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::setFileFlags, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::setFileFlags, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        if( handle.mEntryDesc->Flags & OFS_LINK )
+            return OFS_ACCESS_DENIED;
+
+        if((handle.mEntryDesc->Flags ^ flags) & OFS_COMPRESSED)
+        {
+            if(!(handle.mAccessFlags & OFS_WRITE) || (handle.mEntryDesc->UseCount > 1))
+                return OFS_ACCESS_DENIED;
+
+            if(handle.mDataDesc != NULL)
+                _unshareHandle(handle);
+
+            OfsResult ret = _setCompressed(handle, (flags & OFS_COMPRESSED) != 0);
+            if(ret != OFS_OK)
+                return ret;
+        }
+
+        _setFileFlags(handle.mEntryDesc, flags);
+        mStream.flush();
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getFileFlags(const char *filename, unsigned int& flags)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getFileFlags, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+
+        if(dirDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+
+        std::string fName = _extractFileName(filename);
+
+        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+        if(fileDesc != NULL)
+        {
+            flags = fileDesc->Flags;
+
+            return OFS_OK;
+        }
+        else
+            return OFS_FILE_NOT_FOUND;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getFileFlags(OFSHANDLE& handle, unsigned int& flags)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getFileFlags, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::getFileFlags, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        flags = handle.mEntryDesc->Flags;
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::setFileUUID(const char *filename, const UUID& uuid)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::setFileUUID, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+
+        if(dirDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+
+        std::string fName = _extractFileName(filename);
+
+        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+        if(fileDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+        else if( fileDesc->Flags & OFS_LINK )
+            return OFS_ACCESS_DENIED;
+        else
+        {
+            if(fileDesc->Uuid != uuid)
+            {
+                if(fileDesc->WriteLocked)
+                    return OFS_ACCESS_DENIED;
+
+                if(fileDesc->Uuid != UUID_ZERO)
+                {
+                    UuidDescMap::iterator it = mUuidMap.find(fileDesc->Uuid);
+
+                    assert(it != mUuidMap.end());
+
+                    mUuidMap.erase(it);
+                }
+
+                if(uuid != UUID_ZERO)
+                    mUuidMap.insert(UuidDescMap::value_type(uuid, fileDesc));
+
+                fileDesc->Uuid = uuid;
+                mStream.seek(fileDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Uuid), OFS_SEEK_BEGIN);
+                mStream.write((char*)&(fileDesc->Uuid), sizeof(UUID));
+                mStream.flush();
+            }
+            
+            return OFS_OK;
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::setFileUUID(OFSHANDLE& handle, const UUID& uuid)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::setFileUUID, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::setFileUUID, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        if( handle.mEntryDesc->Flags & OFS_LINK )
+            return OFS_ACCESS_DENIED;
+
+        if(handle.mEntryDesc->Uuid != uuid)
+        {
+            if(handle.mEntryDesc->Uuid != UUID_ZERO)
+            {
+                UuidDescMap::iterator it = mUuidMap.find(handle.mEntryDesc->Uuid);
+
+                assert(it != mUuidMap.end());
+
+                mUuidMap.erase(it);
+            }
+
+            if(uuid != UUID_ZERO)
+                mUuidMap.insert(UuidDescMap::value_type(uuid, handle.mEntryDesc));
+
+            handle.mEntryDesc->Uuid = uuid;
+            mStream.seek(handle.mEntryDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Uuid), OFS_SEEK_BEGIN);
+            mStream.write((char*)&(handle.mEntryDesc->Uuid), sizeof(UUID));
+            mStream.flush();
+        }
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getFileUUID(const char *filename, UUID& uuid)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getFileUUID, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+
+        if(dirDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+
+        std::string fName = _extractFileName(filename);
+
+        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+        if(fileDesc != NULL)
+        {
+            uuid = fileDesc->Uuid;
+
+            return OFS_OK;
+        }
+        else
+            return OFS_FILE_NOT_FOUND;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getFileUUID(OFSHANDLE& handle, UUID& uuid)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getFileUUID, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::getFileUUID, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        uuid = handle.mEntryDesc->Uuid;
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::setDirUUID(const char *dirpath, const UUID& uuid)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::setDirUUID, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(dirpath);
+
+        if(dirDesc == NULL)
+            return OFS_INVALID_PATH;
+        else if( dirDesc->Flags & OFS_LINK )
+            return OFS_ACCESS_DENIED;
+        else
+        {
+            if(dirDesc->Uuid != uuid)
+            {
+                if(dirDesc->Uuid != UUID_ZERO)
+                {
+                    UuidDescMap::iterator it = mUuidMap.find(dirDesc->Uuid);
+
+                    assert(it != mUuidMap.end());
+
+                    mUuidMap.erase(it);
+                }
+
+                if(uuid != UUID_ZERO)
+                    mUuidMap.insert(UuidDescMap::value_type(uuid, dirDesc));
+
+                dirDesc->Uuid = uuid;
+                mStream.seek(dirDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Uuid), OFS_SEEK_BEGIN);
+                mStream.write((char*)&(dirDesc->Uuid), sizeof(UUID));
+                mStream.flush();
+            }
+            
+            return OFS_OK;
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getDirUUID(const char *dirpath, UUID& uuid)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getDirUUID, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(dirpath);
+
+        if(dirDesc == NULL)
+            return OFS_INVALID_PATH;
+        else
+        {
+            uuid = dirDesc->Uuid;
+
+            return OFS_OK;
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::setDirFlags(const char *dirpath, unsigned int flags)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::setDirFlags, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(dirpath);
+
+        if(dirDesc == NULL)
+            return OFS_INVALID_PATH;
+        else if( dirDesc->Flags & OFS_LINK )
+            return OFS_ACCESS_DENIED;
+        else
+        {
+            _setFileFlags(dirDesc, flags);
+            mStream.flush();
+
+            return OFS_OK;
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getDirFlags(const char *dirpath, unsigned int& flags)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getDirFlags, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(dirpath);
+
+        if(dirDesc == NULL)
+            return OFS_INVALID_PATH;
+        else
+        {
+            flags = dirDesc->Flags;
+
+            return OFS_OK;
+        }
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getCreationTime(OFSHANDLE& handle, time_t& creation_time)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getCreationTime, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::getCreationTime, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        creation_time = handle.mEntryDesc->CreationTime;
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getModificationTime(OFSHANDLE& handle, time_t& mod_time) 
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getModificationTime, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::getModificationTime, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        mod_time = handle.mEntryDesc->CreationTime;
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::getFileSize(OFSHANDLE& handle, ofs64& size)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::getFileSize, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_Ofs::getFileSize, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        if(handle.mCompressed != NULL)
+            size = handle.mCompressed->Size;
+        else
+            size = handle.mEntryDesc->FileSize;
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------
+
+    bool _Ofs::exists(const char *filename)
+    {
+        LOCK_SHARED_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::exists, Operation called on an unmounted file system.");
+            return false;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(filename);
+
+        if(dirDesc == NULL)
+            return false;
+
+        std::string fName = _extractFileName(filename);
+
+        OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+        return (fileDesc != NULL);
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _Ofs::copyFile(const char *src, const char *dest)
+    {
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        OFSHANDLE srcHandle, destHandle;
+        OfsResult ret = OFS_OK;
+
+        OfsEntryDesc *srcDesc = NULL;
+        OfsEntryDesc *srcDir = _getDirectoryDesc(src);
+
+        if(srcDir != NULL)
+            srcDesc = _getFileDesc(srcDir, _extractFileName(src));
+
+        /* Shared contents are copied by adding one more reference to them */
+        if(srcDesc != NULL && srcDesc->Owner == this && !srcDesc->WriteLocked)
+        {
+            if(mDedupMode && srcDesc->SharedData == NULL && srcDesc->UseCount == 0 && _canShare(srcDesc))
+                srcDesc = _dedupFile(srcDesc);
+
+            if(srcDesc->SharedData != NULL)
+            {
+                OfsEntryDesc *destDir = _getDirectoryDesc(dest);
+
+                if(destDir == NULL)
+                    return OFS_INVALID_PATH;
+
+                if(destDir->Flags & OFS_LINK)
+                    return OFS_ACCESS_DENIED;
+
+                std::string destName = _extractFileName(dest);
+                OfsEntryDesc *destDesc = _getFileDesc(destDir, destName);
+
+                if(destDesc == srcDesc)
+                    return OFS_OK;
+
+                if(destDesc != NULL && (ret = _deleteFile(destDesc)) != OFS_OK)
+                    return ret;
+
+                destDesc = _createSharedFile(destDir, destName, UUID_ZERO, time(NULL), 0, srcDesc->SharedData);
+
+                _fireTriggers(mTriggers, CLBK_CREATE, destDesc, 0);
+                _fireTriggers(mTriggers, CLBK_CONTENT, destDesc, 0);
+
+                return OFS_OK;
+            }
+        }
+
+        if((ret = openFile(srcHandle, src)) != OFS_OK)
+            return ret;
+
+        ofs64 file_size = 0;
+
+        getFileSize(srcHandle, file_size);
+
+        if(file_size < 1024 * 1024 * 64)
+        {
+            UUID uuid;
+
+            bool compressed = (srcHandle.mEntryDesc->Flags & OFS_COMPRESSED) != 0;
+
+            char *buffer = new char[(unsigned int)file_size];
+            read(srcHandle, buffer, (unsigned int)file_size);
+            closeFile(srcHandle);
+
+            ret = createFileUUID(destHandle, dest, UUID_ZERO, file_size, (unsigned int)file_size, buffer);
+            
+            delete [] buffer;
+
+            if(ret == OFS_OK)
+            {
+                if(compressed)
+                    setFileFlags(destHandle, OFS_COMPRESSED);
+
+                closeFile(destHandle);
+            }
+            
+            return ret;
+        }
+
+        closeFile(srcHandle);
+        return OFS_IO_ERROR;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::moveFile(const char *src, const char *dest)
+    {
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        OFSHANDLE srcHandle;
+        OfsResult ret = OFS_OK;
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(dest);
+
+        if(dirDesc == NULL)
+            return OFS_INVALID_PATH;            
+
+        if((ret = openFile(srcHandle, src)) != OFS_OK)
+            return OFS_INVALID_FILE;
+
+        OfsEntryDesc *srcDesc = srcHandle.mEntryDesc;
+
+        if( srcDesc->Flags & OFS_READONLY || srcDesc->Flags & OFS_LINK )
+        {
+            closeFile(srcHandle);
+            return OFS_ACCESS_DENIED;
+        }
+
+        closeFile(srcHandle);
+
+        ret = deleteFile(dest);
+
+        if(ret == OFS_OK || ret == OFS_FILE_NOT_FOUND)
+        {
+            _removeChild(srcDesc->Parent, srcDesc);
+
+            srcDesc->ParentId = dirDesc->Id;
+            srcDesc->Parent = dirDesc;
+
+            _addChild(dirDesc, srcDesc);
+
+            std::string nName = _extractFileName(dest);
+            if( nName == "" || srcDesc->Name == nName )
+            {
+                mStream.seek(srcDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, ParentId), OFS_SEEK_BEGIN);
+                mStream.write((char*)&(srcDesc->ParentId), sizeof(unsigned int));
+                mStream.flush();
+            }
+            else
+            {
+                int sz = nName.length();
+                if(sz > 251)
+                    nName.erase(251, sz - 251);
+
+                _renameChild(srcDesc, nName);
+
+                mStream.seek(srcDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Name), OFS_SEEK_BEGIN);
+                mStream.write(srcDesc->Name.c_str(), srcDesc->Name.length() + 1);
+                mStream.flush();
+
+                mStream.seek(srcDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, ParentId), OFS_SEEK_BEGIN);
+                mStream.write((char*)&(srcDesc->ParentId), sizeof(unsigned int));
+                mStream.flush();
+            }
+
+            _fireTriggers(mTriggers, CLBK_RENAME, srcDesc, src);
+
+            ret = OFS_OK;
+        }
+
+        return ret;
+    }
+
+//------------------------------------------------------------------------------------------
+    
+    OfsResult _Ofs::moveToRecycleBin(const char *path)
+    {
+        assert(path != NULL);
+
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::moveToRecycleBin, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *dirDesc = _getDirectoryDesc(path);
+
+        if(dirDesc == NULL)
+            return OFS_FILE_NOT_FOUND;
+
+        std::string fName = _extractFileName(path);
+
+        if( fName.size() > 0 )
+        {
+            OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
+
+            if(fileDesc == NULL)
+                return OFS_FILE_NOT_FOUND;
+
+            dirDesc = fileDesc;
+        }
+            
+        if(dirDesc->Flags & OFS_LINK)
+            return OFS_ACCESS_DENIED;
+
+        std::vector<_Ofs::CallBackData> saveTrigs = dirDesc->Triggers;
+
+        IdHandleMap::const_iterator it = mActiveFiles.find(dirDesc->Id);
+
+        if(it != mActiveFiles.end())
+            return OFS_ACCESS_DENIED;
+
+        _removeChild(dirDesc->Parent, dirDesc);
+
+        dirDesc->OldParentId = dirDesc->ParentId;
+        dirDesc->Parent = &mRecycleBinRoot;
+        dirDesc->ParentId = mRecycleBinRoot.Id;
+        _addChild( &mRecycleBinRoot, dirDesc );
+
+        mStream.seek(dirDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, ParentId), OFS_SEEK_BEGIN);
+        mStream.write((char*)&(dirDesc->ParentId), sizeof(unsigned int));
+        mStream.seek(dirDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, OldParentId), OFS_SEEK_BEGIN);
+        mStream.write((char*)&(dirDesc->OldParentId), sizeof(unsigned int));
+        mStream.flush();
+
+        _fireTriggers(saveTrigs, CLBK_DELETE, 0, path);
+
+        _fireTriggers(mTriggers, CLBK_DELETE, 0, path);
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    _Ofs::OfsEntryDesc* _Ofs::_findDescById( _Ofs::OfsEntryDesc* base, int id )
+    {
+        std::vector<OfsEntryDesc*> list;
+        OfsEntryDesc* desc;
+
+        for( unsigned int i = 0; i < base->Children.size(); i++)
+        {
+            desc = base->Children[i];
+            if( (desc->Flags & OFS_DIR) && !(desc->Flags & OFS_LINK))
+            {
+                if( desc->Id == id  )
+                    return desc;
+                else
+                    list.push_back( desc );
+            }
+        }
+
+        for( unsigned int i = 0; i < list.size(); i++)
+        {
+            desc = _findDescById( base->Children[i], id );
+            if( desc != NULL ) 
+                return desc;
+        }
+
+        return NULL;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::restoreFromRecycleBin(int id)
+    {
+        TriggerBatch batch(this);
+
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::restoreFromRecycleBin, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsEntryDesc *sourceDesc = NULL, *destDesc = NULL;
+
+        for( unsigned int i = 0; i < mRecycleBinRoot.Children.size(); i++)
+        {
+            if( mRecycleBinRoot.Children[i]->Id == id )
+            {
+                sourceDesc = mRecycleBinRoot.Children[i];
+                break;
+            }
+        }
+
+        if( sourceDesc == NULL )
+            return OFS_FILE_NOT_FOUND;
+
+        destDesc = _findDescById( &mRootDir, sourceDesc->OldParentId );
+
+        if( destDesc == NULL )
+            destDesc = &mRootDir;
+
+        if( _lookupChild( destDesc, sourceDesc->Name ) != NULL )
+            return OFS_ACCESS_DENIED;
+
+        _removeChild( &mRecycleBinRoot, sourceDesc );
+
+        sourceDesc->OldParentId = ROOT_DIRECTORY_ID;
+        sourceDesc->Parent = destDesc;
+        sourceDesc->ParentId = destDesc->Id;
+        _addChild( destDesc, sourceDesc );
+
+        mStream.seek(sourceDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, ParentId), OFS_SEEK_BEGIN);
+        mStream.write((char*)&(sourceDesc->ParentId), sizeof(unsigned int));
+        mStream.seek(sourceDesc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, OldParentId), OFS_SEEK_BEGIN);
+        mStream.write((char*)&(sourceDesc->OldParentId), sizeof(unsigned int));
+        mStream.flush();
+
+        _fireTriggers(mTriggers, CLBK_CREATE, sourceDesc, 0);
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _Ofs::_deleteRecycleBinDesc(OfsEntryDesc *desc)
+    {
+        unsigned int i;
+
+        _releaseShared(desc);
+
+        for(i = 0;i < desc->UsedBlocks.size();i++)
+        {
+            _markUnused(desc->UsedBlocks[i]);
+        }
+
+
+        for(i = 0; i < desc->Children.size(); i++)
+        {
+            _deleteRecycleBinDesc(desc->Children[i]);
+        }
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::emptyRecycleBin()
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::emptyRecycleBin, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        for( unsigned int i = 0; i < mRecycleBinRoot.Children.size(); i++)
+        {
+            _deleteRecycleBinDesc(mRecycleBinRoot.Children[i]);
+        }
+
+        _deallocateChildren(&mRecycleBinRoot);
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::moveFileSystemTo(const char *dest)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::moveFileSystemTo, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsResult ret = OFS_INVALID_FILE;
+
+        {
+            STATIC_LOCK_AUTO_MUTEX
+
+            NameOfsHandleMap::iterator it = mAllocatedHandles.find(std::string(dest));
+
+            if(it != mAllocatedHandles.end())
+                return ret;
+        }
+
+        FileStream destStream;
+        OPEN_STREAM(destStream, dest, "wb+");
+
+        if(!destStream.fail())
+        {
+            mStream.seek(0, OFS_SEEK_END);
+            ofs64 total_amount = mStream.tell();
+
+            mStream.seek(0, OFS_SEEK_BEGIN);
+
+            char *buffer = new char[65536];
+
+            while(total_amount > 0)
+            {
+                if(total_amount > 65536)
+                {
+                    mStream.read(buffer, 65536);
+                    destStream.write(buffer, 65536);
+                    total_amount -= 65536;
+                }
+                else
+                {
+                    mStream.read(buffer, (unsigned int)total_amount);
+                    destStream.write(buffer, (unsigned int)total_amount);
+                    total_amount = 0;
+                }
+            }
+
+            delete [] buffer;
+
+            /* The copy is identical, so is the validity of its index */
+            bool index_valid = mStream.isWriteBarrierArmed();
+
+            destStream.close();
+            mStream.close();
+
+            OPEN_STREAM(mStream, dest, "rb+");
+            if(!mStream.fail())
+            {
+                STATIC_LOCK_AUTO_MUTEX
+                mAllocatedHandles.erase(mAllocatedHandles.find(mFileName));
+                mActive = true;
+                mFileName = dest;
+                if(index_valid)
+                    _armIndexBarrier();
+                ret = OFS_OK;
+                mAllocatedHandles.insert(NameOfsHandleMap::value_type(std::string(dest), this));
+            }
+            else
+            {
+                mActive = false;
+                mFileName = "";
+                ret = OFS_INVALID_FILE;
+            }
+        }
+        
+        return ret;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::switchFileSystemTo(const char *dest)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::switchFileSystemTo, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsResult ret = OFS_INVALID_FILE;
+
+        {
+            STATIC_LOCK_AUTO_MUTEX
+
+            NameOfsHandleMap::iterator it = mAllocatedHandles.find(std::string(dest));
+
+            if(it != mAllocatedHandles.end())
+                return ret;
+        }
+
+        FileStream destStream;
+        OPEN_STREAM(destStream, dest, "rb+");
+
+        if(!destStream.fail())
+        {
+            destStream.close();
+            mStream.close();
+
+            OPEN_STREAM(mStream, dest, "rb+");
+            if(!mStream.fail())
+            {
+                STATIC_LOCK_AUTO_MUTEX
+                mAllocatedHandles.erase(mAllocatedHandles.find(mFileName));
+                mActive = true;
+                mFileName = dest;
+                mStream.seek(0, OFS_SEEK_BEGIN);
+                mStream.read((char*)&mHeader, sizeof(_Ofs::strFileHeader));
+                /* Keep the index of the new file unless it is modified through this file system */
+                mHeader.INDEX_POS = 0;
+                memset(&mIndexBlock, 0, sizeof(BlockData));
+                _armIndexBarrier();
+                ret = OFS_OK;
+                mAllocatedHandles.insert(NameOfsHandleMap::value_type(std::string(dest), this));
+            }
+            else
+            {
+                mActive = false;
+                mFileName = "";
+                ret = OFS_INVALID_FILE;
+            }
+        }
+        
+        return ret;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::defragFileSystemTo(const char *dest, LogCallBackFunction* logCallbackFunc)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::defragFileSystemTo, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        OfsResult ret = OFS_INVALID_FILE;
+
+        FileList allFiles;
+
+        listFilesRecursive("/", allFiles);
+
+        std::sort(allFiles.begin(), allFiles.end(), FileEntry::Compare);
+
+        OfsPtr destFile;
+        ret = destFile.mount(dest, OFS_MOUNT_CREATE);
+
+        if(ret == OFS_OK)
+        {
+            OFSHANDLE out_handle;
+            OFSHANDLE in_handle;
+
+            ofs64 output_amount = 0;
+
+            char *tmp_buffer = new char[MAX_BUFFER_SIZE];
+
+            for(unsigned int i = 0;i < allFiles.size();i++)
+            {
+                if(allFiles[i].flags & OFS_LINK)
+                    continue;
+
+                if(logCallbackFunc)
+                    (*logCallbackFunc)(std::string("Defragmenting ").append(allFiles[i].name));
+
+                if(allFiles[i].flags & OFS_DIR)
+                {
+                    destFile->createDirectoryUUID(allFiles[i].name.c_str(), allFiles[i].uuid);
+                    destFile->setDirFlags(allFiles[i].name.c_str(), allFiles[i].flags);
+                }
+                else
+                {
+                    std::string file_ofs_path = allFiles[i].name;
+
+                    try
+                    {
+                        OfsResult ret = openFile(in_handle, file_ofs_path.c_str());
+                        if(ret != OFS_OK)
+                            continue;
+
+                        ofs64 total = allFiles[i].file_size;
+
+                        bool dest_file_created = false;
+
+                        while(total > 0)
+                        {
+                            if(total < MAX_BUFFER_SIZE)
+                            {
+                                read(in_handle, tmp_buffer, (unsigned int)total);
+                                if(dest_file_created)
+                                    destFile->write(out_handle, tmp_buffer, (unsigned int)total);
+                                else
+                                {
+                                    destFile->createFileUUID(out_handle, file_ofs_path.c_str(), allFiles[i].uuid, total, (unsigned int)total, tmp_buffer);
+                                    destFile->setFileFlags(out_handle, allFiles[i].flags);
+                                }
+
+                                output_amount += total;
+                                total = 0;
+                            }
+                            else
+                            {
+                                read(in_handle, tmp_buffer, MAX_BUFFER_SIZE);
+                                if(dest_file_created)
+                                    destFile->write(out_handle, tmp_buffer, MAX_BUFFER_SIZE);
+                                else
+                                {
+                                    destFile->createFileUUID(out_handle, file_ofs_path.c_str(), allFiles[i].uuid, MAX_BUFFER_SIZE, MAX_BUFFER_SIZE, tmp_buffer);
+                                    destFile->setFileFlags(out_handle, allFiles[i].flags);
+                                    dest_file_created = true;
+                                }
+
+                                total -= MAX_BUFFER_SIZE;
+                                output_amount += MAX_BUFFER_SIZE;
+                            }
+                        }
+                    }
+                    catch(...)
+                    {
+                    }
+
+                    if(out_handle._valid())
+                        destFile->closeFile(out_handle);
+                    if(in_handle._valid())
+                        closeFile(in_handle);
+                }
+            }
+
+            if(logCallbackFunc)
+                (*logCallbackFunc)(std::string("Defragmenting completed."));
+
+            delete [] tmp_buffer;
+
+            ret = OFS_OK;
+        }
+
+        return ret;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::compactFileSystem(unsigned int max_blocks, CompactionProgress& progress)
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::compactFileSystem, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        memset(&progress, 0, sizeof(CompactionProgress));
+
+        /* Moves are journaled on their own and must not mix with a transaction that may be rolled back */
+        if(mTransactionDepth > 0)
+            return OFS_OK;
+
+        OfsResult ret = OFS_OK;
+
+        PosOwnerMap blocks;
+
+        _collectMovableBlocks(&mRootDir, blocks);
+        _collectMovableBlocks(&mRecycleBinRoot, blocks);
+        _collectMovableBlocks(&mDedupRoot, blocks);
+
+        /* Fill free space starting with the block closest to the end of the file */
+        for(PosOwnerMap::reverse_iterator it = blocks.rbegin();it != blocks.rend() && progress.BlocksMoved < max_blocks;++it)
+        {
+            if(mFreeBlocks.empty() || mFreeBlocks.begin()->first > it->first)
+                break;
+
+            OfsEntryDesc *desc = it->second.first;
+            unsigned int index = it->second.second;
+            BlockData target;
+
+            if(!_findCompactTarget(desc->UsedBlocks[index], target))
+                continue;
+
+            ofs64 length = desc->UsedBlocks[index].Length;
+
+            ret = _compactBlock(desc, index, target);
+            if(ret != OFS_OK)
+                break;
+
+            progress.BlocksMoved++;
+            progress.BytesMoved += length;
+        }
+
+        _truncateFreeTail();
+
+        for(PosBlockDataMap::const_iterator it = mFreeBlocks.begin();it != mFreeBlocks.end();++it)
+            progress.FreeSpace += it->second.Length + sizeof(strBlockHeader);
+
+        mStream.seek(0, OFS_SEEK_END);
+        progress.TotalFileSize = mStream.tell();
+
+        /* Moving a block may open a hole for blocks already visited, so only a pass without moves is final */
+        progress.Finished = mFreeBlocks.empty() || (ret == OFS_OK && progress.BlocksMoved == 0);
+
+        return ret;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _Ofs::_collectMovableBlocks(OfsEntryDesc *desc, PosOwnerMap& blocks)
+    {
+        if(desc->Owner != this)
+            return;
+
+        if(desc->UseCount == 0 && !desc->WriteLocked)
+        {
+            for(unsigned int i = 0;i < desc->UsedBlocks.size();i++)
+                blocks.insert(PosOwnerMap::value_type(desc->UsedBlocks[i].Start, std::make_pair(desc, i)));
+        }
+
+        for(unsigned int i = 0;i < desc->Children.size();i++)
+            _collectMovableBlocks(desc->Children[i], blocks);
+    }
+
+//------------------------------------------------------------------------------------------
+
+    bool _Ofs::_findCompactTarget(const BlockData& block, BlockData& target)
+    {
+        LengthPosSet::const_iterator it = mFreeBlocksBySize.lower_bound(LengthPosSet::value_type(block.Length, 0));
+
+        for(;it != mFreeBlocksBySize.end();++it)
+        {
+            if(it->second > block.Start)
+                continue;
+
+            /* A block can not grow without shifting the contents of following blocks, so the rest
+               of the free block must either be empty or large enough to hold a free block header */
+            if(it->first == block.Length || it->first > block.Length + (ofs64)sizeof(strBlockHeader))
+            {
+                target = mFreeBlocks[it->second];
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::_compactBlock(OfsEntryDesc *desc, unsigned int index, const BlockData& target)
+    {
+        BlockData block = desc->UsedBlocks[index];
+
+        strCompactJournal move;
+        memcpy(move.ID, COMPACT_JOURNAL_ID, 4);
+        move.Type = block.Type;
+        move.SrcPos = block.Start;
+        move.DestPos = target.Start;
+        move.Length = block.Length;
+        move.NewLength = block.Length;
+        move.FreePos = 0;
+        move.FreeLength = 0;
+        move.PointerPos = 0;
+
+        if(target.Length > block.Length)
+        {
+            move.FreePos = target.Start + block.Length + sizeof(strBlockHeader);
+            move.FreeLength = target.Length - block.Length - sizeof(strBlockHeader);
+        }
+
+        if(index == 1)
+            move.PointerPos = desc->UsedBlocks[0].Start + offsetof(strMainEntryHeader, NextBlock);
+        else if(index > 1)
+            move.PointerPos = desc->UsedBlocks[index - 1].Start + offsetof(strExtendedEntryHeader, NextBlock);
+
+        /* The journal must be on disk before the file system is touched, so an interrupted move can be completed on mount */
+        std::string journal_name = _getCompactJournalName();
+        FileStream journal;
+        OPEN_STREAM(journal, journal_name.c_str(), "wb");
+
+        if(journal.fail())
+        {
+            OFS_EXCEPT("_Ofs::compactFileSystem, Can not create compaction journal.");
+            return OFS_IO_ERROR;
+        }
+
+        journal.write((char*)&move, sizeof(strCompactJournal));
+        journal.commit();
+        journal.close();
+
+        _applyCompactMove(move);
+
+        remove(journal_name.c_str());
+
+        _eraseFreeBlock(target);
+
+        if(move.FreePos != 0)
+        {
+            BlockData freeBlock;
+            freeBlock.Type = OFS_FREE_BLOCK;
+            freeBlock.Start = move.FreePos;
+            freeBlock.Length = move.FreeLength;
+            freeBlock.NextBlock = 0;
+            _insertFreeBlock(freeBlock);
+        }
+
+        desc->UsedBlocks[index].Start = move.DestPos;
+        desc->UsedBlocks[index].Length = move.NewLength;
+
+        if(index > 0)
+            desc->UsedBlocks[index - 1].NextBlock = move.DestPos;
+
+        _markUnused(block);
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _Ofs::_applyCompactMove(const strCompactJournal& move)
+    {
+        /* Positional reads bypass stdio buffers, flush them so the source data is current */
+        mStream.flush();
+
+        char *tmp_buffer = new char[COMPACT_BUFFER_SIZE];
+
+        for(ofs64 copied = 0;copied < move.Length;)
+        {
+            unsigned int amount = COMPACT_BUFFER_SIZE;
+            if(move.Length - copied < amount)
+                amount = (unsigned int)(move.Length - copied);
+
+            mStream.readAt(move.SrcPos + copied, tmp_buffer, amount);
+            mStream.seek(move.DestPos + copied, OFS_SEEK_BEGIN);
+            mStream.write(tmp_buffer, amount);
+
+            copied += amount;
+        }
+
+        delete [] tmp_buffer;
+
+        strBlockHeader blHeader;
+        blHeader.Signature[0] = mHeader.BLOCK_HEADER_SIG[0];
+        blHeader.Signature[1] = mHeader.BLOCK_HEADER_SIG[1];
+        blHeader.Reserved = 0;
+
+        if(move.FreePos != 0)
+        {
+            blHeader.Type = OFS_FREE_BLOCK;
+            blHeader.Length = move.FreeLength;
+            mStream.seek(move.FreePos - sizeof(strBlockHeader), OFS_SEEK_BEGIN);
+            mStream.write((char*)&blHeader, sizeof(strBlockHeader));
+        }
+
+        blHeader.Type = move.Type;
+        blHeader.Length = move.NewLength;
+        mStream.seek(move.DestPos - sizeof(strBlockHeader), OFS_SEEK_BEGIN);
+        mStream.write((char*)&blHeader, sizeof(strBlockHeader));
+
+        if(move.PointerPos != 0)
+        {
+            mStream.seek(move.PointerPos, OFS_SEEK_BEGIN);
+            mStream.write((char*)&(move.DestPos), sizeof(ofs64));
+        }
+
+        unsigned int old_type = move.Type | OFS_FREE_BLOCK;
+        mStream.seek(move.SrcPos - sizeof(strBlockHeader) + offsetof(strBlockHeader, Type), OFS_SEEK_BEGIN);
+        mStream.write((char*)&old_type, sizeof(unsigned int));
+
+        mStream.commit();
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _Ofs::_replayCompactJournal()
+    {
+        std::string journal_name = _getCompactJournalName();
+        FileStream journal;
+        OPEN_STREAM(journal, journal_name.c_str(), "rb");
+
+        if(journal.fail())
+            return;
+
+        strCompactJournal move;
+        bool valid = (journal.read((char*)&move, sizeof(strCompactJournal)) == sizeof(strCompactJournal));
+        journal.close();
+
+        /* An incomplete journal means the move itself never started */
+        valid = valid && memcmp(move.ID, COMPACT_JOURNAL_ID, 4) == 0 && move.Length > 0 && move.DestPos < move.SrcPos;
+
+        if(valid)
+            _applyCompactMove(move);
+
+        remove(journal_name.c_str());
+    }
+
+//------------------------------------------------------------------------------------------
+
+    std::string _Ofs::_getCompactJournalName()
+    {
+        return mFileName + ".compact";
+    }
+
+//------------------------------------------------------------------------------------------
+
+    std::string _Ofs::_getTransactionJournalName()
+    {
+        return mFileName + ".journal";
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::beginTransaction()
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::beginTransaction, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(mTransactionDepth == 0 && !mStream.beginUndoJournal(_getTransactionJournalName().c_str()))
+        {
+            OFS_EXCEPT("_Ofs::beginTransaction, Can not create transaction journal.");
+            return OFS_IO_ERROR;
+        }
+
+        mTransactionDepth++;
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::commitTransaction()
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::commitTransaction, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(mTransactionDepth == 0)
+        {
+            OFS_EXCEPT("_Ofs::commitTransaction, No transaction to commit.");
+            return OFS_IO_ERROR;
+        }
+
+        if(--mTransactionDepth > 0)
+            return OFS_OK;
+
+        if(mTransactionAborted)
+        {
+            _rollbackTransaction();
+            return OFS_IO_ERROR;
+        }
+
+        mStream.commitUndoJournal();
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::abortTransaction()
+    {
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_Ofs::abortTransaction, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(mTransactionDepth == 0)
+        {
+            OFS_EXCEPT("_Ofs::abortTransaction, No transaction to abort.");
+            return OFS_IO_ERROR;
+        }
+
+        mTransactionAborted = true;
+
+        if(--mTransactionDepth > 0)
+            return OFS_OK;
+
+        return _rollbackTransaction();
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _Ofs::_rollbackTransaction()
+    {
+        mTransactionAborted = false;
+
+        /* Handles of open files would point to freed entries after reloading */
+        if(!mActiveFiles.empty())
+        {
+            mStream.commitUndoJournal();
+            return OFS_ACCESS_DENIED;
+        }
+
+        std::string fileName = mFileName;
+
+        unsigned int op = OFS_MOUNT_OPEN;
+        if(mRecoveryMode)
+            op |= OFS_MOUNT_RECOVER;
+        if(mLinkMode)
+            op |= OFS_MOUNT_LINK;
+        if(mDedupMode)
+            op |= OFS_MOUNT_DEDUP;
+        if(mStream.isMapped())
+            op |= OFS_MOUNT_MMAP;
+
+        /* Triggers and links are not stored in the file, they are put back on the reloaded entries */
+        std::vector<CallBackData> triggers = mTriggers;
+        std::vector<EntryState> states;
+        _saveEntryState(&mRootDir, "/", states);
+
+        mStream.abortUndoJournal();
+
+        _clear();
+
+        OfsResult ret = _mount(fileName.c_str(), op);
+        if(ret != OFS_OK)
+            return ret;
+
+        mTriggers = triggers;
+
+        for(unsigned int i = 0;i < states.size();i++)
+        {
+            const std::string& path = states[i].Path;
+            OfsEntryDesc *desc = _getDirectoryDesc(path.c_str());
+
+            if(desc != NULL && path[path.length() - 1] != '/')
+                desc = _getFileDesc(desc, _extractFileName(path.c_str()));
+
+            /* Entries created by the rolled back batch are gone along with their state */
+            if(desc == NULL)
+                continue;
+
+            desc->Triggers = states[i].Triggers;
+
+            for(unsigned int j = 0;j < states[i].Links.size();j++)
+                linkFileSystem(states[i].Links[j].c_str(), path.c_str());
+        }
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _Ofs::_saveEntryState(OfsEntryDesc *desc, const std::string& path, std::vector<EntryState>& states)
+    {
+        if(!desc->Triggers.empty() || !desc->Links.empty())
+        {
+            EntryState state;
+            state.Path = path;
+            state.Triggers = desc->Triggers;
+
+            for(NameOfsPtrMap::const_iterator it = desc->Links.begin();it != desc->Links.end();it++)
+                state.Links.push_back(it->first);
+
+            states.push_back(state);
+        }
+
+        for(unsigned int i = 0;i < desc->Children.size();i++)
+        {
+            OfsEntryDesc *child = desc->Children[i];
+
+            /* Entries of linked file systems belong to their owners */
+            if(child->Owner != this)
+                continue;
+
+            if(child->Flags & OFS_DIR)
+                _saveEntryState(child, path + child->Name + "/", states);
+            else
+                _saveEntryState(child, path + child->Name, states);
+        }
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _Ofs::_truncateFreeTail()
+    {
+        if(mFreeBlocks.empty())
+            return;
+
+        BlockData last = mFreeBlocks.rbegin()->second;
+
+        mStream.seek(0, OFS_SEEK_END);
+        if(last.Start + last.Length != mStream.tell())
+            return;
+
+        if(mStream.truncate(last.Start - sizeof(strBlockHeader)))
+            _eraseFreeBlock(last);
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _Ofs::_linkSharedFiles()
+    {
+        IdDescMap shared;
+
+        for(unsigned int i = 0;i < mDedupRoot.Children.size();i++)
+        {
+            mDedupRoot.Children[i]->ShareCount = 0;
+            shared.insert(IdDescMap::value_type(mDedupRoot.Children[i]->Id, mDedupRoot.Children[i]));
+        }
+
+        _linkSharedFilesRecursive(&mRootDir, shared);
+        _linkSharedFilesRecursive(&mRecycleBinRoot, shared);
+
+        if(mLinkMode)
+            return;
+
+        /* Contents left without references by an interrupted delete are released */
+        unsigned int i = 0;
+        while(i < mDedupRoot.Children.size())
+        {
+            if(mDedupRoot.Children[i]->ShareCount == 0)
+                _freeShared(mDedupRoot.Children[i]);
+            else
+                i++;
+        }
+    }
+
+//------------------------------------------------------------------------------------------
 
-            destStream.close();
-            mStream.close();
+    void _Ofs::_linkSharedFilesRecursive(OfsEntryDesc *desc, const IdDescMap& shared)
+    {
+        if(desc->Owner != this)
+            return;
 
-            OPEN_STREAM(mStream, dest, "rb+");
-            if(!mStream.fail())
+        if(desc->Flags & OFS_DEDUP)
+        {
+            strDedupReference reference;
+
+            _readData(desc->UsedBlocks[0].Start + sizeof(strMainEntryHeader), (char*)&reference, sizeof(strDedupReference));
+
+            IdDescMap::const_iterator it = shared.end();
+
+            if(memcmp(reference.ID, DEDUP_REFERENCE_ID, 4) == 0)
+                it = shared.find(reference.SharedId);
+
+            if(it != shared.end())
             {
-                STATIC_LOCK_AUTO_MUTEX
-                mAllocatedHandles.erase(mAllocatedHandles.find(mFileName));
-                mActive = true;
-                mFileName = dest;
-                ret = OFS_OK;
-                mAllocatedHandles.insert(NameOfsHandleMap::value_type(std::string(dest), this));
+                desc->SharedData = it->second;
+                desc->SharedData->ShareCount++;
             }
             else
             {
-                mActive = false;
-                mFileName = "";
-                ret = OFS_INVALID_FILE;
+                /* The shared contents are lost, the file is left empty rather than failing the mount */
+                desc->SharedData = NULL;
+                desc->FileSize = 0;
             }
         }
-        
-        return ret;
+
+        for(unsigned int i = 0;i < desc->Children.size();i++)
+            _linkSharedFilesRecursive(desc->Children[i], shared);
     }
 
 //------------------------------------------------------------------------------------------
 
-    OfsResult _Ofs::switchFileSystemTo(const char *dest)
+    bool _Ofs::_canShare(OfsEntryDesc *file)
     {
-        LOCK_AUTO_MUTEX
+        return !(file->Flags & (OFS_COMPRESSED | OFS_DEDUP | OFS_LINK)) && (file->FileSize >= DEDUP_MIN_SIZE);
+    }
 
-        if(!mActive)
-        {
-            OFS_EXCEPT("_Ofs::switchFileSystemTo, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
-        }
+//------------------------------------------------------------------------------------------
 
-        OfsResult ret = OFS_INVALID_FILE;
+    std::string _Ofs::_getSharedName(ofs64 hash, ofs64 size)
+    {
+        char name[64];
 
-        {
-            STATIC_LOCK_AUTO_MUTEX
+        sprintf(name, "%016llx-%llx", (unsigned long long)hash, (unsigned long long)size);
 
-            NameOfsHandleMap::iterator it = mAllocatedHandles.find(std::string(dest));
+        return std::string(name);
+    }
 
-            if(it != mAllocatedHandles.end())
-                return ret;
-        }
+//------------------------------------------------------------------------------------------
 
-        FileStream destStream;
-        OPEN_STREAM(destStream, dest, "rb+");
+    ofs64 _Ofs::_hashContents(OfsEntryDesc *desc)
+    {
+        OFSHANDLE handle(desc);
+        handle._preparePointers(false);
 
-        if(!destStream.fail())
+        char *buffer = new char[DEDUP_BUFFER_SIZE];
+        ofs64 hash = DEDUP_HASH_SEED;
+        unsigned int length;
+
+        while((length = _readRaw(handle, buffer, DEDUP_BUFFER_SIZE)) > 0)
+            hash = dedupHash(hash, buffer, length);
+
+        delete [] buffer;
+
+        return hash;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    _Ofs::OfsEntryDesc* _Ofs::_findSharedContents(const std::string& name, OfsEntryDesc *file, const char *data, ofs64 size)
+    {
+        std::pair<NameDescMap::iterator, NameDescMap::iterator> range = mDedupRoot.ChildIndex.equal_range(name);
+
+        if(range.first == range.second)
+            return NULL;
+
+        char *sharedBuffer = new char[DEDUP_BUFFER_SIZE];
+        char *fileBuffer = (file != NULL) ? new char[DEDUP_BUFFER_SIZE] : NULL;
+        OfsEntryDesc *found = NULL;
+
+        /* Equal hashes are not trusted, the contents are compared before sharing them */
+        for(NameDescMap::iterator it = range.first;it != range.second && found == NULL;++it)
         {
-            destStream.close();
-            mStream.close();
+            OfsEntryDesc *shared = it->second;
 
-            OPEN_STREAM(mStream, dest, "rb+");
-            if(!mStream.fail())
-            {
-                STATIC_LOCK_AUTO_MUTEX
-                mAllocatedHandles.erase(mAllocatedHandles.find(mFileName));
-                mActive = true;
-                mFileName = dest;
-                mStream.seek(0, OFS_SEEK_BEGIN);
-                mStream.read((char*)&mHeader, sizeof(_Ofs::strFileHeader));
-                ret = OFS_OK;
-                mAllocatedHandles.insert(NameOfsHandleMap::value_type(std::string(dest), this));
-            }
-            else
+            if(shared->FileSize != size)
+                continue;
+
+            OFSHANDLE sharedHandle(shared);
+            sharedHandle._preparePointers(false);
+
+            OFSHANDLE fileHandle(file);
+            if(file != NULL)
+                fileHandle._preparePointers(false);
+
+            ofs64 pos = 0;
+            bool equal = true;
+
+            while(equal && pos < size)
             {
-                mActive = false;
-                mFileName = "";
-                ret = OFS_INVALID_FILE;
+                unsigned int length = _readRaw(sharedHandle, sharedBuffer, DEDUP_BUFFER_SIZE);
+
+                if(length == 0)
+                    equal = false;
+                else if(file != NULL)
+                    equal = (_readRaw(fileHandle, fileBuffer, length) == length) && (memcmp(sharedBuffer, fileBuffer, length) == 0);
+                else
+                    equal = (memcmp(sharedBuffer, data + pos, length) == 0);
+
+                pos += length;
             }
+
+            if(equal)
+                found = shared;
         }
-        
-        return ret;
+
+        delete [] sharedBuffer;
+        delete [] fileBuffer;
+
+        return found;
     }
 
 //------------------------------------------------------------------------------------------
 
-    OfsResult _Ofs::defragFileSystemTo(const char *dest, LogCallBackFunction* logCallbackFunc)
+    _Ofs::OfsEntryDesc* _Ofs::_createSharedFile(OfsEntryDesc *parent, const std::string& name, const UUID& uuid, time_t creation_time, unsigned int flags, OfsEntryDesc *shared)
     {
-        LOCK_AUTO_MUTEX
+        assert(parent != NULL && shared != NULL);
 
-        if(!mActive)
+        OfsEntryDesc *file = new OfsEntryDesc();
+
+        file->Owner = this;
+        file->Id = mHeader.LAST_ID++;
+        file->ParentId = parent->Id;
+        file->Flags = OFS_FILE | OFS_DEDUP | (flags & (OFS_READONLY | OFS_HIDDEN));
+        file->OldParentId = ROOT_DIRECTORY_ID;
+        file->Name = name;
+        file->FileSize = shared->FileSize;
+        file->Parent = parent;
+        file->CreationTime = creation_time;
+        file->UseCount = 0;
+        file->WriteLocked = false;
+        file->Uuid = uuid;
+        file->SharedData = shared;
+
+        shared->ShareCount++;
+
+        _addChild(parent, file);
+
+        if(uuid != UUID_ZERO)
+            mUuidMap.insert(UuidDescMap::value_type(uuid, file));
+
+        strMainEntryHeader fileHeader;
+
+        fileHeader.Id = file->Id;
+        fileHeader.ParentId = file->ParentId;
+        fileHeader.Flags = file->Flags;
+        fileHeader.OldParentId = ROOT_DIRECTORY_ID;
+        fileHeader.NextBlock = 0;
+        fileHeader.UncompressedSize = 0;
+        fileHeader.FileSize = file->FileSize;
+        fileHeader.CreationTime = file->CreationTime;
+
+        int sz = file->Name.length();
+        if(sz > 251)
+            sz = 251;
+        memcpy(fileHeader.Name, file->Name.c_str(), sz);
+        fileHeader.Name[sz] = 0;
+        fileHeader.Uuid = file->Uuid;
+
+        strDedupReference reference;
+
+        memcpy(reference.ID, DEDUP_REFERENCE_ID, 4);
+        reference.SharedId = shared->Id;
+        reference.RESERVED[0] = reference.RESERVED[1] = 0;
+
+        _allocateFileBlock(file, fileHeader, sizeof(strMainEntryHeader) + sizeof(strDedupReference), sizeof(strDedupReference), (const char*)&reference);
+
+        return file;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    _Ofs::OfsEntryDesc* _Ofs::_dedupFile(OfsEntryDesc *file)
+    {
+        assert(file != NULL && file->Owner == this);
+
+        std::string sharedName = _getSharedName(_hashContents(file), file->FileSize);
+        OfsEntryDesc *shared = _findSharedContents(sharedName, file, NULL, file->FileSize);
+
+        /* The reference is on disk before the original entry goes away, a crash leaves a duplicate instead of a loss */
+        OfsEntryDesc *parent = file->Parent;
+
+        _removeChild(parent, file);
+
+        if(file->Uuid != UUID_ZERO)
+            mUuidMap.erase(file->Uuid);
+
+        OfsEntryDesc *reference = _createSharedFile(parent, file->Name, file->Uuid, (time_t)file->CreationTime, file->Flags, (shared != NULL) ? shared : file);
+
+        reference->Triggers.swap(file->Triggers);
+        _retargetPendingTriggers(file, reference);
+
+        if(shared != NULL)
         {
-            OFS_EXCEPT("_Ofs::defragFileSystemTo, Operation called on an unmounted file system.");
-            return OFS_IO_ERROR;
+            for(unsigned int i = 0;i < file->UsedBlocks.size();i++)
+                _markUnused(file->UsedBlocks[i]);
+
+            delete file;
+        }
+        else
+        {
+            /* No match, the file's own blocks become the shared contents */
+            file->Parent = &mDedupRoot;
+            file->ParentId = DEDUP_DIRECTORY_ID;
+            file->OldParentId = ROOT_DIRECTORY_ID;
+            file->Flags = OFS_FILE;
+            file->Uuid = UUID_ZERO;
+            file->Name = sharedName;
+
+            _addChild(&mDedupRoot, file);
+
+            strMainEntryHeader fileHeader;
+
+            fileHeader.Id = file->Id;
+            fileHeader.ParentId = file->ParentId;
+            fileHeader.Flags = file->Flags;
+            fileHeader.OldParentId = file->OldParentId;
+            fileHeader.NextBlock = file->UsedBlocks[0].NextBlock;
+            fileHeader.UncompressedSize = 0;
+            fileHeader.FileSize = file->FileSize;
+            fileHeader.CreationTime = file->CreationTime;
+            memset(fileHeader.Name, 0, sizeof(fileHeader.Name));
+            memcpy(fileHeader.Name, file->Name.c_str(), file->Name.length());
+            fileHeader.Uuid = file->Uuid;
+
+            mStream.seek(file->UsedBlocks[0].Start, OFS_SEEK_BEGIN);
+            mStream.write((char*)&fileHeader, sizeof(strMainEntryHeader));
+            mStream.flush();
         }
 
-        OfsResult ret = OFS_INVALID_FILE;
+        return reference;
+    }
 
-        FileList allFiles;
+//------------------------------------------------------------------------------------------
 
-        listFilesRecursive("/", allFiles);
+    void _Ofs::_unshareFile(OfsEntryDesc *file, bool keep_contents)
+    {
+        OfsEntryDesc *shared = file->SharedData;
 
-        std::sort(allFiles.begin(), allFiles.end(), FileEntry::Compare);
+        file->FileSize = 0;
 
-        OfsPtr destFile;
-        ret = destFile.mount(dest, OFS_MOUNT_CREATE);
+        if(keep_contents && shared != NULL)
+        {
+            OFSHANDLE src(shared);
+            src._preparePointers(false);
 
-        if(ret == OFS_OK)
+            /* Room for the whole contents in one extended block instead of one per buffer */
+            ofs64 capacity = file->UsedBlocks[0].Length - sizeof(strMainEntryHeader);
+            if(file->UsedBlocks.size() == 1 && shared->FileSize > capacity)
+                _allocateExtendedFileBlock(file, sizeof(strExtendedEntryHeader) + shared->FileSize - capacity);
+
+            OFSHANDLE dest(file);
+            dest._preparePointers(false);
+
+            char *buffer = new char[DEDUP_BUFFER_SIZE];
+            unsigned int length;
+
+            while((length = _readRaw(src, buffer, DEDUP_BUFFER_SIZE)) > 0)
+                _writeRaw(dest, buffer, length);
+
+            delete [] buffer;
+        }
+        else
         {
-            OFSHANDLE out_handle;
-            OFSHANDLE in_handle;
+            mStream.seek(file->UsedBlocks[0].Start + offsetof(strMainEntryHeader, FileSize), OFS_SEEK_BEGIN);
+            mStream.write((char*)&(file->FileSize), sizeof(ofs64));
+        }
 
-            ofs64 output_amount = 0;
+        /* The flag goes last, until then the file still reads as a reference */
+        file->Flags &= ~OFS_DEDUP;
 
-            char *tmp_buffer = new char[MAX_BUFFER_SIZE];
+        mStream.seek(file->UsedBlocks[0].Start + offsetof(strMainEntryHeader, Flags), OFS_SEEK_BEGIN);
+        mStream.write((char*)&(file->Flags), sizeof(unsigned int));
+        mStream.flush();
 
-            for(unsigned int i = 0;i < allFiles.size();i++)
-            {
-                if(allFiles[i].flags & OFS_LINK)
-                    continue;
+        _releaseShared(file);
+    }
 
-                if(logCallbackFunc)
-                    (*logCallbackFunc)(std::string("Defragmenting ").append(allFiles[i].name));
+//------------------------------------------------------------------------------------------
 
-                if(allFiles[i].flags & OFS_DIR)
-                {
-                    destFile->createDirectoryUUID(allFiles[i].name.c_str(), allFiles[i].uuid);
-                    destFile->setDirFlags(allFiles[i].name.c_str(), allFiles[i].flags);
-                }
-                else
-                {
-                    std::string file_ofs_path = allFiles[i].name;
+    void _Ofs::_unshareHandle(OFSHANDLE& handle)
+    {
+        ofs64 pos = handle.mPos;
 
-                    try
-                    {
-                        OfsResult ret = openFile(in_handle, file_ofs_path.c_str());
-                        if(ret != OFS_OK)
-                            continue;
+        {
+            boost::mutex::scoped_lock activeLock(mActiveFilesMutex);
 
-                        ofs64 total = allFiles[i].file_size;
+            handle.mDataDesc->UseCount--;
+        }
 
-                        bool dest_file_created = false;
+        handle.mDataDesc = NULL;
 
-                        while(total > 0)
-                        {
-                            if(total < MAX_BUFFER_SIZE)
-                            {
-                                read(in_handle, tmp_buffer, (unsigned int)total);
-                                if(dest_file_created)
-                                    destFile->write(out_handle, tmp_buffer, (unsigned int)total);
-                                else
-                                {
-                                    destFile->createFileUUID(out_handle, file_ofs_path.c_str(), allFiles[i].uuid, total, (unsigned int)total, tmp_buffer);
-                                    destFile->setFileFlags(out_handle, allFiles[i].flags);
-                                }
+        _unshareFile(handle.mEntryDesc, true);
 
-                                output_amount += total;
-                                total = 0;
-                            }
-                            else
-                            {
-                                read(in_handle, tmp_buffer, MAX_BUFFER_SIZE);
-                                if(dest_file_created)
-                                    destFile->write(out_handle, tmp_buffer, MAX_BUFFER_SIZE);
-                                else
-                                {
-                                    destFile->createFileUUID(out_handle, file_ofs_path.c_str(), allFiles[i].uuid, MAX_BUFFER_SIZE, MAX_BUFFER_SIZE, tmp_buffer);
-                                    destFile->setFileFlags(out_handle, allFiles[i].flags);
-                                    dest_file_created = true;
-                                }
+        handle._preparePointers(false);
+        handle._setPos(pos);
+    }
 
-                                total -= MAX_BUFFER_SIZE;
-                                output_amount += MAX_BUFFER_SIZE;
-                            }
-                        }
-                    }
-                    catch(...)
-                    {
-                    }
+//------------------------------------------------------------------------------------------
 
-                    if(out_handle._valid())
-                        destFile->closeFile(out_handle);
-                    if(in_handle._valid())
-                        closeFile(in_handle);
-                }
-            }
+    void _Ofs::_releaseShared(OfsEntryDesc *file)
+    {
+        OfsEntryDesc *shared = file->SharedData;
 
-            if(logCallbackFunc)
-                (*logCallbackFunc)(std::string("Defragmenting completed."));
+        if(shared == NULL)
+            return;
 
-            delete [] tmp_buffer;
+        file->SharedData = NULL;
 
-            ret = OFS_OK;
-        }
+        if(--shared->ShareCount == 0 && shared->UseCount == 0)
+            _freeShared(shared);
+    }
 
-        return ret;
+//------------------------------------------------------------------------------------------
+
+    void _Ofs::_freeShared(OfsEntryDesc *shared)
+    {
+        _removeChild(&mDedupRoot, shared);
+
+        for(unsigned int i = 0;i < shared->UsedBlocks.size();i++)
+            _markUnused(shared->UsedBlocks[i]);
+
+        delete shared;
     }
 
 //------------------------------------------------------------------------------------------
@@ -3712,11 +6559,11 @@ namespace OFS
     }
 
 //------------------------------------------------------------------------------------------
-    OfsResult _Ofs::addTrigger(void *_owner, _Ofs::CallBackType _type, _Ofs::CallBackFunction _func, void *_data)
+    OfsResult _Ofs::addTrigger(void *_owner, _Ofs::CallBackType _type, _Ofs::CallBackFunction _func, void *_data, unsigned int _interval)
     {
         assert(_owner != 0);
 
-        LOCK_AUTO_MUTEX
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -3729,6 +6576,7 @@ namespace OFS
         tdata.type = _type;
         tdata.func = _func;
         tdata.data = _data;
+        tdata.interval = _interval;
 
         mTriggers.push_back(tdata);
 
@@ -3739,7 +6587,7 @@ namespace OFS
     {
         assert(_owner != 0);
 
-        LOCK_AUTO_MUTEX
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -3752,6 +6600,7 @@ namespace OFS
             if(mTriggers[i].owner == _owner && mTriggers[i].type == _type)
             {
                 mTriggers.erase(mTriggers.begin() + i);
+                _dropPendingTriggers(_owner, _type);
                 return;
             }
         }
@@ -3763,7 +6612,7 @@ namespace OFS
     {
         assert(_owner != 0);
 
-        LOCK_AUTO_MUTEX
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -3788,6 +6637,7 @@ namespace OFS
         tdata.type = _type;
         tdata.func = _func;
         tdata.data = _data;
+        tdata.interval = 0;
 
         fileDesc->Triggers.push_back(tdata);
 
@@ -3798,7 +6648,7 @@ namespace OFS
     {
         assert(_owner != 0);
 
-        LOCK_AUTO_MUTEX
+        LOCK_EXCLUSIVE_AUTO_MUTEX(&mStream)
 
         if(!mActive)
         {
@@ -3823,6 +6673,7 @@ namespace OFS
             if(fileDesc->Triggers[i].owner == _owner && fileDesc->Triggers[i].type == _type)
             {
                 fileDesc->Triggers.erase(fileDesc->Triggers.begin() + i);
+                _dropPendingTriggers(_owner, _type);
                 return;
             }
         }
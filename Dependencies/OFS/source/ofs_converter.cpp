@@ -34,6 +34,7 @@
 #include "ofs14.h"
 #include "ofs_converter.h"
 #include <algorithm>
+#include <stdio.h>
 
 using namespace std;
 
@@ -46,7 +47,11 @@ using namespace std;
 namespace OFS
 {
 
-    
+    /* Size of the buffer files are copied through */
+    const unsigned int CONVERT_BUFFER_SIZE = 1024 * 1024;
+    /* Amount of data converted between two commits, an interruption loses at most this much work */
+    const ofs64 CONVERT_BATCH_SIZE = 64 * 1024 * 1024;
+
  //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
@@ -63,12 +68,14 @@ namespace OFS
 
 //------------------------------------------------------------------------------
 
-    bool OfsConverter::convert(std::string infile, std::string outfile)
+    bool OfsConverter::convert(std::string infile, std::string outfile, LogCallBackFunction* logCallbackFunc)
     {
         OPEN_STREAM(mInStream, infile.c_str(), fstream::in | fstream::out | fstream::binary | fstream::ate);
         if(mInStream.fail() || !mInStream.is_open())
             return false;
 
+        ofs64 source_size = mInStream.tellg();
+
         _Ofs::strFileHeader fsHeader;
 
         mInStream.seekg(0, fstream::beg);
@@ -94,7 +101,7 @@ namespace OFS
         {
             switch(file_version)
             {
-            case 13:return _convertv13_v14(infile, outfile);
+            case 13:return _convertv13_v14(infile, outfile, source_size, logCallbackFunc);
             };
         }
 
@@ -103,111 +110,195 @@ namespace OFS
 
 //------------------------------------------------------------------------------
 
-    bool OfsConverter::_convertv13_v14(std::string infile, std::string outfile)
+    bool OfsConverter::_convertv13_v14(std::string infile, std::string outfile, ofs64 source_size, LogCallBackFunction* logCallbackFunc)
     {
         OFS13::OfsPtr    srcFile;
         OfsPtr           destFile;
         OFS13::OfsResult ret1;
         OfsResult        ret2;
 
+        /* Exists while a conversion is unfinished, names the source it belongs to */
+        std::string resume_file = outfile + ".resume";
+        bool resume = false;
+
+        {
+            std::ifstream resume_stream(resume_file.c_str());
+            std::string resume_name;
+            ofs64 resume_size = 0;
+
+            if(std::getline(resume_stream, resume_name) && (resume_stream >> resume_size))
+                resume = (resume_name == infile && resume_size == source_size);
+        }
+
         ret1 = srcFile.mount(infile.c_str(), OFS13::OFS_MOUNT_OPEN);
 
         if( ret1 != OFS13::OFS_OK )
             return false;
 
-        ret2 = destFile.mount(outfile.c_str(), OFS_MOUNT_CREATE);
+        /* Opening rolls back the batch which was being converted when the previous run stopped */
+        if(resume)
+            resume = (destFile.mount(outfile.c_str(), OFS_MOUNT_OPEN) == OFS_OK);
 
-        if( ret2 != OFS_OK )
-            return false;
+        if(!resume)
+        {
+            ret2 = destFile.mount(outfile.c_str(), OFS_MOUNT_CREATE);
+
+            if( ret2 != OFS_OK )
+                return false;
+
+            std::ofstream resume_stream(resume_file.c_str(), ofstream::trunc);
+            resume_stream << infile << "\n" << source_size << "\n";
+        }
 
-        
         OFS13::FileList allFiles;
 
         srcFile->listFilesRecursive("/", allFiles);
 
         std::sort(allFiles.begin(), allFiles.end(), OFS13::FileEntry::Compare);
 
-        if(ret2 == OFS_OK)
+        ofs64 total_amount = 0;
+
+        for(unsigned int i = 0;i < allFiles.size();i++)
         {
-            OFS13::OFSHANDLE in_handle;
-            OFSHANDLE        out_handle;
+            if(allFiles[i].flags & OFS13::OFS_FILE)
+                total_amount += allFiles[i].file_size;
+        }
 
-            unsigned int output_amount = 0;
+        if(logCallbackFunc)
+            (*logCallbackFunc)(std::string(resume ? "Resuming conversion of " : "Converting ").append(infile));
 
-            char *tmp_buffer = new char[MAX_BUFFER_SIZE];
+        OFS13::OFSHANDLE in_handle;
+        OFSHANDLE        out_handle;
 
-            for(unsigned int i = 0;i < allFiles.size();i++)
+        ofs64 output_amount = 0;
+        ofs64 batch_amount = 0;
+        int   last_percent = -1;
+        bool  success = true;
+
+        char *tmp_buffer = new char[CONVERT_BUFFER_SIZE];
+
+        destFile->beginTransaction();
+
+        for(unsigned int i = 0;i < allFiles.size();i++)
+        {
+            if(allFiles[i].flags & OFS13::OFS_DIR)
             {
-                if(allFiles[i].flags & OFS13::OFS_DIR)
+                FileEntry entry;
+
+                /* Version 14 resolves a path without the trailing '/' to its parent directory */
+                std::string dir_ofs_path = allFiles[i].name + "/";
+
+                /* Directory flags propagate to children, so directories kept from an earlier run are left as they are */
+                if(!resume || destFile->getDirEntry(dir_ofs_path.c_str(), entry) != OFS_OK)
                 {
-                    destFile->createDirectoryUUID(allFiles[i].name.c_str(), *((OFS::UUID*)&allFiles[i].uuid));
-                    destFile->setDirFlags(allFiles[i].name.c_str(), allFiles[i].flags);
+                    destFile->createDirectoryUUID(dir_ofs_path.c_str(), *((OFS::UUID*)&allFiles[i].uuid));
+                    destFile->setDirFlags(dir_ofs_path.c_str(), allFiles[i].flags);
                 }
-                else
+                continue;
+            }
+
+            std::string file_ofs_path = allFiles[i].name;
+            unsigned int total = allFiles[i].file_size;
+
+            ofs64 converted_size = 0;
+
+            /* Files of committed batches are complete, anything else is converted again */
+            if(resume && destFile->getFileSize(file_ofs_path.c_str(), converted_size) == OFS_OK)
+            {
+                if(converted_size == total)
                 {
-                    std::string file_ofs_path = allFiles[i].name;
+                    output_amount += total;
+                    continue;
+                }
 
-                    try
-                    {
-                        ret1 = srcFile->openFile(in_handle, file_ofs_path.c_str());
-                        if(ret1 != OFS13::OFS_OK)
-                            continue;
-
-                        unsigned int total = allFiles[i].file_size;
-
-                        bool dest_file_created = false;
-
-                        while(total > 0)
-                        {
-                            if(total < MAX_BUFFER_SIZE)
-                            {
-                                srcFile->read(in_handle, tmp_buffer, total);
-                                if(dest_file_created)
-                                    destFile->write(out_handle, tmp_buffer, total);
-                                else
-                                {
-                                    destFile->createFileUUID(out_handle, file_ofs_path.c_str(), *((OFS::UUID*)&allFiles[i].uuid), total, total, tmp_buffer);
-                                    destFile->setFileFlags(out_handle, allFiles[i].flags);
-                                }
-
-                                output_amount += total;
-                                total = 0;
-                            }
-                            else
-                            {
-                                srcFile->read(in_handle, tmp_buffer, MAX_BUFFER_SIZE);
-                                if(dest_file_created)
-                                    destFile->write(out_handle, tmp_buffer, MAX_BUFFER_SIZE);
-                                else
-                                {
-                                    destFile->createFileUUID(out_handle, file_ofs_path.c_str(), *((OFS::UUID*)&allFiles[i].uuid), MAX_BUFFER_SIZE, MAX_BUFFER_SIZE, tmp_buffer);
-                                    destFile->setFileFlags(out_handle, allFiles[i].flags);
-                                    dest_file_created = true;
-                                }
-
-                                total -= MAX_BUFFER_SIZE;
-                                output_amount += MAX_BUFFER_SIZE;
-                            }
-                        }
-                    }
-                    catch(...)
+                destFile->deleteFile(file_ofs_path.c_str());
+            }
+
+            bool converted = false;
+
+            try
+            {
+                ret1 = srcFile->openFile(in_handle, file_ofs_path.c_str());
+
+                if(ret1 == OFS13::OFS_OK)
+                    ret2 = destFile->createFileUUID(out_handle, file_ofs_path.c_str(), *((OFS::UUID*)&allFiles[i].uuid));
+
+                if(ret1 == OFS13::OFS_OK && ret2 == OFS_OK)
+                {
+                    destFile->reserve(out_handle, total);
+
+                    converted = true;
+
+                    while(total > 0 && converted)
                     {
+                        unsigned int length = std::min(total, CONVERT_BUFFER_SIZE);
+                        unsigned int actual_read = 0;
+
+                        srcFile->read(in_handle, tmp_buffer, length, &actual_read);
+
+                        converted = (actual_read == length && destFile->write(out_handle, tmp_buffer, length) == OFS_OK);
+
+                        total -= length;
                     }
 
-                    if(out_handle._valid())
-                        destFile->closeFile(out_handle);
-                    if(in_handle._valid())
-                        srcFile->closeFile(in_handle);
+                    /* Flags are applied last, a read-only file would not accept the data */
+                    destFile->setFileFlags(out_handle, allFiles[i].flags);
                 }
             }
+            catch(...)
+            {
+                converted = false;
+            }
+
+            if(out_handle._valid())
+                destFile->closeFile(out_handle);
+            if(in_handle._valid())
+                srcFile->closeFile(in_handle);
+
+            if(!converted)
+            {
+                success = false;
+
+                if(logCallbackFunc)
+                    (*logCallbackFunc)(std::string("Failed to convert ").append(file_ofs_path));
+            }
+
+            output_amount += allFiles[i].file_size;
+            batch_amount += allFiles[i].file_size;
+
+            if(batch_amount >= CONVERT_BATCH_SIZE)
+            {
+                destFile->commitTransaction();
+                destFile->beginTransaction();
+                batch_amount = 0;
+            }
 
-            delete [] tmp_buffer;
+            int percent = (total_amount > 0) ? (int)((output_amount * 100) / total_amount) : 100;
 
-            srcFile.unmount();
-            destFile.unmount();
+            if(logCallbackFunc && percent != last_percent)
+            {
+                std::ostringstream msg;
+                msg << "Converting " << file_ofs_path << " (" << percent << "%)";
+                (*logCallbackFunc)(msg.str());
+
+                last_percent = percent;
+            }
         }
 
-        return true;
+        destFile->commitTransaction();
+
+        delete [] tmp_buffer;
+
+        srcFile.unmount();
+        destFile.unmount();
+
+        if(success)
+            remove(resume_file.c_str());
+
+        if(logCallbackFunc)
+            (*logCallbackFunc)(std::string(success ? "Conversion completed." : "Conversion completed with errors."));
+
+        return success;
     }
 
 //------------------------------------------------------------------------------
@@ -43,6 +43,9 @@ using namespace std;
 namespace OFS
 {
 
+    /* Longest time the tracking thread waits for changes before checking if it should stop */
+    const int TRACKING_POLL_INTERVAL = 100;
+
     std::string constructFullPath( _OfsBase::OfsEntryDesc *desc )
     {
         std::string path = desc->Name;
@@ -60,7 +63,7 @@ namespace OFS
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-    _OfsRfs::_OfsRfs() : _OfsBase(OFS_RFS), mNextAvailableId(1)
+    _OfsRfs::_OfsRfs() : _OfsBase(OFS_RFS), mNextAvailableId(1), mWatcher(-1), mTrackingThread(NULL)
     {
     }
 
@@ -155,7 +158,8 @@ namespace OFS
                     add_list.push_back( foreignDir->Children[i] );
             }
 
-            dirDesc->Children.insert( dirDesc->Children.end(), add_list.begin(), add_list.end() );
+            for( unsigned int i = 0; i < add_list.size(); i++ )
+                _addChild( dirDesc, add_list[i] );
 
             dirDesc->Links.insert( NameOfsPtrMap::value_type( filename, _ofsptr ) );
         }
@@ -204,14 +208,7 @@ namespace OFS
 
             for( unsigned int i = 0; i < foreignDir->Children.size(); i++ )
             {
-                for( unsigned int k = 0; k < dirDesc->Children.size(); k++ )
-                {
-                    if( dirDesc->Children[k] == foreignDir->Children[i] )
-                    {
-                        dirDesc->Children.erase( dirDesc->Children.begin() + k );
-                        break;
-                    }
-                }
+                _removeChild( dirDesc, foreignDir->Children[i] );
             }
 
             dirDesc->Links.erase( it );
@@ -293,7 +290,7 @@ namespace OFS
             }
         }
 
-        parent->Children.clear();
+        _clearChildren(parent);
     }
 
 //------------------------------------------------------------------------------
@@ -339,6 +336,11 @@ namespace OFS
         {
             _clear();
         }
+        else if(!mLinkMode)
+        {
+            /* Linked file systems lend their entries to the linking tree, so only owners follow changes */
+            _startTracking();
+        }
         
         return ret;
     }
@@ -347,6 +349,9 @@ namespace OFS
 
     void _OfsRfs::_unmount()
     {
+        /* The tracking thread needs the lock to finish, so it is stopped first */
+        _stopTracking();
+
         LOCK_AUTO_MUTEX
 
         if(!mActive)
@@ -362,6 +367,8 @@ namespace OFS
 
     void _OfsRfs::_clear()
     {
+        _stopTracking();
+
         mActive = false;
 
         mFileName = "";
@@ -372,6 +379,8 @@ namespace OFS
         mActiveFiles.clear();
         mUuidMap.clear();
         mTriggers.clear();
+        _discardPendingTriggers();
+        _clearPathCache();
         mRecoveryMode = false;
         mLinkMode = false;
 
@@ -396,6 +405,13 @@ namespace OFS
         if(*filename == '/')
             ++filename;
 
+        /* Paths are resolved once, including those crossing into linked file systems, until any tree changes */
+        long generation = mTreeGeneration;
+        OfsEntryDesc *cached;
+
+        if(_lookupPathCache(filename, generation, cached))
+            return cached;
+
         std::string dir;
         std::string tmp = filename;
         const char *pos = filename;
@@ -411,19 +427,10 @@ namespace OFS
                 {
                     dir = tmp.substr(pos - name_st, filename - pos);
 
-                    OfsEntryDesc *tmpDesc = NULL;
-
-                    for(unsigned int i = 0;i < curDesc->Children.size();i++)
-                    {
-                        if((curDesc->Children[i]->Flags & OFS_DIR) && curDesc->Children[i]->Name == dir)
-                        {
-                            tmpDesc = curDesc->Children[i];
-                            break;
-                        }
-                    }
+                    OfsEntryDesc *tmpDesc = _lookupChild(curDesc, dir, OFS_DIR);
 
                     if(tmpDesc == NULL)
-                        return NULL;
+                        return _storePathCache(name_st, generation, NULL);
                     else
                         curDesc = tmpDesc;
                 }
@@ -438,50 +445,27 @@ namespace OFS
         {
             dir = tmp.substr(pos - name_st, filename - pos);
 
-            OfsEntryDesc *tmpDesc = NULL;
-
-            for(unsigned int i = 0;i < curDesc->Children.size();i++)
-            {
-                if((curDesc->Children[i]->Flags & OFS_DIR) && curDesc->Children[i]->Name == dir)
-                {
-                    tmpDesc = curDesc->Children[i];
-                    break;
-                }
-            }
+            OfsEntryDesc *tmpDesc = _lookupChild(curDesc, dir, OFS_DIR);
 
             if(tmpDesc != NULL)
                 curDesc = tmpDesc;
         }
 
-        return curDesc;
+        return _storePathCache(name_st, generation, curDesc);
     }
 
 //------------------------------------------------------------------------------
 
-    _OfsRfs::OfsEntryDesc* _OfsRfs::_getFileDesc(OfsEntryDesc *dir_desc, std::string filename)
+    _OfsRfs::OfsEntryDesc* _OfsRfs::_getFileDesc(OfsEntryDesc *dir_desc, const std::string& filename)
     {
-        for(unsigned int i = 0;i < dir_desc->Children.size();i++)
-        {
-            if((dir_desc->Children[i]->Flags & OFS_FILE) && dir_desc->Children[i]->Name == filename)
-            {
-                return dir_desc->Children[i];
-            }
-        }
-        return NULL;
+        return _lookupChild(dir_desc, filename, OFS_FILE);
     }
 
 //------------------------------------------------------------------------------
     
-    _OfsRfs::OfsEntryDesc* _OfsRfs::_findChild(OfsEntryDesc *dir_desc, std::string child_name)
+    _OfsRfs::OfsEntryDesc* _OfsRfs::_findChild(OfsEntryDesc *dir_desc, const std::string& child_name)
     {
-        for(unsigned int i = 0;i < dir_desc->Children.size();i++)
-        {
-            if(dir_desc->Children[i]->Name == child_name)
-            {
-                return dir_desc->Children[i];
-            }
-        }
-        return NULL;
+        return _lookupChild(dir_desc, child_name);
     }
 
 //------------------------------------------------------------------------------
@@ -508,11 +492,10 @@ namespace OFS
     {
         assert(parent != NULL);
 
-        for(unsigned int i = 0; i < parent->Children.size();i++)
-        {
-            if(parent->Children[i]->Name == name)
-                return parent->Children[i];
-        }
+        OfsEntryDesc *existing = _lookupChild(parent, name);
+
+        if(existing != NULL)
+            return existing;
 
         OfsEntryDesc *dir = new OfsEntryDesc();
 
@@ -548,7 +531,7 @@ namespace OFS
         dir->WriteLocked = false;
         dir->Uuid = uuid;
 
-        parent->Children.push_back(dir);
+        _addChild(parent, dir);
 
         std::string full_path = mFileName + constructFullPath( dir );
 
@@ -591,7 +574,7 @@ namespace OFS
             handle.mStream.write(data, data_size);
 
         handle.mEntryDesc = file;
-        parent->Children.push_back(file);
+        _addChild(parent, file);
 
         return file;
     }
@@ -602,6 +585,8 @@ namespace OFS
     {
         assert(path != NULL);
 
+        TriggerBatch batch(this);
+
         LOCK_AUTO_MUTEX
 
         if(!mActive)
@@ -653,14 +638,7 @@ namespace OFS
 
                 for( unsigned int i = 0; i < foreignDir->Children.size(); i++ )
                 {
-                    for( unsigned int k = 0; k < dirDesc->Children.size(); k++ )
-                    {
-                        if( dirDesc->Children[k] == foreignDir->Children[i] )
-                        {
-                            dirDesc->Children.erase( dirDesc->Children.begin() + k );
-                            break;
-                        }
-                    }
+                    _removeChild( dirDesc, foreignDir->Children[i] );
                 }
 
                 it++;
@@ -668,15 +646,8 @@ namespace OFS
 
             OfsResult ret = _deleteDirectory(dirDesc);
 
-            std::string fName = _extractFileName(path);
-            OfsEntryDesc *fileDesc = _getFileDesc(dirDesc, fName);
-            for(unsigned int i = 0;i < mTriggers.size();i++)
-            {
-                if(mTriggers[i].type == CLBK_DELETE)
-                {
-                    mTriggers[i].func(mTriggers[i].data, fileDesc, 0);
-                }
-            }
+            /* The directory is gone by the time the notification is delivered, only its path is passed */
+            _fireTriggers(mTriggers, CLBK_DELETE, 0, path);
 
             return ret;
         }
@@ -718,14 +689,7 @@ namespace OFS
             }
         }
 
-        for(unsigned int i = 0;i < dir->Parent->Children.size();i++)
-        {
-            if(dir->Parent->Children[i]->Id == dir->Id)
-            {
-                dir->Parent->Children.erase(dir->Parent->Children.begin() + i);
-                break;
-            }
-        }
+        _removeChild(dir->Parent, dir);
 
         if( dir->Uuid != UUID_ZERO )
         {
@@ -735,6 +699,10 @@ namespace OFS
                mUuidMap.erase( uit );
         }
 
+        _retargetPendingTriggers(dir, NULL);
+
+        _unwatchDirectory(dir);
+
         delete dir;
 
         OfsDeleteDirectory( full_path.c_str() );
@@ -748,6 +716,8 @@ namespace OFS
     {
         assert(filename != NULL);
 
+        TriggerBatch batch(this);
+
         LOCK_AUTO_MUTEX
 
         if(!mActive)
@@ -777,21 +747,9 @@ namespace OFS
 
         if(ret == OFS_OK)
         {
-            for(unsigned int i = 0;i < saveTrigs.size();i++)
-            {
-                if(saveTrigs[i].type == CLBK_DELETE)
-                {
-                    saveTrigs[i].func(saveTrigs[i].data, 0, filename);
-                }
-            }
+            _fireTriggers(saveTrigs, CLBK_DELETE, 0, filename);
 
-            for(unsigned int i = 0;i < mTriggers.size();i++)
-            {
-                if(mTriggers[i].type == CLBK_DELETE)
-                {
-                    mTriggers[i].func(mTriggers[i].data, 0, filename);
-                }
-            }
+            _fireTriggers(mTriggers, CLBK_DELETE, 0, filename);
         }
 
         return ret;
@@ -813,14 +771,7 @@ namespace OFS
         std::string full_path = mFileName + constructFullPath( file );
 
         
-        for(unsigned int i = 0;i < file->Parent->Children.size();i++)
-        {
-            if(file->Parent->Children[i]->Id == file->Id)
-            {
-                file->Parent->Children.erase(file->Parent->Children.begin() + i);
-                break;
-            }
-        }
+        _removeChild(file->Parent, file);
 
         if( file->Uuid != UUID_ZERO )
         {
@@ -830,6 +781,10 @@ namespace OFS
                mUuidMap.erase( uit );
         }
 
+        _retargetPendingTriggers(file, NULL);
+
+        mOwnCloses.erase(file->Id);
+
         delete file;
 
         OfsDeleteFile( full_path.c_str() );
@@ -877,15 +832,7 @@ namespace OFS
             {
                 dir = tmp.substr(pos - name_st, filename - pos);
 
-                OfsEntryDesc *tmpDesc = NULL;
-                for(unsigned int i = 0;i < curDesc->Children.size();i++)
-                {
-                    if((curDesc->Children[i]->Flags & OFS_DIR) && curDesc->Children[i]->Name == dir)
-                    {
-                        tmpDesc = curDesc->Children[i];
-                        break;
-                    }
-                }
+                OfsEntryDesc *tmpDesc = _lookupChild(curDesc, dir, OFS_DIR);
 
                 if(tmpDesc == NULL)
                 {
@@ -925,6 +872,8 @@ namespace OFS
     {
         assert(filename != NULL);
 
+        TriggerBatch batch(this);
+
         LOCK_AUTO_MUTEX
 
         if(!mActive)
@@ -959,27 +908,15 @@ namespace OFS
 
         std::string full_path1 = mFileName + constructFullPath( fileDesc );
         
-        fileDesc->Name = nName;
+        _renameChild(fileDesc, nName);
 
         std::string full_path2 = mFileName + constructFullPath( fileDesc );
 
         OfsRenameFile( full_path1.c_str(), full_path2.c_str() );
         
-        for(unsigned int i = 0;i < fileDesc->Triggers.size();i++)
-        {
-            if(fileDesc->Triggers[i].type == CLBK_RENAME)
-            {
-                fileDesc->Triggers[i].func(fileDesc->Triggers[i].data, fileDesc, filename);
-            }
-        }
+        _fireTriggers(fileDesc->Triggers, CLBK_RENAME, fileDesc, filename);
 
-        for(unsigned int i = 0;i < mTriggers.size();i++)
-        {
-            if(mTriggers[i].type == CLBK_RENAME)
-            {
-                mTriggers[i].func(mTriggers[i].data, fileDesc, filename);
-            }
-        }
+        _fireTriggers(mTriggers, CLBK_RENAME, fileDesc, filename);
 
         return OFS_OK;
     }
@@ -1030,18 +967,15 @@ namespace OFS
             if(sz > 251)
                 nName.erase(251, sz - 251);
 
-            for(unsigned int i = 0;i < dirDesc->Parent->Children.size();i++)
-            {
-                if(dirDesc->Parent->Children[i]->Name == nName)
-                    return OFS_ACCESS_DENIED;
-            }
+            if(_lookupChild(dirDesc->Parent, nName) != NULL)
+                return OFS_ACCESS_DENIED;
 
             if(dirDesc->WriteLocked || (dirDesc->Flags & OFS_READONLY))
                 return OFS_ACCESS_DENIED;
 
             std::string full_path1 = mFileName + constructFullPath( dirDesc );
         
-            dirDesc->Name = nName;
+            _renameChild(dirDesc, nName);
 
             std::string full_path2 = mFileName + constructFullPath( dirDesc );
 
@@ -1197,6 +1131,8 @@ namespace OFS
     {
         assert(filename != NULL);
 
+        TriggerBatch batch(this);
+
         LOCK_AUTO_MUTEX
 
         if(!mActive)
@@ -1262,13 +1198,7 @@ namespace OFS
         handle.mEntryDesc = fileDesc;
         handle.mAccessFlags = OFS_READWRITE;
 
-        for(unsigned int i = 0;i < mTriggers.size();i++)
-        {
-            if(mTriggers[i].type == CLBK_CREATE)
-            {
-                mTriggers[i].func(mTriggers[i].data, fileDesc, 0);
-            }
-        }
+        _fireTriggers(mTriggers, CLBK_CREATE, fileDesc, 0);
 
         return OFS_OK;
     }
@@ -1277,6 +1207,8 @@ namespace OFS
 
     OfsResult _OfsRfs::closeFile(OFSHANDLE& handle)
     {
+        TriggerBatch batch(this);
+
         LOCK_AUTO_MUTEX
 
         if(!mActive)
@@ -1306,25 +1238,17 @@ namespace OFS
             }
         }
 
+        /* Handles are opened for writing, the host reports each close as a change which is not news to us */
+        if(mWatcher != -1)
+            ++mOwnCloses[handle.mEntryDesc->Id];
+
         handle.mStream.close();
 
         if(handle.mAccessFlags & OFS_WRITE)
         {
-            for(unsigned int i = 0;i < handle.mEntryDesc->Triggers.size();i++)
-            {
-                if(handle.mEntryDesc->Triggers[i].type == CLBK_CONTENT)
-                {
-                    handle.mEntryDesc->Triggers[i].func(handle.mEntryDesc->Triggers[i].data, handle.mEntryDesc, 0);
-                }
-            }
+            _fireTriggers(handle.mEntryDesc->Triggers, CLBK_CONTENT, handle.mEntryDesc, 0);
 
-            for(unsigned int i = 0;i < mTriggers.size();i++)
-            {
-                if(mTriggers[i].type == CLBK_CONTENT)
-                {
-                    mTriggers[i].func(mTriggers[i].data, handle.mEntryDesc, 0);
-                }
-            }
+            _fireTriggers(mTriggers, CLBK_CONTENT, handle.mEntryDesc, 0);
         }
 
         handle.mEntryDesc = NULL;
@@ -1357,6 +1281,31 @@ namespace OFS
         return OFS_OK;
     }
 
+//------------------------------------------------------------------------------
+
+    OfsResult _OfsRfs::reserve(OFSHANDLE& handle, ofs64 /*size*/)
+    {
+        LOCK_AUTO_MUTEX
+
+        if(!mActive)
+        {
+            OFS_EXCEPT("_OfsRfs::reserve, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        if(!handle._valid())
+        {
+            OFS_EXCEPT("_OfsRfs::reserve, Supplied OfsHandle is not valid.");
+            return OFS_INVALID_FILE;
+        }
+
+        if(!(handle.mAccessFlags & OFS_WRITE) || (handle.mAccessFlags & OFS_LINK))
+            return OFS_ACCESS_DENIED;
+
+        /* Host files are laid out by the host file system */
+        return OFS_OK;
+    }
+
 //------------------------------------------------------------------------------
 
     void _OfsRfs::_setFileFlags(OfsEntryDesc *file, unsigned int flags)
@@ -1502,6 +1451,177 @@ namespace OFS
         return OFS_OK;
     }
 
+//------------------------------------------------------------------------------
+
+    OfsResult _OfsRfs::readFiles(ReadRequestList& requests)
+    {
+        /* Files are separate on disk, so there is no ordering to gain; serve each through a handle */
+        OfsResult result = OFS_OK;
+
+        for(unsigned int i = 0;i < requests.size();i++)
+        {
+            ReadRequest& request = requests[i];
+            OFSHANDLE handle;
+
+            request.BytesRead = 0;
+            request.FileSize = 0;
+
+            if(request.Uuid != UUID_ZERO)
+                request.Result = openFile(handle, request.Uuid, OFS_READ);
+            else
+                request.Result = openFile(handle, request.Name.c_str(), OFS_READ);
+
+            if(request.Result == OFS_OK)
+            {
+                getFileSize(handle, request.FileSize);
+
+                if(request.Buffer != NULL)
+                {
+                    unsigned int length = (unsigned int)std::min(request.FileSize, (ofs64)request.BufferSize);
+                    request.Result = read(handle, request.Buffer, length, &request.BytesRead);
+                }
+
+                closeFile(handle);
+            }
+
+            if(result == OFS_OK && request.Result != OFS_OK)
+                result = request.Result;
+        }
+
+        return result;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _OfsRfs::importFiles(ImportRequestList& requests, unsigned int /*num_threads*/, ImportCallBackFunction callback, void *userData)
+    {
+        TriggerBatch batch(this);
+
+        /* Both ends are host files, nothing would be gained by reading ahead on other threads */
+        OfsResult result = OFS_OK;
+        std::vector<char> buffer(4 * 1024 * 1024);
+
+        for(unsigned int i = 0;i < requests.size();i++)
+        {
+            ImportRequest& request = requests[i];
+
+            request.FileSize = 0;
+
+            if(request.SourcePath.empty())
+                request.Result = createDirectory(request.Name.c_str(), true);
+            else
+            {
+                std::ifstream stream(request.SourcePath.c_str(), std::fstream::in | std::fstream::binary);
+
+                if(!stream.is_open())
+                    request.Result = OFS_FILE_NOT_FOUND;
+                else
+                {
+                    std::string::size_type pos = request.Name.find_last_of('/');
+
+                    if(pos != std::string::npos && pos > 0)
+                        createDirectory(request.Name.substr(0, pos + 1).c_str(), true);
+
+                    OFSHANDLE handle;
+                    request.Result = createFile(handle, request.Name.c_str());
+
+                    while(request.Result == OFS_OK && stream.read(&buffer[0], buffer.size()).gcount() > 0)
+                    {
+                        request.Result = write(handle, &buffer[0], (unsigned int)stream.gcount());
+                        request.FileSize += stream.gcount();
+                    }
+
+                    if(handle._valid())
+                        closeFile(handle);
+                }
+            }
+
+            if(result == OFS_OK && request.Result != OFS_OK)
+                result = request.Result;
+
+            if(callback != NULL)
+                callback(userData, request);
+        }
+
+        return result;
+    }
+
+//------------------------------------------------------------------------------
+
+    OfsResult _OfsRfs::extractFiles(ExtractRequestList& requests, unsigned int /*num_threads*/, ExtractCallBackFunction callback, void *userData)
+    {
+        if(!mActive)
+        {
+            OFS_EXCEPT("_OfsRfs::extractFiles, Operation called on an unmounted file system.");
+            return OFS_IO_ERROR;
+        }
+
+        /* Files are already on the host, each one is a plain copy done serially on the calling thread */
+        OfsResult result = OFS_OK;
+        std::vector<char> buffer(4 * 1024 * 1024);
+
+        for(unsigned int i = 0;i < requests.size();i++)
+        {
+            ExtractRequest& request = requests[i];
+
+            request.FileSize = 0;
+            request.Skipped = false;
+            request.Result = OFS_OK;
+
+            std::string source = mFileName + "/" + ((request.Name.c_str()[0] == '/') ? request.Name.substr(1) : request.Name);
+            ofs64 size, dest_size;
+            time_t mod_time, dest_time;
+
+            if(OfsGetFileInfo(source.c_str(), size, mod_time))
+            {
+                request.FileSize = size;
+
+                if(OfsGetFileInfo(request.DestPath.c_str(), dest_size, dest_time) && dest_size == size && dest_time == mod_time)
+                    request.Skipped = true;
+                else
+                {
+                    std::string::size_type pos = request.DestPath.find_last_of("/\\");
+
+                    if(pos != std::string::npos && pos > 0)
+                        OfsCreateDirectories(request.DestPath.substr(0, pos).c_str());
+
+                    std::ifstream in_stream(source.c_str(), std::fstream::in | std::fstream::binary);
+                    std::ofstream out_stream(request.DestPath.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+
+                    if(!in_stream.is_open() || !out_stream.is_open())
+                        request.Result = OFS_IO_ERROR;
+                    else
+                    {
+                        while(in_stream.read(&buffer[0], buffer.size()).gcount() > 0)
+                            out_stream.write(&buffer[0], in_stream.gcount());
+
+                        out_stream.close();
+
+                        if(out_stream.fail())
+                            request.Result = OFS_IO_ERROR;
+                        else
+                            OfsSetModificationTime(request.DestPath.c_str(), mod_time);
+                    }
+                }
+            }
+            else if(OfsDirectoryExists(source.c_str()))
+            {
+                if(!OfsCreateDirectories(request.DestPath.c_str()))
+                    request.Result = OFS_IO_ERROR;
+            }
+            else
+                request.Result = OFS_FILE_NOT_FOUND;
+
+            if(result == OFS_OK && request.Result != OFS_OK)
+                result = request.Result;
+
+            if(callback != NULL)
+                callback(userData, request);
+        }
+
+        return result;
+    }
+
 //------------------------------------------------------------------------------
 
     OfsResult _OfsRfs::write(OFSHANDLE& handle, const char *src, unsigned int length)
@@ -2294,6 +2414,8 @@ namespace OFS
 
     OfsResult _OfsRfs::copyFile(const char *src, const char *dest)
     {
+        TriggerBatch batch(this);
+
         LOCK_AUTO_MUTEX
 
         OFSHANDLE srcHandle, destHandle;
@@ -2332,6 +2454,8 @@ namespace OFS
 
     OfsResult _OfsRfs::moveFile(const char *src, const char *dest)
     {
+        TriggerBatch batch(this);
+
         LOCK_AUTO_MUTEX
 
         OFSHANDLE srcHandle;
@@ -2371,6 +2495,8 @@ namespace OFS
 
     OfsResult _OfsRfs::moveDirectory(const char *dirname, const char *dest)
     {
+        TriggerBatch batch(this);
+
         LOCK_AUTO_MUTEX
 
         OFSHANDLE srcHandle;
@@ -2646,6 +2772,37 @@ namespace OFS
         return OFS_OK;
     }
 
+//------------------------------------------------------------------------------------------
+
+    OfsResult _OfsRfs::compactFileSystem(unsigned int /*max_blocks*/, CompactionProgress& progress)
+    {
+        memset(&progress, 0, sizeof(CompactionProgress));
+        progress.Finished = true;
+
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _OfsRfs::beginTransaction()
+    {
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _OfsRfs::commitTransaction()
+    {
+        return OFS_OK;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    OfsResult _OfsRfs::abortTransaction()
+    {
+        return OFS_OK;
+    }
+
 //------------------------------------------------------------------------------------------
 
     ofs64 _OfsRfs::listFilesRecursive(const std::string& path, FileList& list)
@@ -2684,7 +2841,7 @@ namespace OFS
     }
 
 //------------------------------------------------------------------------------------------
-    OfsResult _OfsRfs::addTrigger(void *_owner, _OfsRfs::CallBackType _type, _OfsRfs::CallBackFunction _func, void *_data)
+    OfsResult _OfsRfs::addTrigger(void *_owner, _OfsRfs::CallBackType _type, _OfsRfs::CallBackFunction _func, void *_data, unsigned int _interval)
     {
         assert(_owner != 0);
 
@@ -2701,6 +2858,7 @@ namespace OFS
         tdata.type = _type;
         tdata.func = _func;
         tdata.data = _data;
+        tdata.interval = _interval;
 
         mTriggers.push_back(tdata);
 
@@ -2724,6 +2882,7 @@ namespace OFS
             if(mTriggers[i].owner == _owner && mTriggers[i].type == _type)
             {
                 mTriggers.erase(mTriggers.begin() + i);
+                _dropPendingTriggers(_owner, _type);
                 return;
             }
         }
@@ -2760,6 +2919,7 @@ namespace OFS
         tdata.type = _type;
         tdata.func = _func;
         tdata.data = _data;
+        tdata.interval = 0;
 
         fileDesc->Triggers.push_back(tdata);
 
@@ -2795,12 +2955,442 @@ namespace OFS
             if(fileDesc->Triggers[i].owner == _owner && fileDesc->Triggers[i].type == _type)
             {
                 fileDesc->Triggers.erase(fileDesc->Triggers.begin() + i);
+                _dropPendingTriggers(_owner, _type);
                 return;
             }
         }
 
         assert("removeFileTrigger: The trigger could not be found!!");
     }
+
+//------------------------------------------------------------------------------------------
+
+    void _OfsRfs::_startTracking()
+    {
+        mWatcher = OfsWatchOpen();
+
+        if(mWatcher == -1)
+            return;
+
+        _watchDirectory(&mRootDir);
+
+        mTrackingThread = new boost::thread(&_OfsRfs::_trackChanges, this);
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _OfsRfs::_stopTracking()
+    {
+        if(mTrackingThread != NULL)
+        {
+            mTrackingThread->interrupt();
+            mTrackingThread->join();
+
+            delete mTrackingThread;
+            mTrackingThread = NULL;
+        }
+
+        if(mWatcher != -1)
+        {
+            OfsWatchClose(mWatcher);
+            mWatcher = -1;
+        }
+
+        mWatchedDirs.clear();
+        mDirWatches.clear();
+        mOwnCloses.clear();
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _OfsRfs::_trackChanges()
+    {
+        std::vector<OfsWatchEvent> events;
+
+        try
+        {
+            while(true)
+            {
+                boost::this_thread::interruption_point();
+
+                events.clear();
+
+                if(!OfsWatchRead(mWatcher, events, TRACKING_POLL_INTERVAL))
+                    return;
+
+                if(events.empty())
+                    continue;
+
+                /* Notifications about external changes are delivered on this thread */
+                TriggerBatch batch(this);
+
+                LOCK_AUTO_MUTEX
+
+                try
+                {
+                    _applyChanges(events);
+                }
+                catch(std::exception&)
+                {
+                    /* An entry changed again while it was examined, the host reports that change as well */
+                }
+            }
+        }
+        catch(boost::thread_interrupted&)
+        {
+        }
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _OfsRfs::_applyChanges(std::vector<OfsWatchEvent>& events)
+    {
+        typedef std::map<unsigned int, std::pair<OfsEntryDesc*, std::string> > CookieMoveMap;
+
+        /* Entries moved away, kept until the other half of the move tells where they went */
+        CookieMoveMap moved;
+        /* Moves whose source was already gone from the tree, as they were made through the file system */
+        std::set<unsigned int> ownMoves;
+
+        for(unsigned int i = 0;i < events.size();i++)
+        {
+            OfsWatchEvent& event = events[i];
+
+            if(event.Type & OFS_WATCH_OVERFLOW)
+            {
+                /* Changes were lost, this is the only case the whole tree is checked again */
+                _syncDirectory(&mRootDir, true);
+                continue;
+            }
+
+            WatchDescMap::iterator wit = mWatchedDirs.find(event.Watch);
+
+            if(wit == mWatchedDirs.end())
+                continue;
+
+            OfsEntryDesc *dir = wit->second;
+
+            if(event.Type & OFS_WATCH_IGNORED)
+            {
+                mDirWatches.erase(dir);
+                mWatchedDirs.erase(wit);
+                continue;
+            }
+
+            if(event.Name.empty())
+                continue;
+
+            if(event.Type & OFS_WATCH_MOVED_FROM)
+            {
+                std::string path = constructFullPath(dir) + "/" + event.Name;
+                OfsEntryDesc *desc = _findChild(dir, event.Name);
+
+                if(desc == NULL)
+                    ownMoves.insert(event.Cookie);
+                else if(desc->Owner == this && !OfsPathExists((mFileName + path).c_str()) && !_isEntryInUse(desc))
+                {
+                    _removeChild(dir, desc);
+                    desc->Parent = NULL;
+
+                    moved[event.Cookie] = std::make_pair(desc, path);
+                }
+
+                continue;
+            }
+
+            if(event.Type & OFS_WATCH_MOVED_TO)
+            {
+                CookieMoveMap::iterator mit = moved.find(event.Cookie);
+
+                if(mit != moved.end())
+                {
+                    OfsEntryDesc *desc = mit->second.first;
+                    std::string oldPath = mit->second.second;
+
+                    moved.erase(mit);
+
+                    if(_findChild(dir, event.Name) == NULL)
+                    {
+                        desc->Name = event.Name;
+                        desc->Parent = dir;
+                        desc->ParentId = dir->Id;
+
+                        _addChild(dir, desc);
+
+                        _fireTriggers(desc->Triggers, CLBK_RENAME, desc, oldPath.c_str());
+                        _fireTriggers(mTriggers, CLBK_RENAME, desc, oldPath.c_str());
+
+                        _syncEntry(dir, event.Name, false);
+                        continue;
+                    }
+
+                    /* Moved over an existing entry, which takes its place */
+                    _dropTrackedEntry(desc, oldPath);
+                }
+
+                _syncEntry(dir, event.Name, ownMoves.find(event.Cookie) == ownMoves.end());
+                continue;
+            }
+
+            _syncEntry(dir, event.Name, (event.Type & OFS_WATCH_CONTENT) != 0);
+        }
+
+        /* Entries moved out of the host directory */
+        for(CookieMoveMap::iterator it = moved.begin();it != moved.end();it++)
+            _dropTrackedEntry(it->second.first, it->second.second);
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _OfsRfs::_watchDirectory(OfsEntryDesc *dir)
+    {
+        if(mWatcher == -1 || dir->Owner != this)
+            return;
+
+        if(mDirWatches.find(dir) == mDirWatches.end())
+        {
+            std::string full_path = mFileName + constructFullPath( dir );
+
+            int watch = OfsWatchAdd(mWatcher, full_path.c_str());
+
+            if(watch != -1)
+            {
+                mWatchedDirs[watch] = dir;
+                mDirWatches[dir] = watch;
+            }
+        }
+
+        for(unsigned int i = 0;i < dir->Children.size();i++)
+        {
+            if(dir->Children[i]->Flags & OFS_DIR)
+                _watchDirectory(dir->Children[i]);
+        }
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _OfsRfs::_unwatchDirectory(OfsEntryDesc *dir)
+    {
+        DescWatchMap::iterator it = mDirWatches.find(dir);
+
+        if(it == mDirWatches.end())
+            return;
+
+        OfsWatchRemove(mWatcher, it->second);
+
+        mWatchedDirs.erase(it->second);
+        mDirWatches.erase(it);
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _OfsRfs::_syncDirectory(OfsEntryDesc *dir, bool recursive)
+    {
+        std::string path = constructFullPath( dir );
+        std::vector<std::string> names;
+
+        OfsListDirectory((mFileName + path).c_str(), names);
+
+        for(unsigned int i = 0;i < names.size();i++)
+            _syncEntry(dir, names[i], false);
+
+        std::set<std::string> present(names.begin(), names.end());
+        std::vector<OfsEntryDesc*> gone;
+        std::vector<OfsEntryDesc*> subdirs;
+
+        for(unsigned int i = 0;i < dir->Children.size();i++)
+        {
+            OfsEntryDesc *child = dir->Children[i];
+
+            if(child->Owner != this)
+                continue;
+
+            if(present.find(child->Name) == present.end())
+                gone.push_back(child);
+            else if(recursive && (child->Flags & OFS_DIR))
+                subdirs.push_back(child);
+        }
+
+        for(unsigned int i = 0;i < gone.size();i++)
+            _dropTrackedEntry(gone[i], path + "/" + gone[i]->Name);
+
+        for(unsigned int i = 0;i < subdirs.size();i++)
+            _syncDirectory(subdirs[i], true);
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _OfsRfs::_syncEntry(OfsEntryDesc *dir, const std::string& name, bool content)
+    {
+        std::string path = constructFullPath( dir ) + "/" + name;
+        std::string full_path = mFileName + path;
+
+        ofs64 file_size = 0;
+        time_t mod_time;
+
+        bool isFile = OfsGetFileInfo(full_path.c_str(), file_size, mod_time);
+        bool isDir = !isFile && OfsDirectoryExists(full_path.c_str());
+
+        OfsEntryDesc *desc = _findChild(dir, name);
+
+        if(desc != NULL)
+        {
+            if(desc->Owner != this)
+                return;
+
+            if(isDir && (desc->Flags & OFS_DIR))
+            {
+                /* Directories created through the file system are watched once the host reports them */
+                if(mDirWatches.find(desc) == mDirWatches.end())
+                {
+                    _watchDirectory(desc);
+                    _syncDirectory(desc, false);
+                }
+
+                return;
+            }
+
+            if(isFile && (desc->Flags & OFS_FILE))
+            {
+                if(content)
+                {
+                    IdCountMap::iterator it = mOwnCloses.find(desc->Id);
+
+                    if(it != mOwnCloses.end())
+                    {
+                        if(--(it->second) == 0)
+                            mOwnCloses.erase(it);
+
+                        return;
+                    }
+                }
+
+                /* Open handles keep the entry up to date themselves */
+                if(desc->UseCount > 0)
+                    return;
+
+                bool resized = (desc->FileSize != file_size);
+
+                desc->FileSize = file_size;
+
+                if(content || resized)
+                {
+                    _fireTriggers(desc->Triggers, CLBK_CONTENT, desc, 0);
+                    _fireTriggers(mTriggers, CLBK_CONTENT, desc, 0);
+                }
+
+                return;
+            }
+
+            if(!_dropTrackedEntry(desc, path))
+                return;
+        }
+
+        if(!isFile && !isDir)
+            return;
+
+        desc = _addTrackedEntry(dir, name, isDir);
+        desc->FileSize = file_size;
+
+        _fireTriggers(mTriggers, CLBK_CREATE, desc, 0);
+
+        if(isDir)
+        {
+            _watchDirectory(desc);
+            _syncDirectory(desc, false);
+        }
+    }
+
+//------------------------------------------------------------------------------------------
+
+    _OfsRfs::OfsEntryDesc* _OfsRfs::_addTrackedEntry(OfsEntryDesc *parent, const std::string& name, bool directory)
+    {
+        OfsEntryDesc *desc = new OfsEntryDesc();
+
+        desc->Owner = this;
+        desc->Id = mNextAvailableId++;
+        desc->ParentId = parent->Id;
+        desc->Flags = directory ? OFS_DIR : OFS_FILE;
+        desc->OldParentId = ROOT_DIRECTORY_ID;
+        desc->Name = name;
+        desc->FileSize = 0;
+        desc->Parent = parent;
+        desc->CreationTime = time( NULL );
+        desc->UseCount = 0;
+        desc->WriteLocked = false;
+        desc->Uuid = UUID_ZERO;
+
+        _addChild(parent, desc);
+
+        return desc;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    bool _OfsRfs::_dropTrackedEntry(OfsEntryDesc *desc, const std::string& path)
+    {
+        /* Open entries stay in the tree until the next mount */
+        if(_isEntryInUse(desc))
+            return false;
+
+        std::vector<CallBackData> saveTrigs = desc->Triggers;
+
+        _untrackEntry(desc);
+
+        if(desc->Parent != NULL)
+            _removeChild(desc->Parent, desc);
+
+        _deallocateChildren(desc);
+
+        delete desc;
+
+        _fireTriggers(saveTrigs, CLBK_DELETE, 0, path.c_str());
+        _fireTriggers(mTriggers, CLBK_DELETE, 0, path.c_str());
+
+        return true;
+    }
+
+//------------------------------------------------------------------------------------------
+
+    void _OfsRfs::_untrackEntry(OfsEntryDesc *desc)
+    {
+        for(unsigned int i = 0;i < desc->Children.size();i++)
+        {
+            if(desc->Children[i]->Owner == this)
+                _untrackEntry(desc->Children[i]);
+        }
+
+        _unwatchDirectory(desc);
+
+        mOwnCloses.erase(desc->Id);
+
+        if(desc->Uuid != UUID_ZERO)
+        {
+            UuidDescMap::iterator uit = mUuidMap.find(desc->Uuid);
+
+            if(uit != mUuidMap.end() && uit->second == desc)
+               mUuidMap.erase(uit);
+        }
+
+        _retargetPendingTriggers(desc, NULL);
+    }
+
+//------------------------------------------------------------------------------------------
+
+    bool _OfsRfs::_isEntryInUse(OfsEntryDesc *desc)
+    {
+        if(desc->UseCount > 0)
+            return true;
+
+        for(unsigned int i = 0;i < desc->Children.size();i++)
+        {
+            if(desc->Children[i]->Owner == this && _isEntryInUse(desc->Children[i]))
+                return true;
+        }
+
+        return false;
+    }
+
 //------------------------------------------------------------------------------------------
 //------------------------------------------------------------------------------------------
 //------------------------------------------------------------------------------------------
@@ -0,0 +1,952 @@
+/*/////////////////////////////////////////////////////////////////////////////////
+/// An
+///    ___   ____ ___ _____ ___  ____
+///   / _ \ / ___|_ _|_   _/ _ \|  _ \
+///  | | | | |  _ | |  | || | | | |_) |
+///  | |_| | |_| || |  | || |_| |  _ <
+///   \___/ \____|___| |_| \___/|_| \_\
+///                              File
+///
+/// Copyright (c) 2008-2015 Ismail TARIM <ismail@royalspor.com> and the Ogitor Team
+////
+/// The MIT License
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+/// THE SOFTWARE. 
+///////////////////////////////////////////////////////////////////////////////////*/
+
+#include "ofs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+/* Headless benchmark of the OFS library. Generates a synthetic file system and measures
+   mount, path lookup (also over growing directory sizes), reads, writes, creation and
+   deletion of many small files, fragmentation, defragmentation, concurrent reads and
+   resource loading with buffered versus memory mapped reads.
+   Results are written as JSON (default) or CSV so they can be compared between builds.
+   Run "ofsbench -h" for the list of options */
+
+using namespace OFS;
+
+//------------------------------------------------------------------------------
+
+/* Configuration of a benchmark run */
+struct BenchConfig
+{
+    std::string  File;            /* Path of the generated file system */
+    std::string  Output;          /* Result file, stdout if empty */
+    std::string  Format;          /* "json" or "csv" */
+    std::string  Tests;           /* Comma separated list of tests to run, empty for all */
+    unsigned int NumFiles;        /* Number of files to generate */
+    unsigned int MinSize;         /* Smallest generated file size */
+    unsigned int MaxSize;         /* Largest generated file size */
+    std::string  Distribution;    /* "uniform", "log" or "fixed" */
+    unsigned int Depth;           /* Depth of the directory tree */
+    unsigned int Fanout;          /* Number of sub directories per directory */
+    unsigned int Threads;         /* Number of threads for the concurrent read test */
+    unsigned int Operations;      /* Number of operations of lookup and random access tests */
+    unsigned int Seed;            /* Seed of the random generator */
+    bool         Mapped;          /* Mount with OFS_MOUNT_MMAP */
+    bool         Keep;            /* Keep the generated files */
+};
+
+/* Result of a single test */
+struct BenchResult
+{
+    std::string Name;
+    ofs64       Operations;
+    ofs64       Bytes;
+    double      Seconds;
+};
+
+typedef std::vector<BenchResult> BenchResultList;
+
+/* Small deterministic generator, results stay comparable between platforms */
+class BenchRandom
+{
+public:
+    BenchRandom(unsigned int seed) : mState(seed * 2654435761u + 1) {}
+
+    unsigned int next()
+    {
+        mState ^= mState << 13;
+        mState ^= mState >> 17;
+        mState ^= mState << 5;
+        return mState;
+    }
+
+    unsigned int range(unsigned int min, unsigned int max)
+    {
+        if(max <= min)
+            return min;
+
+        return min + (next() % (max - min + 1));
+    }
+
+    double unit()
+    {
+        return (next() & 0xFFFFFF) / double(0x1000000);
+    }
+
+private:
+    unsigned int mState;
+};
+
+/* Measures the wall clock time of a test */
+class BenchTimer
+{
+public:
+    BenchTimer() : mStart(boost::posix_time::microsec_clock::universal_time()) {}
+
+    double elapsed() const
+    {
+        return (boost::posix_time::microsec_clock::universal_time() - mStart).total_microseconds() / 1000000.0;
+    }
+
+private:
+    boost::posix_time::ptime mStart;
+};
+
+/* A generated file and its size */
+struct BenchFile
+{
+    std::string  Name;
+    unsigned int Size;
+};
+
+typedef std::vector<BenchFile> BenchFileList;
+
+const unsigned int BENCH_CHUNK_SIZE = 64 * 1024;
+const unsigned int BENCH_RANDOM_READ_SIZE = 4096;
+const unsigned int BENCH_APPEND_SIZE = 256;
+
+/* Directory sizes of the lookup sweep */
+const unsigned int BENCH_SWEEP_SIZES[] = {16, 256, 4096, 65536};
+
+/* Number of small files created and deleted by the churn test */
+const unsigned int BENCH_CHURN_FILES = 100000;
+const unsigned int BENCH_CHURN_MAX_SIZE = 4096;
+
+//------------------------------------------------------------------------------
+
+void benchCheck(OfsResult ret, const char *what)
+{
+    if(ret != OFS_OK)
+    {
+        fprintf(stderr, "ofsbench: %s failed with error %d\n", what, (int)ret);
+        exit(2);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+unsigned int benchFileSize(const BenchConfig& config, BenchRandom& random)
+{
+    if(config.Distribution == "fixed")
+        return config.MaxSize;
+
+    if(config.Distribution == "log")
+    {
+        /* Many small files and few large ones, as in typical asset folders */
+        double low = log((double)std::max(config.MinSize, 1u));
+        double high = log((double)std::max(config.MaxSize, 1u));
+        return (unsigned int)exp(low + (high - low) * random.unit());
+    }
+
+    return random.range(config.MinSize, config.MaxSize);
+}
+
+//------------------------------------------------------------------------------
+
+void benchFillBuffer(std::vector<char>& buffer, unsigned int seed)
+{
+    BenchRandom random(seed);
+
+    for(unsigned int i = 0;i < buffer.size();i++)
+        buffer[i] = (char)(random.next() & 0x7F);
+}
+
+//------------------------------------------------------------------------------
+
+void benchCreateDirectories(OfsPtr& ofsFile, const BenchConfig& config, std::vector<std::string>& dirs)
+{
+    dirs.clear();
+    dirs.push_back("");
+
+    unsigned int level_start = 0;
+
+    for(unsigned int level = 0;level < config.Depth;level++)
+    {
+        unsigned int level_end = dirs.size();
+
+        for(unsigned int i = level_start;i < level_end;i++)
+        {
+            for(unsigned int j = 0;j < config.Fanout;j++)
+            {
+                char name[32];
+                sprintf(name, "dir%02u_%02u/", level, j);
+
+                std::string path = dirs[i] + name;
+                benchCheck(ofsFile->createDirectory(path.c_str()), "createDirectory");
+                dirs.push_back(path);
+            }
+        }
+
+        level_start = level_end;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void benchWriteFile(OfsPtr& ofsFile, const std::string& name, unsigned int size, const std::vector<char>& data)
+{
+    OFSHANDLE handle;
+
+    benchCheck(ofsFile->createFile(handle, name.c_str()), "createFile");
+
+    unsigned int pos = 0;
+
+    while(pos < size)
+    {
+        unsigned int length = std::min(size - pos, BENCH_CHUNK_SIZE);
+        benchCheck(ofsFile->write(handle, &data[pos % BENCH_CHUNK_SIZE], length), "write");
+        pos += length;
+    }
+
+    ofsFile->closeFile(handle);
+}
+
+//------------------------------------------------------------------------------
+
+ofs64 benchReadFile(OfsPtr& ofsFile, const std::string& name, std::vector<char>& buffer)
+{
+    OFSHANDLE handle;
+    ofs64 total = 0;
+    unsigned int actual_read = 0;
+
+    benchCheck(ofsFile->openFile(handle, name.c_str()), "openFile");
+
+    do
+    {
+        ofsFile->read(handle, &buffer[0], buffer.size(), &actual_read);
+        total += actual_read;
+    } while(actual_read == buffer.size());
+
+    ofsFile->closeFile(handle);
+
+    return total;
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchGenerate(OfsPtr& ofsFile, const BenchConfig& config, BenchFileList& files)
+{
+    BenchRandom random(config.Seed);
+    std::vector<std::string> dirs;
+    std::vector<char> data(2 * BENCH_CHUNK_SIZE);
+
+    benchFillBuffer(data, config.Seed);
+
+    BenchResult result = {"generate", 0, 0, 0.0};
+    BenchTimer timer;
+
+    unsigned int mount_flags = OFS_MOUNT_CREATE | (config.Mapped ? OFS_MOUNT_MMAP : 0);
+    benchCheck(ofsFile.mount(config.File.c_str(), mount_flags), "mount");
+
+    benchCreateDirectories(ofsFile, config, dirs);
+
+    files.resize(config.NumFiles);
+
+    for(unsigned int i = 0;i < config.NumFiles;i++)
+    {
+        char name[32];
+        sprintf(name, "file%06u.dat", i);
+
+        files[i].Name = dirs[random.next() % dirs.size()] + name;
+        files[i].Size = benchFileSize(config, random);
+
+        benchWriteFile(ofsFile, files[i].Name, files[i].Size, data);
+
+        result.Bytes += files[i].Size;
+    }
+
+    result.Operations = config.NumFiles;
+    result.Seconds = timer.elapsed();
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchMount(OfsPtr& ofsFile, const BenchConfig& config)
+{
+    const unsigned int iterations = 10;
+
+    BenchResult result = {"mount", iterations, 0, 0.0};
+
+    ofsFile.unmount();
+
+    unsigned int mount_flags = OFS_MOUNT_OPEN | (config.Mapped ? OFS_MOUNT_MMAP : 0);
+
+    BenchTimer timer;
+
+    for(unsigned int i = 0;i < iterations;i++)
+    {
+        benchCheck(ofsFile.mount(config.File.c_str(), mount_flags), "mount");
+
+        if(i + 1 < iterations)
+            ofsFile.unmount();
+    }
+
+    result.Seconds = timer.elapsed();
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchLookup(OfsPtr& ofsFile, const BenchConfig& config, const BenchFileList& files)
+{
+    BenchRandom random(config.Seed + 1);
+    FileEntry entry;
+
+    BenchResult result = {"lookup", config.Operations, 0, 0.0};
+    BenchTimer timer;
+
+    for(unsigned int i = 0;i < config.Operations;i++)
+        benchCheck(ofsFile->getFileEntry(files[random.next() % files.size()].Name.c_str(), entry), "getFileEntry");
+
+    result.Seconds = timer.elapsed();
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+/* Looks up files in single directories of growing size, the cost per lookup should not grow with the directory */
+void benchLookupSweep(OfsPtr& ofsFile, const BenchConfig& config, BenchResultList& results)
+{
+    BenchRandom random(config.Seed + 7);
+    FileEntry entry;
+
+    for(unsigned int s = 0;s < sizeof(BENCH_SWEEP_SIZES) / sizeof(BENCH_SWEEP_SIZES[0]);s++)
+    {
+        unsigned int count = BENCH_SWEEP_SIZES[s];
+        char dir[64];
+        sprintf(dir, "sweep%u/", count);
+
+        benchCheck(ofsFile->createDirectory(dir), "createDirectory");
+
+        std::vector<std::string> names(count);
+
+        for(unsigned int i = 0;i < count;i++)
+        {
+            char name[96];
+            sprintf(name, "%sentry%06u.dat", dir, i);
+            names[i] = name;
+
+            OFSHANDLE handle;
+            benchCheck(ofsFile->createFile(handle, name), "createFile");
+            ofsFile->closeFile(handle);
+        }
+
+        char test[64];
+        sprintf(test, "lookup_dir_%u", count);
+
+        BenchResult result = {test, config.Operations, 0, 0.0};
+        BenchTimer timer;
+
+        for(unsigned int i = 0;i < config.Operations;i++)
+            benchCheck(ofsFile->getFileEntry(names[random.next() % count].c_str(), entry), "getFileEntry");
+
+        result.Seconds = timer.elapsed();
+        results.push_back(result);
+
+        benchCheck(ofsFile->deleteDirectory(dir, true), "deleteDirectory");
+    }
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchSequentialRead(OfsPtr& ofsFile, const BenchFileList& files)
+{
+    std::vector<char> buffer(BENCH_CHUNK_SIZE);
+
+    BenchResult result = {"sequential_read", (ofs64)files.size(), 0, 0.0};
+    BenchTimer timer;
+
+    for(unsigned int i = 0;i < files.size();i++)
+        result.Bytes += benchReadFile(ofsFile, files[i].Name, buffer);
+
+    result.Seconds = timer.elapsed();
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchRandomRead(OfsPtr& ofsFile, const BenchConfig& config, const BenchFileList& files)
+{
+    BenchRandom random(config.Seed + 2);
+    char buffer[BENCH_RANDOM_READ_SIZE];
+
+    /* Files stay open, only seek and read are measured */
+    std::vector<OFSHANDLE> handles(std::min<unsigned int>(files.size(), 64));
+    std::vector<unsigned int> sizes(handles.size());
+
+    for(unsigned int i = 0;i < handles.size();i++)
+    {
+        unsigned int index = random.next() % files.size();
+        benchCheck(ofsFile->openFile(handles[i], files[index].Name.c_str()), "openFile");
+        sizes[i] = files[index].Size;
+    }
+
+    BenchResult result = {"random_read", config.Operations, 0, 0.0};
+    BenchTimer timer;
+
+    for(unsigned int i = 0;i < config.Operations;i++)
+    {
+        unsigned int h = random.next() % handles.size();
+        unsigned int pos = (sizes[h] > BENCH_RANDOM_READ_SIZE) ? random.next() % (sizes[h] - BENCH_RANDOM_READ_SIZE) : 0;
+        unsigned int actual_read = 0;
+
+        ofsFile->seek(handles[h], pos, OFS_SEEK_BEGIN);
+        ofsFile->read(handles[h], buffer, BENCH_RANDOM_READ_SIZE, &actual_read);
+
+        result.Bytes += actual_read;
+    }
+
+    result.Seconds = timer.elapsed();
+
+    for(unsigned int i = 0;i < handles.size();i++)
+        ofsFile->closeFile(handles[i]);
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchAppend(OfsPtr& ofsFile, const BenchConfig& config)
+{
+    const unsigned int num_files = 16;
+
+    BenchRandom random(config.Seed + 3);
+    std::vector<char> data(BENCH_APPEND_SIZE);
+    std::vector<OFSHANDLE> handles(num_files);
+    std::vector<unsigned int> remaining(num_files);
+
+    benchFillBuffer(data, config.Seed + 3);
+
+    BenchResult result = {"append", 0, 0, 0.0};
+    BenchTimer timer;
+
+    benchCheck(ofsFile->createDirectory("append/"), "createDirectory");
+
+    for(unsigned int i = 0;i < num_files;i++)
+    {
+        char name[32];
+        sprintf(name, "append/log%02u.txt", i);
+
+        benchCheck(ofsFile->createFile(handles[i], name), "createFile");
+        remaining[i] = std::max(benchFileSize(config, random), BENCH_APPEND_SIZE);
+    }
+
+    /* Small interleaved writes, the worst case for block allocation */
+    bool writing = true;
+
+    while(writing)
+    {
+        writing = false;
+
+        for(unsigned int i = 0;i < num_files;i++)
+        {
+            if(remaining[i] == 0)
+                continue;
+
+            unsigned int length = std::min(remaining[i], BENCH_APPEND_SIZE);
+            benchCheck(ofsFile->write(handles[i], &data[0], length), "write");
+
+            remaining[i] -= length;
+            result.Bytes += length;
+            ++result.Operations;
+            writing = true;
+        }
+    }
+
+    for(unsigned int i = 0;i < num_files;i++)
+        ofsFile->closeFile(handles[i]);
+
+    result.Seconds = timer.elapsed();
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+/* Creates many small files in one directory and deletes them in random order, measures block allocation and freeing */
+void benchChurn(OfsPtr& ofsFile, const BenchConfig& config, BenchResultList& results)
+{
+    BenchRandom random(config.Seed + 8);
+    std::vector<char> data(BENCH_CHUNK_SIZE);
+    benchFillBuffer(data, config.Seed + 8);
+
+    benchCheck(ofsFile->createDirectory("churn/"), "createDirectory");
+
+    std::vector<std::string> names(BENCH_CHURN_FILES);
+
+    BenchResult create = {"create_files", (ofs64)BENCH_CHURN_FILES, 0, 0.0};
+    BenchTimer create_timer;
+
+    for(unsigned int i = 0;i < BENCH_CHURN_FILES;i++)
+    {
+        char name[64];
+        sprintf(name, "churn/file%06u.dat", i);
+        names[i] = name;
+
+        unsigned int size = random.range(1, BENCH_CHURN_MAX_SIZE);
+        benchWriteFile(ofsFile, names[i], size, data);
+        create.Bytes += size;
+    }
+
+    create.Seconds = create_timer.elapsed();
+    results.push_back(create);
+
+    for(unsigned int i = names.size();i > 1;i--)
+        std::swap(names[i - 1], names[random.next() % i]);
+
+    BenchResult remove = {"delete_files", (ofs64)BENCH_CHURN_FILES, create.Bytes, 0.0};
+    BenchTimer remove_timer;
+
+    for(unsigned int i = 0;i < names.size();i++)
+        benchCheck(ofsFile->deleteFile(names[i].c_str()), "deleteFile");
+
+    remove.Seconds = remove_timer.elapsed();
+    results.push_back(remove);
+
+    benchCheck(ofsFile->deleteDirectory("churn/", true), "deleteDirectory");
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchFragment(OfsPtr& ofsFile, const BenchConfig& config, BenchFileList& files)
+{
+    const unsigned int cycles = 4;
+
+    BenchRandom random(config.Seed + 4);
+    std::vector<char> data(2 * BENCH_CHUNK_SIZE);
+
+    benchFillBuffer(data, config.Seed + 4);
+
+    BenchResult result = {"delete_fragment", 0, 0, 0.0};
+    BenchTimer timer;
+
+    /* Every cycle replaces a random half of the files with files of new sizes */
+    for(unsigned int c = 0;c < cycles;c++)
+    {
+        for(unsigned int i = 0;i < files.size();i++)
+        {
+            if(random.next() & 1)
+                continue;
+
+            benchCheck(ofsFile->deleteFile(files[i].Name.c_str()), "deleteFile");
+
+            files[i].Size = benchFileSize(config, random);
+            benchWriteFile(ofsFile, files[i].Name, files[i].Size, data);
+
+            result.Bytes += files[i].Size;
+            ++result.Operations;
+        }
+    }
+
+    result.Seconds = timer.elapsed();
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchDefrag(OfsPtr& ofsFile, const BenchConfig& config)
+{
+    std::string dest = config.File + ".defrag.ofs";
+
+    FileSystemStats stats;
+    ofsFile->getFileSystemStats(stats);
+
+    BenchResult result = {"defrag", 1, stats.UsedSpace, 0.0};
+    BenchTimer timer;
+
+    benchCheck(ofsFile->defragFileSystemTo(dest.c_str()), "defragFileSystemTo");
+
+    result.Seconds = timer.elapsed();
+
+    remove(dest.c_str());
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchCompact(OfsPtr& ofsFile)
+{
+    BenchResult result = {"compact", 0, 0, 0.0};
+    CompactionProgress progress;
+    BenchTimer timer;
+
+    do
+    {
+        benchCheck(ofsFile->compactFileSystem(256, progress), "compactFileSystem");
+
+        result.Bytes += progress.BytesMoved;
+        result.Operations += progress.BlocksMoved;
+    } while(!progress.Finished && progress.BlocksMoved > 0);
+
+    result.Seconds = timer.elapsed();
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+/* Shared state of the concurrent read test */
+struct BenchReaderData
+{
+    OfsPtr              *File;
+    const BenchFileList *Files;
+    unsigned int         Operations;
+    unsigned int         Seed;
+    ofs64                Bytes;
+};
+
+void benchReaderThread(BenchReaderData *data)
+{
+    BenchRandom random(data->Seed);
+    std::vector<char> buffer(BENCH_CHUNK_SIZE);
+
+    for(unsigned int i = 0;i < data->Operations;i++)
+        data->Bytes += benchReadFile(*data->File, (*data->Files)[random.next() % data->Files->size()].Name, buffer);
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchThreadedRead(OfsPtr& ofsFile, const BenchConfig& config, const BenchFileList& files)
+{
+    unsigned int per_thread = std::max(config.Operations / (10 * config.Threads), 1u);
+    std::vector<BenchReaderData> data(config.Threads);
+
+    BenchResult result = {"threaded_read", 0, 0, 0.0};
+    BenchTimer timer;
+
+    boost::thread_group threads;
+
+    for(unsigned int i = 0;i < config.Threads;i++)
+    {
+        BenchReaderData reader = {&ofsFile, &files, per_thread, config.Seed + 10 + i, 0};
+        data[i] = reader;
+        threads.create_thread(boost::bind(&benchReaderThread, &data[i]));
+    }
+
+    threads.join_all();
+
+    result.Seconds = timer.elapsed();
+
+    for(unsigned int i = 0;i < config.Threads;i++)
+    {
+        result.Operations += data[i].Operations;
+        result.Bytes += data[i].Bytes;
+    }
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+/* Loads every file whole into a buffer of its size the way Ogre loads a resource,
+   once with buffered reads and once memory mapped */
+void benchResourceLoad(OfsPtr& ofsFile, const BenchConfig& config, const BenchFileList& files, BenchResultList& results)
+{
+    BenchRandom random(config.Seed + 6);
+    std::vector<unsigned int> order(files.size());
+
+    for(unsigned int i = 0;i < order.size();i++)
+        order[i] = i;
+
+    for(unsigned int i = order.size();i > 1;i--)
+        std::swap(order[i - 1], order[random.next() % i]);
+
+    std::vector<char> buffer;
+
+    for(int mapped = 0;mapped < 2;mapped++)
+    {
+        ofsFile.setMemoryMapped(mapped != 0);
+
+        BenchResult result = {mapped ? "resource_load_mmap" : "resource_load_stdio", (ofs64)files.size(), 0, 0.0};
+        BenchTimer timer;
+
+        for(unsigned int i = 0;i < order.size();i++)
+        {
+            const std::string& name = files[order[i]].Name;
+            OFSHANDLE handle;
+            ofs64 size = 0;
+            unsigned int actual_read = 0;
+
+            benchCheck(ofsFile->getFileSize(name.c_str(), size), "getFileSize");
+            benchCheck(ofsFile->openFile(handle, name.c_str()), "openFile");
+
+            if(size > 0)
+            {
+                buffer.resize((size_t)size);
+                ofsFile->read(handle, &buffer[0], (unsigned int)size, &actual_read);
+            }
+
+            ofsFile->closeFile(handle);
+
+            result.Bytes += actual_read;
+        }
+
+        result.Seconds = timer.elapsed();
+        results.push_back(result);
+    }
+
+    ofsFile.setMemoryMapped(config.Mapped);
+}
+
+//------------------------------------------------------------------------------
+
+void benchWriteResults(FILE *out, const BenchConfig& config, const BenchResultList& results, const FileSystemStats& stats)
+{
+    if(config.Format == "csv")
+    {
+        fprintf(out, "test,operations,bytes,seconds,ops_per_sec,mb_per_sec\n");
+
+        for(unsigned int i = 0;i < results.size();i++)
+        {
+            const BenchResult& r = results[i];
+            double seconds = std::max(r.Seconds, 1e-9);
+
+            fprintf(out, "%s,%lld,%lld,%.6f,%.1f,%.2f\n", r.Name.c_str(), (long long)r.Operations, (long long)r.Bytes,
+                r.Seconds, r.Operations / seconds, r.Bytes / seconds / (1024.0 * 1024.0));
+        }
+
+        return;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"config\": {\"files\": %u, \"min_size\": %u, \"max_size\": %u, \"distribution\": \"%s\", \"depth\": %u, "
+        "\"fanout\": %u, \"threads\": %u, \"operations\": %u, \"seed\": %u, \"mmap\": %s},\n",
+        config.NumFiles, config.MinSize, config.MaxSize, config.Distribution.c_str(), config.Depth,
+        config.Fanout, config.Threads, config.Operations, config.Seed, config.Mapped ? "true" : "false");
+    fprintf(out, "  \"stats\": {\"directories\": %lld, \"files\": %lld, \"used_allocations\": %lld, \"free_allocations\": %lld, "
+        "\"used_space\": %lld, \"free_space\": %lld, \"file_size\": %lld},\n",
+        (long long)stats.NumDirectories, (long long)stats.NumFiles, (long long)stats.UsedAllocations, (long long)stats.FreeAllocations,
+        (long long)stats.UsedSpace, (long long)stats.FreeSpace, (long long)stats.TotalFileSize);
+    fprintf(out, "  \"results\": [\n");
+
+    for(unsigned int i = 0;i < results.size();i++)
+    {
+        const BenchResult& r = results[i];
+        double seconds = std::max(r.Seconds, 1e-9);
+
+        fprintf(out, "    {\"test\": \"%s\", \"operations\": %lld, \"bytes\": %lld, \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"mb_per_sec\": %.2f}%s\n",
+            r.Name.c_str(), (long long)r.Operations, (long long)r.Bytes, r.Seconds, r.Operations / seconds,
+            r.Bytes / seconds / (1024.0 * 1024.0), (i + 1 < results.size()) ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+}
+
+//------------------------------------------------------------------------------
+
+void printUsage()
+{
+    printf("Usage: ofsbench [options]\n");
+    printf("  -f <file.ofs>      File system to generate (default ofsbench.ofs)\n");
+    printf("  -o <file>          Write results to file instead of stdout\n");
+    printf("  --csv              Write results as CSV instead of JSON\n");
+    printf("  -t <a,b,...>       Tests to run: mount,lookup,lookup_sweep,sequential_read,random_read,\n");
+    printf("                     append,churn,delete_fragment,defrag,compact,threaded_read,\n");
+    printf("                     resource_load (default all)\n");
+    printf("  -n <count>         Number of files (default 2000)\n");
+    printf("  --min-size <n>     Smallest file size in bytes (default 1024)\n");
+    printf("  --max-size <n>     Largest file size in bytes (default 1048576)\n");
+    printf("  --dist <d>         Size distribution: uniform, log or fixed (default log)\n");
+    printf("  --depth <n>        Depth of the directory tree (default 3)\n");
+    printf("  --fanout <n>       Sub directories per directory (default 4)\n");
+    printf("  -j <threads>       Threads of the concurrent read test (default 4)\n");
+    printf("  --ops <n>          Operations of lookup and random access tests (default 100000)\n");
+    printf("  --seed <n>         Random seed (default 1)\n");
+    printf("  --mmap             Mount memory mapped\n");
+    printf("  --keep             Keep the generated file system\n");
+}
+
+//------------------------------------------------------------------------------
+
+bool benchSelected(const BenchConfig& config, const char *name)
+{
+    if(config.Tests.empty())
+        return true;
+
+    std::string list = "," + config.Tests + ",";
+    return list.find(std::string(",") + name + ",") != std::string::npos;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    BenchConfig config;
+
+    config.File = "ofsbench.ofs";
+    config.Format = "json";
+    config.NumFiles = 2000;
+    config.MinSize = 1024;
+    config.MaxSize = 1024 * 1024;
+    config.Distribution = "log";
+    config.Depth = 3;
+    config.Fanout = 4;
+    config.Threads = 4;
+    config.Operations = 100000;
+    config.Seed = 1;
+    config.Mapped = false;
+    config.Keep = false;
+
+    for(int i = 1;i < argc;i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if(arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+        else if(arg == "--csv")
+            config.Format = "csv";
+        else if(arg == "--mmap")
+            config.Mapped = true;
+        else if(arg == "--keep")
+            config.Keep = true;
+        else if(!has_value)
+        {
+            printUsage();
+            return 1;
+        }
+        else if(arg == "-f")
+            config.File = argv[++i];
+        else if(arg == "-o")
+            config.Output = argv[++i];
+        else if(arg == "-t")
+            config.Tests = argv[++i];
+        else if(arg == "-n")
+            config.NumFiles = atoi(argv[++i]);
+        else if(arg == "--min-size")
+            config.MinSize = atoi(argv[++i]);
+        else if(arg == "--max-size")
+            config.MaxSize = atoi(argv[++i]);
+        else if(arg == "--dist")
+            config.Distribution = argv[++i];
+        else if(arg == "--depth")
+            config.Depth = atoi(argv[++i]);
+        else if(arg == "--fanout")
+            config.Fanout = atoi(argv[++i]);
+        else if(arg == "-j")
+            config.Threads = atoi(argv[++i]);
+        else if(arg == "--ops")
+            config.Operations = atoi(argv[++i]);
+        else if(arg == "--seed")
+            config.Seed = atoi(argv[++i]);
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if(config.NumFiles == 0 || config.Threads == 0 || config.Operations == 0 || config.MinSize > config.MaxSize)
+    {
+        printUsage();
+        return 1;
+    }
+
+    BenchResultList results;
+    BenchFileList files;
+    FileSystemStats stats;
+    OfsPtr ofsFile;
+
+    try
+    {
+        results.push_back(benchGenerate(ofsFile, config, files));
+
+        if(benchSelected(config, "mount"))
+            results.push_back(benchMount(ofsFile, config));
+        if(benchSelected(config, "lookup"))
+            results.push_back(benchLookup(ofsFile, config, files));
+        if(benchSelected(config, "lookup_sweep"))
+            benchLookupSweep(ofsFile, config, results);
+        if(benchSelected(config, "sequential_read"))
+            results.push_back(benchSequentialRead(ofsFile, files));
+        if(benchSelected(config, "random_read"))
+            results.push_back(benchRandomRead(ofsFile, config, files));
+        if(benchSelected(config, "threaded_read"))
+            results.push_back(benchThreadedRead(ofsFile, config, files));
+        if(benchSelected(config, "resource_load"))
+            benchResourceLoad(ofsFile, config, files, results);
+        if(benchSelected(config, "append"))
+            results.push_back(benchAppend(ofsFile, config));
+        if(benchSelected(config, "churn"))
+            benchChurn(ofsFile, config, results);
+        if(benchSelected(config, "delete_fragment"))
+            results.push_back(benchFragment(ofsFile, config, files));
+        if(benchSelected(config, "defrag"))
+            results.push_back(benchDefrag(ofsFile, config));
+        if(benchSelected(config, "compact"))
+            results.push_back(benchCompact(ofsFile));
+
+        ofsFile->getFileSystemStats(stats);
+        ofsFile.unmount();
+    }
+    catch(Exception& e)
+    {
+        fprintf(stderr, "ofsbench: %s\n", e.getDescription().c_str());
+        return 2;
+    }
+
+    if(!config.Keep)
+        remove(config.File.c_str());
+
+    FILE *out = config.Output.empty() ? stdout : fopen(config.Output.c_str(), "w");
+
+    if(out == NULL)
+    {
+        fprintf(stderr, "ofsbench: cannot write %s\n", config.Output.c_str());
+        return 1;
+    }
+
+    benchWriteResults(out, config, results, stats);
+
+    if(out != stdout)
+        fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*/////////////////////////////////////////////////////////////////////////////////
+/// An
+///    ___   ____ ___ _____ ___  ____
+///   / _ \ / ___|_ _|_   _/ _ \|  _ \
+///  | | | | |  _ | |  | || | | | |_) |
+///  | |_| | |_| || |  | || |_| |  _ <
+///   \___/ \____|___| |_| \___/|_| \_\
+///                              File
+///
+/// Copyright (c) 2008-2015 Ismail TARIM <ismail@royalspor.com> and the Ogitor Team
+////
+/// The MIT License
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+/// THE SOFTWARE. 
+///////////////////////////////////////////////////////////////////////////////////*/
+
+#include "ofs.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/* Command line tool upgrading file systems of previous versions to the current one.
+   Usage: ofsconvert <file.ofs> [<file.ofs> ...]   converts each file in place
+          ofsconvert -o <dest.ofs> <file.ofs>       writes the converted file to dest.ofs
+   An interrupted conversion continues where it stopped when run again */
+
+void logCallback(std::string msg)
+{
+    printf("%s\n", msg.c_str());
+    fflush(stdout);
+}
+
+//------------------------------------------------------------------------------
+
+bool convertFile(const std::string& source, const std::string& dest)
+{
+    OFS::OfsPtr ofsFile;
+    OFS::OfsResult ret;
+
+    try
+    {
+        ret = ofsFile.mount(source.c_str(), OFS::OFS_MOUNT_OPEN);
+    }
+    catch(OFS::Exception& e)
+    {
+        printf("%s: %s\n", source.c_str(), e.getDescription().c_str());
+        return false;
+    }
+
+    if(ret == OFS::OFS_OK)
+    {
+        ofsFile.unmount();
+        printf("%s: Already of the current version.\n", source.c_str());
+        return true;
+    }
+
+    if(ret != OFS::OFS_PREVIOUS_VERSION)
+    {
+        printf("%s: Not a valid file system.\n", source.c_str());
+        return false;
+    }
+
+    /* Mount picks the file system type from the extension, so the temporary target keeps ".ofs" */
+    bool in_place = dest.empty();
+    std::string target = in_place ? source + ".converting.ofs" : dest;
+
+    OFS::LogCallBackFunction callback = &logCallback;
+    OFS::OfsConverter conv;
+
+    /* On failure the target is kept, running again resumes the conversion */
+    if(!conv.convert(source, target, &callback))
+    {
+        printf("%s: Conversion failed, run again to resume.\n", source.c_str());
+        return false;
+    }
+
+    if(in_place)
+    {
+        remove(source.c_str());
+
+        if(rename(target.c_str(), source.c_str()) != 0)
+        {
+            printf("%s: Could not replace the file, converted file is %s\n", source.c_str(), target.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    std::string dest;
+    std::vector<std::string> sources;
+
+    for(int i = 1;i < argc;i++)
+    {
+        std::string arg = argv[i];
+
+        if(arg == "-o" && i + 1 < argc)
+            dest = argv[++i];
+        else
+            sources.push_back(arg);
+    }
+
+    if(sources.empty() || (!dest.empty() && sources.size() != 1))
+    {
+        printf("Usage: ofsconvert <file.ofs> [<file.ofs> ...]\n");
+        printf("       ofsconvert -o <dest.ofs> <file.ofs>\n");
+        return 1;
+    }
+
+    int failed = 0;
+
+    for(unsigned int i = 0;i < sources.size();i++)
+    {
+        if(!convertFile(sources[i], dest))
+            ++failed;
+    }
+
+    return (failed > 0) ? 1 : 0;
+}
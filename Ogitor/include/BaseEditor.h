@@ -82,7 +82,11 @@ namespace Ogitors
         /** Static initialization */
         static void _initStatic(OgitorsRoot *root);
 
-        inline void setModified(bool value) { mModified->set(value); }
+        /**
+        * Flags editor object as modified since the last save, scene saves only write modified objects
+        * @param value modified flag
+        */
+        void setModified(bool value);
         inline void setSelected(bool value) { mSelected->set(value); }
         inline void setHighlighted(bool value) { mHighlighted->set(value); }
         inline void setLoaded(bool value) { mLoaded->set(value); }
@@ -128,10 +132,16 @@ namespace Ogitors
         */
         OgitorWorldSectionId        getDefaultWorldSection();
         /**
-        * Tests if editor object was modified 
+        * Tests if editor object was modified since the last save
+        * Editors keeping data outside of their properties override this to report changes to it
         * @return true if editor object was modified, otherwise false
         */
-        inline bool                 isModified() {return mModified->get();};
+        virtual bool                isModified() {return mModified->get();};
+        /**
+        * Fetches the revision of editor object, a scene wide unique number renewed each time the object is modified
+        * @return revision of editor object
+        */
+        inline unsigned int         getRevision() {return mRevision;};
         /**
         * Tests if editor object uses gizmos
         * @return true if editor object uses gizmos, otherwise false
@@ -234,6 +244,13 @@ namespace Ogitors
         */
         virtual void                getPropertyMapImpl(OgitorsPropertyValueMap& map) {};
         /**
+        * Tests if a property only reflects the editing state, such properties are not saved
+        * and changing them does not modify the object
+        * @param propname name of the property
+        * @return true if the property is not saved, otherwise false
+        */
+        static bool                 isTransientProperty(const Ogre::String& propname);
+        /**
         * Destroys editor object and cleans up used memory
         * @param informparent flag to inform the parent of this object' destruction
         */
@@ -554,6 +571,7 @@ namespace Ogitors
         static OgitorsRoot      *mOgitorsRoot;              /** Global OgitorsRoot handle */ 
         static OgitorsSystem    *mSystem;                   /** Global OgitorsSystem handle */ 
         static OgitorsPhysics   *mPhysics;                  /** Global OgitorsPhysics handle */ 
+        static unsigned int      mRevisionCounter;          /** Last revision given to an editor object */
 
         CBaseEditorFactory      *mFactory;                  /** The factory that created the object */
         OgitorsView             *mView;                     /** The View instantiating the object, NULL for OgitorsRoot */
@@ -570,6 +588,7 @@ namespace Ogitors
         void                    *mLayerTreeItemHandle;      /** Treeview item handle */
         int                      mRefCount;                 /** Used for Scripting */
         unsigned int             mScriptResourceHandle;     /** Handle for Object's resources at the Script Interpreter side */
+        unsigned int             mRevision;                 /** Revision of the object, see getRevision */
 
         OgitorsParentProperty           *mParentEditor;     /** Parent handle */
         OgitorsProperty<unsigned int>   *mObjectID;         /** Unique Object ID */
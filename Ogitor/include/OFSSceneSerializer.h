@@ -38,9 +38,19 @@
 
 namespace Ogitors
 {
+    class BinarySceneReader;
+    class XmlPullReader;
+
     //! Ogitor scene serializer class
     /*!  
     A class that is responsible for serializing entire Ogitor-based scene
+
+    Scene objects are stored in segment files grouped by editor type, depth in the scene tree and
+    object id, a save only rewrites the segments holding modified, created or destroyed objects
+
+    On import segments are read and parsed by worker threads while the main thread creates the objects
+    of the segments already parsed, resources the objects refer to are prepared in the background.
+    Scene and segment files are streamed with XmlPullReader, no DOM of the objects is built
     */
     class OgitorExport COFSSceneSerializer: public CBaseSerializer
     {
@@ -48,7 +58,8 @@ namespace Ogitors
         /**
         * Constructor (empty)
         */
-        COFSSceneSerializer() : CBaseSerializer("OFS Scene Serializer", CAN_EXPORT | CAN_IMPORT) {};
+        COFSSceneSerializer() : CBaseSerializer("OFS Scene Serializer", CAN_EXPORT | CAN_IMPORT),
+            mLoadedObjects(0), mTotalObjects(0), mLastProgress(-1) {};
         /**
         * Destructor (empty)
         */
@@ -73,9 +84,31 @@ namespace Ogitors
         */
         virtual int  Import(Ogre::String importfile = "");
     private:
+        struct IMPORTOBJECT;
+        struct IMPORTQUEUE;
+
+        unsigned int mLoadedObjects;    /** Number of objects created so far during import */
+        unsigned int mTotalObjects;     /** Number of objects expected during import */
+        int          mLastProgress;     /** Last load progress reported */
+        Ogre::set<Ogre::String>::type mPreparedResources;   /** Resources already queued for background preparation during import */
+
         int  _writeFile(Ogre::String exportfile = "", const bool forceSave=true);
-        void _upgradeOgsceneFileFrom2To3(TiXmlNode* ogsceneRootNode);
-        void _upgradeOgsceneFileFrom3To4(TiXmlNode* ogsceneRootNode);
+        int  _writeSegment(const Ogre::String& filename, const ObjectVector& objects, bool binary);
+        int  _readFile(const Ogre::String& filename, std::vector<char>& data);
+        int  _importBinaryObjects(const Ogre::String& filename, Ogre::StringVector& invalidEditorTypes);
+        int  _importSegments(TiXmlElement* segmentsElement, Ogre::StringVector& invalidEditorTypes);
+        int  _createBinaryObjects(BinarySceneReader& reader, Ogre::StringVector& invalidEditorTypes);
+        void _parseSegments(IMPORTQUEUE* queue);
+        int  _parseSegment(const Ogre::String& filename, int format, std::vector<IMPORTOBJECT>& objects);
+        bool _readObject(XmlPullReader& reader, OgitorsPropertyValueMap& params, OgitorsCustomPropertySet*& customProperties);
+        CBaseEditor *_createObject(OgitorsPropertyValueMap& params, Ogre::StringVector& invalidEditorTypes);
+        void _prepareResources(const OgitorsPropertyValueMap& params);
+        void _prepareResource(const Ogre::String& resourceType, const Ogre::String& name, const Ogre::String& group);
+        void _updateObjectProgress();
+        unsigned int _getSegmentID(CBaseEditor* object, unsigned int bucketCount);
+        Ogre::String _getSegmentFileName(unsigned int segmentID);
+        void _upgradeOgsceneObjectFrom2To3(OgitorsPropertyValueMap& params);
+        void _upgradeOgsceneFileFrom3To4();
     };
 };
 
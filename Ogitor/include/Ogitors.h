@@ -58,4 +58,5 @@
 #include "MultiSelEditor.h"
 #include "TerrainEditor.h"
 #include "OgitorsUndoManager.h"
+#include "OgitorsAutoBackup.h"
 
@@ -0,0 +1,109 @@
+/*/////////////////////////////////////////////////////////////////////////////////
+/// An
+///    ___   ____ ___ _____ ___  ____
+///   / _ \ / ___|_ _|_   _/ _ \|  _ \
+///  | | | | |  _ | |  | || | | | |_) |
+///  | |_| | |_| || |  | || |_| |  _ <
+///   \___/ \____|___| |_| \___/|_| \_\
+///                              File
+///
+/// Copyright (c) 2008-2015 Ismail TARIM <ismail@royalspor.com> and the Ogitor Team
+///
+/// The MIT License
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+/// THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////*/
+
+
+#pragma once
+
+#include "OgitorsSingleton.h"
+
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace Ogitors
+{
+    //! Automatic backup class
+    /*!  
+        A class that backs up the scene without stalling the editor: the scene is copied on the 
+        main thread and written to the backup folder of the project by a worker thread. 
+        Copies of unmodified objects are shared between backups, so only modified objects are copied again
+    */
+    class OgitorExport OgitorsAutoBackup: public Singleton<OgitorsAutoBackup>, public Ogre::GeneralAllocatedObject
+    {
+    public:
+        /**
+        * Constructor
+        */
+        OgitorsAutoBackup();
+        /**
+        * Destructor, waits for the backup being written
+        */
+        virtual ~OgitorsAutoBackup();
+        /**
+        * Takes a snapshot of the scene and writes it to the backup folder in the background,
+        * the oldest backups are deleted to keep the number set in the project options
+        * @return false if there is no loaded scene or the previous backup is still being written
+        */
+        bool backupScene();
+        /**
+        * Tests if a backup is being written
+        * @return true if a backup is being written, otherwise false
+        */
+        bool isWriting();
+        /**
+        * Waits for the backup being written and drops the snapshots kept for the next backup
+        */
+        void reset();
+
+    private:
+        struct OBJECTSNAPSHOT
+        {
+            unsigned int             Revision;          /** Revision of the object when the snapshot was taken */
+            unsigned int             ObjectID;          /** Id of the object */
+            Ogre::String             Name;              /** Name of the object */
+            Ogre::String             TypeName;          /** Type name of the object */
+            Ogre::String             ParentName;        /** Name of the parent, empty if the parent is the root */
+            OgitorsPropertyValueMap  Properties;        /** Properties of the object */
+            Ogre::String             CustomProperties;  /** XML structure of the custom properties */
+        };
+
+        typedef boost::shared_ptr<OBJECTSNAPSHOT> ObjectSnapshotPtr;
+        typedef std::vector<ObjectSnapshotPtr> ObjectSnapshotVector;
+        typedef OGRE_HashMap<unsigned int, ObjectSnapshotPtr> ObjectSnapshotMap;
+
+        struct BACKUPJOB
+        {
+            Ogre::String             FileName;          /** Full path of the backup file */
+            Ogre::String             FileSpec;          /** Pattern matching all backups of the project */
+            unsigned int             MaxBackups;        /** Number of backups to keep, 0 keeps all */
+            Ogre::String             Header;            /** XML structure of the project options */
+            ObjectSnapshotVector     Objects;           /** Objects in the order they are saved */
+        };
+
+        ObjectSnapshotMap   mSnapshots;                 /** Last snapshot of each object, shared with the backup being written */
+        boost::thread      *mThread;                    /** Thread writing the last backup */
+        boost::mutex        mMutex;                     /** Guards mWriting */
+        bool                mWriting;                   /** Is a backup being written? */
+
+        void _join();
+        void _writeBackup(BACKUPJOB *job);
+    };
+}
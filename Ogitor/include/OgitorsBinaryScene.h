@@ -0,0 +1,181 @@
+/*/////////////////////////////////////////////////////////////////////////////////
+/// An
+///    ___   ____ ___ _____ ___  ____
+///   / _ \ / ___|_ _|_   _/ _ \|  _ \
+///  | | | | |  _ | |  | || | | | |_) |
+///  | |_| | |_| || |  | || |_| |  _ <
+///   \___/ \____|___| |_| \___/|_| \_\
+///                              File
+///
+/// Copyright (c) 2008-2015 Ismail TARIM <ismail@royalspor.com> and the Ogitor Team
+///
+/// The MIT License
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+/// THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////*/
+
+#pragma once
+
+#include "OgitorsExports.h"
+
+namespace Ogitors
+{
+    /*////////////////////////////////////////////////////////////////////////////////
+    // Binary scene file layout, values are stored in the byte order of the writer:
+    //   header : magic "OGBS", format version, size of Ogre::Real
+    //   chunks : chunk id, payload size, payload
+    //     STRT : string table, count followed by length prefixed strings
+    //     OBJS : object count followed by object records, strings are table indices
+    // Readers skip chunks they do not know, new chunks do not break older versions
+    ////////////////////////////////////////////////////////////////////////////////*/
+
+    const unsigned int BINARYSCENE_MAGIC          = 0x5342474F;   /** "OGBS" */
+    const unsigned int BINARYSCENE_VERSION        = 1;            /** Current format version */
+    const unsigned int BINARYSCENE_CHUNK_STRINGS  = 0x54525453;   /** "STRT" */
+    const unsigned int BINARYSCENE_CHUNK_OBJECTS  = 0x534A424F;   /** "OBJS" */
+    const unsigned int BINARYSCENE_NO_STRING      = 0xFFFFFFFF;   /** String index of an absent string */
+
+    //! Binary scene writer class
+    /*!  
+        A class that serializes objects into the binary scene format
+    */
+    class OgitorExport BinarySceneWriter
+    {
+    public:
+        /**
+        * Constructor
+        */
+        BinarySceneWriter();
+        /**
+        * Destructor
+        */
+        ~BinarySceneWriter();
+        /**
+        * Appends an object to the scene
+        * @param object the object to write
+        */
+        void writeObject(CBaseEditor *object);
+        /**
+        * Appends an object record to the scene
+        * @param objectID id of the object
+        * @param name name of the object
+        * @param typeName type name of the object
+        * @param parentName name of the parent, empty if the parent is the root
+        * @param properties the properties of the object, name, typename and object_id are skipped
+        * @param customProperties the custom properties of the object, may be NULL
+        */
+        void writeObject(unsigned int objectID, const Ogre::String& name, const Ogre::String& typeName, const Ogre::String& parentName,
+                         const OgitorsPropertyValueMap& properties, OgitorsCustomPropertySet *customProperties);
+        /**
+        * Fetches the number of objects written so far
+        * @return number of objects
+        */
+        unsigned int getObjectCount() const { return mObjectCount; }
+        /**
+        * Assembles the binary scene file
+        * @param output receives the file contents
+        */
+        void getData(std::string& output) const;
+
+    private:
+        typedef OGRE_HashMap<Ogre::String, unsigned int> StringIndexMap;
+
+        StringIndexMap  mStringIndices;     /** Index of each string in the string table */
+        std::string     mStrings;           /** Contents of the string table */
+        std::string     mObjects;           /** Contents of the object records */
+        unsigned int    mObjectCount;       /** Number of objects written */
+
+        template<typename T> void _write(const T& value)
+        {
+            mObjects.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void _writeReals(const Ogre::Real *values, unsigned int count);
+        void _writeString(const Ogre::String& value);
+        void _writeValue(const OgitorsPropertyValue& value);
+        void _writeCustomProperties(OgitorsCustomPropertySet *set);
+    };
+
+    //! Binary scene reader class
+    /*!  
+        A class that reads objects from the binary scene format sequentially,
+        the data has to stay valid as long as the reader is used
+    */
+    class OgitorExport BinarySceneReader
+    {
+    public:
+        /**
+        * Constructor, validates the header and loads the string table
+        * @param data contents of the binary scene file
+        * @param size size of the data
+        */
+        BinarySceneReader(const char *data, size_t size);
+        /**
+        * Destructor
+        */
+        ~BinarySceneReader();
+        /**
+        * Tests if the data is a binary scene of a supported version
+        * @return true if objects can be read
+        */
+        bool isValid() const { return mValid; }
+        /**
+        * Fetches the number of objects in the scene
+        * @return number of objects
+        */
+        unsigned int getObjectCount() const { return mObjectCount; }
+        /**
+        * Reads the next object record, must be followed by readCustomProperties
+        * @param params receives the properties of the object including object_id, name, typename and parentnode
+        * @return true if an object was read
+        */
+        bool readObject(OgitorsPropertyValueMap& params);
+        /**
+        * Reads the custom properties of the object last read by readObject
+        * @param set receives the custom properties, NULL to skip them
+        * @return true on success
+        */
+        bool readCustomProperties(OgitorsCustomPropertySet *set);
+
+    private:
+        const char     *mData;              /** Contents of the binary scene file */
+        size_t          mSize;              /** Size of the contents */
+        size_t          mPos;               /** Read position inside the object records */
+        size_t          mObjectsEnd;        /** End of the object records */
+        unsigned int    mObjectCount;       /** Number of objects in the scene */
+        unsigned int    mObjectsRead;       /** Number of objects read so far */
+        bool            mValid;             /** Is the data a supported binary scene? */
+        Ogre::StringVector mStrings;        /** The string table */
+
+        template<typename T> bool _read(T& value)
+        {
+            if(mPos + sizeof(T) > mObjectsEnd)
+                return false;
+
+            memcpy(&value, mData + mPos, sizeof(T));
+            mPos += sizeof(T);
+            return true;
+        }
+
+        bool _readReals(Ogre::Real *values, unsigned int count);
+        bool _readString(Ogre::String& value);
+        bool _readValue(OgitorsPropertyType type, OgitorsPropertyValue& value);
+        bool _loadStringTable(size_t pos, size_t size);
+    };
+}
@@ -302,6 +302,25 @@ namespace Ogitors
       int                AutoBackupPeriodType;      /** Period type of auto backups: 0 = minutes, 1 = hours */
       Ogre::String       AutoBackupFolder;          /** Folder the backups are stored in */
       int                AutoBackupNumber;          /** Number of backups to be stored */
+      int                SceneFormat;               /** Format scene objects are stored in: 0 = XML, 1 = binary */
+      bool               MemoryMapped;              /** Flag specifying if the project file is read through a memory mapping */
+    };
+
+    /** Scene file segment structure */
+    struct SCENESEGMENT
+    {
+      unsigned int       ObjectCount;               /** Number of objects stored in the segment */
+      Ogre::uint64       ObjectIDSum;               /** Sum of the ids of the objects stored in the segment */
+    };
+
+    typedef Ogre::map<unsigned int, SCENESEGMENT>::type SceneSegmentMap;
+
+    /** Segments the scene objects were last read from or written to */
+    struct SCENESEGMENTTABLE
+    {
+      int                Format;                    /** Scene format of the segments, -1 if the scene is not stored in segments */
+      unsigned int       BucketCount;               /** Number of segments objects of the same type and depth are spread over */
+      SceneSegmentMap    Segments;                  /** Segments keyed by segment id */
     };
 
     /** Ogitor Plugin Features enumeration */
@@ -65,6 +65,9 @@ namespace Ogitors
         static const std::string LIBOGREOFSPLUGIN_PATH;
         static const std::string OGSCENE_FORMAT_VERSION;
         static const std::string OGSCENE_FORMAT_EXTENSION;
+        static const std::string OGSCENE_BINARY_EXTENSION;
+        static const std::string OGSCENE_SEGMENT_EXTENSION;
+        static const std::string OGSCENE_SEGMENT_DIRECTORY;
     };
 }
 // On MSVC, restore warnings state
@@ -70,6 +70,7 @@ namespace Ogitors
     class OgitorsPhysics;
     class OgitorsUndoManager;
     class OgitorsClipboardManager;
+    class OgitorsAutoBackup;
     class CBaseSerializer;
     class COgitorsSceneSerializer;
     class ITerrainEditor;
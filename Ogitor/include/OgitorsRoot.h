@@ -430,6 +430,15 @@ namespace Ogitors
         */
         PROJECTOPTIONS CreateDefaultProjectOptions();
         /**
+        * Fetches the segments the scene was last read from or written to
+        * @return a pointer to the scene segment table
+        */
+        SCENESEGMENTTABLE *GetSceneSegmentTable() {return &mSceneSegmentTable;}
+        /**
+        * Forgets the scene segments, the next save writes all of them
+        */
+        void            ResetSceneSegmentTable();
+        /**
         * Fetches project file system
         * @return project file system
         */
@@ -1118,12 +1127,14 @@ namespace Ogitors
         unsigned int                 mEditorTool;
 
         OgitorsUndoManager *mUndoManager;                               /** Undo manager handle */
+        OgitorsAutoBackup  *mAutoBackup;                                /** Automatic backup handle */
         OgitorsClipboardManager *mClipboardManager;                     /** Clipboard manager handle */
         OgitorsSystem      *mSystem;                                    /** The platform-dependent system handle */
         OgitorsPhysics     *mPhysics;                                   /** The platform-dependent physics handle */
         OgitorsScriptConsole *mScriptConsole;                           /** Script Console handle */
         OgitorsScriptInterpreter *mScriptInterpreter;                   /** Script Interpreter handle */
         PROJECTOPTIONS      mProjectOptions;                            /** A handle to hold all project options for the current scene */
+        SCENESEGMENTTABLE   mSceneSegmentTable;                         /** Segments the scene was last read from or written to */
         Ogre::SceneManager *mSceneManager;                              /** Current scene manager handle */
         CBaseEditor        *mSceneManagerEditor;                        /** Current scene manager editor handle */
         Ogre::RenderWindow *mRenderWindow;                              /** Current render window handle */
@@ -241,6 +241,18 @@ namespace Ogitors
         */
         static Ogre::String GetObjectSaveStringV2(CBaseEditor *object, int indentation, bool useobjid, bool addparent);
         /**
+        * Returns a string containing XML structure of an object from a copy of its data
+        * @param objectID id of the object, 0 leaves out the object_id parameter
+        * @param name name of the object
+        * @param typeName type name of the object
+        * @param parentName name of the parent, empty leaves out the parent node parameter
+        * @param properties the properties of the object, name, typename and object_id are skipped
+        * @param customProperties XML structure of the custom properties, see GetCustomPropertySaveString
+        * @return returns a string containing XML syntax created from the data
+        */
+        static Ogre::String GetObjectSaveStringV2(unsigned int objectID, const Ogre::String& name, const Ogre::String& typeName, const Ogre::String& parentName,
+                                                  OgitorsPropertyValueMap& properties, const Ogre::String& customProperties, int indentation);
+        /**
         * Returns a string containing XML structure of a custom property set for DotScene Format
         * @param set the set that will be used to create XML structure
         * @param indentation space to be left at the beginning of each line
@@ -259,6 +271,13 @@ namespace Ogitors
         */
         static bool SaveStreamOfs(std::stringstream& stream, Ogre::String filename);
         /**
+        * Saves given buffer to OFS
+        * @param data the contents to be saved
+        * @param size size of the contents
+        * @param filename the filename to be saved as
+        */
+        static bool SaveBufferOfs(const char *data, unsigned int size, Ogre::String filename);
+        /**
         * Copies a file system directory contents into OFS file system
         * @param dirpath path of the file system directory
         * @param ofs_path path of the OFS directory to copy files into
@@ -0,0 +1,272 @@
+/*/////////////////////////////////////////////////////////////////////////////////
+/// An
+///    ___   ____ ___ _____ ___  ____
+///   / _ \ / ___|_ _|_   _/ _ \|  _ \
+///  | | | | |  _ | |  | || | | | |_) |
+///  | |_| | |_| || |  | || |_| |  _ <
+///   \___/ \____|___| |_| \___/|_| \_\
+///                              File
+///
+/// Copyright (c) 2008-2015 Ismail TARIM <ismail@royalspor.com> and the Ogitor Team
+///
+/// The MIT License
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+/// THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////*/
+
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "tinyxml.h"
+
+#include "OgitorsExports.h"
+
+namespace OFS
+{
+    class OfsPtr;
+    class OFSHANDLE;
+}
+
+namespace Ogitors
+{
+    //! XML pull reader input class
+    /*!  
+        Supplies the document to an XmlPullReader chunk by chunk
+    */
+    class OgitorExport XmlPullSource
+    {
+    public:
+        /**
+        * Destructor
+        */
+        virtual ~XmlPullSource() {};
+        /**
+        * Reads the next chunk of the document
+        * @param buffer receives the data
+        * @param size size of the buffer
+        * @return number of bytes read, 0 at the end of the document or on error
+        */
+        virtual size_t read(char *buffer, size_t size) = 0;
+    };
+
+    //! XML pull reader memory input class
+    /*!  
+        Reads a document held in memory, the data has to stay valid as long as the source is used
+    */
+    class OgitorExport XmlPullMemorySource : public XmlPullSource
+    {
+    public:
+        XmlPullMemorySource(const char *data, size_t size) : mData(data), mSize(size), mPos(0) {};
+        virtual size_t read(char *buffer, size_t size);
+
+    private:
+        const char *mData;      /** The document */
+        size_t      mSize;      /** Size of the document */
+        size_t      mPos;       /** Read position */
+    };
+
+    //! XML pull reader disk file input class
+    class OgitorExport XmlPullFileSource : public XmlPullSource
+    {
+    public:
+        XmlPullFileSource(const std::string& filename);
+        virtual ~XmlPullFileSource();
+        /**
+        * Tests if the file could be opened
+        * @return true if the file is open
+        */
+        bool isOpen() const { return mFile != 0; }
+        virtual size_t read(char *buffer, size_t size);
+
+    private:
+        FILE       *mFile;      /** The file, NULL if it could not be opened */
+    };
+
+    //! XML pull reader OFS file input class
+    /*!  
+        Reads a file of an OFS file system, the file system has to stay mounted as long as the source is used
+    */
+    class OgitorExport XmlPullOfsSource : public XmlPullSource
+    {
+    public:
+        XmlPullOfsSource(OFS::OfsPtr& file, const std::string& filename);
+        virtual ~XmlPullOfsSource();
+        /**
+        * Tests if the file could be opened
+        * @return true if the file is open
+        */
+        bool isOpen() const { return mHandle != 0; }
+        virtual size_t read(char *buffer, size_t size);
+
+    private:
+        OFS::OfsPtr&      mOfsFile;     /** The file system holding the file */
+        OFS::OFSHANDLE   *mHandle;      /** Handle of the file, NULL if it could not be opened */
+    };
+
+    //! Streaming XML reader class
+    /*!  
+        A pull parser reading a document in chunks without building a DOM, each call to next()
+        reports the start or the end of an element, character data, comments, processing
+        instructions and document type declarations are skipped.
+        Parts of the document needed as a DOM can be materialized with readElement()
+    */
+    class OgitorExport XmlPullReader
+    {
+    public:
+        /** Events reported by next() */
+        enum EventType
+        {
+            EVENT_START_ELEMENT,    /** An element starts, its name and attributes are available */
+            EVENT_END_ELEMENT,      /** An element ends, empty elements end right after they start */
+            EVENT_END_DOCUMENT,     /** The root element has ended */
+            EVENT_ERROR             /** The document is malformed or could not be read, see getError() */
+        };
+
+        /**
+        * Constructor
+        * @param source input of the reader, has to stay valid as long as the reader is used
+        * @param bufferSize size of the chunks read from the source
+        */
+        XmlPullReader(XmlPullSource *source, size_t bufferSize = 64 * 1024);
+        /**
+        * Destructor
+        */
+        ~XmlPullReader();
+        /**
+        * Advances to the next event
+        * @return the event, errors and the end of the document are reported by all further calls
+        */
+        EventType next();
+        /**
+        * Advances to the next child of the current element, skipping the rest of the child last reported
+        * @param depth depth of the parent element
+        * @return true if a child starts, false if the parent has ended or on error
+        */
+        bool nextChild(int depth);
+        /**
+        * Skips the children and the end of the element that has just started
+        * @return false on error
+        */
+        bool skipElement();
+        /**
+        * Reads the element that has just started including its children into a DOM element
+        * @return the element, owned by the caller, NULL on error
+        */
+        TiXmlElement *readElement();
+        /**
+        * Fetches the last event reported
+        * @return the event
+        */
+        EventType getEvent() const { return mEvent; }
+        /**
+        * Fetches the name of the element that has started or ended
+        * @return name of the element
+        */
+        const std::string& getName() const { return mName; }
+        /**
+        * Fetches the depth of the element that has started or ended, the root element has depth 1
+        * @return depth of the element
+        */
+        int getDepth() const { return mDepth; }
+        /**
+        * Tests if the element that has just started is empty (<element/>)
+        * @return true if the element is empty
+        */
+        bool isEmptyElement() const { return mEmptyElement; }
+        /**
+        * Fetches an attribute of the element that has just started, entities are decoded
+        * @param name name of the attribute
+        * @return value of the attribute, NULL if the element has no such attribute
+        */
+        const char *getAttribute(const char *name) const;
+        /**
+        * Fetches the number of attributes of the element that has just started
+        * @return number of attributes
+        */
+        unsigned int getAttributeCount() const { return mAttributeCount; }
+        /**
+        * Fetches the name of an attribute of the element that has just started
+        * @param index index of the attribute
+        * @return name of the attribute
+        */
+        const std::string& getAttributeName(unsigned int index) const { return mAttributes[index].first; }
+        /**
+        * Fetches the value of an attribute of the element that has just started
+        * @param index index of the attribute
+        * @return value of the attribute
+        */
+        const std::string& getAttributeValue(unsigned int index) const { return mAttributes[index].second; }
+        /**
+        * Fetches the description of the error that stopped the reader
+        * @return the description, empty if there was no error
+        */
+        const std::string& getError() const { return mError; }
+
+    private:
+        typedef std::pair<std::string, std::string> Attribute;
+
+        XmlPullSource  *mSource;            /** Input of the reader */
+        char           *mBuffer;            /** Chunk currently parsed */
+        size_t          mBufferSize;        /** Capacity of the chunk buffer */
+        size_t          mPos;               /** Parse position inside the chunk */
+        size_t          mEnd;               /** End of the valid data inside the chunk */
+        size_t          mOffset;            /** Document offset of the chunk, used for error messages */
+        EventType       mEvent;             /** Last event reported */
+        std::string     mName;              /** Name of the element that has started or ended */
+        int             mDepth;             /** Depth of the element that has started or ended */
+        bool            mEmptyElement;      /** Is the element that has just started empty? */
+        bool            mPendingEnd;        /** Has an empty element yet to report its end? */
+        bool            mRootSeen;          /** Has the root element started? */
+        std::vector<Attribute> mAttributes; /** Attributes of the element, entries past mAttributeCount are kept for reuse */
+        unsigned int    mAttributeCount;    /** Number of attributes of the element that has just started */
+        std::vector<std::string> mOpenElements; /** Names of the elements not yet ended, entries past mOpenCount are kept for reuse */
+        unsigned int    mOpenCount;         /** Number of elements not yet ended */
+        std::string     mEntity;            /** Scratch buffer for entity references */
+        std::string     mError;             /** Description of the error that stopped the reader */
+
+        inline int _peek()
+        {
+            if(mPos == mEnd && !_fill())
+                return -1;
+            return (unsigned char)mBuffer[mPos];
+        }
+
+        inline int _get()
+        {
+            if(mPos == mEnd && !_fill())
+                return -1;
+            return (unsigned char)mBuffer[mPos++];
+        }
+
+        bool _fill();
+        void _skipWhiteSpace();
+        bool _skipPast(const char *terminator);
+        bool _skipDeclaration();
+        bool _readName(std::string& name);
+        bool _readAttributeValue(std::string& value);
+        void _decodeEntity(std::string& value);
+        EventType _readStartElement();
+        EventType _readEndElement();
+        EventType _setError(const std::string& error);
+    };
+}
@@ -142,6 +142,8 @@ namespace Ogitors
         Ogre::Real                   hitTest(Ogre::Ray& ray, Ogre::Vector3& retPos);
           /** @copydoc CBaseEditor::onSave(bool) */
         virtual void                 onSave(bool forced = false);
+        /** @copydoc CBaseEditor::isModified() */
+        virtual bool                 isModified();
         /**
         * Called before displaying an object properties in properties view 
         */
@@ -51,7 +51,11 @@ namespace Ogitors
     OgitorsRoot          *CBaseEditor::mOgitorsRoot = 0;
     OgitorsSystem        *CBaseEditor::mSystem = 0;
     OgitorsPhysics       *CBaseEditor::mPhysics = 0;
+    unsigned int          CBaseEditor::mRevisionCounter = 0;
     Ogre::String          CBaseEditor::mOBBMaterials[3];
+
+    // Properties reflecting the editing state, left out of getPropertyMap
+    static const char    *gTransientProperties[] = {"selected", "modified", "loaded", "destroyed", "highlighted"};
     //-----------------------------------------------------------------------------------------
     void CBaseEditor::_initStatic(OgitorsRoot *root)
     {
@@ -67,7 +71,7 @@ namespace Ogitors
     mFactory(factory), mHelper(0), 
         mBoxParentNode(0), mBBoxNode(0), mOBBoxRenderable(0), 
         mOBBoxData(AxisAlignedBox::BOX_NULL), mSceneTreeItemHandle(0), mLayerTreeItemHandle(0), 
-        mScriptResourceHandle(0)
+        mScriptResourceHandle(0), mRevision(++mRevisionCounter)
     {
         mView = factory->mView;
         mRefCount = 1;
@@ -177,6 +181,18 @@ namespace Ogitors
         return (getFactoryDynamic()->mDefaultWorldSection);
     }
     //-----------------------------------------------------------------------------------------
+    void CBaseEditor::setModified(bool value)
+    {
+        // Set without signalling, the flag is bookkeeping and must not show up in the undo history
+        mModified->init(value);
+
+        if(value)
+        {
+            mRevision = ++mRevisionCounter;
+            mOgitorsRoot->ChangeSceneModified(true);
+        }
+    }
+    //-----------------------------------------------------------------------------------------
     bool CBaseEditor::_setModified(OgitorsPropertyBase* property, const bool& bModified) 
     {
         mOgitorsRoot->ChangeSceneModified(bModified);
@@ -347,16 +363,26 @@ namespace Ogitors
     void CBaseEditor::getPropertyMap(OgitorsPropertyValueMap& map)
     {
         map = mProperties.getValueMap();
+        // The parent is saved along with the object, not as a property
         map.erase(map.find("parent"));
-        map.erase(map.find("selected"));
-        map.erase(map.find("modified"));
-        map.erase(map.find("loaded"));
-        map.erase(map.find("destroyed"));
-        map.erase(map.find("highlighted"));
+
+        for(unsigned int i = 0;i < sizeof(gTransientProperties) / sizeof(gTransientProperties[0]);i++)
+            map.erase(map.find(gTransientProperties[i]));
 
         getPropertyMapImpl(map);
     }
     //-----------------------------------------------------------------------------------------
+    bool CBaseEditor::isTransientProperty(const Ogre::String& propname)
+    {
+        for(unsigned int i = 0;i < sizeof(gTransientProperties) / sizeof(gTransientProperties[0]);i++)
+        {
+            if(propname == gTransientProperties[i])
+                return true;
+        }
+
+        return false;
+    }
+    //-----------------------------------------------------------------------------------------
     Ogre::AxisAlignedBox CBaseEditor::getWorldAABB()
     {
         Ogre::AxisAlignedBox box = getAABB();
@@ -655,6 +681,14 @@ namespace Ogitors
                 mParentEditor->get()->_addChild(this);
             }
 
+            // Children store the name of their parent, their segments have to be rewritten too
+            NameObjectPairList::iterator it = mChildren.begin();
+            while(it != mChildren.end())
+            {
+                it->second->setModified(true);
+                it++;
+            }
+
             if(selected)
                 showBoundingBox(true);
         }
@@ -40,18 +40,58 @@
 #include "OgreTerrainConverter.h"
 #include "OgreDeflate.h"
 #include "OFSDataStream.h"
+#include "OgitorsBinaryScene.h"
+#include "OgitorsXmlPullReader.h"
 #include "OgreRoot.h"
 
 #include "ofs.h"
 
+#include <iomanip>
+#include <boost/bind.hpp>
+
 using namespace Ogitors;
 
+/* Number of objects of the same type and depth a segment holds on average */
+static const unsigned int SEGMENT_OBJECT_COUNT = 256;
+/* Upper limit of the bucket count, bucket indices occupy 16 bits of the segment id */
+static const unsigned int SEGMENT_MAX_BUCKETS = 0x10000;
+/* Upper limit of the number of threads parsing segments during import */
+static const unsigned int IMPORT_MAX_WORKERS = 8;
+
+/* An object parsed by an import worker, waiting to be created on the main thread */
+struct COFSSceneSerializer::IMPORTOBJECT
+{
+    OgitorsPropertyValueMap   Params;               /* Converted properties of the object */
+    OgitorsCustomPropertySet *CustomProperties;     /* Custom properties of the object, NULL if it has none */
+};
+
+/* Segments shared between the main thread and the import workers */
+struct COFSSceneSerializer::IMPORTQUEUE
+{
+    struct SEGMENT
+    {
+        Ogre::String              FileName;         /* Segment file in the project file system */
+        int                       Result;           /* Result of parsing the segment */
+        bool                      Ready;            /* Has a worker finished parsing the segment? */
+        std::vector<IMPORTOBJECT> Objects;          /* Objects of the segment in creation order */
+    };
+
+    int                           Format;           /* Scene format of the segments */
+    unsigned int                  NextSegment;      /* Next segment to be picked up by a worker */
+    bool                          Cancelled;        /* Set by the main thread to stop the workers */
+    std::vector<SEGMENT>          Segments;         /* Segments in creation order, never resized while workers run */
+    boost::mutex                  Mutex;            /* Guards all members above except Format and the file names */
+    boost::condition_variable     SegmentReady;     /* Signalled each time a worker finishes a segment */
+};
+
 int COFSSceneSerializer::Import(Ogre::String importfile)
 {
     OgitorsRoot *ogRoot = OgitorsRoot::getSingletonPtr();
     OgitorsSystem *mSystem = OgitorsSystem::getSingletonPtr();
     OFS::OfsPtr& mFile = OgitorsRoot::getSingletonPtr()->GetProjectFile();
 
+    mPreparedResources.clear();
+
     if(importfile == "")
     {
         UTFStringVector extlist;
@@ -101,7 +141,7 @@ int COFSSceneSerializer::Import(Ogre::String importfile)
     
 
     OFS::OfsResult oRet;
-    if((oRet = mFile.mount(importfile.c_str(), OFS::OFS_MOUNT_OPEN | OFS::OFS_MOUNT_RECOVER)) != OFS::OFS_OK)
+    if((oRet = mFile.mount(importfile.c_str(), OFS::OFS_MOUNT_OPEN | OFS::OFS_MOUNT_RECOVER | OFS::OFS_MOUNT_DEDUP)) != OFS::OFS_OK)
     {
         if(oRet == OFS::OFS_PREVIOUS_VERSION)
         {
@@ -154,45 +194,25 @@ int COFSSceneSerializer::Import(Ogre::String importfile)
 			return SCF_ERRFILE;
 	}
 
-    char *file_data = new char[(unsigned int)file_size + 1];
-
-    OFS::OFSHANDLE projHandle;
+    // The scene file is streamed, only the project options and the segment table are built as a DOM
+    XmlPullOfsSource source(mFile, fileName);
 
-    if(mFile->openFile(projHandle, fileName.c_str(), OFS::OFS_READ) != OFS::OFS_OK)
-    {
-        delete [] file_data;
+    if(!source.isOpen())
         return SCF_ERRFILE;
-    }
-
-    mFile->read(projHandle, file_data, file_size);
-    mFile->closeFile(projHandle);
 
-    TiXmlDocument docImport;
-
-    if(docImport.Parse(file_data) == 0)
-    {
-        delete [] file_data;
-        return SCF_ERRFILE;
-    }
-
-    delete [] file_data;
+    XmlPullReader reader(&source);
 
     loadmsg = mSystem->Translate("Parsing Scene File");
     mSystem->UpdateLoadProgress(1, loadmsg);
 
-    TiXmlNode* ogitorSceneNode = 0;
-    TiXmlNode* projectNode;
-    TiXmlElement* element = 0;
-    bool upgradeExecuted = false;
-    ogitorSceneNode = docImport.FirstChild("OGITORSCENE");
-
-    if(!ogitorSceneNode)
+    if(reader.next() != XmlPullReader::EVENT_START_ELEMENT || reader.getName() != "OGITORSCENE")
         return SCF_ERRPARSE;
 
-    element = ogitorSceneNode->ToElement();
+    bool upgradeExecuted = false;
+    bool upgradeTypeNames = false;
 
     // Old OGSCENE version check and attempt to fix/update
-    int version = Ogre::StringConverter::parseInt(ValidAttr(element->Attribute("version"), "0"));    
+    int version = Ogre::StringConverter::parseInt(ValidAttr(reader.getAttribute("version"), "0"));    
     if(Ogre::StringConverter::toString(version) < Globals::OGSCENE_FORMAT_VERSION)
     {
         mSystem->DisplayMessageDialog(mSystem->Translate("Old OGSCENE file version detected. Ogitor will now attempt to upgrade the format and will also create a backup version of your OFS file."), DLGTYPE_OK);
@@ -219,123 +239,104 @@ int COFSSceneSerializer::Import(Ogre::String importfile)
         switch(version)
         {
          case 2:
-            _upgradeOgsceneFileFrom2To3(ogitorSceneNode);
-            _upgradeOgsceneFileFrom3To4(ogitorSceneNode);
+            // Type names are upgraded as the objects are read
+            upgradeTypeNames = true;
+            _upgradeOgsceneFileFrom3To4();
             break;
          case 3:
-            _upgradeOgsceneFileFrom3To4(ogitorSceneNode);
+            _upgradeOgsceneFileFrom3To4();
             break;
         }
 
         upgradeExecuted = true;
     }  
 
-    projectNode = ogitorSceneNode->FirstChild("PROJECT");
-
-    if(projectNode)
-    {
-        loadmsg = mSystem->Translate("Parsing project options");
-        mSystem->UpdateLoadProgress(5, loadmsg);
-        ogRoot->LoadProjectOptions(projectNode->ToElement());
-        ogRoot->PrepareProjectResources();
-    }
+    // Objects are stored in segment files, scenes saved by older versions keep them inline
+    // or in a single binary file
+    TiXmlElement* segmentsElement = 0;
+    Ogre::String binarySceneFile;
+    bool hasBinaryScene = false;
 
-    element = ogitorSceneNode->FirstChildElement();
-
-    loadmsg = mSystem->Translate("Creating scene objects");
-    mSystem->UpdateLoadProgress(10, loadmsg);
-
-    unsigned int obj_count = 0;
-    Ogre::String objecttype;
     OgitorsPropertyValueMap params;
-    OgitorsPropertyValue tmpPropVal;
-    Ogre::String objAttValue;
-    Ogre::String elementName;
-    TiXmlElement* properties = 0;
-    Ogre::String attID;
-    Ogre::String attValue;
-    CBaseEditor* result = 0;
-    TiXmlElement* customprop = 0;
+    OgitorsCustomPropertySet *customProperties;
     Ogre::StringVector invalidEditorTypes;
 
-    do
+    mLoadedObjects = 0;
+    mTotalObjects = 0;
+
+    while(reader.nextChild(1))
     {
-        // Make sure its NON-ZERO
-        if(pOpt->ObjectCount)
+        const std::string& elementName = reader.getName();
+
+        if(elementName == "PROJECT")
         {
-            ++obj_count;
-            mSystem->UpdateLoadProgress(10 + ((obj_count * 70) / pOpt->ObjectCount), loadmsg);
-        }
+            TiXmlElement* projectElement = reader.readElement();
 
-        params.clear();       
+            if(projectElement)
+            {
+                loadmsg = mSystem->Translate("Parsing project options");
+                mSystem->UpdateLoadProgress(5, loadmsg);
+                ogRoot->LoadProjectOptions(projectElement);
 
-        objAttValue = ValidAttr(element->Attribute("object_id"), "");
-        if(objAttValue != "")
-        {
-            tmpPropVal.propType = PROP_UNSIGNED_INT;
-            tmpPropVal.val = Ogre::Any(Ogre::StringConverter::parseUnsignedInt(objAttValue));
-            params.insert(OgitorsPropertyValueMap::value_type("object_id", tmpPropVal));
-        }
+                // Resource archives share this mount, so they read through the mapping too
+                mFile.setMemoryMapped(pOpt->MemoryMapped);
 
-        objAttValue = ValidAttr(element->Attribute("parentnode"), "");
-        if(objAttValue != "")
-        {
-            tmpPropVal.propType = PROP_STRING;
-            tmpPropVal.val = Ogre::Any(objAttValue);
-            params.insert(OgitorsPropertyValueMap::value_type("parentnode", tmpPropVal));
-        }
+                ogRoot->PrepareProjectResources();
+                delete projectElement;
+
+                loadmsg = mSystem->Translate("Creating scene objects");
+                mSystem->UpdateLoadProgress(10, loadmsg);
 
-        objAttValue = ValidAttr(element->Attribute("name"), "");
-        if(objAttValue != "")
+                mTotalObjects = pOpt->ObjectCount;
+            }
+        }
+        else if(elementName == "SEGMENTS")
         {
-            tmpPropVal.propType = PROP_STRING;
-            tmpPropVal.val = Ogre::Any(objAttValue);
-            params.insert(OgitorsPropertyValueMap::value_type("name", tmpPropVal));
+            if(!segmentsElement)
+                segmentsElement = reader.readElement();
         }
-        else
-            continue;
-
-        objAttValue = ValidAttr(element->Attribute("typename"), "");
-        if(objAttValue != "")
+        else if(elementName == "BINARYSCENE")
         {
-            tmpPropVal.propType = PROP_STRING;
-            tmpPropVal.val = Ogre::Any(objAttValue);
-            params.insert(OgitorsPropertyValueMap::value_type("typename", tmpPropVal));
+            if(!hasBinaryScene)
+                binarySceneFile = ValidAttr(reader.getAttribute("file"), "");
+
+            hasBinaryScene = true;
         }
-        else
-            continue;
+        else if(_readObject(reader, params, customProperties))
+        {
+            if(upgradeTypeNames)
+                _upgradeOgsceneObjectFrom2To3(params);
 
-        properties = element->FirstChildElement();
-        if(properties)
-        {            
-            do
-            {
-                elementName = properties->Value();
-                if(elementName != "PROPERTY")
-                    continue;
+            _updateObjectProgress();
 
-                attID = ValidAttr(properties->Attribute("id"), "");
-                int attType = Ogre::StringConverter::parseInt(ValidAttr(properties->Attribute("type"), ""));
-                attValue = ValidAttr(properties->Attribute("value"), "");
+            CBaseEditor *result = _createObject(params, invalidEditorTypes);
 
-                params.insert(OgitorsPropertyValueMap::value_type(attID, OgitorsPropertyValue::createFromString((OgitorsPropertyType)attType, attValue)));
-            } while(properties = properties->NextSiblingElement());
-        }
+            if(result && customProperties)
+                customProperties->cloneSet(*result->getCustomProperties());
 
-        objecttype = Ogre::any_cast<Ogre::String>(params["typename"].val);
-        result = ogRoot->CreateEditorObject(0, objecttype, params, false, false);
-        if(result)
-        {
-            customprop = element->FirstChildElement("CUSTOMPROPERTIES");
-            if(customprop) 
-            {
-                OgitorsUtils::ReadCustomPropertySet(customprop, result->getCustomProperties());
-            }
+            delete customProperties;
         }
-        else
-            invalidEditorTypes.push_back(objecttype);
+    }
+
+    if(reader.getEvent() == XmlPullReader::EVENT_ERROR)
+    {
+        Ogre::LogManager::getSingleton().getDefaultLog()->logMessage("OGITOR ERROR: Cannot parse " + fileName + ": " + reader.getError(), Ogre::LML_CRITICAL);
+        delete segmentsElement;
+        return SCF_ERRPARSE;
+    }
 
-    } while(element = element->NextSiblingElement());
+    int ret = SCF_OK;
+
+    if(segmentsElement)
+    {
+        ret = _importSegments(segmentsElement, invalidEditorTypes);
+        delete segmentsElement;
+    }
+    else if(hasBinaryScene)
+        ret = _importBinaryObjects(binarySceneFile, invalidEditorTypes);
+
+    if(ret != SCF_OK)
+        return ret;
 
     // Print out invalid/unsupported editor types (= types where no factory could be found)
     if(invalidEditorTypes.size() > 0)
@@ -430,17 +431,33 @@ int COFSSceneSerializer::Export(bool SaveAs, Ogre::String exportfile)
         return SCF_ERRFILE;
     }
 
+    // Everything written during the save is committed at once, an interrupted save leaves the previous state
+    mFile->beginTransaction();
+
+    Ogre::String oldProjectName = pOpt->ProjectName;
+
     if (SaveAs)
     {
         mFile->deleteFile((pOpt->ProjectName + Globals::OGSCENE_FORMAT_EXTENSION).c_str());
+        mFile->deleteFile((pOpt->ProjectName + Globals::OGSCENE_BINARY_EXTENSION).c_str());
         pOpt->ProjectName = fileName;
     }
 
-    if (_writeFile(fileName + Globals::OGSCENE_FORMAT_EXTENSION, forceSave) != SCF_OK)
+    int ret = _writeFile(fileName + Globals::OGSCENE_FORMAT_EXTENSION, forceSave);
+
+    if (ret != SCF_OK)
     {
+        // Nothing of a failed save may become durable, the project is back to its previous state
+        mFile->abortTransaction();
+        pOpt->ProjectName = oldProjectName;
+
+        // Objects written before the failure are no longer saved, the next save rewrites every segment
+        ogRoot->ResetSceneSegmentTable();
         return SCF_ERRFILE;
     }
 
+    mFile->commitTransaction();
+
     return SCF_OK;
 }
 //-----------------------------------------------------------------------------
@@ -450,6 +467,7 @@ int COFSSceneSerializer::_writeFile(Ogre::String exportfile, const bool forceSav
         return SCF_ERRUNKNOWN;
 
     OgitorsRoot *ogRoot = OgitorsRoot::getSingletonPtr();
+    OFS::OfsPtr& mFile = ogRoot->GetProjectFile();
     // Open a stream to output our XML Content and write the general headercopyFile
     std::stringstream outfile;
 
@@ -461,30 +479,132 @@ int COFSSceneSerializer::_writeFile(Ogre::String exportfile, const bool forceSav
 
     ogRoot->WriteProjectOptions(outfile, pOpt);
 
+    SCENESEGMENTTABLE *table = ogRoot->GetSceneSegmentTable();
     ObjectVector ObjectList;
-    OgitorsPropertyValueMap theList;
-    OgitorsPropertyValueMap::iterator ni;
+    ObjectVector sceneObjects;
+    unsigned int largestType = 0;
 
     // Start from 1, since 0 means all objects
     for(unsigned int i = 1; i < LAST_EDITOR; i++)
     {
         ogRoot->GetObjectList(i, ObjectList);
+        unsigned int typeCount = 0;
         for(unsigned int ob = 0; ob < ObjectList.size(); ob++)
         {
             /// If Object does not have a parent, then it is not part of the scene
             if(ObjectList[ob]->getParent())
             {
-                ObjectList[ob]->onSave(forceSave);
-                if(ObjectList[ob]->isSerializable())
-                {
-                    outfile << OgitorsUtils::GetObjectSaveStringV2(ObjectList[ob], 2, true, true).c_str();
-                    outfile << "\n";
-                }
+                sceneObjects.push_back(ObjectList[ob]);
+                ++typeCount;
+            }
+        }
+
+        largestType = std::max(largestType, typeCount);
+    }
+
+    // Segments of a scene that outgrew its bucket count are redistributed, which rewrites all of them
+    bool fullSave = forceSave || (table->Format != pOpt->SceneFormat);
+    unsigned int bucketCount = table->BucketCount;
+
+    if(fullSave || largestType > bucketCount * SEGMENT_OBJECT_COUNT * 4)
+    {
+        bucketCount = 1;
+        while(bucketCount < SEGMENT_MAX_BUCKETS && bucketCount * SEGMENT_OBJECT_COUNT < largestType)
+            bucketCount <<= 1;
+
+        fullSave |= (bucketCount != table->BucketCount);
+    }
+
+    typedef std::map<unsigned int, ObjectVector> SegmentObjectMap;
+    SegmentObjectMap segmentObjects;
+
+    for(unsigned int ob = 0; ob < sceneObjects.size(); ob++)
+        segmentObjects[_getSegmentID(sceneObjects[ob], bucketCount)].push_back(sceneObjects[ob]);
+
+    mFile->createDirectory(Globals::OGSCENE_SEGMENT_DIRECTORY.c_str());
+
+    outfile << "  <SEGMENTS format=\"" << pOpt->SceneFormat << "\" buckets=\"" << bucketCount << "\">\n";
+
+    SceneSegmentMap segments;
+    Ogre::StringVector segmentFiles;
+
+    for(SegmentObjectMap::iterator it = segmentObjects.begin(); it != segmentObjects.end(); it++)
+    {
+        ObjectVector& objects = it->second;
+        SCENESEGMENT segment;
+        segment.ObjectCount = objects.size();
+        segment.ObjectIDSum = 0;
+
+        // A segment is written if one of its objects changed or its set of objects is not the one on disk
+        bool modified = fullSave;
+        for(unsigned int ob = 0; ob < objects.size(); ob++)
+        {
+            segment.ObjectIDSum += objects[ob]->getObjectID();
+            modified |= objects[ob]->isModified();
+        }
+
+        SceneSegmentMap::const_iterator previous = table->Segments.find(it->first);
+        if(previous == table->Segments.end() || previous->second.ObjectCount != segment.ObjectCount || previous->second.ObjectIDSum != segment.ObjectIDSum)
+            modified = true;
+
+        Ogre::String filename = _getSegmentFileName(it->first);
+
+        if(modified)
+        {
+            for(unsigned int ob = 0; ob < objects.size(); ob++)
+            {
+                if(forceSave || objects[ob]->isModified())
+                    objects[ob]->onSave(forceSave);
+            }
+
+            if(_writeSegment(filename, objects, pOpt->SceneFormat == 1) != SCF_OK)
+            {
+                ogRoot->ResetSceneSegmentTable();
+                return SCF_ERRFILE;
             }
+
+            for(unsigned int ob = 0; ob < objects.size(); ob++)
+                objects[ob]->setModified(false);
         }
+
+        segments[it->first] = segment;
+        segmentFiles.push_back(filename);
+
+        outfile << "    <SEGMENT id=\"" << it->first << "\" file=\"" << filename << "\" objects=\"" << segment.ObjectCount;
+        outfile << "\" idsum=\"" << segment.ObjectIDSum << "\"></SEGMENT>\n";
     }
+
+    outfile << "  </SEGMENTS>\n";
     outfile << "</OGITORSCENE>\n";
 
+    // Remove segments that lost all of their objects, a full save also clears anything left by other versions
+    if(fullSave)
+    {
+        OFS::FileList files = mFile->listFiles(Globals::OGSCENE_SEGMENT_DIRECTORY.c_str(), OFS::OFS_FILE);
+        for(unsigned int i = 0; i < files.size(); i++)
+        {
+            Ogre::String filename = Globals::OGSCENE_SEGMENT_DIRECTORY + files[i].name;
+            if(std::find(segmentFiles.begin(), segmentFiles.end(), filename) == segmentFiles.end())
+                mFile->deleteFile(filename.c_str());
+        }
+    }
+    else
+    {
+        for(SceneSegmentMap::const_iterator it = table->Segments.begin(); it != table->Segments.end(); it++)
+        {
+            if(segments.find(it->first) == segments.end())
+                mFile->deleteFile(_getSegmentFileName(it->first).c_str());
+        }
+    }
+
+    // Objects of scenes saved by older versions may still reside in a single binary file
+    Ogre::String binaryfile = exportfile.substr(0, exportfile.size() - Globals::OGSCENE_FORMAT_EXTENSION.size()) + Globals::OGSCENE_BINARY_EXTENSION;
+    mFile->deleteFile(binaryfile.c_str());
+
+    table->Format = pOpt->SceneFormat;
+    table->BucketCount = bucketCount;
+    table->Segments.swap(segments);
+
     if (OgitorsUtils::SaveStreamOfs(outfile, exportfile)) {
         return SCF_OK;
     }
@@ -492,38 +612,558 @@ int COFSSceneSerializer::_writeFile(Ogre::String exportfile, const bool forceSav
     return SCF_ERRFILE;
 }
 //-----------------------------------------------------------------------------
-void Ogitors::COFSSceneSerializer::_upgradeOgsceneFileFrom2To3(TiXmlNode* ogsceneRootNode)
+int COFSSceneSerializer::_writeSegment(const Ogre::String& filename, const ObjectVector& objects, bool binary)
+{
+    if(binary)
+    {
+        BinarySceneWriter binaryWriter;
+
+        for(unsigned int ob = 0; ob < objects.size(); ob++)
+        {
+            if(objects[ob]->isSerializable())
+                binaryWriter.writeObject(objects[ob]);
+        }
+
+        std::string data;
+        binaryWriter.getData(data);
+
+        if(!OgitorsUtils::SaveBufferOfs(data.c_str(), data.size(), filename))
+            return SCF_ERRFILE;
+
+        return SCF_OK;
+    }
+
+    std::stringstream outfile;
+
+    outfile << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    outfile << "<OGITORSEGMENT version=\"" << Globals::OGSCENE_FORMAT_VERSION << "\">\n";
+
+    for(unsigned int ob = 0; ob < objects.size(); ob++)
+    {
+        if(objects[ob]->isSerializable())
+        {
+            outfile << OgitorsUtils::GetObjectSaveStringV2(objects[ob], 2, true, true).c_str();
+            outfile << "\n";
+        }
+    }
+
+    outfile << "</OGITORSEGMENT>\n";
+
+    if(!OgitorsUtils::SaveStreamOfs(outfile, filename))
+        return SCF_ERRFILE;
+
+    return SCF_OK;
+}
+//-----------------------------------------------------------------------------
+unsigned int COFSSceneSerializer::_getSegmentID(CBaseEditor* object, unsigned int bucketCount)
+{
+    // Segments are loaded in id order, type and depth come first so parents are created before their children
+    unsigned int depth = 0;
+    for(CBaseEditor *parent = object->getParent(); parent && depth < 0xFF; parent = parent->getParent())
+        ++depth;
+
+    return ((object->getEditorType() & 0xFF) << 24) | (depth << 16) | (object->getObjectID() % bucketCount);
+}
+//-----------------------------------------------------------------------------
+Ogre::String COFSSceneSerializer::_getSegmentFileName(unsigned int segmentID)
+{
+    std::stringstream name;
+    name << Globals::OGSCENE_SEGMENT_DIRECTORY << std::hex << std::uppercase << std::setw(8) << std::setfill('0') << segmentID;
+    name << Globals::OGSCENE_SEGMENT_EXTENSION;
+    return name.str();
+}
+//-----------------------------------------------------------------------------
+int COFSSceneSerializer::_readFile(const Ogre::String& filename, std::vector<char>& data)
+{
+    OFS::OfsPtr& mFile = OgitorsRoot::getSingletonPtr()->GetProjectFile();
+
+    OFS::ofs64 file_size = 0;
+
+    if(filename.empty() || mFile->getFileSize(filename.c_str(), file_size) != OFS::OFS_OK)
+        return SCF_ERRFILE;
+
+    // Keep a terminating zero after the contents for the XML parser
+    data.assign((size_t)file_size + 1, 0);
+
+    OFS::OFSHANDLE fileHandle;
+
+    if(mFile->openFile(fileHandle, filename.c_str(), OFS::OFS_READ) != OFS::OFS_OK)
+        return SCF_ERRFILE;
+
+    unsigned int actual_read = 0;
+    if(file_size)
+        mFile->read(fileHandle, &data[0], file_size, &actual_read);
+    mFile->closeFile(fileHandle);
+
+    if(actual_read != file_size)
+        return SCF_ERRFILE;
+
+    return SCF_OK;
+}
+//-----------------------------------------------------------------------------
+int COFSSceneSerializer::_importBinaryObjects(const Ogre::String& filename, Ogre::StringVector& invalidEditorTypes)
+{
+    std::vector<char> file_data;
+
+    if(_readFile(filename, file_data) != SCF_OK)
+        return SCF_ERRFILE;
+
+    BinarySceneReader reader(&file_data[0], file_data.size() - 1);
+
+    if(!reader.isValid())
+        return SCF_ERRPARSE;
+
+    mLoadedObjects = 0;
+    mTotalObjects = reader.getObjectCount();
+
+    return _createBinaryObjects(reader, invalidEditorTypes);
+}
+//-----------------------------------------------------------------------------
+int COFSSceneSerializer::_importSegments(TiXmlElement* segmentsElement, Ogre::StringVector& invalidEditorTypes)
+{
+    SCENESEGMENTTABLE *table = OgitorsRoot::getSingletonPtr()->GetSceneSegmentTable();
+
+    int format = Ogre::StringConverter::parseInt(ValidAttr(segmentsElement->Attribute("format"), "0"));
+    unsigned int bucketCount = Ogre::StringConverter::parseUnsignedInt(ValidAttr(segmentsElement->Attribute("buckets"), "1"));
+
+    TiXmlElement* segmentElement;
+
+    mLoadedObjects = 0;
+    mTotalObjects = 0;
+
+    IMPORTQUEUE queue;
+    queue.Format = format;
+    queue.NextSegment = 0;
+    queue.Cancelled = false;
+
+    SceneSegmentMap segments;
+
+    for(segmentElement = segmentsElement->FirstChildElement("SEGMENT"); segmentElement; segmentElement = segmentElement->NextSiblingElement("SEGMENT"))
+    {
+        SCENESEGMENT segment;
+        segment.ObjectCount = Ogre::StringConverter::parseUnsignedInt(ValidAttr(segmentElement->Attribute("objects"), "0"));
+        segment.ObjectIDSum = 0;
+        std::istringstream(ValidAttr(segmentElement->Attribute("idsum"), "0")) >> segment.ObjectIDSum;
+
+        segments[Ogre::StringConverter::parseUnsignedInt(ValidAttr(segmentElement->Attribute("id"), "0"))] = segment;
+        mTotalObjects += segment.ObjectCount;
+
+        queue.Segments.push_back(IMPORTQUEUE::SEGMENT());
+        queue.Segments.back().FileName = ValidAttr(segmentElement->Attribute("file"), "");
+        queue.Segments.back().Result = SCF_OK;
+        queue.Segments.back().Ready = false;
+    }
+
+    // Segments are read and parsed in parallel, objects are created in segment order on this thread,
+    // which keeps parents ahead of their children
+    unsigned int workerCount = std::min(std::max(boost::thread::hardware_concurrency(), 1u), IMPORT_MAX_WORKERS);
+    workerCount = std::min(workerCount, (unsigned int)queue.Segments.size());
+
+    boost::thread_group workers;
+    for(unsigned int w = 0; w < workerCount; w++)
+        workers.create_thread(boost::bind(&COFSSceneSerializer::_parseSegments, this, &queue));
+
+    int ret = SCF_OK;
+
+    for(unsigned int i = 0; i < queue.Segments.size() && ret == SCF_OK; i++)
+    {
+        IMPORTQUEUE::SEGMENT& segment = queue.Segments[i];
+
+        {
+            boost::mutex::scoped_lock lock(queue.Mutex);
+            while(!segment.Ready)
+                queue.SegmentReady.wait(lock);
+        }
+
+        ret = segment.Result;
+
+        for(unsigned int ob = 0; ob < segment.Objects.size() && ret == SCF_OK; ob++)
+        {
+            IMPORTOBJECT& object = segment.Objects[ob];
+
+            _updateObjectProgress();
+
+            CBaseEditor *result = _createObject(object.Params, invalidEditorTypes);
+
+            if(result && object.CustomProperties)
+                object.CustomProperties->cloneSet(*result->getCustomProperties());
+
+            delete object.CustomProperties;
+            object.CustomProperties = 0;
+        }
+
+        // Objects not created because of an error still own their custom properties
+        for(unsigned int ob = 0; ob < segment.Objects.size(); ob++)
+            delete segment.Objects[ob].CustomProperties;
+
+        segment.Objects.clear();
+    }
+
+    {
+        boost::mutex::scoped_lock lock(queue.Mutex);
+        queue.Cancelled = true;
+    }
+
+    workers.join_all();
+
+    // Objects of segments left behind after an error still own their custom properties
+    for(unsigned int i = 0; i < queue.Segments.size(); i++)
+    {
+        for(unsigned int ob = 0; ob < queue.Segments[i].Objects.size(); ob++)
+            delete queue.Segments[i].Objects[ob].CustomProperties;
+    }
+
+    if(ret != SCF_OK)
+        return ret;
+
+    // The segments on disk match the created objects, the next save only writes what changes from here on
+    table->Format = format;
+    table->BucketCount = std::max(bucketCount, 1u);
+    table->Segments.swap(segments);
+
+    return SCF_OK;
+}
+//-----------------------------------------------------------------------------
+void COFSSceneSerializer::_parseSegments(IMPORTQUEUE* queue)
+{
+    while(true)
+    {
+        unsigned int index;
+
+        {
+            boost::mutex::scoped_lock lock(queue->Mutex);
+            if(queue->Cancelled || queue->NextSegment >= queue->Segments.size())
+                return;
+
+            index = queue->NextSegment++;
+        }
+
+        IMPORTQUEUE::SEGMENT& segment = queue->Segments[index];
+        std::vector<IMPORTOBJECT> objects;
+
+        int result;
+
+        // The main thread waits for every segment, a worker must never leave one unfinished
+        try
+        {
+            result = _parseSegment(segment.FileName, queue->Format, objects);
+        }
+        catch(...)
+        {
+            result = SCF_ERRPARSE;
+        }
+
+        {
+            boost::mutex::scoped_lock lock(queue->Mutex);
+            segment.Objects.swap(objects);
+            segment.Result = result;
+            segment.Ready = true;
+        }
+
+        queue->SegmentReady.notify_all();
+    }
+}
+//-----------------------------------------------------------------------------
+int COFSSceneSerializer::_parseSegment(const Ogre::String& filename, int format, std::vector<IMPORTOBJECT>& objects)
 {
-    TiXmlElement* element = ogsceneRootNode->FirstChildElement();   
+    // Runs on import workers, must not touch the scene
+    IMPORTOBJECT object;
+    object.CustomProperties = 0;
+
+    if(format == 1)
+    {
+        std::vector<char> file_data;
+
+        if(_readFile(filename, file_data) != SCF_OK)
+            return SCF_ERRFILE;
+
+        BinarySceneReader reader(&file_data[0], file_data.size() - 1);
+
+        if(!reader.isValid())
+            return SCF_ERRPARSE;
+
+        unsigned int obj_count = reader.getObjectCount();
+        objects.reserve(obj_count);
 
-    unsigned int obj_count = 0;
-    Ogre::String objecttype;
+        for(unsigned int i = 0; i < obj_count; i++)
+        {
+            objects.push_back(object);
+
+            if(!reader.readObject(objects.back().Params))
+                return SCF_ERRPARSE;
+
+            objects.back().CustomProperties = new OgitorsCustomPropertySet();
+
+            if(!reader.readCustomProperties(objects.back().CustomProperties))
+                return SCF_ERRPARSE;
+
+            if(objects.back().CustomProperties->isEmpty())
+            {
+                delete objects.back().CustomProperties;
+                objects.back().CustomProperties = 0;
+            }
+        }
+
+        return SCF_OK;
+    }
+
+    XmlPullOfsSource source(OgitorsRoot::getSingletonPtr()->GetProjectFile(), filename);
+
+    if(filename.empty() || !source.isOpen())
+        return SCF_ERRFILE;
+
+    XmlPullReader reader(&source);
+
+    if(reader.next() != XmlPullReader::EVENT_START_ELEMENT || reader.getName() != "OGITORSEGMENT")
+        return SCF_ERRPARSE;
+
+    while(reader.nextChild(1))
+    {
+        if(reader.getName() != "OBJECT")
+            continue;
+
+        if(_readObject(reader, object.Params, object.CustomProperties))
+            objects.push_back(object);
+    }
+
+    if(reader.getEvent() == XmlPullReader::EVENT_ERROR)
+        return SCF_ERRPARSE;
+
+    return SCF_OK;
+}
+//-----------------------------------------------------------------------------
+int COFSSceneSerializer::_createBinaryObjects(BinarySceneReader& reader, Ogre::StringVector& invalidEditorTypes)
+{
     OgitorsPropertyValueMap params;
+    unsigned int obj_count = reader.getObjectCount();
+
+    for(unsigned int i = 0; i < obj_count; i++)
+    {
+        _updateObjectProgress();
+
+        params.clear();
+
+        if(!reader.readObject(params))
+            return SCF_ERRPARSE;
+
+        CBaseEditor *result = _createObject(params, invalidEditorTypes);
+
+        if(!reader.readCustomProperties(result ? result->getCustomProperties() : 0))
+            return SCF_ERRPARSE;
+    }
+
+    return SCF_OK;
+}
+//-----------------------------------------------------------------------------
+bool COFSSceneSerializer::_readObject(XmlPullReader& reader, OgitorsPropertyValueMap& params, OgitorsCustomPropertySet*& customProperties)
+{
+    // Called at the start of an object element, the whole element is consumed
     OgitorsPropertyValue tmpPropVal;
     Ogre::String objAttValue;
-    size_t offset = 0;
 
-    do
+    params.clear();
+    customProperties = 0;
+
+    objAttValue = ValidAttr(reader.getAttribute("object_id"), "");
+    if(objAttValue != "")
+    {
+        tmpPropVal.propType = PROP_UNSIGNED_INT;
+        tmpPropVal.val = Ogre::Any(Ogre::StringConverter::parseUnsignedInt(objAttValue));
+        params.insert(OgitorsPropertyValueMap::value_type("object_id", tmpPropVal));
+    }
+
+    objAttValue = ValidAttr(reader.getAttribute("parentnode"), "");
+    if(objAttValue != "")
+    {
+        tmpPropVal.propType = PROP_STRING;
+        tmpPropVal.val = Ogre::Any(objAttValue);
+        params.insert(OgitorsPropertyValueMap::value_type("parentnode", tmpPropVal));
+    }
+
+    objAttValue = ValidAttr(reader.getAttribute("name"), "");
+    if(objAttValue != "")
+    {
+        tmpPropVal.propType = PROP_STRING;
+        tmpPropVal.val = Ogre::Any(objAttValue);
+        params.insert(OgitorsPropertyValueMap::value_type("name", tmpPropVal));
+    }
+    else
+    {
+        reader.skipElement();
+        return false;
+    }
+
+    objAttValue = ValidAttr(reader.getAttribute("typename"), "");
+    if(objAttValue != "")
     {
-        objAttValue = ValidAttr(element->Attribute("typename"), "");
-        if(objAttValue != "")
+        tmpPropVal.propType = PROP_STRING;
+        tmpPropVal.val = Ogre::Any(objAttValue);
+        params.insert(OgitorsPropertyValueMap::value_type("typename", tmpPropVal));
+    }
+    else
+    {
+        reader.skipElement();
+        return false;
+    }
+
+    int depth = reader.getDepth();
+
+    while(reader.nextChild(depth))
+    {
+        if(reader.getName() == "PROPERTY")
         {
-            if((offset = objAttValue.find(" Object")) != Ogre::String::npos)
+            Ogre::String attID = ValidAttr(reader.getAttribute("id"), "");
+            int attType = Ogre::StringConverter::parseInt(ValidAttr(reader.getAttribute("type"), ""));
+            Ogre::String attValue = ValidAttr(reader.getAttribute("value"), "");
+
+            params.insert(OgitorsPropertyValueMap::value_type(attID, OgitorsPropertyValue::createFromString((OgitorsPropertyType)attType, attValue)));
+        }
+        else if(reader.getName() == "CUSTOMPROPERTIES" && !customProperties)
+        {
+            // Custom properties are few, they are read through the DOM based helper
+            TiXmlElement* customprop = reader.readElement();
+            if(customprop)
             {
-                objAttValue = objAttValue.substr(0, offset);
-                element->SetAttribute("typename", objAttValue.c_str());
+                customProperties = new OgitorsCustomPropertySet();
+                OgitorsUtils::ReadCustomPropertySet(customprop, customProperties);
+                delete customprop;
             }
         }
-        else
+    }
+
+    if(reader.getEvent() == XmlPullReader::EVENT_ERROR)
+    {
+        delete customProperties;
+        customProperties = 0;
+        return false;
+    }
+
+    return true;
+}
+//-----------------------------------------------------------------------------
+CBaseEditor *COFSSceneSerializer::_createObject(OgitorsPropertyValueMap& params, Ogre::StringVector& invalidEditorTypes)
+{
+    // Objects are loaded after all of them are created, their resources are prepared meanwhile
+    _prepareResources(params);
+
+    Ogre::String objecttype = Ogre::any_cast<Ogre::String>(params["typename"].val);
+    CBaseEditor *result = OgitorsRoot::getSingletonPtr()->CreateEditorObject(0, objecttype, params, false, false);
+
+    if(!result)
+        invalidEditorTypes.push_back(objecttype);
+
+    return result;
+}
+//-----------------------------------------------------------------------------
+void COFSSceneSerializer::_prepareResources(const OgitorsPropertyValueMap& params)
+{
+    for(OgitorsPropertyValueMap::const_iterator it = params.begin(); it != params.end(); it++)
+    {
+        if(it->second.propType != PROP_STRING)
+            continue;
+
+        const Ogre::String& key = it->first;
+        bool isMesh = (key == "meshfile");
+        bool isMaterial = (key == "material") || (key.size() > 10 && key.compare(key.size() - 10, 10, "::material") == 0);
+
+        if(!isMesh && !isMaterial)
             continue;
 
-    } while(element = element->NextSiblingElement());
+        Ogre::String name = Ogre::any_cast<Ogre::String>(it->second.val);
+
+        if(name.empty() || !mPreparedResources.insert(Ogre::String(isMesh ? "mesh/" : "material/") + name).second)
+            continue;
+
+        if(isMesh)
+        {
+            _prepareResource("Mesh", name, "");
+            continue;
+        }
+
+        // Materials are parsed with the project resources, only their textures are left to load
+        Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().getByName(name);
+        if(material.isNull())
+            continue;
+
+        Ogre::Material::TechniqueIterator techniques = material->getTechniqueIterator();
+        while(techniques.hasMoreElements())
+        {
+            Ogre::Technique::PassIterator passes = techniques.getNext()->getPassIterator();
+            while(passes.hasMoreElements())
+            {
+                Ogre::Pass::TextureUnitStateIterator units = passes.getNext()->getTextureUnitStateIterator();
+                while(units.hasMoreElements())
+                {
+                    Ogre::TextureUnitState *unit = units.getNext();
+
+                    // A texture prepared here is created with the default texture options, units asking
+                    // for other options have to create their textures themselves
+                    if(unit->getContentType() != Ogre::TextureUnitState::CONTENT_NAMED || unit->getTextureType() != Ogre::TEX_TYPE_2D ||
+                       unit->getNumMipmaps() != Ogre::MIP_DEFAULT || unit->getDesiredFormat() != Ogre::PF_UNKNOWN ||
+                       unit->getIsAlpha() || unit->isHardwareGammaEnabled() || unit->getGamma() != 1.0f)
+                        continue;
+
+                    for(unsigned int frame = 0; frame < unit->getNumFrames(); frame++)
+                    {
+                        const Ogre::String& texture = unit->getFrameTextureName(frame);
+                        if(!texture.empty() && mPreparedResources.insert("texture/" + texture).second)
+                            _prepareResource("Texture", texture, material->getGroup());
+                    }
+                }
+            }
+        }
+    }
 }
 //-----------------------------------------------------------------------------
-void Ogitors::COFSSceneSerializer::_upgradeOgsceneFileFrom3To4(TiXmlNode* ogsceneRootNode)
+void COFSSceneSerializer::_prepareResource(const Ogre::String& resourceType, const Ogre::String& name, const Ogre::String& group)
 {
-    TiXmlElement* element = ogsceneRootNode->FirstChildElement();   
+    Ogre::String resourceGroup = group;
 
+    try
+    {
+        if(resourceGroup.empty())
+            resourceGroup = Ogre::ResourceGroupManager::getSingleton().findGroupContainingResource(name);
+
+        // Reads the files on Ogre's worker threads, loading a prepared resource later skips the file access
+        Ogre::ResourceBackgroundQueue::getSingleton().prepare(resourceType, name, resourceGroup);
+    }
+    catch(...)
+    {
+        // Missing resources are reported when the objects are loaded
+    }
+}
+//-----------------------------------------------------------------------------
+void COFSSceneSerializer::_updateObjectProgress()
+{
+    ++mLoadedObjects;
+
+    if(mTotalObjects == 0)
+        return;
+
+    int progress = 10 + (int)(((Ogre::uint64)std::min(mLoadedObjects, mTotalObjects) * 70) / mTotalObjects);
+    if(progress != mLastProgress)
+    {
+        OgitorsSystem *mSystem = OgitorsSystem::getSingletonPtr();
+        mSystem->UpdateLoadProgress(progress, mSystem->Translate("Creating scene objects"));
+        mLastProgress = progress;
+    }
+}
+//-----------------------------------------------------------------------------
+void Ogitors::COFSSceneSerializer::_upgradeOgsceneObjectFrom2To3(OgitorsPropertyValueMap& params)
+{
+    OgitorsPropertyValueMap::iterator it = params.find("typename");
+    if(it == params.end())
+        return;
+
+    Ogre::String objAttValue = Ogre::any_cast<Ogre::String>(it->second.val);
+    size_t offset = 0;
+
+    if((offset = objAttValue.find(" Object")) != Ogre::String::npos)
+        it->second.val = Ogre::Any(objAttValue.substr(0, offset));
+}
+//-----------------------------------------------------------------------------
+void Ogitors::COFSSceneSerializer::_upgradeOgsceneFileFrom3To4()
+{
     OFS::OfsPtr& mFile = OgitorsRoot::getSingletonPtr()->GetProjectFile();
     OgitorsSystem *mSystem = OgitorsSystem::getSingletonPtr();
 
@@ -0,0 +1,221 @@
+/*/////////////////////////////////////////////////////////////////////////////////
+/// An
+///    ___   ____ ___ _____ ___  ____
+///   / _ \ / ___|_ _|_   _/ _ \|  _ \
+///  | | | | |  _ | |  | || | | | |_) |
+///  | |_| | |_| || |  | || |_| |  _ <
+///   \___/ \____|___| |_| \___/|_| \_\
+///                              File
+///
+/// Copyright (c) 2008-2015 Ismail TARIM <ismail@royalspor.com> and the Ogitor Team
+///
+/// The MIT License
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+/// THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////*/
+
+
+#include "OgitorsPrerequisites.h"
+#include "OgitorsAutoBackup.h"
+#include "OgitorsRoot.h"
+#include "OgitorsSystem.h"
+#include "OgitorsUtils.h"
+#include "BaseEditor.h"
+#include "ViewportEditor.h"
+
+#include <ctime>
+#include <fstream>
+
+using namespace Ogitors;
+
+template<> OgitorsAutoBackup* Ogitors::Singleton<OgitorsAutoBackup>::ms_Singleton = 0;
+
+//----------------------------------------------------------------------------------------
+OgitorsAutoBackup::OgitorsAutoBackup() : mThread(0), mWriting(false)
+{
+}
+//----------------------------------------------------------------------------------------
+OgitorsAutoBackup::~OgitorsAutoBackup()
+{
+    _join();
+}
+//----------------------------------------------------------------------------------------
+bool OgitorsAutoBackup::isWriting()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    return mWriting;
+}
+//----------------------------------------------------------------------------------------
+void OgitorsAutoBackup::reset()
+{
+    _join();
+    mSnapshots.clear();
+}
+//----------------------------------------------------------------------------------------
+void OgitorsAutoBackup::_join()
+{
+    if(mThread)
+    {
+        mThread->join();
+        delete mThread;
+        mThread = 0;
+    }
+}
+//----------------------------------------------------------------------------------------
+bool OgitorsAutoBackup::backupScene()
+{
+    OgitorsRoot *ogRoot = OgitorsRoot::getSingletonPtr();
+
+    if(ogRoot->GetLoadState() != LS_LOADED || isWriting())
+        return false;
+
+    // The thread has finished its work, only its handle is left
+    _join();
+
+    PROJECTOPTIONS options = *(ogRoot->GetProjectOptions());
+    if(ogRoot->GetViewport())
+        options.CameraSpeed = ogRoot->GetViewport()->GetCameraSpeed();
+
+    BACKUPJOB *job = new BACKUPJOB();
+
+    Ogre::String folder = options.AutoBackupFolder;
+    if(!folder.empty() && folder[0] == '.')
+        folder = options.ProjectDir + "/" + folder;
+
+    char timestamp[32];
+    time_t now = time(0);
+    strftime(timestamp, sizeof(timestamp), "_%Y_%m_%d_%H_%M", localtime(&now));
+
+    job->FileName = folder + "/" + options.ProjectName + timestamp + Globals::OGSCENE_FORMAT_EXTENSION;
+    job->FileSpec = folder + "/" + options.ProjectName + "_*" + Globals::OGSCENE_FORMAT_EXTENSION;
+    job->MaxBackups = std::max(options.AutoBackupNumber, 0);
+
+    std::stringstream header;
+    ogRoot->WriteProjectOptions(header, &options);
+    job->Header = header.str();
+
+    ObjectSnapshotMap snapshots;
+    ObjectVector ObjectList;
+
+    // Same order as a scene save, start from 1, since 0 means all objects
+    for(unsigned int i = 1; i < LAST_EDITOR; i++)
+    {
+        ogRoot->GetObjectList(i, ObjectList);
+        for(unsigned int ob = 0; ob < ObjectList.size(); ob++)
+        {
+            CBaseEditor *object = ObjectList[ob];
+
+            /// If Object does not have a parent, then it is not part of the scene
+            if(!object->getParent() || !object->isSerializable())
+                continue;
+
+            // If Object's parent name is "" then the parent is mRootEditor
+            const Ogre::String& parentName = object->getParent()->getName();
+
+            ObjectSnapshotMap::iterator it = mSnapshots.find(object->getObjectID());
+            ObjectSnapshotPtr snapshot;
+
+            // Revisions are unique in the scene, an unchanged revision means an unchanged object
+            if(it != mSnapshots.end() && it->second->Revision == object->getRevision() && it->second->ParentName == parentName)
+            {
+                snapshot = it->second;
+            }
+            else
+            {
+                snapshot.reset(new OBJECTSNAPSHOT());
+                snapshot->Revision = object->getRevision();
+                snapshot->ObjectID = object->getObjectID();
+                snapshot->Name = object->getName();
+                snapshot->TypeName = object->getTypeName();
+                snapshot->ParentName = parentName;
+                object->getPropertyMap(snapshot->Properties);
+                snapshot->CustomProperties = OgitorsUtils::GetCustomPropertySaveString(object->getCustomProperties(), 4);
+            }
+
+            snapshots[snapshot->ObjectID] = snapshot;
+            job->Objects.push_back(snapshot);
+        }
+    }
+
+    // Objects destroyed since the last backup are dropped here
+    mSnapshots.swap(snapshots);
+
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        mWriting = true;
+    }
+
+    mThread = new boost::thread(&OgitorsAutoBackup::_writeBackup, this, job);
+
+    return true;
+}
+//----------------------------------------------------------------------------------------
+void OgitorsAutoBackup::_writeBackup(BACKUPJOB *job)
+{
+    OgitorsSystem *system = OgitorsSystem::getSingletonPtr();
+
+    system->MakeDirectory(OgitorsUtils::ExtractFilePath(job->FileName));
+
+    // Written under a temporary name first, a backup interrupted while writing never replaces a complete one
+    Ogre::String tempName = job->FileName + ".tmp";
+    std::ofstream outfile(tempName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if(outfile.is_open())
+    {
+        outfile << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        outfile << "<OGITORSCENE version=\"" << Globals::OGSCENE_FORMAT_VERSION << "\">\n";
+        outfile << job->Header;
+
+        for(unsigned int ob = 0; ob < job->Objects.size(); ob++)
+        {
+            OBJECTSNAPSHOT *snapshot = job->Objects[ob].get();
+            outfile << OgitorsUtils::GetObjectSaveStringV2(snapshot->ObjectID, snapshot->Name, snapshot->TypeName, snapshot->ParentName,
+                                                           snapshot->Properties, snapshot->CustomProperties, 2);
+            outfile << "\n";
+        }
+
+        outfile << "</OGITORSCENE>\n";
+        outfile.close();
+
+        if(outfile.good())
+        {
+            system->DeleteFile(job->FileName);
+            system->RenameFile(tempName, job->FileName);
+        }
+        else
+            system->DeleteFile(tempName);
+    }
+
+    // Backups carry their date and time in their names, so sorting the names puts the oldest first
+    if(job->MaxBackups)
+    {
+        Ogre::StringVector backups;
+        system->GetFileList(job->FileSpec, backups);
+        std::sort(backups.begin(), backups.end());
+
+        for(unsigned int i = 0; i + job->MaxBackups < backups.size(); i++)
+            system->DeleteFile(backups[i]);
+    }
+
+    delete job;
+
+    boost::mutex::scoped_lock lock(mMutex);
+    mWriting = false;
+}
+//----------------------------------------------------------------------------------------
@@ -0,0 +1,613 @@
+/*/////////////////////////////////////////////////////////////////////////////////
+/// An
+///    ___   ____ ___ _____ ___  ____
+///   / _ \ / ___|_ _|_   _/ _ \|  _ \
+///  | | | | |  _ | |  | || | | | |_) |
+///  | |_| | |_| || |  | || |_| |  _ <
+///   \___/ \____|___| |_| \___/|_| \_\
+///                              File
+///
+/// Copyright (c) 2008-2015 Ismail TARIM <ismail@royalspor.com> and the Ogitor Team
+///
+/// The MIT License
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+/// THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////*/
+
+#include "OgitorsPrerequisites.h"
+#include "BaseEditor.h"
+#include "OgitorsRoot.h"
+#include "OgitorsBinaryScene.h"
+
+using namespace Ogitors;
+
+//----------------------------------------------------------------------------------
+BinarySceneWriter::BinarySceneWriter() : mObjectCount(0)
+{
+}
+//----------------------------------------------------------------------------------
+BinarySceneWriter::~BinarySceneWriter()
+{
+}
+//----------------------------------------------------------------------------------
+void BinarySceneWriter::writeObject(CBaseEditor *object)
+{
+    OgitorsPropertyValueMap theList;
+
+    object->getPropertyMap(theList);
+
+    // If Object's parent name is "" then the parent is mRootEditor
+    writeObject(object->getObjectID(), object->getName(), object->getTypeName(), object->getParent()->getName(), theList, object->getCustomProperties());
+}
+//----------------------------------------------------------------------------------
+void BinarySceneWriter::writeObject(unsigned int objectID, const Ogre::String& name, const Ogre::String& typeName, const Ogre::String& parentName,
+                                    const OgitorsPropertyValueMap& properties, OgitorsCustomPropertySet *customProperties)
+{
+    _write(objectID);
+    _writeString(name);
+    _writeString(typeName);
+
+    if(parentName.empty())
+        _write(BINARYSCENE_NO_STRING);
+    else
+        _writeString(parentName);
+
+    /* The count is patched once the skipped properties are known */
+    size_t countPos = mObjects.size();
+    unsigned int count = 0;
+    _write(count);
+
+    OgitorsPropertyValueMap::const_iterator it = properties.begin();
+
+    while(it != properties.end())
+    {
+        if(it->first != "name" && it->first != "typename" && it->first != "object_id")
+        {
+            _writeString(it->first);
+            _write((unsigned int)it->second.propType);
+            _writeValue(it->second);
+            ++count;
+        }
+        ++it;
+    }
+
+    memcpy(&mObjects[countPos], &count, sizeof(count));
+
+    _writeCustomProperties(customProperties);
+
+    ++mObjectCount;
+}
+//----------------------------------------------------------------------------------
+void BinarySceneWriter::getData(std::string& output) const
+{
+    unsigned int realSize = sizeof(Ogre::Real);
+    unsigned int stringCount = mStringIndices.size();
+    unsigned int chunkSize;
+
+    output.clear();
+    // Header, two chunk headers and the two counts
+    output.reserve(9 * sizeof(unsigned int) + mStrings.size() + mObjects.size());
+
+    output.append(reinterpret_cast<const char*>(&BINARYSCENE_MAGIC), sizeof(unsigned int));
+    output.append(reinterpret_cast<const char*>(&BINARYSCENE_VERSION), sizeof(unsigned int));
+    output.append(reinterpret_cast<const char*>(&realSize), sizeof(unsigned int));
+
+    chunkSize = sizeof(unsigned int) + mStrings.size();
+    output.append(reinterpret_cast<const char*>(&BINARYSCENE_CHUNK_STRINGS), sizeof(unsigned int));
+    output.append(reinterpret_cast<const char*>(&chunkSize), sizeof(unsigned int));
+    output.append(reinterpret_cast<const char*>(&stringCount), sizeof(unsigned int));
+    output.append(mStrings);
+
+    chunkSize = sizeof(unsigned int) + mObjects.size();
+    output.append(reinterpret_cast<const char*>(&BINARYSCENE_CHUNK_OBJECTS), sizeof(unsigned int));
+    output.append(reinterpret_cast<const char*>(&chunkSize), sizeof(unsigned int));
+    output.append(reinterpret_cast<const char*>(&mObjectCount), sizeof(unsigned int));
+    output.append(mObjects);
+}
+//----------------------------------------------------------------------------------
+void BinarySceneWriter::_writeReals(const Ogre::Real *values, unsigned int count)
+{
+    mObjects.append(reinterpret_cast<const char*>(values), count * sizeof(Ogre::Real));
+}
+//----------------------------------------------------------------------------------
+void BinarySceneWriter::_writeString(const Ogre::String& value)
+{
+    StringIndexMap::iterator it = mStringIndices.find(value);
+
+    if(it != mStringIndices.end())
+    {
+        _write(it->second);
+        return;
+    }
+
+    unsigned int index = mStringIndices.size();
+    unsigned int length = value.size();
+
+    mStringIndices.insert(StringIndexMap::value_type(value, index));
+
+    mStrings.append(reinterpret_cast<const char*>(&length), sizeof(unsigned int));
+    mStrings.append(value);
+
+    _write(index);
+}
+//----------------------------------------------------------------------------------
+void BinarySceneWriter::_writeValue(const OgitorsPropertyValue& value)
+{
+    switch(value.propType)
+    {
+    case PROP_SHORT:
+        _write(Ogre::any_cast<short>(value.val));break;
+    case PROP_UNSIGNED_SHORT:
+        _write(Ogre::any_cast<unsigned short>(value.val));break;
+    case PROP_INT:
+        _write(Ogre::any_cast<int>(value.val));break;
+    case PROP_UNSIGNED_INT:
+        _write(Ogre::any_cast<unsigned int>(value.val));break;
+    case PROP_LONG:
+        // long differs in size between platforms, always stored as 64 bits
+        _write((Ogre::int64)Ogre::any_cast<long>(value.val));break;
+    case PROP_UNSIGNED_LONG:
+        _write((Ogre::uint64)Ogre::any_cast<unsigned long>(value.val));break;
+    case PROP_REAL:
+        _write(Ogre::any_cast<Ogre::Real>(value.val));break;
+    case PROP_STRING:
+        _writeString(Ogre::any_cast<Ogre::String>(value.val));break;
+    case PROP_VECTOR2:
+        _writeReals(Ogre::any_cast<Ogre::Vector2>(value.val).ptr(), 2);break;
+    case PROP_VECTOR3:
+        _writeReals(Ogre::any_cast<Ogre::Vector3>(value.val).ptr(), 3);break;
+    case PROP_VECTOR4:
+        _writeReals(Ogre::any_cast<Ogre::Vector4>(value.val).ptr(), 4);break;
+    case PROP_COLOUR:
+        {
+            Ogre::ColourValue colour = Ogre::any_cast<Ogre::ColourValue>(value.val);
+            mObjects.append(reinterpret_cast<const char*>(colour.ptr()), 4 * sizeof(float));
+            break;
+        }
+    case PROP_BOOL:
+        _write((unsigned char)(Ogre::any_cast<bool>(value.val) ? 1 : 0));break;
+    case PROP_QUATERNION:
+        _writeReals(Ogre::any_cast<Ogre::Quaternion>(value.val).ptr(), 4);break;
+    case PROP_MATRIX3:
+        _writeReals(Ogre::any_cast<Ogre::Matrix3>(value.val)[0], 9);break;
+    case PROP_MATRIX4:
+        _writeReals(Ogre::any_cast<Ogre::Matrix4>(value.val)[0], 16);break;
+    default:
+        break;
+    };
+}
+//----------------------------------------------------------------------------------
+void BinarySceneWriter::_writeCustomProperties(OgitorsCustomPropertySet *set)
+{
+    if(!set)
+    {
+        _write((unsigned int)0);
+        return;
+    }
+
+    OgitorsPropertyVector vec = set->getPropertyVector();
+
+    _write((unsigned int)vec.size());
+
+    for(unsigned int i = 0; i < vec.size(); i++)
+    {
+        OgitorsPropertyBase *property = vec[i];
+        const OgitorsPropertyDef *def = property->getDefinition();
+        OgitorsPropertyValue value;
+        value.propType = property->getType();
+        value.val = property->getValue();
+
+        _writeString(property->getName());
+        _write((unsigned int)value.propType);
+        _writeValue(value);
+        _write((unsigned int)def->getAutoOptionType());
+
+        unsigned char fieldCount = 0;
+
+        switch(value.propType)
+        {
+        case PROP_VECTOR2:fieldCount = 2;break;
+        case PROP_VECTOR3:fieldCount = 3;break;
+        case PROP_VECTOR4:fieldCount = 4;break;
+        default:break;
+        }
+
+        _write(fieldCount);
+        for(unsigned char f = 0; f < fieldCount; f++)
+            _writeString(def->getFieldName(f));
+
+        const PropertyOptionsVector *opt = def->getOptions();
+
+        if(def->getAutoOptionType() == AUTO_OPTIONS_NONE && opt != NULL)
+        {
+            _write((unsigned int)opt->size());
+
+            for(unsigned int o = 0; o < opt->size(); o++)
+            {
+                value.val = (*opt)[o].mValue;
+                _writeString((*opt)[o].mKey);
+                _writeValue(value);
+            }
+        }
+        else
+            _write((unsigned int)0);
+    }
+}
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------
+BinarySceneReader::BinarySceneReader(const char *data, size_t size) : 
+    mData(data), mSize(size), mPos(0), mObjectsEnd(0), mObjectCount(0), mObjectsRead(0), mValid(false)
+{
+    unsigned int header[3];
+
+    if(mSize < sizeof(header))
+        return;
+
+    memcpy(header, mData, sizeof(header));
+
+    if(header[0] != BINARYSCENE_MAGIC || header[1] > BINARYSCENE_VERSION || header[2] != sizeof(Ogre::Real))
+        return;
+
+    size_t pos = sizeof(header);
+    size_t objectsPos = 0;
+    size_t objectsSize = 0;
+    bool hasStrings = false;
+
+    while(pos + 2 * sizeof(unsigned int) <= mSize)
+    {
+        unsigned int chunk[2];
+        memcpy(chunk, mData + pos, sizeof(chunk));
+        pos += sizeof(chunk);
+
+        if(chunk[1] > mSize - pos)
+            return;
+
+        if(chunk[0] == BINARYSCENE_CHUNK_STRINGS)
+        {
+            if(!_loadStringTable(pos, chunk[1]))
+                return;
+            hasStrings = true;
+        }
+        else if(chunk[0] == BINARYSCENE_CHUNK_OBJECTS)
+        {
+            objectsPos = pos;
+            objectsSize = chunk[1];
+        }
+
+        pos += chunk[1];
+    }
+
+    if(!hasStrings || objectsSize < sizeof(unsigned int))
+        return;
+
+    memcpy(&mObjectCount, mData + objectsPos, sizeof(unsigned int));
+    mPos = objectsPos + sizeof(unsigned int);
+    mObjectsEnd = objectsPos + objectsSize;
+    mValid = true;
+}
+//----------------------------------------------------------------------------------
+BinarySceneReader::~BinarySceneReader()
+{
+}
+//----------------------------------------------------------------------------------
+bool BinarySceneReader::readObject(OgitorsPropertyValueMap& params)
+{
+    if(!mValid || mObjectsRead >= mObjectCount)
+        return false;
+
+    unsigned int objectID;
+    unsigned int count;
+    Ogre::String name;
+    Ogre::String typeName;
+    unsigned int parentIndex;
+
+    if(!_read(objectID) || !_readString(name) || !_readString(typeName) || !_read(parentIndex))
+        return false;
+
+    params.insert(OgitorsPropertyValueMap::value_type("object_id", OgitorsPropertyValue(PROP_UNSIGNED_INT, Ogre::Any(objectID))));
+    params.insert(OgitorsPropertyValueMap::value_type("name", OgitorsPropertyValue(PROP_STRING, Ogre::Any(name))));
+    params.insert(OgitorsPropertyValueMap::value_type("typename", OgitorsPropertyValue(PROP_STRING, Ogre::Any(typeName))));
+
+    if(parentIndex != BINARYSCENE_NO_STRING)
+    {
+        if(parentIndex >= mStrings.size())
+            return false;
+
+        params.insert(OgitorsPropertyValueMap::value_type("parentnode", OgitorsPropertyValue(PROP_STRING, Ogre::Any(mStrings[parentIndex]))));
+    }
+
+    if(!_read(count))
+        return false;
+
+    for(unsigned int i = 0; i < count; i++)
+    {
+        unsigned int nameIndex;
+        unsigned int type;
+        OgitorsPropertyValue value;
+
+        if(!_read(nameIndex) || nameIndex >= mStrings.size() || !_read(type) || !_readValue((OgitorsPropertyType)type, value))
+            return false;
+
+        params.insert(OgitorsPropertyValueMap::value_type(mStrings[nameIndex], value));
+    }
+
+    ++mObjectsRead;
+
+    return true;
+}
+//----------------------------------------------------------------------------------
+bool BinarySceneReader::readCustomProperties(OgitorsCustomPropertySet *set)
+{
+    unsigned int count;
+
+    if(!_read(count))
+        return false;
+
+    for(unsigned int i = 0; i < count; i++)
+    {
+        Ogre::String name;
+        unsigned int type;
+        unsigned int autoOptionType;
+        unsigned char fieldCount;
+        OgitorsPropertyValue value;
+
+        if(!_readString(name) || !_read(type) || !_readValue((OgitorsPropertyType)type, value) || !_read(autoOptionType) || !_read(fieldCount))
+            return false;
+
+        OgitorsPropertyDef *def = 0;
+
+        if(set)
+        {
+            // Type changes of custom properties convert from the textual value
+            value.origVal = OgitorsUtils::GetValueString(value);
+            def = set->addProperty(name, value);
+            def->setAutoOptionType((AutoOptionType)autoOptionType);
+        }
+
+        for(unsigned char f = 0; f < fieldCount; f++)
+        {
+            Ogre::String fieldName;
+
+            if(!_readString(fieldName))
+                return false;
+
+            if(def)
+                def->setFieldName(f, fieldName);
+        }
+
+        unsigned int optionCount;
+
+        if(!_read(optionCount))
+            return false;
+
+        PropertyOptionsVector *options = (def && optionCount > 0) ? new PropertyOptionsVector() : 0;
+
+        for(unsigned int o = 0; o < optionCount; o++)
+        {
+            Ogre::String key;
+            OgitorsPropertyValue optionValue;
+
+            if(!_readString(key) || !_readValue((OgitorsPropertyType)type, optionValue))
+            {
+                delete options;
+                return false;
+            }
+
+            if(options)
+                options->push_back(PropertyOption(key, optionValue.val));
+        }
+
+        if(options)
+            def->setOptions(options);
+        else if(def && autoOptionType == AUTO_OPTIONS_MATERIAL)
+            def->setOptions(OgitorsRoot::GetMaterialNames());
+        else if(def && autoOptionType == AUTO_OPTIONS_MESH)
+            def->setOptions(OgitorsRoot::GetModelNames());
+    }
+
+    return true;
+}
+//----------------------------------------------------------------------------------
+bool BinarySceneReader::_readReals(Ogre::Real *values, unsigned int count)
+{
+    size_t size = count * sizeof(Ogre::Real);
+
+    if(mPos + size > mObjectsEnd)
+        return false;
+
+    memcpy(values, mData + mPos, size);
+    mPos += size;
+    return true;
+}
+//----------------------------------------------------------------------------------
+bool BinarySceneReader::_readString(Ogre::String& value)
+{
+    unsigned int index;
+
+    if(!_read(index) || index >= mStrings.size())
+        return false;
+
+    value = mStrings[index];
+    return true;
+}
+//----------------------------------------------------------------------------------
+bool BinarySceneReader::_readValue(OgitorsPropertyType type, OgitorsPropertyValue& value)
+{
+    value.propType = type;
+
+    switch(type)
+    {
+    case PROP_SHORT:
+        {
+            short val;
+            if(!_read(val)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_UNSIGNED_SHORT:
+        {
+            unsigned short val;
+            if(!_read(val)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_INT:
+        {
+            int val;
+            if(!_read(val)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_UNSIGNED_INT:
+        {
+            unsigned int val;
+            if(!_read(val)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_LONG:
+        {
+            Ogre::int64 val;
+            if(!_read(val)) return false;
+            value.val = Ogre::Any((long)val);
+            return true;
+        }
+    case PROP_UNSIGNED_LONG:
+        {
+            Ogre::uint64 val;
+            if(!_read(val)) return false;
+            value.val = Ogre::Any((unsigned long)val);
+            return true;
+        }
+    case PROP_REAL:
+        {
+            Ogre::Real val;
+            if(!_read(val)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_STRING:
+        {
+            unsigned int index;
+            if(!_read(index) || index >= mStrings.size()) return false;
+            value.val = Ogre::Any(mStrings[index]);
+            return true;
+        }
+    case PROP_VECTOR2:
+        {
+            Ogre::Vector2 val;
+            if(!_readReals(val.ptr(), 2)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_VECTOR3:
+        {
+            Ogre::Vector3 val;
+            if(!_readReals(val.ptr(), 3)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_VECTOR4:
+        {
+            Ogre::Vector4 val;
+            if(!_readReals(val.ptr(), 4)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_COLOUR:
+        {
+            Ogre::ColourValue val;
+            if(mPos + 4 * sizeof(float) > mObjectsEnd) return false;
+            memcpy(val.ptr(), mData + mPos, 4 * sizeof(float));
+            mPos += 4 * sizeof(float);
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_BOOL:
+        {
+            unsigned char val;
+            if(!_read(val)) return false;
+            value.val = Ogre::Any(val != 0);
+            return true;
+        }
+    case PROP_QUATERNION:
+        {
+            Ogre::Quaternion val;
+            if(!_readReals(val.ptr(), 4)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_MATRIX3:
+        {
+            Ogre::Matrix3 val;
+            if(!_readReals(val[0], 9)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    case PROP_MATRIX4:
+        {
+            Ogre::Matrix4 val;
+            if(!_readReals(val[0], 16)) return false;
+            value.val = Ogre::Any(val);
+            return true;
+        }
+    default:
+        return false;
+    };
+}
+//----------------------------------------------------------------------------------
+bool BinarySceneReader::_loadStringTable(size_t pos, size_t size)
+{
+    size_t end = pos + size;
+    unsigned int count;
+
+    if(size < sizeof(unsigned int))
+        return false;
+
+    memcpy(&count, mData + pos, sizeof(unsigned int));
+    pos += sizeof(unsigned int);
+
+    // Every string takes at least its length, a larger count is corrupt and must not size the table
+    if(count > (end - pos) / sizeof(unsigned int))
+        return false;
+
+    mStrings.clear();
+    mStrings.reserve(count);
+
+    for(unsigned int i = 0; i < count; i++)
+    {
+        unsigned int length;
+
+        if(pos + sizeof(unsigned int) > end)
+            return false;
+
+        memcpy(&length, mData + pos, sizeof(unsigned int));
+        pos += sizeof(unsigned int);
+
+        if(length > end - pos)
+            return false;
+
+        mStrings.push_back(Ogre::String(mData + pos, length));
+        pos += length;
+    }
+
+    return true;
+}
+//----------------------------------------------------------------------------------
@@ -59,6 +59,7 @@
 #include "OgitorsPaging.h"
 #include "OgitorsUndoManager.h"
 #include "OgitorsClipboardManager.h"
+#include "OgitorsAutoBackup.h"
 #include "Selection2D.h"
 #include "PGInstanceManager.h"
 #include "PGInstanceEditor.h"
@@ -103,18 +104,30 @@ namespace Ogitors
 
         void OnPropertyRemoved(OgitorsPropertySet* set, OgitorsPropertyBase* property)
         {
-            OgitorsRoot::getSingletonPtr()->SetSceneModified(true);
+            markModified(set, property);
         }
         void OnPropertyAdded(OgitorsPropertySet* set, OgitorsPropertyBase* property)
         {
-            OgitorsRoot::getSingletonPtr()->SetSceneModified(true);
+            markModified(set, property);
         }
         void OnPropertyChanged(OgitorsPropertySet* set, OgitorsPropertyBase* property)
         {
-            OgitorsRoot::getSingletonPtr()->SetSceneModified(true);
+            markModified(set, property);
         }
         void OnPropertySetRebuilt(OgitorsPropertySet* set)
         {
+            markModified(set, 0);
+        }
+
+    private:
+        /* Flags the scene and the editor owning the set, so the next save writes it. Selecting or
+           highlighting is not saved, the editor stays unmodified and keeps its segment and revision */
+        void markModified(OgitorsPropertySet* set, OgitorsPropertyBase* property)
+        {
+            const PropertySetOwnerData owner = set->getOwnerData();
+            if(owner.mOwnerType == PROPSETOWNER_EDITOR && (property == 0 || !CBaseEditor::isTransientProperty(property->getName())))
+                static_cast<CBaseEditor*>(owner.mOwnerPtr)->setModified(true);
+
             OgitorsRoot::getSingletonPtr()->SetSceneModified(true);
         }
     };
@@ -356,7 +369,7 @@ namespace Ogitors
     //-----------------------------------------------------------------------------------------
 
     OgitorsRoot::OgitorsRoot(Ogre::StringVector* pDisabledPluginPaths) :
-        mUndoManager(0), mClipboardManager(0), mSceneManager(0), mSceneManagerEditor(0), mRenderWindow(0), mActiveViewport(0),
+        mUndoManager(0), mAutoBackup(0), mClipboardManager(0), mSceneManager(0), mSceneManagerEditor(0), mRenderWindow(0), mActiveViewport(0),
         mRootEditor(0), mMultiSelection(0), mLastTranslationDelta(Vector3::ZERO),
         mTerrainEditor(0), mTerrainEditorObject(0), mPagingEditor(0), mPagingEditorObject(0), mIsSceneModified(false),
         mGlobalLightVisiblity(true), mGlobalCameraVisiblity(true), mSelRect(0), mSelectionNode(0),
@@ -370,6 +383,8 @@ namespace Ogitors
 
         mProjectFile = new OFS::OfsPtr();
 
+        ResetSceneSegmentTable();
+
         mGizmoEntities[0] = mGizmoEntities[1] = mGizmoEntities[2] = 0;
         mGizmoEntities[3] = mGizmoEntities[4] = mGizmoEntities[5] = 0;
 
@@ -427,6 +442,7 @@ namespace Ogitors
         mIDList[id] = mRootEditor;
 
         mUndoManager = OGRE_NEW OgitorsUndoManager();
+        mAutoBackup = OGRE_NEW OgitorsAutoBackup();
 
         mObjectDisplayOrder.clear();
 
@@ -488,6 +504,7 @@ namespace Ogitors
         OGRE_DELETE mScriptConsole;
         OGRE_DELETE gDummyInterpreter;
         OGRE_DELETE mUndoManager;
+        OGRE_DELETE mAutoBackup;
         OGRE_DELETE gDummySystem;
         OGRE_DELETE gDummyPhysics;
 
@@ -1272,7 +1289,10 @@ namespace Ogitors
         object->getCustomProperties()->addListener(mUndoManager);
 
         if(mLoadState == LS_LOADED)
+        {
             mUndoManager->AddUndo(OGRE_NEW ObjectCreationUndo(object));
+            object->setModified(true);
+        }
 
         SetSceneModified(true);
 
@@ -1324,6 +1344,8 @@ namespace Ogitors
         if(mLoadState == LS_LOADED)
             mUndoManager->AddUndo(OGRE_NEW ObjectCreationUndo(clone));
 
+        clone->setModified(true);
+
         SetSceneModified(true);
 
         if(mPagingEditor)
@@ -1556,6 +1578,8 @@ namespace Ogitors
         mProjectOptions.AutoBackupPeriodType = 0;
         mProjectOptions.AutoBackupFolder = ".";
         mProjectOptions.AutoBackupNumber = 0;
+        mProjectOptions.SceneFormat = 0;
+        mProjectOptions.MemoryMapped = false;
     }
     //-----------------------------------------------------------------------------------------
     PROJECTOPTIONS OgitorsRoot::CreateDefaultProjectOptions()
@@ -1602,6 +1626,8 @@ namespace Ogitors
         opt.AutoBackupPeriodType = 0;
         opt.AutoBackupFolder = ".";
         opt.AutoBackupNumber = 0;
+        opt.SceneFormat = 0;
+        opt.MemoryMapped = false;
 
         return opt;
     }
@@ -1745,6 +1771,8 @@ namespace Ogitors
             else if(eType == "AUTOBACKUPPERIODTYPE") mProjectOptions.AutoBackupPeriodType = Ogre::StringConverter::parseInt(ValidAttr(element->Attribute("value"), "0"));
             else if(eType == "AUTOBACKUPFOLDER") mProjectOptions.AutoBackupFolder = ValidAttr(element->Attribute("value"), "/backup");
             else if(eType == "AUTOBACKUPNUMBER") mProjectOptions.AutoBackupNumber = Ogre::StringConverter::parseInt(ValidAttr(element->Attribute("value"), "10"));
+            else if(eType == "SCENEFORMAT") mProjectOptions.SceneFormat = Ogre::StringConverter::parseInt(ValidAttr(element->Attribute("value"), "0"));
+            else if(eType == "MEMORYMAPPED") mProjectOptions.MemoryMapped = Ogre::StringConverter::parseBool(ValidAttr(element->Attribute("value"), "false"));
         } while(element = element->NextSiblingElement());
         return true;
     }
@@ -1754,6 +1782,7 @@ namespace Ogitors
         SetLoadState(LS_LOADING);
 
         ClearProjectOptions();
+        ResetSceneSegmentTable();
         mPostSceneUpdateList.clear();
 
         Ogre::UTFString msg = mSystem->Translate("Load in progress...");
@@ -1967,6 +1996,14 @@ namespace Ogitors
             mLayerNames.push_back(PropertyOption(mProjectOptions.LayerNames[li], Ogre::Any(li)));
         }
 
+        // Whatever changed while loading is not a user modification, objects start out in sync with the scene file
+        NameObjectPairList::iterator it = mNameList.begin();
+        while(it != mNameList.end())
+        {
+            it->second->setModified(false);
+            it++;
+        }
+
         SetLoadState(LS_LOADED);
         SetSceneModified(false);
         return true;
@@ -2056,6 +2093,9 @@ namespace Ogitors
         mSystem->PresentPropertiesView(0);
 
         mUndoManager->Clear();
+        mAutoBackup->reset();
+
+        ResetSceneSegmentTable();
 
         mRenderWindow->removeAllViewports();
 
@@ -2373,6 +2413,13 @@ namespace Ogitors
     {
         SetSceneModified(mIsSceneModified | state);
     }
+    //-----------------------------------------------------------------------------------------
+    void OgitorsRoot::ResetSceneSegmentTable()
+    {
+        mSceneSegmentTable.Format = -1;
+        mSceneSegmentTable.BucketCount = 1;
+        mSceneSegmentTable.Segments.clear();
+    }
 
 }
 
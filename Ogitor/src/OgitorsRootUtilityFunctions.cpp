@@ -400,6 +400,10 @@ void OgitorsRoot::WriteProjectOptions(std::ostream &outstream, const PROJECTOPTI
     outstream << buffer;
     sprintf_s(buffer,5000,"  <AUTOBACKUPNUMBER value=\"%s\"></AUTOBACKUPNUMBER>\n",Ogre::StringConverter::toString(pOpt->AutoBackupNumber).c_str());
     outstream << buffer;
+    sprintf_s(buffer,5000,"  <SCENEFORMAT value=\"%s\"></SCENEFORMAT>\n",Ogre::StringConverter::toString(pOpt->SceneFormat).c_str());
+    outstream << buffer;
+    sprintf_s(buffer,5000,"  <MEMORYMAPPED value=\"%s\"></MEMORYMAPPED>\n",Ogre::StringConverter::toString(pOpt->MemoryMapped).c_str());
+    outstream << buffer;
     outstream << "  </PROJECT>\n";
 }
 //-----------------------------------------------------------------------------------------
@@ -1139,6 +1139,20 @@ Ogre::String OgitorsUtils::GetUserDataSaveString(OgitorsCustomPropertySet *set,
 }
 //----------------------------------------------------------------------------------------
 Ogre::String OgitorsUtils::GetObjectSaveStringV2(CBaseEditor *object, int indentation, bool useobjid, bool addparent)
+{
+    OgitorsPropertyValueMap theList;
+
+    object->getPropertyMap(theList);
+
+    // If Object's parent name is "" then the parent is mRootEditor
+    Ogre::String parentName = addparent ? object->getParent()->getName() : "";
+
+    return GetObjectSaveStringV2(useobjid ? object->getObjectID() : 0, object->getName(), object->getTypeName(), parentName,
+                                 theList, GetCustomPropertySaveString(object->getCustomProperties(), indentation + 2), indentation);
+}
+//----------------------------------------------------------------------------------------
+Ogre::String OgitorsUtils::GetObjectSaveStringV2(unsigned int objectID, const Ogre::String& name, const Ogre::String& typeName, const Ogre::String& parentName,
+                                                 OgitorsPropertyValueMap& properties, const Ogre::String& customProperties, int indentation)
 {
     Ogre::String outStr;
     Ogre::String indentStr = "";
@@ -1147,37 +1161,30 @@ Ogre::String OgitorsUtils::GetObjectSaveStringV2(CBaseEditor *object, int indent
         indentStr += " ";
     
     outStr = indentStr + "<OBJECT";
-    if(useobjid)
+    if(objectID)
     {
-        outStr += " object_id=\"" + Ogre::StringConverter::toString(object->getObjectID()) + "\"";
+        outStr += " object_id=\"" + Ogre::StringConverter::toString(objectID) + "\"";
     }
-    outStr += " name=\"" + object->getName() + "\"";
-    outStr += " typename=\"" + object->getTypeName() + "\"";
-    // If Object's parent name is "" then the parent is mRootEditor
-    if(object->getParent()->getName() != "" && addparent)
+    outStr += " name=\"" + name + "\"";
+    outStr += " typename=\"" + typeName + "\"";
+    if(parentName != "")
     {
-        outStr += " parentnode=\"" + object->getParent()->getName() + "\"";
+        outStr += " parentnode=\"" + parentName + "\"";
     }
     outStr += ">\n";
     
-    OgitorsPropertyValueMap theList;
-    OgitorsPropertyValueMap::iterator ni;
-
-    object->getPropertyMap(theList);
-
-    theList.erase(theList.find("name"));
-    theList.erase(theList.find("typename"));
-    theList.erase(theList.find("object_id"));
-
-    ni = theList.begin();
-    while(ni != theList.end())
+    OgitorsPropertyValueMap::iterator ni = properties.begin();
+    while(ni != properties.end())
     {
-        outStr += indentStr + "  <PROPERTY id=\"" + ni->first + "\"";
-        outStr += " type=\"" + Ogre::StringConverter::toString(ni->second.propType) + "\"";
-        outStr += " value=\"" + GetValueString(ni->second) + "\"></PROPERTY>\n";
+        if(ni->first != "name" && ni->first != "typename" && ni->first != "object_id")
+        {
+            outStr += indentStr + "  <PROPERTY id=\"" + ni->first + "\"";
+            outStr += " type=\"" + Ogre::StringConverter::toString(ni->second.propType) + "\"";
+            outStr += " value=\"" + GetValueString(ni->second) + "\"></PROPERTY>\n";
+        }
         ni++;
     }
-    outStr += GetCustomPropertySaveString(object->getCustomProperties(), indentation + 2).c_str();
+    outStr += customProperties;
     outStr += indentStr + "</OBJECT>\n";
     return outStr;
 }
@@ -1218,14 +1225,20 @@ bool OgitorsUtils::SaveImageOfs(Ogre::Image& image, Ogre::String filename)
 }
 //----------------------------------------------------------------------------------------
 bool OgitorsUtils::SaveStreamOfs(std::stringstream& stream, Ogre::String filename)
+{
+        const std::string contents = stream.str();
+
+        return SaveBufferOfs(contents.c_str(), contents.size(), filename);
+}
+//----------------------------------------------------------------------------------------
+bool OgitorsUtils::SaveBufferOfs(const char *data, unsigned int size, Ogre::String filename)
 {
         OFS::OFSHANDLE handle;
 
         OFS::OfsPtr& filePtr = OgitorsRoot::getSingletonPtr()->GetProjectFile();
 
-        unsigned int file_size = stream.str().size();
-
-        OFS::OfsResult ret = filePtr->createFile(handle, filename.c_str(), file_size, file_size, stream.str().c_str());
+        // Passing the contents to createFile stores them in a single block
+        OFS::OfsResult ret = filePtr->createFile(handle, filename.c_str(), size, size, data);
 
         if(ret != OFS::OFS_OK)
             return false;
@@ -1235,118 +1248,52 @@ bool OgitorsUtils::SaveStreamOfs(std::stringstream& stream, Ogre::String filenam
         return true;
 }
 //----------------------------------------------------------------------------------------
-#define MAX_BUFFER_SIZE (16 * 1024 * 1024)
-
-bool OgitorsUtils::CopyDirOfs(Ogre::String dirpath, Ogre::String ofs_path)
+static void CollectImportRequests(const Ogre::String& dirpath, const Ogre::String& ofs_path, OFS::ImportRequestList& requests)
 {
-    OFS::OfsPtr& filePtr = OgitorsRoot::getSingletonPtr()->GetProjectFile();
-
-    OFS::OFSHANDLE fhandle;
-
-    dirpath = QualifyPath(dirpath);
-
     Ogre::StringVector filelist;
 
     OgitorsSystem::getSingletonPtr()->GetFileList(dirpath + "/*.*", filelist);
 
-    char *tmp_buffer = new char[MAX_BUFFER_SIZE];
-
     for(unsigned int i = 0; i < filelist.size(); i++)
     {
-        Ogre::String path = filelist[i];
-        Ogre::String file_ofs_path = ofs_path + ExtractFileName(filelist[i]);
-            
-        std::ifstream stream;
-        stream.open(path.c_str(), std::fstream::in | std::fstream::binary);
-            
-        if(stream.is_open())
-        {
-            stream.seekg(0, std::fstream::end);
-            unsigned int stream_size = stream.tellg();
-
-            stream.seekg(0, std::fstream::beg);
- 
-            if(stream_size >= MAX_BUFFER_SIZE)
-            {
-                // CreateFile accepts initial data to be written during allocation
-                // It's an optimization, that's why we don't have to call Ofs:write after createFile
-                stream.read(tmp_buffer, MAX_BUFFER_SIZE);
-                try
-                {
-                    if(filePtr->createFile(fhandle, file_ofs_path.c_str(), MAX_BUFFER_SIZE, MAX_BUFFER_SIZE, tmp_buffer) != OFS::OFS_OK)
-                    {
-                        stream.close();
-                        continue;
-                    }
-
-                    stream_size -= MAX_BUFFER_SIZE;
-                }
-                catch(OFS::Exception&)
-                {
-                    stream.close();
-                    continue;
-                }
+        OFS::ImportRequest request;
+        request.SourcePath = filelist[i];
+        request.Name = ofs_path + OgitorsUtils::ExtractFileName(filelist[i]);
+        requests.push_back(request);
+    }
 
-                try
-                {
-                    while(stream_size > 0)
-                    {
-                        if(stream_size >= MAX_BUFFER_SIZE)
-                        {
-                            stream.read(tmp_buffer, MAX_BUFFER_SIZE);
-                            filePtr->write(fhandle, tmp_buffer, MAX_BUFFER_SIZE);
-                            stream_size -= MAX_BUFFER_SIZE;
-                        }
-                        else
-                        {
-                            stream.read(tmp_buffer, stream_size);
-                            filePtr->write(fhandle, tmp_buffer, stream_size);
-                            stream_size = 0;
-                        }
-                    }
-                }
-                catch(OFS::Exception&)
-                {
-                }
+    filelist.clear();
 
-                stream.close();
-                filePtr->closeFile(fhandle);
-            }
-            else
-            {
-                stream.read(tmp_buffer, stream_size);
+    OgitorsSystem::getSingletonPtr()->GetDirList(dirpath + "/", filelist);
 
-                try
-                {
-                    // CreateFile accepts initial data to be written during allocation
-                    // It's an optimization, that's why we don't have to call Ofs:write after createFile
-                    if(filePtr->createFile(fhandle, file_ofs_path.c_str(), stream_size, stream_size, tmp_buffer) != OFS::OFS_OK)
-                    {
-                        stream.close();
-                        continue;
-                    }
-                }
-                catch(OFS::Exception&)
-                {
-                }
+    for(unsigned int i = 0; i < filelist.size(); i++)
+    {
+        OFS::ImportRequest request;
+        request.Name = ofs_path + filelist[i] + "/";
+        requests.push_back(request);
 
-                stream.close();
-                filePtr->closeFile(fhandle);
-            }
-        }
+        CollectImportRequests(dirpath + "/" + filelist[i], request.Name, requests);
     }
+}
+//----------------------------------------------------------------------------------------
+bool OgitorsUtils::CopyDirOfs(Ogre::String dirpath, Ogre::String ofs_path)
+{
+    OFS::OfsPtr& filePtr = OgitorsRoot::getSingletonPtr()->GetProjectFile();
 
-    delete [] tmp_buffer;
+    dirpath = QualifyPath(dirpath);
 
-    filelist.clear();
+    // The whole tree is handed over at once, so host files are read on several threads
+    // while OFS stores the ones already read
+    OFS::ImportRequestList requests;
 
-    OgitorsSystem::getSingletonPtr()->GetDirList(dirpath + "/", filelist);
+    CollectImportRequests(dirpath, ofs_path, requests);
 
-    for(unsigned int i = 0; i < filelist.size(); i++)
+    try
+    {
+        filePtr->importFiles(requests);
+    }
+    catch(OFS::Exception&)
     {
-        Ogre::String dir_name = ofs_path + filelist[i] + "/"; 
-        filePtr->createDirectory(dir_name.c_str());
-        CopyDirOfs(dirpath + "/" + filelist[i], dir_name);
     }
 
     return true;
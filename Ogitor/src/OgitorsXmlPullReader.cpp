@@ -0,0 +1,505 @@
+/*/////////////////////////////////////////////////////////////////////////////////
+/// An
+///    ___   ____ ___ _____ ___  ____
+///   / _ \ / ___|_ _|_   _/ _ \|  _ \
+///  | | | | |  _ | |  | || | | | |_) |
+///  | |_| | |_| || |  | || |_| |  _ <
+///   \___/ \____|___| |_| \___/|_| \_\
+///                              File
+///
+/// Copyright (c) 2008-2015 Ismail TARIM <ismail@royalspor.com> and the Ogitor Team
+///
+/// The MIT License
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+/// THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////*/
+
+
+#include "OgitorsXmlPullReader.h"
+
+#include "ofs.h"
+
+#include <algorithm>
+
+using namespace Ogitors;
+
+/* Longest entity reference decoded in attribute values, longer ones are kept literally */
+static const size_t XMLPULL_MAX_ENTITY = 10;
+
+//----------------------------------------------------------------------------------
+size_t XmlPullMemorySource::read(char *buffer, size_t size)
+{
+    size = std::min(size, mSize - mPos);
+    memcpy(buffer, mData + mPos, size);
+    mPos += size;
+    return size;
+}
+//----------------------------------------------------------------------------------
+XmlPullFileSource::XmlPullFileSource(const std::string& filename)
+{
+    mFile = fopen(filename.c_str(), "rb");
+}
+//----------------------------------------------------------------------------------
+XmlPullFileSource::~XmlPullFileSource()
+{
+    if(mFile)
+        fclose(mFile);
+}
+//----------------------------------------------------------------------------------
+size_t XmlPullFileSource::read(char *buffer, size_t size)
+{
+    if(!mFile)
+        return 0;
+
+    return fread(buffer, 1, size, mFile);
+}
+//----------------------------------------------------------------------------------
+XmlPullOfsSource::XmlPullOfsSource(OFS::OfsPtr& file, const std::string& filename) : mOfsFile(file)
+{
+    mHandle = new OFS::OFSHANDLE();
+
+    if(mOfsFile->openFile(*mHandle, filename.c_str(), OFS::OFS_READ) != OFS::OFS_OK)
+    {
+        delete mHandle;
+        mHandle = 0;
+    }
+}
+//----------------------------------------------------------------------------------
+XmlPullOfsSource::~XmlPullOfsSource()
+{
+    if(mHandle)
+    {
+        mOfsFile->closeFile(*mHandle);
+        delete mHandle;
+    }
+}
+//----------------------------------------------------------------------------------
+size_t XmlPullOfsSource::read(char *buffer, size_t size)
+{
+    if(!mHandle)
+        return 0;
+
+    unsigned int actual_read = 0;
+    if(mOfsFile->read(*mHandle, buffer, (unsigned int)size, &actual_read) != OFS::OFS_OK)
+        return 0;
+
+    return actual_read;
+}
+//----------------------------------------------------------------------------------
+XmlPullReader::XmlPullReader(XmlPullSource *source, size_t bufferSize) :
+    mSource(source), mBufferSize(std::max(bufferSize, (size_t)16)), mPos(0), mEnd(0), mOffset(0),
+    mEvent(EVENT_START_ELEMENT), mDepth(0), mEmptyElement(false), mPendingEnd(false), mRootSeen(false),
+    mAttributeCount(0), mOpenCount(0)
+{
+    mBuffer = new char[mBufferSize];
+}
+//----------------------------------------------------------------------------------
+XmlPullReader::~XmlPullReader()
+{
+    delete [] mBuffer;
+}
+//----------------------------------------------------------------------------------
+XmlPullReader::EventType XmlPullReader::next()
+{
+    if(mEvent == EVENT_ERROR || mEvent == EVENT_END_DOCUMENT)
+        return mEvent;
+
+    mAttributeCount = 0;
+
+    if(mPendingEnd)
+    {
+        // The name of the empty element is still in mName
+        mPendingEnd = false;
+        mDepth = mOpenCount--;
+        return mEvent = EVENT_END_ELEMENT;
+    }
+
+    while(true)
+    {
+        if(mRootSeen && mOpenCount == 0)
+            return mEvent = EVENT_END_DOCUMENT;
+
+        // Character data is skipped
+        int c;
+        while((c = _get()) != '<')
+        {
+            if(c < 0)
+                return _setError(mRootSeen ? "Unexpected end of document" : "No root element");
+        }
+
+        c = _peek();
+
+        if(c == '/')
+        {
+            ++mPos;
+            return mEvent = _readEndElement();
+        }
+        else if(c == '?')
+        {
+            if(!_skipPast("?>"))
+                return _setError("Unterminated processing instruction");
+        }
+        else if(c == '!')
+        {
+            ++mPos;
+            if(!_skipDeclaration())
+                return _setError("Unterminated declaration");
+        }
+        else
+            return mEvent = _readStartElement();
+    }
+}
+//----------------------------------------------------------------------------------
+bool XmlPullReader::nextChild(int depth)
+{
+    // Skip whatever is left of a child the caller did not consume
+    if(mEvent == EVENT_START_ELEMENT && mDepth > depth && !skipElement())
+        return false;
+
+    return next() == EVENT_START_ELEMENT;
+}
+//----------------------------------------------------------------------------------
+bool XmlPullReader::skipElement()
+{
+    int depth = mDepth;
+
+    while(true)
+    {
+        switch(next())
+        {
+        case EVENT_START_ELEMENT:
+            break;
+        case EVENT_END_ELEMENT:
+            if(mDepth == depth)
+                return true;
+            break;
+        default:
+            return false;
+        }
+    }
+}
+//----------------------------------------------------------------------------------
+TiXmlElement *XmlPullReader::readElement()
+{
+    TiXmlElement *element = new TiXmlElement(mName.c_str());
+
+    for(unsigned int i = 0; i < mAttributeCount; i++)
+        element->SetAttribute(mAttributes[i].first.c_str(), mAttributes[i].second.c_str());
+
+    int depth = mDepth;
+
+    while(true)
+    {
+        EventType event = next();
+
+        if(event == EVENT_START_ELEMENT)
+        {
+            TiXmlElement *child = readElement();
+            if(!child)
+                break;
+
+            element->LinkEndChild(child);
+        }
+        else if(event == EVENT_END_ELEMENT && mDepth == depth)
+            return element;
+        else
+            break;
+    }
+
+    delete element;
+    return 0;
+}
+//----------------------------------------------------------------------------------
+const char *XmlPullReader::getAttribute(const char *name) const
+{
+    for(unsigned int i = 0; i < mAttributeCount; i++)
+    {
+        if(mAttributes[i].first == name)
+            return mAttributes[i].second.c_str();
+    }
+
+    return 0;
+}
+//----------------------------------------------------------------------------------
+bool XmlPullReader::_fill()
+{
+    mOffset += mEnd;
+    mPos = 0;
+    mEnd = mSource->read(mBuffer, mBufferSize);
+    return mEnd != 0;
+}
+//----------------------------------------------------------------------------------
+void XmlPullReader::_skipWhiteSpace()
+{
+    int c;
+    while((c = _peek()) == ' ' || c == '\t' || c == '\n' || c == '\r')
+        ++mPos;
+}
+//----------------------------------------------------------------------------------
+bool XmlPullReader::_skipPast(const char *terminator)
+{
+    // Terminators are at most 3 characters, the last characters read are compared to it
+    size_t len = strlen(terminator);
+    char window[4] = {0, 0, 0, 0};
+
+    while(true)
+    {
+        int c = _get();
+        if(c < 0)
+            return false;
+
+        window[0] = window[1];
+        window[1] = window[2];
+        window[2] = (char)c;
+
+        if(memcmp(window + 3 - len, terminator, len) == 0)
+            return true;
+    }
+}
+//----------------------------------------------------------------------------------
+bool XmlPullReader::_skipDeclaration()
+{
+    int c = _peek();
+
+    if(c == '-')
+    {
+        ++mPos;
+        if(_get() != '-')
+            return false;
+
+        return _skipPast("-->");
+    }
+    else if(c == '[')
+        return _skipPast("]]>");
+
+    // Document type declaration, may contain an internal subset in brackets
+    int brackets = 0;
+    while((c = _get()) >= 0)
+    {
+        if(c == '[')
+            ++brackets;
+        else if(c == ']')
+            --brackets;
+        else if(c == '>' && brackets <= 0)
+            return true;
+    }
+
+    return false;
+}
+//----------------------------------------------------------------------------------
+bool XmlPullReader::_readName(std::string& name)
+{
+    name.clear();
+
+    while(true)
+    {
+        int c = _peek();
+
+        if(c < 0 || c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '/' || c == '>' ||
+           c == '=' || c == '<' || c == '"' || c == '\'')
+            break;
+
+        name += (char)c;
+        ++mPos;
+    }
+
+    return !name.empty();
+}
+//----------------------------------------------------------------------------------
+bool XmlPullReader::_readAttributeValue(std::string& value)
+{
+    value.clear();
+
+    int quote = _get();
+    if(quote != '"' && quote != '\'')
+        return false;
+
+    while(true)
+    {
+        int c = _get();
+
+        if(c < 0)
+            return false;
+        else if(c == quote)
+            return true;
+        else if(c == '&')
+            _decodeEntity(value);
+        else
+            value += (char)c;
+    }
+}
+//----------------------------------------------------------------------------------
+void XmlPullReader::_decodeEntity(std::string& value)
+{
+    // Called after '&', unknown or malformed references are kept literally like TinyXML does
+    mEntity.clear();
+
+    int c;
+    while((c = _peek()) >= 0 && c != ';' && c != '"' && c != '\'' && c != '<' && c != '&' && mEntity.size() < XMLPULL_MAX_ENTITY)
+    {
+        mEntity += (char)c;
+        ++mPos;
+    }
+
+    if(c != ';')
+    {
+        value += '&';
+        value += mEntity;
+        return;
+    }
+
+    ++mPos;
+
+    if(mEntity == "amp")
+        value += '&';
+    else if(mEntity == "lt")
+        value += '<';
+    else if(mEntity == "gt")
+        value += '>';
+    else if(mEntity == "quot")
+        value += '"';
+    else if(mEntity == "apos")
+        value += '\'';
+    else if(mEntity.size() > 1 && mEntity[0] == '#')
+    {
+        unsigned long code;
+        if(mEntity[1] == 'x')
+            code = strtoul(mEntity.c_str() + 2, 0, 16);
+        else
+            code = strtoul(mEntity.c_str() + 1, 0, 10);
+
+        // Encode as UTF-8
+        if(code < 0x80)
+            value += (char)code;
+        else if(code < 0x800)
+        {
+            value += (char)(0xC0 | (code >> 6));
+            value += (char)(0x80 | (code & 0x3F));
+        }
+        else if(code < 0x10000)
+        {
+            value += (char)(0xE0 | (code >> 12));
+            value += (char)(0x80 | ((code >> 6) & 0x3F));
+            value += (char)(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            value += (char)(0xF0 | ((code >> 18) & 0x07));
+            value += (char)(0x80 | ((code >> 12) & 0x3F));
+            value += (char)(0x80 | ((code >> 6) & 0x3F));
+            value += (char)(0x80 | (code & 0x3F));
+        }
+    }
+    else
+    {
+        value += '&';
+        value += mEntity;
+        value += ';';
+    }
+}
+//----------------------------------------------------------------------------------
+XmlPullReader::EventType XmlPullReader::_readStartElement()
+{
+    if(!_readName(mName))
+        return _setError("Malformed element name");
+
+    mEmptyElement = false;
+
+    while(true)
+    {
+        _skipWhiteSpace();
+
+        int c = _peek();
+
+        if(c < 0)
+            return _setError("Unexpected end of document");
+        else if(c == '>')
+        {
+            ++mPos;
+            break;
+        }
+        else if(c == '/')
+        {
+            ++mPos;
+            if(_get() != '>')
+                return _setError("Malformed element <" + mName + ">");
+
+            mEmptyElement = true;
+            break;
+        }
+
+        if(mAttributeCount == mAttributes.size())
+            mAttributes.push_back(Attribute());
+
+        Attribute& attribute = mAttributes[mAttributeCount];
+
+        if(!_readName(attribute.first))
+            return _setError("Malformed attribute in element <" + mName + ">");
+
+        _skipWhiteSpace();
+        if(_get() != '=')
+            return _setError("Malformed attribute in element <" + mName + ">");
+
+        _skipWhiteSpace();
+        if(!_readAttributeValue(attribute.second))
+            return _setError("Malformed attribute value in element <" + mName + ">");
+
+        ++mAttributeCount;
+    }
+
+    if(mOpenCount == mOpenElements.size())
+        mOpenElements.push_back(mName);
+    else
+        mOpenElements[mOpenCount] = mName;
+
+    mDepth = ++mOpenCount;
+    mRootSeen = true;
+    mPendingEnd = mEmptyElement;
+
+    return EVENT_START_ELEMENT;
+}
+//----------------------------------------------------------------------------------
+XmlPullReader::EventType XmlPullReader::_readEndElement()
+{
+    if(!_readName(mName))
+        return _setError("Malformed end tag");
+
+    _skipWhiteSpace();
+    if(_get() != '>')
+        return _setError("Malformed end tag </" + mName + ">");
+
+    if(mOpenCount == 0 || mOpenElements[mOpenCount - 1] != mName)
+        return _setError("Mismatched end tag </" + mName + ">");
+
+    mEmptyElement = false;
+    mDepth = mOpenCount--;
+
+    return EVENT_END_ELEMENT;
+}
+//----------------------------------------------------------------------------------
+XmlPullReader::EventType XmlPullReader::_setError(const std::string& error)
+{
+    char offset[32];
+    sprintf_s(offset, 32, " at offset %lu", (unsigned long)(mOffset + mPos));
+
+    mError = error + offset;
+    mPendingEnd = false;
+    return mEvent = EVENT_ERROR;
+}
+//----------------------------------------------------------------------------------
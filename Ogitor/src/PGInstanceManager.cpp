@@ -564,6 +564,8 @@ int CPGInstanceManager::addInstance(const Ogre::Vector3& pos, const Ogre::Real&
     int result = mNextInstanceIndex++;
     mInstanceList.insert(PGInstanceList::value_type(result, instance));
 
+    setModified(true);
+
     return result;
 }
 //-----------------------------------------------------------------------------------------
@@ -581,6 +583,7 @@ void CPGInstanceManager::removeInstance(int index)
         {
             mHandle->deleteTrees(it->second.pos, 0.01f, mEntityHandle);
             mInstanceList.erase(it);
+            setModified(true);
         }
     }
 }
@@ -601,6 +604,7 @@ void CPGInstanceManager::modifyInstancePosition(int index, const Ogre::Vector3&
         }
 
         it->second.pos = pos;
+        setModified(true);
     }
 }
 //-----------------------------------------------------------------------------------------
@@ -614,6 +618,7 @@ void CPGInstanceManager::modifyInstanceScale(int index, Ogre::Real scale)
     if(it != mInstanceList.end())
     {
         it->second.scale = scale;
+        setModified(true);
         if(mEntityHandle)
         {
             mHandle->deleteTrees(it->second.pos, 0.01f, mEntityHandle);
@@ -632,6 +637,7 @@ void CPGInstanceManager::modifyInstanceYaw(int index, Ogre::Real yaw)
     if(it != mInstanceList.end())
     {
         it->second.yaw = yaw;
+        setModified(true);
         if(mEntityHandle)
         {
             mHandle->deleteTrees(it->second.pos, 0.01f, mEntityHandle);
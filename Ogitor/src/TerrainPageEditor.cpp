@@ -122,9 +122,6 @@ void CTerrainPageEditor::_saveTerrain(Ogre::String pathPrefix)
         filename = mTempFileName;
     }
 
-    Ogre::String tmpCompressFile = mOgitorsRoot->GetProjectFile()->getFileSystemDirectory() + "/Temp/";
-    tmpCompressFile = tmpCompressFile + Ogre::StringConverter::toString(mObjectID->get()) + ".compress";
-
     OFS::OFSHANDLE *fileHandle = new OFS::OFSHANDLE();
 
     if( mOgitorsRoot->GetProjectFile()->openFile(*fileHandle, filename.c_str(), OFS::OFS_READWRITE | OFS::OFS_FORCE ) != OFS::OFS_OK )
@@ -132,12 +129,20 @@ void CTerrainPageEditor::_saveTerrain(Ogre::String pathPrefix)
 
     if( fileHandle->_valid() )
     {
+        // Terrain data compresses well, let OFS store the page compressed (ignored by directory based projects)
+        unsigned int flags = 0;
+        mOgitorsRoot->GetProjectFile()->getFileFlags(*fileHandle, flags);
+        mOgitorsRoot->GetProjectFile()->setFileFlags(*fileHandle, flags | OFS::OFS_COMPRESSED);
+
         // Force to load highest LoD, or quadTree may contain hole
         mHandle->load(0, true);
 
+        // StreamSerialiser writes in many small pieces, make room for the heights, deltas and blend maps up front
+        size_t vertexCount = (size_t)mHandle->getSize() * mHandle->getSize();
+        size_t blendMapSize = (size_t)mHandle->getLayerBlendMapSize() * mHandle->getLayerBlendMapSize();
+        mOgitorsRoot->GetProjectFile()->reserve(*fileHandle, vertexCount * sizeof(float) * 2 + blendMapSize * mHandle->getLayerCount());
+
         Ogre::DataStreamPtr stream = Ogre::DataStreamPtr(OGRE_NEW OfsDataStream(mOgitorsRoot->GetProjectFile(), fileHandle));
-        //Ogre::DataStreamPtr compressStream(OGRE_NEW Ogre::DeflateStream(filename, stream, tmpCompressFile));
-        //Ogre::StreamSerialiser ser(compressStream);
         Ogre::StreamSerialiser ser(stream);
         mHandle->save(ser);
     }
@@ -189,6 +194,15 @@ void CTerrainPageEditor::onSave(bool forced)
     mTempDensityModified->set(false);
 }
 //-----------------------------------------------------------------------------------------
+bool CTerrainPageEditor::isModified()
+{
+    // Height and blend maps are edited directly on the terrain, the page's properties do not change
+    if(mHandle && mHandle->isModified())
+        return true;
+
+    return CBaseEditor::isModified() || mPGModified || mTempModified->get() || mTempDensityModified->get();
+}
+//-----------------------------------------------------------------------------------------
 Ogre::AxisAlignedBox CTerrainPageEditor::getAABB()
 {
     if(mHandle)
@@ -0,0 +1,577 @@
+/*/////////////////////////////////////////////////////////////////////////////////
+/// An
+///    ___   ____ ___ _____ ___  ____
+///   / _ \ / ___|_ _|_   _/ _ \|  _ \
+///  | | | | |  _ | |  | || | | | |_) |
+///  | |_| | |_| || |  | || |_| |  _ <
+///   \___/ \____|___| |_| \___/|_| \_\
+///                              File
+///
+/// Copyright (c) 2008-2015 Ismail TARIM <ismail@royalspor.com> and the Ogitor Team
+////
+/// The MIT License
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+/// THE SOFTWARE. 
+///////////////////////////////////////////////////////////////////////////////////*/
+
+
+#include "OgitorsXmlPullReader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+/* Headless benchmark of the scene file parsers. Generates a synthetic .ogscene file and parses it
+   with TinyXML the way scenes used to be imported (whole file in memory, then a DOM) and with the
+   streaming XmlPullReader, measuring parse time and peak resident memory of each.
+   Results are written as JSON (default) or CSV so they can be compared between builds.
+   Run "xmlbench -h" for the list of options */
+
+using namespace Ogitors;
+
+//------------------------------------------------------------------------------
+
+/* Configuration of a benchmark run */
+struct BenchConfig
+{
+    std::string  File;            /* Path of the generated scene file */
+    std::string  Output;          /* Result file, stdout if empty */
+    std::string  Format;          /* "json" or "csv" */
+    std::string  Parsers;         /* Comma separated list of parsers to run, empty for all */
+    unsigned int NumObjects;      /* Number of objects to generate */
+    unsigned int NumProperties;   /* Number of properties per object */
+    unsigned int CustomEvery;     /* Every n-th object gets custom properties, 0 for none */
+    unsigned int BufferSize;      /* Chunk size of the pull reader */
+    unsigned int Seed;            /* Seed of the random generator */
+    bool         Keep;            /* Keep the generated file */
+};
+
+/* What a parser found in the scene, both parsers have to agree */
+struct BenchSummary
+{
+    unsigned int  Objects;
+    unsigned int  Properties;
+    unsigned int  Checksum;
+};
+
+/* Result of a single parser run, plain data so a child process can pass it back */
+struct BenchResult
+{
+    int           Parser;         /* Index into BENCH_PARSERS */
+    bool          Succeeded;
+    BenchSummary  Summary;
+    double        Seconds;
+    long long     PeakRss;        /* Peak resident memory of the process in KB */
+    long long     RssGrowth;      /* Growth of the peak while parsing in KB */
+};
+
+typedef std::vector<BenchResult> BenchResultList;
+
+/* Small deterministic generator, results stay comparable between platforms */
+class BenchRandom
+{
+public:
+    BenchRandom(unsigned int seed) : mState(seed * 2654435761u + 1) {}
+
+    unsigned int next()
+    {
+        mState ^= mState << 13;
+        mState ^= mState >> 17;
+        mState ^= mState << 5;
+        return mState;
+    }
+
+    float unit()
+    {
+        return (next() & 0xFFFFFF) / float(0x1000000);
+    }
+
+private:
+    unsigned int mState;
+};
+
+/* Measures the wall clock time of a test */
+class BenchTimer
+{
+public:
+    BenchTimer() : mStart(boost::posix_time::microsec_clock::universal_time()) {}
+
+    double elapsed() const
+    {
+        return (boost::posix_time::microsec_clock::universal_time() - mStart).total_microseconds() / 1000000.0;
+    }
+
+private:
+    boost::posix_time::ptime mStart;
+};
+
+const char *BENCH_PARSERS[] = { "pull", "tinyxml" };
+const int BENCH_PARSER_COUNT = 2;
+
+//------------------------------------------------------------------------------
+
+long long benchPeakRss()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return (long long)(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+#if defined(__APPLE__)
+    return (long long)usage.ru_maxrss / 1024;
+#else
+    return (long long)usage.ru_maxrss;
+#endif
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+void benchHash(unsigned int& hash, const char *value)
+{
+    /* FNV-1a */
+    for(;*value;value++)
+    {
+        hash ^= (unsigned char)*value;
+        hash *= 16777619u;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+long long benchGenerate(const BenchConfig& config)
+{
+    static const char *types[] = { "Entity", "Node", "Light", "Particle", "Marker" };
+    static const char *ids[] = { "position", "orientation", "scale", "autotracktarget", "castshadows", "meshfile",
+                                 "layer", "renderingdistance", "subentity0::material", "subentity0::visible", "updatescript" };
+    static const int types_count = sizeof(types) / sizeof(types[0]);
+    static const int ids_count = sizeof(ids) / sizeof(ids[0]);
+
+    FILE *file = fopen(config.File.c_str(), "wb");
+
+    if(file == NULL)
+    {
+        fprintf(stderr, "xmlbench: cannot write %s\n", config.File.c_str());
+        exit(2);
+    }
+
+    BenchRandom random(config.Seed);
+
+    /* Written object by object, the generator itself must not inflate the memory baseline */
+    fprintf(file, "<OGITORSCENE version=\"4\">\n");
+    fprintf(file, "    <PROJECT>\n");
+    fprintf(file, "        <PROJECTNAME value=\"xmlbench\"></PROJECTNAME>\n");
+    fprintf(file, "        <SCENEMANAGER value=\"OctreeSceneManager\"></SCENEMANAGER>\n");
+    fprintf(file, "        <OBJECTCOUNT value=\"%u\"></OBJECTCOUNT>\n", config.NumObjects);
+    fprintf(file, "    </PROJECT>\n");
+
+    for(unsigned int i = 0;i < config.NumObjects;i++)
+    {
+        const char *type = types[random.next() % types_count];
+
+        fprintf(file, "    <OBJECT object_id=\"%u\" name=\"%s%u\" typename=\"%s\" parentnode=\"SceneManager\">\n",
+            i + 1, type, i, type);
+
+        for(unsigned int p = 0;p < config.NumProperties;p++)
+        {
+            fprintf(file, "        <PROPERTY id=\"%s%u\" type=\"9\" value=\"%.4f %.4f %.4f\"></PROPERTY>\n",
+                ids[p % ids_count], p / ids_count, random.unit() * 1000.0f, random.unit() * 100.0f, random.unit() * -1000.0f);
+        }
+
+        if(config.CustomEvery && (i % config.CustomEvery) == 0)
+        {
+            fprintf(file, "        <CUSTOMPROPERTIES>\n");
+            fprintf(file, "            <PROPERTY id=\"health\" type=\"1\" value=\"%u\" autooptiontype=\"0\"></PROPERTY>\n", random.next() % 100);
+            fprintf(file, "            <PROPERTY id=\"team\" type=\"6\" value=\"blue &amp; gold\" autooptiontype=\"0\"></PROPERTY>\n");
+            fprintf(file, "        </CUSTOMPROPERTIES>\n");
+        }
+
+        fprintf(file, "    </OBJECT>\n");
+    }
+
+    fprintf(file, "</OGITORSCENE>\n");
+
+    long long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+//------------------------------------------------------------------------------
+
+void benchSummarizeProperty(BenchSummary& summary, const char *id, const char *value)
+{
+    summary.Properties++;
+    benchHash(summary.Checksum, id ? id : "");
+    benchHash(summary.Checksum, value ? value : "");
+}
+
+//------------------------------------------------------------------------------
+
+bool benchParseTinyXml(const BenchConfig& config, BenchSummary& summary)
+{
+    /* Same steps as the DOM based scene import: the whole file in memory, then a DOM */
+    FILE *file = fopen(config.File.c_str(), "rb");
+    if(file == NULL)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *file_data = new char[size + 1];
+    size_t actual_read = fread(file_data, 1, size, file);
+    file_data[actual_read] = 0;
+    fclose(file);
+
+    TiXmlDocument docImport;
+    docImport.Parse(file_data);
+    delete [] file_data;
+
+    if(docImport.Error())
+        return false;
+
+    TiXmlElement *root = docImport.FirstChildElement("OGITORSCENE");
+    if(root == NULL)
+        return false;
+
+    for(TiXmlElement *element = root->FirstChildElement("OBJECT");element;element = element->NextSiblingElement("OBJECT"))
+    {
+        summary.Objects++;
+        benchHash(summary.Checksum, element->Attribute("name"));
+        benchHash(summary.Checksum, element->Attribute("typename"));
+
+        for(TiXmlElement *property = element->FirstChildElement();property;property = property->NextSiblingElement())
+        {
+            if(strcmp(property->Value(), "PROPERTY") == 0)
+                benchSummarizeProperty(summary, property->Attribute("id"), property->Attribute("value"));
+            else if(strcmp(property->Value(), "CUSTOMPROPERTIES") == 0)
+            {
+                for(TiXmlElement *custom = property->FirstChildElement("PROPERTY");custom;custom = custom->NextSiblingElement("PROPERTY"))
+                    benchSummarizeProperty(summary, custom->Attribute("id"), custom->Attribute("value"));
+            }
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool benchParsePull(const BenchConfig& config, BenchSummary& summary)
+{
+    /* Same steps as the streaming scene import, custom properties are materialized as a DOM */
+    XmlPullFileSource source(config.File);
+    if(!source.isOpen())
+        return false;
+
+    XmlPullReader reader(&source, config.BufferSize);
+
+    if(reader.next() != XmlPullReader::EVENT_START_ELEMENT || reader.getName() != "OGITORSCENE")
+        return false;
+
+    while(reader.nextChild(1))
+    {
+        if(reader.getName() != "OBJECT")
+            continue;
+
+        summary.Objects++;
+        benchHash(summary.Checksum, reader.getAttribute("name"));
+        benchHash(summary.Checksum, reader.getAttribute("typename"));
+
+        while(reader.nextChild(2))
+        {
+            if(reader.getName() == "PROPERTY")
+                benchSummarizeProperty(summary, reader.getAttribute("id"), reader.getAttribute("value"));
+            else if(reader.getName() == "CUSTOMPROPERTIES")
+            {
+                TiXmlElement *element = reader.readElement();
+                if(element == NULL)
+                    return false;
+
+                for(TiXmlElement *custom = element->FirstChildElement("PROPERTY");custom;custom = custom->NextSiblingElement("PROPERTY"))
+                    benchSummarizeProperty(summary, custom->Attribute("id"), custom->Attribute("value"));
+
+                delete element;
+            }
+        }
+    }
+
+    if(reader.getEvent() == XmlPullReader::EVENT_ERROR)
+    {
+        fprintf(stderr, "xmlbench: %s\n", reader.getError().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchRun(const BenchConfig& config, int parser)
+{
+    BenchResult result;
+    memset(&result, 0, sizeof(result));
+    result.Parser = parser;
+    result.Summary.Checksum = 2166136261u;
+
+    long long baseline = benchPeakRss();
+    BenchTimer timer;
+
+    if(parser == 0)
+        result.Succeeded = benchParsePull(config, result.Summary);
+    else
+        result.Succeeded = benchParseTinyXml(config, result.Summary);
+
+    result.Seconds = timer.elapsed();
+    result.PeakRss = benchPeakRss();
+    result.RssGrowth = result.PeakRss - baseline;
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+BenchResult benchRunIsolated(const BenchConfig& config, int parser)
+{
+#if defined(_WIN32)
+    /* The peak only grows, run the pull parser first (see main) so its figure is not hidden */
+    return benchRun(config, parser);
+#else
+    /* Each parser runs in its own process, so the peak of one does not hide the other */
+    int fds[2];
+    if(pipe(fds) != 0)
+        return benchRun(config, parser);
+
+    fflush(NULL);
+    pid_t pid = fork();
+
+    if(pid == 0)
+    {
+        close(fds[0]);
+        BenchResult result = benchRun(config, parser);
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == sizeof(result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+
+    BenchResult result;
+    memset(&result, 0, sizeof(result));
+    result.Parser = parser;
+
+    if(pid < 0 || read(fds[0], &result, sizeof(result)) != sizeof(result))
+        result.Succeeded = false;
+
+    close(fds[0]);
+
+    if(pid > 0)
+    {
+        int status;
+        waitpid(pid, &status, 0);
+    }
+
+    return result;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+void benchWriteResults(FILE *out, const BenchConfig& config, long long fileSize, const BenchResultList& results)
+{
+    if(config.Format == "csv")
+    {
+        fprintf(out, "parser,succeeded,objects,properties,checksum,seconds,mb_per_sec,peak_rss_kb,rss_growth_kb\n");
+
+        for(unsigned int i = 0;i < results.size();i++)
+        {
+            const BenchResult& r = results[i];
+            double seconds = std::max(r.Seconds, 1e-9);
+
+            fprintf(out, "%s,%d,%u,%u,%08x,%.6f,%.2f,%lld,%lld\n", BENCH_PARSERS[r.Parser], r.Succeeded ? 1 : 0,
+                r.Summary.Objects, r.Summary.Properties, r.Summary.Checksum, r.Seconds,
+                fileSize / seconds / (1024.0 * 1024.0), r.PeakRss, r.RssGrowth);
+        }
+
+        return;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"config\": {\"objects\": %u, \"properties\": %u, \"custom_every\": %u, \"buffer_size\": %u, \"seed\": %u, \"file_size\": %lld},\n",
+        config.NumObjects, config.NumProperties, config.CustomEvery, config.BufferSize, config.Seed, fileSize);
+    fprintf(out, "  \"results\": [\n");
+
+    for(unsigned int i = 0;i < results.size();i++)
+    {
+        const BenchResult& r = results[i];
+        double seconds = std::max(r.Seconds, 1e-9);
+
+        fprintf(out, "    {\"parser\": \"%s\", \"succeeded\": %s, \"objects\": %u, \"properties\": %u, \"checksum\": \"%08x\", "
+            "\"seconds\": %.6f, \"mb_per_sec\": %.2f, \"peak_rss_kb\": %lld, \"rss_growth_kb\": %lld}%s\n",
+            BENCH_PARSERS[r.Parser], r.Succeeded ? "true" : "false", r.Summary.Objects, r.Summary.Properties, r.Summary.Checksum,
+            r.Seconds, fileSize / seconds / (1024.0 * 1024.0), r.PeakRss, r.RssGrowth, (i + 1 < results.size()) ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+}
+
+//------------------------------------------------------------------------------
+
+void printUsage()
+{
+    printf("Usage: xmlbench [options]\n");
+    printf("  -f <file.ogscene>  Scene file to generate (default xmlbench.ogscene)\n");
+    printf("  -o <file>          Write results to file instead of stdout\n");
+    printf("  --csv              Write results as CSV instead of JSON\n");
+    printf("  -p <a,b>           Parsers to run: pull,tinyxml (default all)\n");
+    printf("  -n <count>         Number of objects (default 50000)\n");
+    printf("  --props <n>        Properties per object (default 16)\n");
+    printf("  --custom <n>       Every n-th object gets custom properties, 0 for none (default 10)\n");
+    printf("  --buffer <n>       Chunk size of the pull reader in bytes (default 65536)\n");
+    printf("  --seed <n>         Random seed (default 1)\n");
+    printf("  --keep             Keep the generated scene file\n");
+}
+
+//------------------------------------------------------------------------------
+
+bool benchSelected(const BenchConfig& config, const char *name)
+{
+    if(config.Parsers.empty())
+        return true;
+
+    std::string list = "," + config.Parsers + ",";
+    return list.find(std::string(",") + name + ",") != std::string::npos;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    BenchConfig config;
+
+    config.File = "xmlbench.ogscene";
+    config.Format = "json";
+    config.NumObjects = 50000;
+    config.NumProperties = 16;
+    config.CustomEvery = 10;
+    config.BufferSize = 64 * 1024;
+    config.Seed = 1;
+    config.Keep = false;
+
+    for(int i = 1;i < argc;i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if(arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+        else if(arg == "--csv")
+            config.Format = "csv";
+        else if(arg == "--keep")
+            config.Keep = true;
+        else if(!has_value)
+        {
+            printUsage();
+            return 1;
+        }
+        else if(arg == "-f")
+            config.File = argv[++i];
+        else if(arg == "-o")
+            config.Output = argv[++i];
+        else if(arg == "-p")
+            config.Parsers = argv[++i];
+        else if(arg == "-n")
+            config.NumObjects = atoi(argv[++i]);
+        else if(arg == "--props")
+            config.NumProperties = atoi(argv[++i]);
+        else if(arg == "--custom")
+            config.CustomEvery = atoi(argv[++i]);
+        else if(arg == "--buffer")
+            config.BufferSize = atoi(argv[++i]);
+        else if(arg == "--seed")
+            config.Seed = atoi(argv[++i]);
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if(config.NumObjects == 0 || config.BufferSize == 0)
+    {
+        printUsage();
+        return 1;
+    }
+
+    long long fileSize = benchGenerate(config);
+
+    BenchResultList results;
+
+    for(int parser = 0;parser < BENCH_PARSER_COUNT;parser++)
+    {
+        if(benchSelected(config, BENCH_PARSERS[parser]))
+            results.push_back(benchRunIsolated(config, parser));
+    }
+
+    if(!config.Keep)
+        remove(config.File.c_str());
+
+    FILE *out = config.Output.empty() ? stdout : fopen(config.Output.c_str(), "w");
+
+    if(out == NULL)
+    {
+        fprintf(stderr, "xmlbench: cannot write %s\n", config.Output.c_str());
+        return 1;
+    }
+
+    benchWriteResults(out, config, fileSize, results);
+
+    if(out != stdout)
+        fclose(out);
+
+    /* Parsers that failed or disagree with each other fail the run */
+    for(unsigned int i = 0;i < results.size();i++)
+    {
+        if(!results[i].Succeeded || results[i].Summary.Checksum != results[0].Summary.Checksum ||
+           results[i].Summary.Properties != results[0].Summary.Properties)
+            return 2;
+    }
+
+    return 0;
+}
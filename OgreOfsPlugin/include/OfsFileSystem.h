@@ -40,7 +40,9 @@
 
 #include "OgreArchive.h"
 #include "OgreArchiveFactory.h"
+#include "OgreResourceGroupManager.h"
 #include "Threading/OgreThreadHeaders.h"
+#include "OgreAtomicScalar.h"
 
 #include "ofs.h"
 
@@ -56,6 +58,30 @@
 
 namespace Ogre {
 
+    /** Glob pattern as used by Archive::find ('*' matches any run of
+        characters, '?' any single character), split up once so it can be
+        matched against many names without being parsed again.
+    */
+    class PluginExport OfsGlobMatcher
+    {
+    public:
+        OfsGlobMatcher(const String& pattern = "*");
+
+        /** Checks if a file name matches the pattern
+        @param name File name without directory
+        */
+        bool match(const String& name) const;
+
+    protected:
+        /// Parts of the pattern around the '*'s, the first and last ones are anchored
+        StringVector mParts;
+
+        /// Finds a part between pos and end, returns npos if not found
+        static size_t findPart(const String& name, size_t pos, size_t end, const String& part);
+        /// Checks if a part matches name at pos, the caller ensures it fits
+        static bool matchPart(const String& name, size_t pos, const String& part);
+    };
+
 	/** Specialisation of the Archive class to allow reading of files from 
         OFS filesystem folders / directories.
     */
@@ -79,6 +105,48 @@ namespace Ogre {
         void findFiles(const String& pattern, bool recursive, bool dirs,
             StringVector* simpleList, FileInfoList* detailList) const;
 
+        /** Rebuilds the cached listing if the file system changed since it was built */
+        void updateListing() const;
+
+        /** Appends the entries below a directory to the cached listing
+        @param path Full path of the directory inside the OFS, with trailing '/'
+        @param relative Path of the directory relative to the archive, with trailing '/' or empty
+        */
+        void buildListing(const String& path, const String& relative) const;
+
+        /** Trigger invalidating the cached listing whenever an entry is created, deleted, renamed or written */
+        static void fileSystemChanged(void *userData, OFS::_OfsBase::OfsEntryDesc *desc, const char *arg);
+
+        struct ListingEntry
+        {
+            String       path;       /// Directory relative to the archive, with trailing '/' or empty
+            String       basename;
+            size_t       size;
+            unsigned int flags;
+        };
+
+        typedef std::vector<ListingEntry> Listing;
+        typedef std::map<String, OfsGlobMatcher> GlobMatcherMap;
+
+        /// Every entry below the archive's directory, in depth first order
+        mutable Listing mListing;
+        /// Value of mFileSystemVersion mListing was built for
+        mutable unsigned int mListingVersion;
+        /// Bumped by fileSystemChanged, may be changed from any thread holding the OFS lock
+        AtomicScalar<unsigned int> mFileSystemVersion;
+        /// Masks used with find so far, Ogre asks for the same few over and over
+        mutable GlobMatcherMap mMatchers;
+
+        /** Drops the prefetched copies of a file or of everything below a directory which changed
+        @param name Full path of the file or directory inside the OFS
+        */
+        void discardPrefetched(const String& name) const;
+
+        typedef std::map<String, std::pair<uchar*, size_t> > PrefetchMap;
+
+        /// File contents read ahead by prefetch, consumed by the first read-only open
+        mutable PrefetchMap mPrefetched;
+
         OGRE_AUTO_MUTEX;
 
     public:
@@ -96,6 +164,16 @@ namespace Ogre {
         /// @copydoc Archive::open
         DataStreamPtr open(const String& filename, bool readOnly = true) const;
 
+        /** Reads a set of files (e.g. all files of a resource group) with one
+            batched OFS read ordered by disk position. The first read-only open
+            of each file is then served from memory.
+        @param filenames Names of the files relative to the archive
+        */
+        void prefetch(const StringVector& filenames);
+
+        /** Frees prefetched file contents which were not consumed by open */
+        void clearPrefetched();
+
 		/// @copydoc Archive::create
 		DataStreamPtr create(const String& filename);
 
@@ -160,6 +238,32 @@ namespace Ogre {
         void destroyInstance( Archive* arch) { delete arch; }
     };
 
+    /** Prefetches the scripts of the OFS archives in a resource group right
+        before they are parsed, so they are read with one batched OFS read.
+        Contents not consumed by then are freed when parsing is over.
+    */
+    class PluginExport OFSScriptPrefetcher : public ResourceGroupListener
+    {
+    public:
+        /// @copydoc ResourceGroupListener::resourceGroupScriptingStarted
+        void resourceGroupScriptingStarted(const String& groupName, size_t scriptCount);
+        /// @copydoc ResourceGroupListener::resourceGroupScriptingEnded
+        void resourceGroupScriptingEnded(const String& groupName);
+
+        void scriptParseStarted(const String& scriptName, bool& skipThisScript) {}
+        void scriptParseEnded(const String& scriptName, bool skipped) {}
+        void resourceGroupLoadStarted(const String& groupName, size_t resourceCount) {}
+        void resourceLoadStarted(const ResourcePtr& resource) {}
+        void resourceLoadEnded(void) {}
+        void worldGeometryStageStarted(const String& description) {}
+        void worldGeometryStageEnded(void) {}
+        void resourceGroupLoadEnded(const String& groupName) {}
+
+    protected:
+        /// Returns the OFS archives among the locations of a resource group
+        std::vector<OFSArchive*> getArchives(const String& groupName) const;
+    };
+
     /** Specialisation of DataStream to handle streaming data from ofs archives. */
     class PluginExport OfsDataStream : public DataStream
     {
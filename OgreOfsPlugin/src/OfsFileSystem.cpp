@@ -36,8 +36,7 @@
 #include "OgreException.h"
 #include "OgreStringVector.h"
 #include "OgreRoot.h"
-
-#include <boost/regex.hpp>
+#include "OgreScriptCompiler.h"
 
 namespace Ogre {
 
@@ -45,7 +44,7 @@ namespace Ogre {
 
     //-----------------------------------------------------------------------
     OFSArchive::OFSArchive(const String& name, const String& archType)
-        : Archive(name, archType)
+        : Archive(name, archType), mListingVersion(0), mFileSystemVersion(1)
     {
         int pos = name.find("::");
         mName = name;
@@ -61,6 +60,72 @@ namespace Ogre {
         return true;
     }
     //-----------------------------------------------------------------------
+    OfsGlobMatcher::OfsGlobMatcher(const String& pattern)
+    {
+        size_t start = 0;
+        size_t star;
+
+        while ((star = pattern.find('*', start)) != pattern.npos)
+        {
+            mParts.push_back(pattern.substr(start, star - start));
+            start = star + 1;
+        }
+
+        mParts.push_back(pattern.substr(start));
+    }
+    //-----------------------------------------------------------------------
+    bool OfsGlobMatcher::matchPart(const String& name, size_t pos, const String& part)
+    {
+        for (size_t i = 0; i < part.length(); i++)
+        {
+            if (part[i] != '?' && part[i] != name[pos + i])
+                return false;
+        }
+
+        return true;
+    }
+    //-----------------------------------------------------------------------
+    size_t OfsGlobMatcher::findPart(const String& name, size_t pos, size_t end, const String& part)
+    {
+        for (; pos + part.length() <= end; pos++)
+        {
+            if (matchPart(name, pos, part))
+                return pos;
+        }
+
+        return String::npos;
+    }
+    //-----------------------------------------------------------------------
+    bool OfsGlobMatcher::match(const String& name) const
+    {
+        const String& head = mParts.front();
+
+        if (mParts.size() == 1)
+            return name.length() == head.length() && matchPart(name, 0, head);
+
+        const String& tail = mParts.back();
+
+        if (head.length() + tail.length() > name.length())
+            return false;
+
+        size_t pos = head.length();
+        size_t end = name.length() - tail.length();
+
+        if (!matchPart(name, 0, head) || !matchPart(name, end, tail))
+            return false;
+
+        // Parts between stars are matched leftmost first, which never misses a match
+        for (size_t i = 1; i + 1 < mParts.size(); i++)
+        {
+            pos = findPart(name, pos, end, mParts[i]);
+            if (pos == String::npos)
+                return false;
+            pos += mParts[i].length();
+        }
+
+        return true;
+    }
+    //-----------------------------------------------------------------------
     static bool is_absolute_path(const char* path)
     {
         return path[0] == '/' || path[0] == '\\';
@@ -77,146 +142,125 @@ namespace Ogre {
     void OFSArchive::findFiles(const String& pattern, bool recursive, 
         bool dirs, StringVector* simpleList, FileInfoList* detailList) const
     {
+        OGRE_LOCK_AUTO_MUTEX;
+
         // pattern can contain a directory name, separate it from mask
-        size_t pos1 = pattern.rfind ('/');
-        size_t pos2 = pattern.rfind ('\\');
-        if (pos1 == pattern.npos || ((pos2 != pattern.npos) && (pos1 < pos2)))
-            pos1 = pos2;
         String directory;
-        if (pos1 != pattern.npos)
-            directory = pattern.substr (0, pos1 + 1);
+        String mask = pattern;
+        std::replace(mask.begin(), mask.end(), '\\', '/');
+
+        size_t pos = mask.rfind('/');
+        if (pos != mask.npos)
+        {
+            directory = mask.substr(0, pos + 1);
+            mask.erase(0, pos + 1);
+        }
+
+        GlobMatcherMap::iterator mit = mMatchers.find(mask);
+        if (mit == mMatchers.end())
+            mit = mMatchers.insert(GlobMatcherMap::value_type(mask, OfsGlobMatcher(mask))).first;
 
-        String full_pattern = concatenate_path(mDir, pattern);
-        String mod_pattern = pattern;
+        const OfsGlobMatcher& matcher = mit->second;
 
-        OFS::FileList retList = mOfs->listFiles(mDir.c_str(), OFS::OFS_FILE);
+        updateListing();
 
-        if(pattern == "*")
+        for (Listing::const_iterator it = mListing.begin(); it != mListing.end(); ++it)
         {
-            for(unsigned int i = 0;i < retList.size();i++)
+            if (dirs != ((it->flags & OFS::OFS_DIR) != 0))
+                continue;
+
+            if (ms_IgnoreHidden && (it->flags & OFS::OFS_HIDDEN))
+                continue;
+
+            if (recursive)
             {
-                if (simpleList)
-                {
-                    simpleList->push_back(directory + retList[i].name);
-                }
-                else if (detailList)
-                {
-                    FileInfo fi;
-                    fi.archive = (Archive*)this;
-                    fi.filename = directory + retList[i].name;
-                    fi.basename = retList[i].name;
-                    fi.path = directory;
-                    fi.compressedSize = retList[i].file_size;
-                    fi.uncompressedSize = retList[i].file_size;
-                    detailList->push_back(fi);
-                }
+                if (it->path.compare(0, directory.length(), directory) != 0)
+                    continue;
             }
-        }
-        else
-        {
-            if(mod_pattern[0] == '*')
-                mod_pattern = "." + mod_pattern;
+            else if (it->path != directory)
+                continue;
 
-            try
+            if (!matcher.match(it->basename))
+                continue;
+
+            if (simpleList)
             {
-                const boost::regex e(mod_pattern.c_str());
-
-                for(unsigned int i = 0;i < retList.size();i++)   
-                {
-                    if(regex_match(retList[i].name.c_str(), e))
-                    {
-                        if (simpleList)
-                        {
-                            simpleList->push_back(directory + retList[i].name);
-                        }
-                        else if (detailList)
-                        {
-                            FileInfo fi;
-                            fi.archive = (Archive*)this;
-                            fi.filename = directory + retList[i].name;
-                            fi.basename = retList[i].name;
-                            fi.path = directory;
-                            fi.compressedSize = retList[i].file_size;
-                            fi.uncompressedSize = retList[i].file_size;
-                            detailList->push_back(fi);
-                        }
-                    }
-                }
+                simpleList->push_back(it->path + it->basename);
             }
-            catch(...)
+            else if (detailList)
             {
+                FileInfo fi;
+                fi.archive = (Archive*)this;
+                fi.filename = it->path + it->basename;
+                fi.basename = it->basename;
+                fi.path = it->path;
+                fi.compressedSize = it->size;
+                fi.uncompressedSize = it->size;
+                detailList->push_back(fi);
             }
         }
-/*
-        lHandle = _findfirst(full_pattern.c_str(), &tagData);
-        res = 0;
-        while (lHandle != -1 && res != -1)
+    }
+    //-----------------------------------------------------------------------
+    void OFSArchive::updateListing() const
+    {
+        OGRE_LOCK_AUTO_MUTEX;
+
+        // Read the version first, a change during the rebuild makes the next call rebuild again
+        unsigned int version = mFileSystemVersion.get();
+
+        if (version == mListingVersion)
+            return;
+
+        mListing.clear();
+
+        if (mOfs.valid())
+            buildListing(mDir.empty() ? "/" : mDir + "/", "");
+
+        mListingVersion = version;
+    }
+    //-----------------------------------------------------------------------
+    void OFSArchive::buildListing(const String& path, const String& relative) const
+    {
+        OFS::FileList list = mOfs->listFiles(path.c_str(), OFS::OFS_FILE | OFS::OFS_DIR);
+
+        for (unsigned int i = 0; i < list.size(); i++)
         {
-            if ((dirs == ((tagData.attrib & _A_SUBDIR) != 0)) &&
-				( !ms_IgnoreHidden || (tagData.attrib & _A_HIDDEN) == 0 ) &&
-                (!dirs || !is_reserved_dir (tagData.name)))
-            {
-                if (simpleList)
-                {
-                    simpleList->push_back(directory + tagData.name);
-                }
-                else if (detailList)
-                {
-                    FileInfo fi;
-                    fi.archive = this;
-                    fi.filename = directory + tagData.name;
-                    fi.basename = tagData.name;
-                    fi.path = directory;
-                    fi.compressedSize = tagData.size;
-                    fi.uncompressedSize = tagData.size;
-                    detailList->push_back(fi);
-                }
-            }
-            res = _findnext( lHandle, &tagData );
+            ListingEntry entry;
+            entry.path = relative;
+            entry.basename = list[i].name;
+            entry.size = (size_t)list[i].file_size;
+            entry.flags = list[i].flags;
+
+            mListing.push_back(entry);
+
+            if (list[i].flags & OFS::OFS_DIR)
+                buildListing(path + list[i].name + "/", relative + list[i].name + "/");
         }
-        // Close if we found any files
-        if(lHandle != -1)
-            _findclose(lHandle);
+    }
+    //-----------------------------------------------------------------------
+    void OFSArchive::fileSystemChanged(void *userData, OFS::_OfsBase::OfsEntryDesc *desc, const char *arg)
+    {
+        OFSArchive *archive = static_cast<OFSArchive*>(userData);
 
-        // Now find directories
-        if (recursive)
-        {
-            String base_dir = mName;
-            if (!directory.empty ())
-            {
-                base_dir = concatenate_path(mName, directory);
-                // Remove the last '/'
-                base_dir.erase (base_dir.length () - 1);
-            }
-            base_dir.append ("/*");
+        // Called once the OFS operation is over, possibly from another thread, the listing is rebuilt on next use
+        ++(archive->mFileSystemVersion);
 
-            // Remove directory name from pattern
-            String mask ("/");
-            if (pos1 != pattern.npos)
-                mask.append (pattern.substr (pos1 + 1));
-            else
-                mask.append (pattern);
+        // Deletes and renames pass the old path, content changes the entry itself
+        if(arg != NULL)
+            archive->discardPrefetched(arg);
+        else if(desc != NULL)
+        {
+            String path = desc->Name;
+            for(OFS::_OfsBase::OfsEntryDesc *parent = desc->Parent; parent != NULL && parent->Parent != NULL; parent = parent->Parent)
+                path = parent->Name + "/" + path;
 
-            lHandle = _findfirst(base_dir.c_str (), &tagData);
-            res = 0;
-            while (lHandle != -1 && res != -1)
-            {
-                if ((tagData.attrib & _A_SUBDIR) &&
-					( !ms_IgnoreHidden || (tagData.attrib & _A_HIDDEN) == 0 ) &&
-                    !is_reserved_dir (tagData.name))
-                {
-                    // recurse
-                    base_dir = directory;
-                    base_dir.append (tagData.name).append (mask);
-                    findFiles(base_dir, recursive, dirs, simpleList, detailList);
-                }
-                res = _findnext( lHandle, &tagData );
-            }
-            // Close if we found any files
-            if(lHandle != -1)
-                _findclose(lHandle);
+            archive->discardPrefetched(path);
+        }
+        else
+        {
+            // A single notification standing for several changes
+            archive->clearPrefetched();
         }
-*/
     }
     //-----------------------------------------------------------------------
     OFSArchive::~OFSArchive()
@@ -241,14 +285,114 @@ namespace Ogre {
 			::remove(testPath.c_str());
 		}
 
-        mOfs.mount(mFileSystemName.c_str(), OFS::OFS_MOUNT_OPEN);
+        // Memory mapped reads are switched on the shared mount by whoever owns the file, see OfsPtr::setMemoryMapped
+        if(mOfs.mount(mFileSystemName.c_str(), OFS::OFS_MOUNT_OPEN) == OFS::OFS_OK)
+        {
+            mOfs->addTrigger(this, OFS::_OfsBase::CLBK_CREATE, &fileSystemChanged, this);
+            mOfs->addTrigger(this, OFS::_OfsBase::CLBK_DELETE, &fileSystemChanged, this);
+            mOfs->addTrigger(this, OFS::_OfsBase::CLBK_RENAME, &fileSystemChanged, this);
+            mOfs->addTrigger(this, OFS::_OfsBase::CLBK_CONTENT, &fileSystemChanged, this);
+        }
+
+        ++mFileSystemVersion;
     }
     //-----------------------------------------------------------------------
     void OFSArchive::unload()
     {
         OGRE_LOCK_AUTO_MUTEX;
 
+        clearPrefetched();
+
+        if(mOfs.valid())
+        {
+            mOfs->removeTrigger(this, OFS::_OfsBase::CLBK_CREATE);
+            mOfs->removeTrigger(this, OFS::_OfsBase::CLBK_DELETE);
+            mOfs->removeTrigger(this, OFS::_OfsBase::CLBK_RENAME);
+            mOfs->removeTrigger(this, OFS::_OfsBase::CLBK_CONTENT);
+        }
+
         mOfs.unmount();
+
+        mListing.clear();
+        ++mFileSystemVersion;
+    }
+    //-----------------------------------------------------------------------
+    void OFSArchive::clearPrefetched()
+    {
+        OGRE_LOCK_AUTO_MUTEX;
+
+        for(PrefetchMap::iterator it = mPrefetched.begin(); it != mPrefetched.end(); ++it)
+            OGRE_FREE(it->second.first, MEMCATEGORY_GENERAL);
+
+        mPrefetched.clear();
+    }
+    //-----------------------------------------------------------------------
+    void OFSArchive::discardPrefetched(const String& name) const
+    {
+        OGRE_LOCK_AUTO_MUTEX;
+
+        // OFS paths may be given with or without the leading '/'
+        String path = (!name.empty() && name[0] == '/') ? name.substr(1) : name;
+
+        PrefetchMap::iterator it = mPrefetched.begin();
+        while(it != mPrefetched.end())
+        {
+            const String& key = it->first;
+            size_t start = (!key.empty() && key[0] == '/') ? 1 : 0;
+
+            if(key.compare(start, path.length(), path) == 0 && (key.length() - start == path.length() || key[start + path.length()] == '/'))
+            {
+                OGRE_FREE(it->second.first, MEMCATEGORY_GENERAL);
+                mPrefetched.erase(it++);
+            }
+            else
+                ++it;
+        }
+    }
+    //-----------------------------------------------------------------------
+    void OFSArchive::prefetch(const StringVector& filenames)
+    {
+        OFS::ReadRequestList requests(filenames.size());
+
+        for(size_t i = 0; i < filenames.size(); ++i)
+        {
+            requests[i].Name = concatenate_path(mDir, filenames[i]);
+            std::replace(requests[i].Name.begin(), requests[i].Name.end(), '\\', '/');
+        }
+
+        // First pass only queries the sizes so buffers can be allocated
+        mOfs->readFiles(requests);
+
+        for(size_t i = 0; i < requests.size(); ++i)
+        {
+            if(requests[i].Result == OFS::OFS_OK && requests[i].FileSize > 0)
+            {
+                requests[i].BufferSize = (unsigned int)requests[i].FileSize;
+                requests[i].Buffer = (char*)OGRE_ALLOC_T(uchar, requests[i].BufferSize, MEMCATEGORY_GENERAL);
+            }
+        }
+
+        mOfs->readFiles(requests);
+
+        OGRE_LOCK_AUTO_MUTEX;
+
+        for(size_t i = 0; i < requests.size(); ++i)
+        {
+            if(requests[i].Buffer == NULL)
+                continue;
+
+            if(requests[i].Result != OFS::OFS_OK)
+            {
+                OGRE_FREE(requests[i].Buffer, MEMCATEGORY_GENERAL);
+                continue;
+            }
+
+            PrefetchMap::iterator it = mPrefetched.find(requests[i].Name);
+            if(it != mPrefetched.end())
+                OGRE_FREE(it->second.first, MEMCATEGORY_GENERAL);
+
+            mPrefetched[requests[i].Name] = std::make_pair((uchar*)requests[i].Buffer, (size_t)requests[i].BytesRead);
+        }
     }
     //-----------------------------------------------------------------------
     DataStreamPtr OFSArchive::open(const String& filename, bool readOnly) const
@@ -257,10 +401,28 @@ namespace Ogre {
 
         std::replace(name.begin(), name.end(), '\\', '/');
 
+        if(readOnly || isReadOnly())
+        {
+            OGRE_LOCK_AUTO_MUTEX;
+
+            PrefetchMap::iterator it = mPrefetched.find(name);
+            if(it != mPrefetched.end())
+            {
+                /// Hand the buffer over to the stream, it frees it on close
+                DataStreamPtr stream(OGRE_NEW MemoryDataStream(filename, it->second.first, it->second.second, true, true));
+                mPrefetched.erase(it);
+
+                return stream;
+            }
+        }
+
         unsigned int mode = OFS::OFS_READ;
 
 		if (!readOnly && !isReadOnly())
+        {
             mode |= OFS::OFS_WRITE;
+            discardPrefetched(name);
+        }
 
         OFS::OFSHANDLE *handle = new OFS::OFSHANDLE();
         OFS::OfsResult ret = mOfs->openFile(*handle, name.c_str(), mode);
@@ -293,6 +455,8 @@ namespace Ogre {
 
         std::replace(name.begin(), name.end(), '\\', '/');
 
+        discardPrefetched(name);
+
         OFS::OFSHANDLE *handle = new OFS::OFSHANDLE();
         OFS::OfsResult ret = mOfs->createFile(*handle, name.c_str());
 
@@ -324,6 +488,8 @@ namespace Ogre {
 
         std::replace(name.begin(), name.end(), '\\', '/');
 
+        discardPrefetched(name);
+
         mOfs->deleteFile(name.c_str());
 	}
     //-----------------------------------------------------------------------
@@ -476,4 +642,51 @@ namespace Ogre {
         return name;
     }
     //-----------------------------------------------------------------------
+    std::vector<OFSArchive*> OFSScriptPrefetcher::getArchives(const String& groupName) const
+    {
+        std::vector<OFSArchive*> archives;
+
+        const ResourceGroupManager::LocationList& locations = ResourceGroupManager::getSingleton().getResourceLocationList(groupName);
+
+        for(ResourceGroupManager::LocationList::const_iterator it = locations.begin(); it != locations.end(); ++it)
+        {
+            if((*it)->archive->getType() == "Ofs")
+                archives.push_back(static_cast<OFSArchive*>((*it)->archive));
+        }
+
+        return archives;
+    }
+    //-----------------------------------------------------------------------
+    void OFSScriptPrefetcher::resourceGroupScriptingStarted(const String& groupName, size_t scriptCount)
+    {
+        if(scriptCount == 0)
+            return;
+
+        std::vector<OFSArchive*> archives = getArchives(groupName);
+
+        const StringVector& patterns = ScriptCompilerManager::getSingleton().getScriptPatterns();
+
+        for(size_t i = 0; i < archives.size(); ++i)
+        {
+            StringVector filenames;
+
+            for(StringVector::const_iterator p = patterns.begin(); p != patterns.end(); ++p)
+            {
+                StringVectorPtr found = archives[i]->find(*p);
+                filenames.insert(filenames.end(), found->begin(), found->end());
+            }
+
+            if(!filenames.empty())
+                archives[i]->prefetch(filenames);
+        }
+    }
+    //-----------------------------------------------------------------------
+    void OFSScriptPrefetcher::resourceGroupScriptingEnded(const String& groupName)
+    {
+        std::vector<OFSArchive*> archives = getArchives(groupName);
+
+        for(size_t i = 0; i < archives.size(); ++i)
+            archives[i]->clearPrefetched();
+    }
+    //-----------------------------------------------------------------------
 }
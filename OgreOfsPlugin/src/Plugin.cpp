@@ -60,6 +60,7 @@ namespace Ogre
 		void uninstall();
 	protected:
 		OFSArchiveFactory* mOFSArchiveFactory;
+		OFSScriptPrefetcher* mOFSScriptPrefetcher;
 
 
 	};
@@ -71,7 +72,7 @@ namespace Ogre
 	const String sPluginName = "OFS Archive";
 	//---------------------------------------------------------------------
 	OFSPlugin::OFSPlugin()
-		:mOFSArchiveFactory(0)
+		:mOFSArchiveFactory(0), mOFSScriptPrefetcher(0)
 	{
 
 	}
@@ -87,6 +88,10 @@ namespace Ogre
 		mOFSArchiveFactory = OGRE_NEW OFSArchiveFactory();
 		// Register
         ArchiveManager::getSingletonPtr()->addArchiveFactory(mOFSArchiveFactory);
+
+		// Scripts of OFS locations are read in one batch when a resource group is initialised
+		mOFSScriptPrefetcher = new OFSScriptPrefetcher();
+		ResourceGroupManager::getSingletonPtr()->addResourceGroupListener(mOFSScriptPrefetcher);
 	}
 	//---------------------------------------------------------------------
 	void OFSPlugin::initialise()
@@ -101,6 +106,13 @@ namespace Ogre
 	//---------------------------------------------------------------------
 	void OFSPlugin::uninstall()
 	{
+        if (mOFSScriptPrefetcher)
+        {
+		    ResourceGroupManager::getSingletonPtr()->removeResourceGroupListener(mOFSScriptPrefetcher);
+		    delete mOFSScriptPrefetcher;
+		    mOFSScriptPrefetcher = 0;
+        }
+
         if (mOFSArchiveFactory)
         {
 		    OGRE_DELETE mOFSArchiveFactory;
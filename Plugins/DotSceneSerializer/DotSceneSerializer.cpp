@@ -31,6 +31,7 @@
 //////////////////////////////////////////////////////////////////////////////////
 
 #include "DotSceneSerializer.h"
+#include "OgitorsXmlPullReader.h"
 #include "ofs.h"
 
 using namespace Ogitors;
@@ -165,15 +166,38 @@ int CDotSceneSerializer::Import(Ogre::String importfile)
     if(typepos != -1)
         pOpt->ProjectName.erase(typepos,pOpt->ProjectName.length() - typepos);
 
-    TiXmlDocument docImport((filePath + fileName).c_str());
+    // The file is streamed twice, the first pass keeps everything but the nodes as a DOM,
+    // the second one creates the nodes one top level node at a time (see ReadNodes)
+    XmlPullFileSource source(filePath + fileName);
+    if(!source.isOpen()) return SCF_ERRFILE;
 
-    if(!docImport.LoadFile()) return SCF_ERRFILE;
+    XmlPullReader reader(&source);
+    if(reader.next() != XmlPullReader::EVENT_START_ELEMENT || reader.getName() != "scene")
+        return SCF_ERRFILE;
 
-    TiXmlElement* element = 0;
-    element = docImport.FirstChildElement("scene");
-    if(!element)
+    TiXmlElement sceneElement("scene");
+    for(unsigned int i = 0; i < reader.getAttributeCount(); i++)
+        sceneElement.SetAttribute(reader.getAttributeName(i).c_str(), reader.getAttributeValue(i).c_str());
+
+    bool hasNodes = false;
+    while(reader.nextChild(1))
+    {
+        if(reader.getName() == "nodes")
+        {
+            hasNodes = true;
+            continue;
+        }
+
+        TiXmlElement* child = reader.readElement();
+        if(child)
+            sceneElement.LinkEndChild(child);
+    }
+
+    if(reader.getEvent() == XmlPullReader::EVENT_ERROR)
         return SCF_ERRFILE;
 
+    TiXmlElement* element = &sceneElement;
+
     float version = Ogre::StringConverter::parseReal(ValidAttr(element->Attribute("formatVersion")));
     if(version != 1.0f)
     {
@@ -222,7 +246,7 @@ int CDotSceneSerializer::Import(Ogre::String importfile)
 
     Ogre::String ofs_file_name = OgitorsUtils::QualifyPath(filePath + "/" + pOpt->ProjectName + ".ofs");
     
-    if(ofsFile.mount(ofs_file_name.c_str(), OFS::OFS_MOUNT_CREATE) != OFS::OFS_OK)
+    if(ofsFile.mount(ofs_file_name.c_str(), OFS::OFS_MOUNT_CREATE | OFS::OFS_MOUNT_DEDUP) != OFS::OFS_OK)
         return SCF_ERRFILE;
 
     OgitorsUtils::CopyDirOfs(filePath, "/");
@@ -337,69 +361,114 @@ int CDotSceneSerializer::Import(Ogre::String importfile)
         otherElems = otherElems->NextSiblingElement("light");
     }
 
-    element = element->FirstChildElement("nodes");
+    if(hasNodes)
+    {
+        int ret = ReadNodes(filePath + fileName, mngred);
+        if(ret != SCF_OK)
+            return ret;
+    }
 
-    RecurseReadObjects(element, mngred);
     ogRoot->AfterLoadScene();
     ogRoot->GetViewport()->getCameraEditor()->setClipDistance(vClipping);
     return SCF_OK;
 }
 //----------------------------------------------------------------------------
+int CDotSceneSerializer::ReadNodes(const Ogre::String& filename, CBaseEditor* parentobject)
+{
+    XmlPullFileSource source(filename);
+    if(!source.isOpen()) return SCF_ERRFILE;
+
+    XmlPullReader reader(&source);
+    if(reader.next() != XmlPullReader::EVENT_START_ELEMENT)
+        return SCF_ERRFILE;
+
+    // Only the first nodes element is read, each of its children is built as a DOM on its own
+    while(reader.nextChild(1))
+    {
+        if(reader.getName() != "nodes")
+            continue;
+
+        while(reader.nextChild(2))
+        {
+            TiXmlElement* element = reader.readElement();
+            if(!element)
+                break;
+
+            int ret = ReadObject(element, parentobject);
+            delete element;
+
+            if(ret != SCF_OK)
+                return ret;
+        }
+        break;
+    }
+
+    if(reader.getEvent() == XmlPullReader::EVENT_ERROR)
+        return SCF_ERRFILE;
+
+    return SCF_OK;
+}
+//----------------------------------------------------------------------------
 int CDotSceneSerializer::RecurseReadObjects(TiXmlElement *parentelement,CBaseEditor* parentobject)
 {
-    CBaseEditor *newobj;
     TiXmlElement* element = 0;
-    Ogre::String eType;
     element = parentelement->FirstChildElement();
     if(!element) return SCF_OK;
     do
     {
-        newobj = 0;
-        eType = element->Value();
-        if(eType == "node") 
-        {
-            ReadSceneNode(element, parentobject, &newobj);
-            int ret = RecurseReadObjects(element, newobj);
-            
-            if(ret != SCF_OK) 
-                return ret;
+        int ret = ReadObject(element, parentobject);
 
-            NameObjectPairList& childlist = newobj->getChildren();
-            if(childlist.size() == 1)
-            {
-                CBaseEditor *childobj = childlist.begin()->second;
-                childobj->setParent(newobj->getParent());
-                OgitorsPropertyValueMap vmapn = newobj->getProperties()->getValueMap();
-                OgitorsPropertyValueMap vmapo;
-
-                OgitorsPropertyValueMap::iterator vit;
-
-                vit = vmapn.find("autotracktarget");
-                vmapo.insert(OgitorsPropertyValueMap::value_type(vit->first, vit->second));
-                vit = vmapn.find("position");
-                vmapo.insert(OgitorsPropertyValueMap::value_type(vit->first, vit->second));
-                vit = vmapn.find("scale");
-                vmapo.insert(OgitorsPropertyValueMap::value_type(vit->first, vit->second));
-                vit = vmapn.find("orientation");
-                vmapo.insert(OgitorsPropertyValueMap::value_type(vit->first, vit->second));
-
-                OgitorsRoot::getSingletonPtr()->DestroyEditorObject(newobj);
-                newobj = childobj;
-                childobj->getProperties()->setValueMap(vmapo);
-            }
-        }
-        else if(eType == "entity") ReadEntity(element, parentobject, &newobj);
-        else if(eType == "subentities") ReadSubEntity(element, parentobject, &newobj);
-        else if(eType == "light") ReadLight(element, parentobject, &newobj);
-        else if(eType == "camera") ReadCamera(element, parentobject, &newobj);
-        else if(eType == "particle") ReadParticle(element, parentobject, &newobj);
-        else if(eType == "plane") ReadPlane(element, parentobject, &newobj);
-        else 
-            continue;
+        if(ret != SCF_OK) 
+            return ret;
     } while(element = element->NextSiblingElement());
     return SCF_OK;
 }
 //----------------------------------------------------------------------------
+int CDotSceneSerializer::ReadObject(TiXmlElement *element, CBaseEditor* parentobject)
+{
+    CBaseEditor *newobj = 0;
+    Ogre::String eType = element->Value();
+    if(eType == "node") 
+    {
+        ReadSceneNode(element, parentobject, &newobj);
+        int ret = RecurseReadObjects(element, newobj);
+        
+        if(ret != SCF_OK) 
+            return ret;
+
+        NameObjectPairList& childlist = newobj->getChildren();
+        if(childlist.size() == 1)
+        {
+            CBaseEditor *childobj = childlist.begin()->second;
+            childobj->setParent(newobj->getParent());
+            OgitorsPropertyValueMap vmapn = newobj->getProperties()->getValueMap();
+            OgitorsPropertyValueMap vmapo;
+
+            OgitorsPropertyValueMap::iterator vit;
+
+            vit = vmapn.find("autotracktarget");
+            vmapo.insert(OgitorsPropertyValueMap::value_type(vit->first, vit->second));
+            vit = vmapn.find("position");
+            vmapo.insert(OgitorsPropertyValueMap::value_type(vit->first, vit->second));
+            vit = vmapn.find("scale");
+            vmapo.insert(OgitorsPropertyValueMap::value_type(vit->first, vit->second));
+            vit = vmapn.find("orientation");
+            vmapo.insert(OgitorsPropertyValueMap::value_type(vit->first, vit->second));
+
+            OgitorsRoot::getSingletonPtr()->DestroyEditorObject(newobj);
+            newobj = childobj;
+            childobj->getProperties()->setValueMap(vmapo);
+        }
+    }
+    else if(eType == "entity") ReadEntity(element, parentobject, &newobj);
+    else if(eType == "subentities") ReadSubEntity(element, parentobject, &newobj);
+    else if(eType == "light") ReadLight(element, parentobject, &newobj);
+    else if(eType == "camera") ReadCamera(element, parentobject, &newobj);
+    else if(eType == "particle") ReadParticle(element, parentobject, &newobj);
+    else if(eType == "plane") ReadPlane(element, parentobject, &newobj);
+    return SCF_OK;
+}
+//----------------------------------------------------------------------------
 int CDotSceneSerializer::ReadSceneNode(TiXmlElement *element, CBaseEditor *parent, CBaseEditor **ret)
 {
     OgitorsPropertyValueMap params;
@@ -61,7 +61,9 @@ namespace Ogitors
         /// The function to Import Data
         virtual int  Import(Ogre::String importfile = "");
     protected:
+        int ReadNodes(const Ogre::String& filename, CBaseEditor* parentobject);
         int RecurseReadObjects(TiXmlElement *parentelement,CBaseEditor* parentobject);
+        int ReadObject(TiXmlElement *element, CBaseEditor* parentobject);
 
         int ReadSceneNode(TiXmlElement *element, CBaseEditor *parent, CBaseEditor **ret);
         int ReadEntity(TiXmlElement *element, CBaseEditor *parent, CBaseEditor **ret);
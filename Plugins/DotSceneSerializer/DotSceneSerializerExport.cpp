@@ -38,75 +38,37 @@ using namespace Ogitors;
 //----------------------------------------------------------------------------
 void extractOFS(Ogre::String path)
 {
-    unsigned int MAX_BUFFER_SIZE = 16 * 1024 * 1024;
-
-    char *tmp_buffer = new char[MAX_BUFFER_SIZE];
-
     OFS::OfsPtr& ofsFile = OgitorsRoot::getSingletonPtr()->GetProjectFile();
 
     OFS::FileList list;
 
     ofsFile->listFilesRecursive("/", list);
 
-    std::sort(list.begin(), list.end(), OFS::FileEntry::Compare);
+    // Files left over from a previous export with the same size and time are not written again
+    OFS::ExtractRequestList requests;
+    requests.reserve(list.size());
 
-    std::ofstream out_handle;
-    OFS::OFSHANDLE in_handle;
+    const Ogre::String& segmentDir = Globals::OGSCENE_SEGMENT_DIRECTORY;
 
     for(unsigned int i = 0;i < list.size();i++)
     {
-        std::string file_path = path + list[i].name;
-
-        if(list[i].flags & OFS::OFS_DIR)
-        {
-            OgitorsSystem::getSingletonPtr()->MakeDirectory(file_path);
-        }
-        else
-        {
-            std::string file_ofs_path = list[i].name;
-
-            out_handle.open(file_path.c_str(), std::ofstream::out | std::ofstream::binary);
-
-            if(out_handle.is_open())
-            {
-                try
-                {
-                    OFS::OfsResult ret = ofsFile->openFile(in_handle, file_ofs_path.c_str());
-                    if(ret != OFS::OFS_OK)
-                    {
-                        out_handle.close();
-                        continue;
-                    }
-
-                    unsigned int total = list[i].file_size;
-
-                    while(total > 0)
-                    {
-                        if(total < MAX_BUFFER_SIZE)
-                        {
-                            ofsFile->read(in_handle, tmp_buffer, total);
-                            out_handle.write(tmp_buffer, total);
-                            total = 0;
-                        }
-                        else
-                        {
-                            ofsFile->read(in_handle, tmp_buffer, MAX_BUFFER_SIZE);
-                            out_handle.write(tmp_buffer, MAX_BUFFER_SIZE);
-                            total -= MAX_BUFFER_SIZE;
-                        }
-                    }
-                }
-                catch(OFS::Exception&)
-                {
-                }
-
-                out_handle.close();
-                ofsFile->closeFile(in_handle);
-            }
-        }
+        // Ogitor scene segments are of no use outside of the project
+        if((list[i].name + "/").compare(0, segmentDir.size(), segmentDir) == 0)
+            continue;
+
+        OFS::ExtractRequest request;
+        request.Name = list[i].name;
+        request.DestPath = path + list[i].name;
+        requests.push_back(request);
     }
 
-    delete [] tmp_buffer;
+    try
+    {
+        ofsFile->extractFiles(requests);
+    }
+    catch(OFS::Exception&)
+    {
+    }
 }
 //----------------------------------------------------------------------------
 void saveUserData(OgitorsCustomPropertySet *set, TiXmlElement *pParent)
@@ -159,6 +121,7 @@ int CDotSceneSerializer::Export(bool SaveAs, Ogre::String exportfile)
 
     extractOFS(newDir);
     mSystem->DeleteFile(newDir + "/" + pOpt->ProjectName + Globals::OGSCENE_FORMAT_EXTENSION);
+    mSystem->DeleteFile(newDir + "/" + pOpt->ProjectName + Globals::OGSCENE_BINARY_EXTENSION);
 
     TiXmlDocument *pXMLDoc = new TiXmlDocument();
     pXMLDoc->InsertEndChild(TiXmlDeclaration("1.0", "UTF-8", ""));
@@ -92,11 +92,13 @@ private:
     float currentPos;
     QMutex mutex;
     OFS::ofs64 mTotalFileSize;
+    OFS::ofs64 mOutputAmount;
     QString msgProgress;
 
     void run();
     OFS::ofs64 generateList(OFS::FileList& list);
     void extractFiles(QString path, const OFS::FileList& list);
+    static void extractCallback(void *userData, const OFS::ExtractRequest& request);
 };
 //-----------------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------
@@ -141,11 +143,13 @@ private:
     float currentPos;
     QMutex mutex;
     OFS::ofs64 mTotalFileSize;
+    OFS::ofs64 mOutputAmount;
     QString msgProgress;
 
     void run();
     OFS::ofs64 generateList(AddFilesList& list);
     void addFiles(const AddFilesList& list);
+    static void importCallback(void *userData, const OFS::ImportRequest& request);
 };
 //-----------------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------
@@ -39,9 +39,6 @@
 
 MainWindow *mOfsMainWindow = 0;
 
-const unsigned int MAX_BUFFER_SIZE = 1024 * 1024 * 16; // 16 MB
-char tmp_buffer[MAX_BUFFER_SIZE];
-
 //------------------------------------------------------------------------------
 bool AddFilesListCompare ( AddFilesData elem1, AddFilesData elem2 )
 {
@@ -710,86 +707,30 @@ void ExtractThread::extract(const OFS::OfsPtr& _ofsFile, const std::string& _cur
 //------------------------------------------------------------------------------------
 void ExtractThread::extractFiles(QString path, const OFS::FileList& list)
 {
-    std::ofstream out_handle;
-    OFS::OFSHANDLE in_handle;
-
-    unsigned int output_amount = 0;
-
     mutex.lock();
     currentPos = 0.0f; 
     msgProgress = "";
     mutex.unlock();
 
-    for(unsigned int i = 0;i < list.size();i++)
-    {
-        if(list[i].flags & OFS::OFS_DIR)
-        {
-            QString dir_path = path + QString("/") + QString(list[i].name.c_str());
-            QDir directory(dir_path);
-            directory.mkpath(dir_path);
-        }
-        else
-        {
-            std::string file_path = path.toStdString() + std::string("/") + list[i].name;
-            std::string file_ofs_path = list[i].name;
-
-            QFileInfo info(QString(file_path.c_str()));
-            QDir directory(info.absolutePath());
-            directory.mkpath(info.absolutePath());
+    mOutputAmount = 0;
 
-            mutex.lock();
-            msgProgress = file_ofs_path.c_str();
-            mutex.unlock();
+    // OFS reads the files in the order they are stored and writes them out on several
+    // threads, files already extracted with the same size and time are skipped
+    OFS::ExtractRequestList requests(list.size());
 
-            out_handle.open(file_path.c_str(), std::ofstream::out | std::ofstream::binary);
-
-            if(out_handle.is_open())
-            {
-                try
-                {
-                    OFS::OfsResult ret = ofsFile->openFile(in_handle, file_ofs_path.c_str());
-                    if(ret != OFS::OFS_OK)
-                    {
-                        out_handle.close();
-                        continue;
-                    }
-
-                    unsigned int total = list[i].file_size;
-
-                    while(total > 0)
-                    {
-                        if(total < MAX_BUFFER_SIZE)
-                        {
-                            ofsFile->read(in_handle, tmp_buffer, total);
-                            out_handle.write(tmp_buffer, total);
-                            output_amount += total;
-                            total = 0;
-                        }
-                        else
-                        {
-                            ofsFile->read(in_handle, tmp_buffer, MAX_BUFFER_SIZE);
-                            out_handle.write(tmp_buffer, MAX_BUFFER_SIZE);
-                            total -= MAX_BUFFER_SIZE;
-                            output_amount += MAX_BUFFER_SIZE;
-                        }
-
-                        if(mTotalFileSize > 0)
-                        {
-                            mutex.lock();
-                            currentPos = (float)output_amount / (float)mTotalFileSize; 
-                            mutex.unlock();
-                        }
-                    }
-                }
-                catch(OFS::Exception& e)
-                {
-                    QMessageBox::information(QApplication::activeWindow(),"Ofs Exception:", tr("Error Extracting File : ") + QString(file_ofs_path.c_str()) + QString("\n") + QString(e.getDescription().c_str()), QMessageBox::Ok);
-                }
+    for(unsigned int i = 0;i < list.size();i++)
+    {
+        requests[i].Name = list[i].name;
+        requests[i].DestPath = path.toStdString() + std::string("/") + list[i].name;
+    }
 
-                out_handle.close();
-                ofsFile->closeFile(in_handle);
-            }
-        }
+    try
+    {
+        ofsFile->extractFiles(requests, 0, &ExtractThread::extractCallback, this);
+    }
+    catch(OFS::Exception& e)
+    {
+        QMessageBox::information(QApplication::activeWindow(),"Ofs Exception:", QString(e.getDescription().c_str()), QMessageBox::Ok);
     }
 
     mutex.lock();
@@ -798,6 +739,22 @@ void ExtractThread::extractFiles(QString path, const OFS::FileList& list)
     mutex.unlock();
 }
 //------------------------------------------------------------------------------------
+void ExtractThread::extractCallback(void *userData, const OFS::ExtractRequest& request)
+{
+    ExtractThread *thread = static_cast<ExtractThread*>(userData);
+
+    if(request.Result != OFS::OFS_OK && request.Result != OFS::OFS_FILE_NOT_FOUND)
+        QMessageBox::information(QApplication::activeWindow(),"Ofs Exception:", tr("Error Extracting File : ") + QString(request.Name.c_str()), QMessageBox::Ok);
+
+    thread->mOutputAmount += request.FileSize;
+
+    thread->mutex.lock();
+    thread->msgProgress = request.Name.c_str();
+    if(thread->mTotalFileSize > 0)
+        thread->currentPos = (float)thread->mOutputAmount / (float)thread->mTotalFileSize; 
+    thread->mutex.unlock();
+}
+//------------------------------------------------------------------------------------
 OFS::ofs64 ExtractThread::generateList(OFS::FileList& list)
 {
     unsigned int list_max = list.size();
@@ -870,154 +827,32 @@ void AddFilesThread::addFiles(const OFS::OfsPtr& _ofsFile, const std::string& _c
 //------------------------------------------------------------------------------------
 void AddFilesThread::addFiles(const AddFilesList& list)
 {
-    OFS::OFSHANDLE fhandle;
-
-    unsigned int output_amount = 0;
-
     mutex.lock();
     currentPos = 0.0f; 
     msgProgress = "";
     mutex.unlock();
 
-    // Handle the dropped items
+    mOutputAmount = 0;
+
+    // The whole list is handed to OFS at once, it reads the files on several threads
+    // and reports back through importCallback as each one is stored
+    OFS::ImportRequestList requests(list.size());
+
     for(unsigned int i = 0; i < list.size(); ++i)
     {
         if(!list[i].isDir)
-        {
-            QString path = list[i].fileName;
-            
-            std::string file_ofs_path = list[i].ofsName.toStdString();
-            
-            mutex.lock();
-            msgProgress = file_ofs_path.c_str();
-            mutex.unlock();
+            requests[i].SourcePath = list[i].fileName.toStdString();
 
-            std::ifstream stream;
-            stream.open(path.toStdString().c_str(), std::fstream::in | std::fstream::binary);
-            
-            if(stream.is_open())
-            {
-                stream.seekg(0, std::fstream::end);
-                unsigned int stream_size = stream.tellg();
-
-                stream.seekg(0, std::fstream::beg);
- 
-                if(stream_size >= MAX_BUFFER_SIZE)
-                {
-                    //createFile accepts initial data to be written during allocation
-                    //its an optimization, thats why we don't have to call Ofs:write after createFile
-                    stream.read(tmp_buffer, MAX_BUFFER_SIZE);
-                    try
-                    {
-                        if(ofsFile->createFile(fhandle, file_ofs_path.c_str(), MAX_BUFFER_SIZE, MAX_BUFFER_SIZE, tmp_buffer) != OFS::OFS_OK)
-                        {
-                            stream.close();
-                            continue;
-                        }
-
-                        stream_size -= MAX_BUFFER_SIZE;
-                        output_amount += MAX_BUFFER_SIZE;
-                    }
-                    catch(OFS::Exception& e)
-                    {
-                        QMessageBox::information(QApplication::activeWindow(),"Ofs Exception:", QString(e.getDescription().c_str()), QMessageBox::Ok);
-                        stream.close();
-                        continue;
-                    }
-
-                    if(mTotalFileSize > 0)
-                    {
-                        mutex.lock();
-                        currentPos = (float)output_amount / (float)mTotalFileSize; 
-                        mutex.unlock();
-                    }
-
-                    try
-                    {
-                        while(stream_size > 0)
-                        {
-                            if(stream_size >= MAX_BUFFER_SIZE)
-                            {
-                                stream.read(tmp_buffer, MAX_BUFFER_SIZE);
-                                ofsFile->write(fhandle, tmp_buffer, MAX_BUFFER_SIZE);
-                                stream_size -= MAX_BUFFER_SIZE;
-                                output_amount += MAX_BUFFER_SIZE;
-                            }
-                            else
-                            {
-                                stream.read(tmp_buffer, stream_size);
-                                ofsFile->write(fhandle, tmp_buffer, stream_size);
-                                output_amount += stream_size;
-                                stream_size = 0;
-                            }
-
-                            if(mTotalFileSize > 0)
-                            {
-                                mutex.lock();
-                                currentPos = (float)output_amount / (float)mTotalFileSize; 
-                                mutex.unlock();
-                            }
-                        }
-                    }
-                    catch(OFS::Exception& e)
-                    {
-                        QMessageBox::information(QApplication::activeWindow(),"Ofs Exception:", QString(e.getDescription().c_str()), QMessageBox::Ok);
-                    }
-
-                    stream.close();
-                    ofsFile->closeFile(fhandle);
-                }
-                else
-                {
-                    stream.read(tmp_buffer, stream_size);
-
-                    try
-                    {
-                        output_amount += stream_size;
-                        if(mTotalFileSize > 0)
-                        {
-                            mutex.lock();
-                            currentPos = (float)output_amount / (float)mTotalFileSize; 
-                            mutex.unlock();
-                        }
-                        //createFile accepts initial data to be written during allocation
-                        //its an optimization, thats why we don't have to call Ofs::write after createFile
-                        if(ofsFile->createFile(fhandle, file_ofs_path.c_str(), stream_size, stream_size, tmp_buffer) != OFS::OFS_OK)
-                        {
-                            QMessageBox::information(QApplication::activeWindow(), "File Copy Error", tr("File copy failed for: ") + QString(file_ofs_path.c_str()), QMessageBox::Ok);
-                            stream.close();
-                            continue;
-                        }
-                    }
-                    catch(OFS::Exception& e)
-                    {
-                        QMessageBox::information(QApplication::activeWindow(), "Ofs Exception:", QString(e.getDescription().c_str()), QMessageBox::Ok);
-                    }
-
-                    stream.close();
-                    ofsFile->closeFile(fhandle);
-                }
-            }
-        }
-        else
-        {
-            std::string dir_ofs_path = list[i].ofsName.toStdString();
+        requests[i].Name = list[i].ofsName.toStdString();
+    }
 
-            try
-            {
-                OFS::OfsResult ret = ofsFile->createDirectory(dir_ofs_path.c_str());
-                if(ret != OFS::OFS_OK)
-                {
-                    QMessageBox::information(QApplication::activeWindow(), "Ofs Exception:", tr("Cannot create directory: ") + QString(dir_ofs_path.c_str()), QMessageBox::Ok);
-                    continue;
-                }
-            }
-            catch(OFS::Exception& e)
-            {
-                QMessageBox::information(QApplication::activeWindow(), "Ofs Exception:", tr("Cannot create directory: ") + QString(dir_ofs_path.c_str()) + QString("\n") + QString(e.getDescription().c_str()), QMessageBox::Ok);
-                continue;
-            }
-        }
+    try
+    {
+        ofsFile->importFiles(requests, 0, &AddFilesThread::importCallback, this);
+    }
+    catch(OFS::Exception& e)
+    {
+        QMessageBox::information(QApplication::activeWindow(),"Ofs Exception:", QString(e.getDescription().c_str()), QMessageBox::Ok);
     }
 
     mutex.lock();
@@ -1025,6 +860,30 @@ void AddFilesThread::addFiles(const AddFilesList& list)
     mutex.unlock();
 }
 //------------------------------------------------------------------------------------
+void AddFilesThread::importCallback(void *userData, const OFS::ImportRequest& request)
+{
+    AddFilesThread *thread = static_cast<AddFilesThread*>(userData);
+
+    if(request.SourcePath.empty())
+    {
+        if(request.Result != OFS::OFS_OK)
+            QMessageBox::information(QApplication::activeWindow(), "Ofs Exception:", tr("Cannot create directory: ") + QString(request.Name.c_str()), QMessageBox::Ok);
+
+        return;
+    }
+
+    if(request.Result != OFS::OFS_OK && request.Result != OFS::OFS_FILE_NOT_FOUND)
+        QMessageBox::information(QApplication::activeWindow(), "File Copy Error", tr("File copy failed for: ") + QString(request.Name.c_str()), QMessageBox::Ok);
+
+    thread->mOutputAmount += request.FileSize;
+
+    thread->mutex.lock();
+    thread->msgProgress = request.Name.c_str();
+    if(thread->mTotalFileSize > 0)
+        thread->currentPos = (float)thread->mOutputAmount / (float)thread->mTotalFileSize; 
+    thread->mutex.unlock();
+}
+//------------------------------------------------------------------------------------
 OFS::ofs64 AddFilesThread::generateList(AddFilesList& list)
 {
     unsigned int list_max = list.size();
@@ -37,6 +37,7 @@
 #include <QtWidgets/QTreeWidget>
 #include <QtCore/QThread>
 #include <QtCore/QMutex>
+#include <QtCore/QTimer>
 
 #include "ofs.h"
 
@@ -72,13 +73,13 @@ private:
     float currentPos;
     QMutex mutex;
     unsigned int mTotalFileSize;
+    unsigned int mOutputAmount;
     QString msgProgress;
 
-    char *tmp_buffer;
-
     void run();
     unsigned int generateList(OFS::FileList& list);
     void extractFiles(QString path, const OFS::FileList& list);
+    static void extractCallback(void *userData, const OFS::ExtractRequest& request);
 };
 //-----------------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------
@@ -131,13 +132,13 @@ private:
     float currentPos;
     QMutex mutex;
     unsigned int mTotalFileSize;
+    unsigned int mOutputAmount;
     QString msgProgress;
 
-    char *tmp_buffer;
-
     void run();
     unsigned int generateList(AddFilesList& list);
     void addFiles(const AddFilesList& list);
+    static void importCallback(void *userData, const OFS::ImportRequest& request);
 };
 //-----------------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------
@@ -172,6 +173,7 @@ public Q_SLOTS:
     void onItemCollapsed(QTreeWidgetItem * item);
     void onItemExpanded(QTreeWidgetItem * item);
     void threadFinished();
+    void onTriggerTimer();
 
 Q_SIGNALS:
     void busyState(bool state);
@@ -187,6 +189,7 @@ protected:
     AddFilesThread   *mAddFilesThread;
     ExtractorThread  *mExtractorThread;
     QTreeWidgetItem  *mRecycleBinParent;
+    QTimer           *mTriggerTimer;
 
     void dragEnterEvent(QDragEnterEvent *evt);
     void dragMoveEvent(QDragMoveEvent *evt);
@@ -40,6 +40,7 @@
 #include <QtWidgets/QAction>
 #include <QtWidgets/QTreeWidgetItem>
 #include <QtWidgets/QToolBar>
+#include <QtCore/QTimer>
 
 class OfsTreeWidget;
 
@@ -93,6 +94,7 @@ public Q_SLOTS:
 	void onSelectionChanged();
     void onEmptyRecycleBin();
     void onRestoreFromRecycleBin();
+    void onCompactTimer();
 
 Q_SIGNALS:
     void needUpdate();
@@ -120,6 +122,9 @@ protected:
     QAction*        mActEmptyRecycleBin;
     QAction*        mActRestoreFromRecycleBin;
 
+    QTimer*         mCompactTimer;
+    qint64          mCompactBytesMoved;
+
     void modifyStats( selectStats& stats, QTreeWidgetItem* item);
 };
 
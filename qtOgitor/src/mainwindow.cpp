@@ -1688,58 +1688,10 @@ void MainWindow::onSelectionChange(Ogitors::IEvent* evt)
 //------------------------------------------------------------------------------------
 void MainWindow::autoSaveScene()
 {
-    bool modified = OgitorsRoot::getSingletonPtr()->IsSceneModified();
-
-    // Build new file name
-    QDateTime current = QDateTime::currentDateTime();
-    QString exportfile = OgitorsRoot::getSingletonPtr()->GetProjectOptions()->AutoBackupFolder.c_str();
-    exportfile.append(QDir::separator());
-    exportfile.append(OgitorsRoot::getSingletonPtr()->GetProjectOptions()->ProjectName.c_str());
-    exportfile.append(current.toString("_yyyy_MM_dd_HH_mm"));
-
-    // Limited number of backups -> count current and delete one if needed
-    if(OgitorsRoot::getSingletonPtr()->GetProjectOptions()->AutoBackupNumber != 0)
-    {
-        QDir dir = QDir(OgitorsRoot::getSingletonPtr()->GetProjectOptions()->AutoBackupFolder.c_str());
-        QFileInfoList fileList = dir.entryInfoList();
-        QFileInfoList fileListBackup = QFileInfoList();
-        QString regexString = OgitorsRoot::getSingletonPtr()->GetProjectOptions()->ProjectName.c_str();
-        regexString.append("{1}\\S*ofs{1}");
-        QRegExp regex = QRegExp(regexString);
-
-        for(int i = 0; i < fileList.size(); i++)
-        {
-            if(regex.exactMatch(fileList[i].fileName()))
-                fileListBackup.append(fileList[i]);
-        }
-
-        // Got the find the oldest file and get rid of it.
-        // To ensure all is correct, the creation dates of the files are compared,
-        // although in most (if not any) cases, the first file of the fileListBackup will be
-        // the one that was created first, since those file names are usually sorted by their names
-        // and the backup date and time is encoded in the file name itself.
-        if(fileListBackup.size() >= OgitorsRoot::getSingletonPtr()->GetProjectOptions()->AutoBackupNumber)
-        {
-            QDateTime oldestDateTime = fileListBackup[0].created();
-            QString oldestFilePath = fileListBackup[0].filePath();
-
-            for(int i = 0; i < fileListBackup.size(); i++)
-                if(fileListBackup[i].created().toTime_t() < oldestDateTime.toTime_t())
-                {
-                    oldestDateTime = fileListBackup[i].created();
-                    oldestFilePath = fileListBackup[i].filePath();
-                }
-
-                QFile::remove(oldestFilePath);
-        }
-    }
-
-    if(exportfile[0] == '.')
-        exportfile = QString(OgitorsRoot::getSingletonPtr()->GetProjectOptions()->ProjectDir.c_str()) + QString("/") + exportfile;
-
-    OgitorsRoot::getSingletonPtr()->SaveScene(false, exportfile.toStdString());
-
-    OgitorsRoot::getSingletonPtr()->SetSceneModified(modified);
+    // The scene is copied here and written to the backup folder by a worker thread,
+    // so neither editing nor running scripts are interrupted. A backup still being
+    // written when the timer fires again is not overtaken, this round is skipped.
+    OgitorsAutoBackup::getSingletonPtr()->backupScene();
 }
 //------------------------------------------------------------------------------------
 void MainWindow::onFocusOnObject()
@@ -672,7 +672,7 @@ void MainWindow::newScene()
 
     try
     {
-        if(mFile.mount(filename.c_str(), OFS::OFS_MOUNT_CREATE) == OFS::OFS_OK)
+        if(mFile.mount(filename.c_str(), OFS::OFS_MOUNT_CREATE | OFS::OFS_MOUNT_DEDUP) == OFS::OFS_OK)
             succeed = true;
 
         std::stringstream outfile;
@@ -1271,6 +1271,8 @@ void MainWindow::openSceneOptions()
 
     if(dlg.exec() == QDialog::Accepted)
     {
+        ogRoot->GetProjectFile().setMemoryMapped(pOpt->MemoryMapped);
+
         bool identical = true;
         if(directories.size() == pOpt->ResourceDirectories.size())
         {
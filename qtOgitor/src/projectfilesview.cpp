@@ -170,6 +170,12 @@ QWidget(parent), mOfsTreeWidget(0)
     mToolBar->addAction(mActDefrag);
 
     mAddFileFolderPath = "/";
+
+    // Compacts the project file in small steps while the editor is idle
+    mCompactTimer = new QTimer(this);
+    mCompactTimer->setInterval(1000);
+    mCompactBytesMoved = 0;
+    connect(mCompactTimer,      SIGNAL(timeout()),      this,   SLOT(onCompactTimer()));
 }
 //----------------------------------------------------------------------------------------
 ProjectFilesViewWidget::~ProjectFilesViewWidget()
@@ -208,6 +214,8 @@ void ProjectFilesViewWidget::prepareView()
     connect(mOfsTreeWidget, SIGNAL(customContextMenuRequested(const QPoint &)), this, SLOT(onOfsWidgetCustomContextMenuRequested(const QPoint &)));
     connect(mOfsTreeWidget, SIGNAL(busyState(bool)), this, SLOT(onOfsWidgetBusyState(bool)));
 	connect(mOfsTreeWidget, SIGNAL(itemSelectionChanged()), this, SLOT(onSelectionChanged()));
+
+    mCompactTimer->start();
 }
 //----------------------------------------------------------------------------------------
 void ProjectFilesViewWidget::clearView()
@@ -229,6 +237,8 @@ void ProjectFilesViewWidget::clearView()
     mActAddFolder->setEnabled(false);
     mActExtract->setEnabled(false);
     mActDefrag->setEnabled(false);
+
+    mCompactTimer->stop();
 }
 //----------------------------------------------------------------------------------------
 void ProjectFilesViewWidget::onSelectionChanged()
@@ -495,6 +505,11 @@ void ProjectFilesViewWidget::onOfsWidgetBusyState(bool state)
     mActRefresh->setEnabled(!state);
     mActExtract->setEnabled(!state);
     mActDefrag->setEnabled(!state);
+
+    if(state)
+        mCompactTimer->stop();
+    else if(mOfsTreeWidget != 0)
+        mCompactTimer->start();
 }
 //----------------------------------------------------------------------------------------
 void ProjectFilesViewWidget::onLinkFileSystem()
@@ -570,6 +585,8 @@ void ProjectFilesViewWidget::onEmptyRecycleBin()
     ofsFile->emptyRecycleBin();
 
     mOfsTreeWidget->refreshWidget();   
+
+    mCompactTimer->start();
 }
 //----------------------------------------------------------------------------------------
 void ProjectFilesViewWidget::onRestoreFromRecycleBin()
@@ -637,6 +654,36 @@ void ProjectFilesViewWidget::onDefrag()
     }
 }
 //----------------------------------------------------------------------------------------
+void ProjectFilesViewWidget::onCompactTimer()
+{
+    OFS::OfsPtr& ofsFile = Ogitors::OgitorsRoot::getSingletonPtr()->GetProjectFile();
+
+    if(!ofsFile.valid())
+    {
+        mCompactTimer->stop();
+        return;
+    }
+
+    // Move only a few blocks per tick so the editor stays responsive
+    OFS::CompactionProgress progress;
+    OFS::OfsResult ret = ofsFile->compactFileSystem(8, progress);
+
+    mCompactBytesMoved += progress.BytesMoved;
+
+    if(ret != OFS::OFS_OK || progress.Finished)
+    {
+        mCompactTimer->stop();
+
+        if(mCompactBytesMoved > 0)
+        {
+            QString msg = tr("Project file compacted, %1 KB moved, %2 KB free space left").arg(mCompactBytesMoved / 1024).arg(progress.FreeSpace / 1024);
+            ofsCallback(msg.toStdString());
+        }
+
+        mCompactBytesMoved = 0;
+    }
+}
+//----------------------------------------------------------------------------------------
 void ProjectFilesViewWidget::onDelete()
 {
     QStringList selItems = mOfsTreeWidget->getSelectedItems();
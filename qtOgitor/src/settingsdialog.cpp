@@ -73,6 +73,8 @@ QDialog(parent, Qt::Dialog | Qt::CustomizeWindowHint | Qt::WindowTitleHint)
     mSceneMgrNameMenu->setCurrentIndex(0);
     mConfigFileTextBox->setText(mOptions->SceneManagerConfigFile.c_str());
     mTerrainDirTextBox->setText(mOptions->TerrainDirectory.c_str());
+    useBinarySceneFormat->setChecked(mOptions->SceneFormat == 1);
+    useMemoryMappedReads->setChecked(mOptions->MemoryMapped);
 
     if(!mOptions->IsNewProject)
     {
@@ -147,6 +149,8 @@ QDialog(parent, Qt::Dialog | Qt::CustomizeWindowHint | Qt::WindowTitleHint)
     connect(mSceneMgrNameMenu,              SIGNAL(currentIndexChanged(int)),           this, SLOT(setDirty()));
     connect(mConfigFileTextBox,             SIGNAL(textChanged(const QString&)),        this, SLOT(setDirty()));
     connect(mTerrainDirTextBox,             SIGNAL(textChanged(const QString&)),        this, SLOT(setDirty()));
+    connect(useBinarySceneFormat,           SIGNAL(stateChanged(int)),                  this, SLOT(setDirty()));
+    connect(useMemoryMappedReads,           SIGNAL(stateChanged(int)),                  this, SLOT(setDirty()));
     connect(mSelectionDepthMenu,            SIGNAL(valueChanged(double)),               this, SLOT(setDirty()));
     connect(mGridSpacingMenu,               SIGNAL(valueChanged(double)),               this, SLOT(setDirty()));
     connect(mSnapAngleMenu,                 SIGNAL(valueChanged(double)),               this, SLOT(setDirty()));
@@ -399,6 +403,8 @@ void SettingsDialog::onAccept()
     mOptions->GridSpacing = mGridSpacingMenu->value();
     mOptions->SnapAngle = mSnapAngleMenu->value();
     mOptions->VolumeSelectionDepth = mSelectionDepthMenu->value();
+    mOptions->SceneFormat = (useBinarySceneFormat->checkState() == Qt::Checked) ? 1 : 0;
+    mOptions->MemoryMapped = (useMemoryMappedReads->checkState() == Qt::Checked);
 
     if(enableAutoBackupBox->checkState() == Qt::Checked && autoBackupPathEdit->text().length() == 0)
     {